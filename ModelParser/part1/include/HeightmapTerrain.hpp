@@ -0,0 +1,111 @@
+/** @file HeightmapTerrain.hpp
+ *
+ *  Terrain from a PPM height field with quadtree level of detail.
+ */
+#ifndef HEIGHTMAPTERRAIN_HPP
+#define HEIGHTMAPTERRAIN_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+#include "Terrain.hpp"
+
+// A height field split into a quadtree. Every node, from the root down to
+// leaves of 32x32 texels, is drawn as the same 33x33 vertex grid sampled at
+// its own spacing, so coarse nodes cover more ground with the same triangles.
+//
+// Each frame the quadtree is refined where the projected geometric error of a
+// node is largest, until the error is below a pixel threshold or the next split
+// would exceed the triangle budget. Nodes of different levels meet with cracks,
+// which are hidden by a skirt hanging down from every node edge; grid and skirt
+// use one shared index buffer. Vertices of the selected nodes are generated
+// on demand into a fixed pool of slots in a single vertex buffer, the least
+// recently used slots are reused, so memory does not grow with the heightmap.
+class HeightmapTerrain{
+public:
+    // Vertices per node side
+    static constexpr int kGridSize = 33;
+    // Grid plus one skirt vertex under every edge vertex
+    static constexpr int kSlotVertices = kGridSize * kGridSize + 4 * kGridSize;
+    // 2 * 32 * 32 grid and 4 * 2 * 32 skirt triangles
+    static constexpr int kTrianglesPerNode = 2 * (kGridSize - 1) * (kGridSize - 1) + 8 * (kGridSize - 1);
+
+    // Counters of the last Update and Draw
+    struct Statistics{
+        double selectMilliseconds{0.0};
+        double uploadMilliseconds{0.0};
+        size_t nodesSelected{0};
+        size_t nodesCulled{0};
+        size_t uploads{0};
+        size_t trianglesDrawn{0};
+        bool budgetLimited{false};
+    };
+
+    // Constructor
+    HeightmapTerrain();
+    // Load the height field from the red channel of a PPM and build the quadtree.
+    // The terrain is centered on the origin and worldSize wide.
+    bool Load(const std::string& filename, float worldSize, float heightScale);
+    // Create the vertex pool and the shared index buffer, needs an OpenGL context
+    void Initialize(size_t triangleBudget);
+    // Select the nodes to draw for a camera and upload the ones that are not resident
+    void Update(const glm::vec3& eyePosition, const glm::mat4& viewProjection,
+                float fieldOfViewY, float screenHeight, float pixelError);
+    // Draw the selected nodes
+    void Draw();
+    // Delete the OpenGL objects
+    void Destroy();
+    // Height of the terrain at a world position
+    float GetHeight(float x, float z) const;
+    // Counters of the last frame
+    const Statistics& GetStatistics() const { return mStatistics; }
+    // Write a fractal height field to test with
+    static void GenerateHeightmap(const std::string& filename, int size);
+private:
+    struct Node{
+        // Area in texels
+        float x0, z0, size;
+        // Largest height difference to the full resolution data, in world units
+        float error;
+        float minY, maxY;
+        int children[4];    // -1 for leaves
+        int slot;           // -1 if the vertices are not in the pool
+        unsigned int lastUsedFrame;
+    };
+
+    // Bilinear height at a texel position, in world units
+    float Sample(float tx, float tz) const;
+    // Create a node and its subtree, returns its index
+    int BuildNode(float x0, float z0, float size);
+    // Write the vertices of a node into a pool slot
+    void FillSlot(const Node& node, int slot);
+    // Take a free slot or the least recently used one that is not drawn this frame
+    int AcquireSlot();
+
+    // Height field in world units
+    std::vector<float> mHeights;
+    int mWidth{0};
+    int mHeight{0};
+    float mTexelSize{1.0f};
+    float mHeightScale{1.0f};
+
+    std::vector<Node> mNodes;
+    std::vector<int> mSelected;
+    // Node index stored in every slot, -1 if free
+    std::vector<int> mSlotOwners;
+    size_t mTriangleBudget{0};
+    unsigned int mFrame{0};
+
+    std::vector<Vertex> mScratch;
+    GLsizei mIndexCount{0};
+    GLuint mVertexArrayObject{0};
+    GLuint mVertexBufferObject{0};
+    GLuint mIndexBufferObject{0};
+
+    Statistics mStatistics;
+};
+
+#endif
@@ -0,0 +1,93 @@
+/** @file StreamingTerrain.hpp
+ *
+ *  Draws the tiles of a TerrainPageCache around the camera.
+ */
+#ifndef STREAMINGTERRAIN_HPP
+#define STREAMINGTERRAIN_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <unordered_map>
+#include <vector>
+
+#include "Terrain.hpp"
+#include "TerrainPageCache.hpp"
+
+// Every frame the tiles within a radius of the camera are requested from the
+// page cache, closest first. Tiles the cache has made resident are uploaded
+// into a fixed number of GPU slots: a (tileSize+1)^2 vertex grid in one shared
+// vertex buffer and a layer of one texture array for the diffuse color. A few
+// uploads per frame at most, so a burst of loaded tiles does not stall a frame;
+// slots of tiles no longer wanted are reused least recently used first.
+class StreamingTerrain{
+public:
+    // Counters of the last Update and Draw, and totals since Initialize
+    struct Statistics{
+        size_t tilesWanted{0};
+        size_t tilesMissing{0};     // Wanted but not on the GPU yet
+        size_t tilesDrawn{0};
+        size_t tilesCulled{0};
+        size_t uploads{0};
+        double uploadMilliseconds{0.0};
+        size_t uploadsTotal{0};
+        size_t gpuEvictionsTotal{0};
+    };
+
+    // Constructor
+    StreamingTerrain();
+    // Create the GPU slots for the tiles of an open cache, needs an OpenGL context
+    void Initialize(TerrainPageCache* cache, float texelSize, float heightScale, int viewRadiusTiles);
+    // Request the tiles around the eye and upload up to maxUploads resident ones.
+    // With waitForLoads the frame blocks until the requested tiles are read.
+    void Update(const glm::vec3& eyePosition, int maxUploads, bool waitForLoads);
+    // Draw the uploaded tiles in view with a program using the terrain shaders
+    void Draw(GLuint program, const glm::mat4& viewProjection);
+    // Delete the OpenGL objects
+    void Destroy();
+    // Height at a world position, false if its tile is not resident
+    bool GetHeight(float x, float z, float& height);
+    // Size of the whole terrain in world units
+    float GetWorldWidth() const;
+    float GetWorldDepth() const;
+    const Statistics& GetStatistics() const { return mStatistics; }
+private:
+    struct Slot{
+        long tile{-1};              // -1 if free
+        unsigned int lastUsedFrame{0};
+        float minY{0.0f}, maxY{0.0f};
+    };
+
+    // World position of the first vertex of a tile
+    glm::vec2 GetTileOrigin(int x, int y) const;
+    // Take a free slot or the least recently used one not wanted this frame, -1 if none
+    int AcquireSlot();
+    // Write vertices and texture of a tile into a slot
+    void Upload(const TerrainTile& tile, int slot);
+
+    TerrainPageCache* mCache{nullptr};
+    int mTileSize{0};
+    int mVerticesPerTile{0};
+    int mMipLevels{0};
+    float mTexelSize{1.0f};
+    float mHeightScale{1.0f};
+    int mViewRadius{0};
+    unsigned int mFrame{0};
+
+    // Tiles wanted this frame, closest first
+    std::vector<uint32_t> mWanted;
+    std::vector<Slot> mSlots;
+    std::unordered_map<uint32_t, int> mSlotOfTile;
+
+    std::vector<Vertex> mScratch;
+    std::vector<uint8_t> mMipScratch;
+    GLsizei mIndexCount{0};
+    GLuint mVertexArrayObject{0};
+    GLuint mVertexBufferObject{0};
+    GLuint mIndexBufferObject{0};
+    GLuint mTexture{0};
+
+    Statistics mStatistics;
+};
+
+#endif
@@ -0,0 +1,89 @@
+/** @file Terrain.hpp
+ *
+ *  Indexed terrain grid split into fixed-size chunks.
+ */
+#ifndef TERRAIN_HPP
+#define TERRAIN_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+struct Vertex{
+    float x,y,z;    // position
+	float r,g,b; 	// color
+	float nx,ny,nz; // normals
+};
+
+// Planes of the view frustum of a projection * view matrix, dot(xyz, p) + w >= 0 inside
+void ExtractFrustumPlanes(const glm::mat4& viewProjection, glm::vec4 planes[6]);
+// True if an axis aligned box is completely outside one of the planes
+bool IsBoxOutsideFrustum(const glm::vec4 planes[6], const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+// A (resolution x resolution) cell grid over [-1,1] in x and z.
+//
+// Every vertex is stored once per chunk (chunk borders are duplicated) in one
+// vertex buffer. All chunks of the same size share one triangle strip pattern
+// in a single index buffer and are drawn with glDrawElementsBaseVertex, so the
+// index data does not grow with the resolution. Changing heights only marks the
+// touched chunks dirty and Update() re-uploads just those.
+class Terrain{
+public:
+    // Cells per chunk side, (64+1)^2 vertices still fit 16-bit indices
+    static constexpr size_t kChunkCells = 64;
+
+    // Constructor
+    Terrain();
+    // Create the vertex array and buffers, needs an OpenGL context
+    void Initialize();
+    // Build a flat grid and upload it
+    void Generate(size_t resolution);
+    // Add a smooth bump of the given height around (x,z)
+    void RaiseHill(float x, float z, float radius, float height);
+    // Upload the chunks changed since the last update
+    void Update();
+    // Draw the chunks whose bounds touch the view frustum, returns how many were drawn
+    size_t Draw(const glm::mat4& viewProjection) const;
+    // Delete the OpenGL objects
+    void Destroy();
+    // Print the memory used by the indexed grid and by the old triangle soup at a resolution
+    static void PrintMemoryComparison(size_t resolution);
+
+    size_t GetChunkCount() const { return mChunks.size(); }
+    size_t GetVertexCount() const { return mVertices.size(); }
+    size_t GetIndexCount() const { return mIndices.size(); }
+private:
+    struct Chunk{
+        // First grid point of the chunk and its size in cells
+        size_t i0, j0;
+        size_t cellsX, cellsZ;
+        // Where its vertices start in mVertices and the vertex buffer
+        size_t firstVertex;
+        // Its strip pattern in the shared index buffer
+        size_t indexOffset;
+        GLsizei indexCount;
+        glm::vec3 boundsMin, boundsMax;
+        bool dirty;
+    };
+
+    // Height of grid point (i,j), clamped to the grid
+    float HeightAt(long i, long j) const;
+    // Recompute positions, normals, colors and bounds of a chunk
+    void BuildChunk(Chunk& chunk);
+    // Chunk layout and strip patterns for a resolution
+    void CreateChunks();
+
+    size_t mResolution{0};
+    // (resolution+1)^2 heights, row i is the x coordinate
+    std::vector<float> mHeights;
+    std::vector<Vertex> mVertices;
+    std::vector<GLushort> mIndices;
+    std::vector<Chunk> mChunks;
+
+    GLuint mVertexArrayObject{0};
+    GLuint mVertexBufferObject{0};
+    GLuint mIndexBufferObject{0};
+};
+
+#endif
@@ -0,0 +1,116 @@
+/** @file TerrainPageCache.hpp
+ *
+ *  Tiled terrain file and a CPU cache that pages its tiles in on worker threads.
+ */
+#ifndef TERRAINPAGECACHE_HPP
+#define TERRAINPAGECACHE_HPP
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// One tile as stored on disk: heights with a one texel border (for normals)
+// and the diffuse color of its tileSize x tileSize texels.
+struct TerrainTile{
+    int x{0}, y{0};
+    std::vector<uint16_t> heights;  // (tileSize+3)^2, row major
+    std::vector<uint8_t> diffuse;   // tileSize^2 RGB
+};
+
+// Tiled terrain file:
+//   header  "TTRN", version, width, height, tileSize, tilesX, tilesY
+//   tiles   tilesX * tilesY fixed-size records in row major order
+// so any tile is one seek and one read.
+//
+// Tiles are requested every frame in priority order (closest first). Missing
+// tiles are read by worker threads; tiles that are requested again are kept,
+// others are evicted least recently used once the memory budget is reached.
+// Ties are broken by tile id, so with WaitForPending() after every Request()
+// the same requests always give the same hits, misses and evictions.
+class TerrainPageCache{
+public:
+    // Counters since Open()
+    struct Statistics{
+        size_t hits{0};             // Requested tiles already in memory
+        size_t misses{0};           // Requested tiles that had to be read
+        size_t loads{0};            // Tiles read from disk
+        size_t evictions{0};
+        size_t tilesResident{0};
+        size_t bytesResident{0};
+        size_t peakBytesResident{0};
+        size_t pending{0};          // Queued or being read
+        double loadMilliseconds{0.0};   // Summed over the workers
+    };
+
+    // Constructor
+    TerrainPageCache();
+    // Destructor stops the workers
+    ~TerrainPageCache();
+    // Open a tiled file and start the workers
+    bool Open(const std::string& filename, size_t memoryBudgetBytes, unsigned int threadCount);
+    // Stop the workers and drop all tiles
+    void Close();
+    // Tiles wanted this frame, closest first. Queues the missing ones and
+    // protects the wanted ones from eviction until the next call.
+    void Request(const std::vector<uint32_t>& tiles);
+    // A resident tile or nullptr. The pointer stays valid until the next Request(),
+    // only for tiles passed to the last Request().
+    const TerrainTile* Find(uint32_t tile);
+    // Copies the heights of texels (x, y) to (x+1, y+1) of a resident tile, row
+    // major, under the lock; safe for any tile. False if the tile is not resident.
+    bool ReadHeights(uint32_t tile, int x, int y, uint16_t heights[4]);
+    // Block until every queued tile is loaded (deterministic benchmarks)
+    void WaitForPending();
+    Statistics GetStatistics();
+
+    int GetWidth() const { return mWidth; }
+    int GetHeight() const { return mHeight; }
+    int GetTileSize() const { return mTileSize; }
+    int GetTilesX() const { return mTilesX; }
+    int GetTilesY() const { return mTilesY; }
+    uint32_t GetTileId(int x, int y) const { return static_cast<uint32_t>(y * mTilesX + x); }
+
+    // Cut a heightmap (and optional diffuse texture of the same size) into a tiled file
+    static bool WriteTiledFile(const std::string& heightmapFile, const std::string& diffuseFile,
+                               const std::string& outputFile, int tileSize);
+private:
+    struct Entry{
+        TerrainTile tile;
+        // Frame of the last Request() that asked for it
+        unsigned int lastRequested;
+    };
+
+    // Body of every worker
+    void WorkerThread();
+    // Read a tile record from the file
+    bool ReadTile(std::ifstream& file, uint32_t id, TerrainTile& tile) const;
+    // Drop least recently used tiles not wanted this frame until under budget, mMutex held
+    void EvictToBudget();
+    size_t GetTileBytes() const;
+
+    std::string mFilename;
+    int mWidth{0}, mHeight{0};
+    int mTileSize{0}, mTilesX{0}, mTilesY{0};
+    size_t mMemoryBudget{0};
+
+    std::mutex mMutex;
+    std::condition_variable mWorkAvailable;
+    std::condition_variable mWorkDone;
+    std::vector<std::thread> mWorkers;
+    bool mRunning{false};
+
+    // Queue in priority order, and tiles being read with the frame of the last Request() that asked for them
+    std::vector<uint32_t> mQueue;
+    std::unordered_map<uint32_t, unsigned int> mInFlight;
+    std::unordered_map<uint32_t, Entry> mTiles;
+    unsigned int mFrame{0};
+
+    Statistics mStatistics;
+};
+
+#endif
@@ -0,0 +1,18 @@
+#version 410 core
+
+in vec2 v_texCoords;
+in vec3 v_vertexNormals;
+
+out vec4 color;
+
+// Diffuse colors of all resident tiles, one layer per tile
+uniform sampler2DArray u_Diffuse;
+uniform float u_Layer;
+
+// Entry point of program
+void main()
+{
+	vec3 diffuse = texture(u_Diffuse, vec3(v_texCoords, u_Layer)).rgb;
+	float light = max(dot(normalize(v_vertexNormals), normalize(vec3(0.4f, 1.0f, 0.3f))), 0.0f);
+	color = vec4(diffuse * (0.3f + 0.7f * light), 1.0f);
+}
@@ -0,0 +1,26 @@
+#version 410 core
+
+layout(location=0) in vec3 position;
+layout(location=1) in vec3 vertexColors;
+layout(location=2) in vec3 vertexNormals;
+
+// Uniform variables
+uniform mat4 u_ModelMatrix;
+uniform mat4 u_ViewMatrix;
+uniform mat4 u_Projection; // a perspective projection
+
+// Corner and size of the tile being drawn, in world units
+uniform vec2 u_TileOrigin;
+uniform float u_TileSize;
+
+// Pass texture coordinates and normals into the fragment shader
+out vec2 v_texCoords;
+out vec3 v_vertexNormals;
+
+void main()
+{
+  v_texCoords = (position.xz - u_TileOrigin) / u_TileSize;
+  v_vertexNormals = vertexNormals;
+
+  gl_Position = u_Projection * u_ViewMatrix * u_ModelMatrix * vec4(position,1.0f);
+}
@@ -0,0 +1,477 @@
+#include "HeightmapTerrain.hpp"
+#include "PPM.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <queue>
+#include <utility>
+
+// Ends a triangle strip
+static const GLushort kRestartIndex = 0xFFFF;
+// Texels covered by a leaf
+static const float kLeafSize = HeightmapTerrain::kGridSize - 1;
+
+
+// Constructor
+HeightmapTerrain::HeightmapTerrain(){
+
+}
+
+
+/**
+* Loads the height field and builds the quadtree with the error of every node
+*
+* @param filename PPM file, the red channel is the height
+* @param worldSize Width of the terrain in world units
+* @param heightScale Height of a texel with value 255
+* @return true if the file could be loaded
+*/
+bool HeightmapTerrain::Load(const std::string& filename, float worldSize, float heightScale){
+    auto begin = std::chrono::steady_clock::now();
+    PPM image(filename);
+    if (image.getWidth() < 2 || image.getHeight() < 2) {
+        std::cout << "Could not load heightmap " << filename << std::endl;
+        return false;
+    }
+    mWidth = image.getWidth();
+    mHeight = image.getHeight();
+    mHeightScale = heightScale;
+    mTexelSize = worldSize / (std::max(mWidth, mHeight) - 1);
+    mHeights.resize(static_cast<size_t>(mWidth) * mHeight);
+    const unsigned char* pixels = image.pixelData();
+    for (size_t i = 0; i < mHeights.size(); ++i) {
+        mHeights[i] = pixels[i * 3] * (heightScale / 255.0f);
+    }
+
+    mNodes.clear();
+    BuildNode(0.0f, 0.0f, static_cast<float>(std::max(mWidth, mHeight) - 1));
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+    std::cout << "Heightmap " << mWidth << "x" << mHeight << ": " << mNodes.size() << " quadtree nodes, "
+              << "root error " << mNodes[0].error << ", loaded in " << elapsed.count() << " ms" << std::endl;
+    return true;
+}
+
+
+float HeightmapTerrain::Sample(float tx, float tz) const{
+    tx = std::min(std::max(tx, 0.0f), static_cast<float>(mWidth - 1));
+    tz = std::min(std::max(tz, 0.0f), static_cast<float>(mHeight - 1));
+    int x0 = std::min(static_cast<int>(tx), mWidth - 2);
+    int z0 = std::min(static_cast<int>(tz), mHeight - 2);
+    float fx = tx - x0;
+    float fz = tz - z0;
+    const float* row0 = &mHeights[static_cast<size_t>(z0) * mWidth + x0];
+    const float* row1 = row0 + mWidth;
+    float top = row0[0] + (row0[1] - row0[0]) * fx;
+    float bottom = row1[0] + (row1[1] - row1[0]) * fx;
+    return top + (bottom - top) * fz;
+}
+
+
+float HeightmapTerrain::GetHeight(float x, float z) const{
+    if (mHeights.empty()) {
+        return 0.0f;
+    }
+    return Sample(x / mTexelSize + (mWidth - 1) * 0.5f, z / mTexelSize + (mHeight - 1) * 0.5f);
+}
+
+
+/**
+* Builds a node and its children. The error of a node is how far its grid is
+* from the height field, measured halfway between its vertices (where the
+* children have theirs), plus the largest error of the children so the error
+* never grows when refining.
+*
+* @return index of the node
+*/
+int HeightmapTerrain::BuildNode(float x0, float z0, float size){
+    int index = static_cast<int>(mNodes.size());
+    Node node;
+    node.x0 = x0;
+    node.z0 = z0;
+    node.size = size;
+    node.error = 0.0f;
+    node.minY = 1e30f;
+    node.maxY = -1e30f;
+    node.slot = -1;
+    node.lastUsedFrame = 0;
+    for (int& child : node.children) {
+        child = -1;
+    }
+    mNodes.push_back(node);
+
+    float childError = 0.0f;
+    if (size > kLeafSize + 1e-3f) {
+        float half = size * 0.5f;
+        int children[4] = {BuildNode(x0, z0, half), BuildNode(x0 + half, z0, half),
+                           BuildNode(x0, z0 + half, half), BuildNode(x0 + half, z0 + half, half)};
+        for (int c = 0; c < 4; ++c) {
+            mNodes[index].children[c] = children[c];
+            childError = std::max(childError, mNodes[children[c]].error);
+            mNodes[index].minY = std::min(mNodes[index].minY, mNodes[children[c]].minY);
+            mNodes[index].maxY = std::max(mNodes[index].maxY, mNodes[children[c]].maxY);
+        }
+    }
+
+    // Compare the node's triangles with the data at twice its resolution
+    const int fine = 2 * (kGridSize - 1) + 1;
+    float halfStep = size / (2 * (kGridSize - 1));
+    std::vector<float> samples(fine * fine);
+    for (int i = 0; i < fine; ++i) {
+        for (int j = 0; j < fine; ++j) {
+            samples[i * fine + j] = Sample(x0 + i * halfStep, z0 + j * halfStep);
+        }
+    }
+    float error = 0.0f;
+    float minY = mNodes[index].minY;
+    float maxY = mNodes[index].maxY;
+    for (int i = 0; i < fine; ++i) {
+        for (int j = 0; j < fine; ++j) {
+            float actual = samples[i * fine + j];
+            minY = std::min(minY, actual);
+            maxY = std::max(maxY, actual);
+            float approximation;
+            if (i % 2 == 0 && j % 2 == 0) {
+                continue;
+            } else if (i % 2 == 0) {
+                approximation = 0.5f * (samples[i * fine + j - 1] + samples[i * fine + j + 1]);
+            } else if (j % 2 == 0) {
+                approximation = 0.5f * (samples[(i - 1) * fine + j] + samples[(i + 1) * fine + j]);
+            } else {
+                // The strips split every cell along the (i+1,j)-(i,j+1) diagonal
+                approximation = 0.5f * (samples[(i + 1) * fine + j - 1] + samples[(i - 1) * fine + j + 1]);
+            }
+            error = std::max(error, std::abs(actual - approximation));
+        }
+    }
+    mNodes[index].error = error + childError;
+    mNodes[index].minY = minY;
+    mNodes[index].maxY = maxY;
+    return index;
+}
+
+
+/**
+* Creates the vertex pool and the index buffer shared by all nodes
+*
+* @param triangleBudget Most triangles drawn in one frame
+* @return void
+*/
+void HeightmapTerrain::Initialize(size_t triangleBudget){
+    mTriangleBudget = std::max<size_t>(triangleBudget, kTrianglesPerNode);
+    // A quarter more slots than the budget can draw keeps recently used nodes around
+    size_t maxNodes = mTriangleBudget / kTrianglesPerNode;
+    mSlotOwners.assign(maxNodes + maxNodes / 4 + 1, -1);
+    mScratch.resize(kSlotVertices);
+
+    std::vector<GLushort> indices;
+    for (int a = 0; a < kGridSize - 1; ++a) {
+        if (a > 0) {
+            indices.push_back(kRestartIndex);
+        }
+        for (int b = 0; b < kGridSize; ++b) {
+            indices.push_back(static_cast<GLushort>(a * kGridSize + b));
+            indices.push_back(static_cast<GLushort>((a + 1) * kGridSize + b));
+        }
+    }
+    // Skirts: a strip between every edge and the copy of it hanging below
+    for (int edge = 0; edge < 4; ++edge) {
+        indices.push_back(kRestartIndex);
+        for (int k = 0; k < kGridSize; ++k) {
+            int a = (edge == 0) ? 0 : (edge == 1) ? kGridSize - 1 : k;
+            int b = (edge == 2) ? 0 : (edge == 3) ? kGridSize - 1 : k;
+            indices.push_back(static_cast<GLushort>(a * kGridSize + b));
+            indices.push_back(static_cast<GLushort>(kGridSize * kGridSize + edge * kGridSize + k));
+        }
+    }
+    mIndexCount = static_cast<GLsizei>(indices.size());
+
+    glGenVertexArrays(1, &mVertexArrayObject);
+    glBindVertexArray(mVertexArrayObject);
+    glGenBuffers(1, &mVertexBufferObject);
+    glGenBuffers(1, &mIndexBufferObject);
+    glBindBuffer(GL_ARRAY_BUFFER, mVertexBufferObject);
+    glBufferData(GL_ARRAY_BUFFER, mSlotOwners.size() * kSlotVertices * sizeof(Vertex), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBufferObject);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
+
+    // Position information (x,y,z)
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    // Color information (r,g,b)
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(sizeof(GL_FLOAT)*3));
+    // Normal information (nx,ny,nz)
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(sizeof(GL_FLOAT)*6));
+    glBindVertexArray(0);
+
+    std::cout << "Terrain budget " << mTriangleBudget << " triangles: " << maxNodes << " nodes, "
+              << mSlotOwners.size() << " pool slots, "
+              << mSlotOwners.size() * kSlotVertices * sizeof(Vertex) / 1024 << " KB vertex pool" << std::endl;
+}
+
+
+int HeightmapTerrain::AcquireSlot(){
+    int oldest = -1;
+    for (size_t slot = 0; slot < mSlotOwners.size(); ++slot) {
+        int owner = mSlotOwners[slot];
+        if (owner < 0) {
+            return static_cast<int>(slot);
+        }
+        if (mNodes[owner].lastUsedFrame != mFrame &&
+            (oldest < 0 || mNodes[owner].lastUsedFrame < mNodes[mSlotOwners[oldest]].lastUsedFrame)) {
+            oldest = static_cast<int>(slot);
+        }
+    }
+    if (oldest >= 0) {
+        mNodes[mSlotOwners[oldest]].slot = -1;
+        mSlotOwners[oldest] = -1;
+    }
+    return oldest;
+}
+
+
+/**
+* Samples the 33x33 grid of a node and its skirts into a pool slot. The skirt
+* hangs twice the node's error below the edge, deeper than any crack to a
+* finer neighbour can be.
+*
+* @return void
+*/
+void HeightmapTerrain::FillSlot(const Node& node, int slot){
+    float step = node.size / (kGridSize - 1);
+    float centerX = (mWidth - 1) * 0.5f;
+    float centerZ = (mHeight - 1) * 0.5f;
+    glm::vec3 lightDirection = glm::normalize(glm::vec3(0.5f, 1.0f, 0.3f));
+
+    for (int a = 0; a < kGridSize; ++a) {
+        for (int b = 0; b < kGridSize; ++b) {
+            float tx = node.x0 + a * step;
+            float tz = node.z0 + b * step;
+            Vertex& v = mScratch[a * kGridSize + b];
+            v.x = (tx - centerX) * mTexelSize;
+            v.y = Sample(tx, tz);
+            v.z = (tz - centerZ) * mTexelSize;
+
+            glm::vec3 normal = glm::normalize(glm::vec3((Sample(tx - step, tz) - Sample(tx + step, tz)) / (2.0f * step * mTexelSize),
+                                                        1.0f,
+                                                        (Sample(tx, tz - step) - Sample(tx, tz + step)) / (2.0f * step * mTexelSize)));
+            v.nx = normal.x;
+            v.ny = normal.y;
+            v.nz = normal.z;
+
+            // Grass, rock and snow by height, lit from above
+            float t = v.y / mHeightScale;
+            glm::vec3 color = (t < 0.5f) ? glm::mix(glm::vec3(0.1f, 0.45f, 0.1f), glm::vec3(0.45f, 0.35f, 0.2f), t * 2.0f)
+                                         : glm::mix(glm::vec3(0.45f, 0.35f, 0.2f), glm::vec3(0.9f, 0.9f, 0.9f), std::max(0.0f, t - 0.6f) * 2.5f);
+            color *= 0.4f + 0.6f * std::max(glm::dot(normal, lightDirection), 0.0f);
+            v.r = color.r;
+            v.g = color.g;
+            v.b = color.b;
+        }
+    }
+
+    float skirtDepth = 2.0f * node.error + mTexelSize;
+    for (int edge = 0; edge < 4; ++edge) {
+        for (int k = 0; k < kGridSize; ++k) {
+            int a = (edge == 0) ? 0 : (edge == 1) ? kGridSize - 1 : k;
+            int b = (edge == 2) ? 0 : (edge == 3) ? kGridSize - 1 : k;
+            Vertex& skirt = mScratch[kGridSize * kGridSize + edge * kGridSize + k];
+            skirt = mScratch[a * kGridSize + b];
+            skirt.y -= skirtDepth;
+        }
+    }
+
+    glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(slot) * kSlotVertices * sizeof(Vertex),
+                    kSlotVertices * sizeof(Vertex), mScratch.data());
+}
+
+
+/**
+* Chooses the nodes to draw. Starting from the root, the visible node with the
+* largest error in pixels is split until every node is below pixelError or
+* splitting would go over the triangle budget. Nodes outside the frustum are
+* dropped and do not count against the budget.
+*
+* @param fieldOfViewY Vertical field of view in radians
+* @param screenHeight Height of the viewport in pixels
+* @param pixelError Largest allowed screen space error
+* @return void
+*/
+void HeightmapTerrain::Update(const glm::vec3& eyePosition, const glm::mat4& viewProjection,
+                              float fieldOfViewY, float screenHeight, float pixelError){
+    auto begin = std::chrono::steady_clock::now();
+    ++mFrame;
+    mStatistics = Statistics();
+    mSelected.clear();
+    if (mNodes.empty()) {
+        return;
+    }
+
+    glm::vec4 planes[6];
+    ExtractFrustumPlanes(viewProjection, planes);
+    float centerX = (mWidth - 1) * 0.5f;
+    float centerZ = (mHeight - 1) * 0.5f;
+    float pixelsPerUnit = screenHeight / (2.0f * std::tan(fieldOfViewY * 0.5f));
+
+    auto bounds = [&](const Node& node, glm::vec3& boundsMin, glm::vec3& boundsMax){
+        float skirtDepth = 2.0f * node.error + mTexelSize;
+        boundsMin = glm::vec3((node.x0 - centerX) * mTexelSize, node.minY - skirtDepth, (node.z0 - centerZ) * mTexelSize);
+        boundsMax = glm::vec3((node.x0 + node.size - centerX) * mTexelSize, node.maxY, (node.z0 + node.size - centerZ) * mTexelSize);
+    };
+    auto isVisible = [&](int index){
+        glm::vec3 boundsMin, boundsMax;
+        bounds(mNodes[index], boundsMin, boundsMax);
+        return !IsBoxOutsideFrustum(planes, boundsMin, boundsMax);
+    };
+    // Error of a node in pixels, measured at the closest point of its bounds
+    auto screenError = [&](int index){
+        glm::vec3 boundsMin, boundsMax;
+        bounds(mNodes[index], boundsMin, boundsMax);
+        float distance = glm::length(glm::clamp(eyePosition, boundsMin, boundsMax) - eyePosition);
+        return mNodes[index].error * pixelsPerUnit / std::max(distance, 1e-3f);
+    };
+
+    size_t maxNodes = mTriangleBudget / kTrianglesPerNode;
+    std::priority_queue<std::pair<float, int>> open;
+    if (isVisible(0)) {
+        open.push(std::make_pair(screenError(0), 0));
+    } else {
+        ++mStatistics.nodesCulled;
+    }
+    size_t nodeCount = open.size();
+    while (!open.empty()) {
+        std::pair<float, int> top = open.top();
+        open.pop();
+        const Node& node = mNodes[top.second];
+        if (top.first <= pixelError || node.children[0] < 0) {
+            mSelected.push_back(top.second);
+            continue;
+        }
+        int visible[4];
+        int visibleCount = 0;
+        for (int child : node.children) {
+            if (isVisible(child)) {
+                visible[visibleCount++] = child;
+            } else {
+                ++mStatistics.nodesCulled;
+            }
+        }
+        if (nodeCount - 1 + visibleCount > maxNodes) {
+            mStatistics.budgetLimited = true;
+            mSelected.push_back(top.second);
+            continue;
+        }
+        nodeCount += visibleCount - 1;
+        for (int i = 0; i < visibleCount; ++i) {
+            open.push(std::make_pair(screenError(visible[i]), visible[i]));
+        }
+    }
+    std::chrono::duration<double, std::milli> selectTime = std::chrono::steady_clock::now() - begin;
+    mStatistics.selectMilliseconds = selectTime.count();
+
+    // Make every selected node resident
+    auto uploadBegin = std::chrono::steady_clock::now();
+    for (int index : mSelected) {
+        mNodes[index].lastUsedFrame = mFrame;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, mVertexBufferObject);
+    for (int index : mSelected) {
+        if (mNodes[index].slot >= 0) {
+            continue;
+        }
+        int slot = AcquireSlot();
+        mNodes[index].slot = slot;
+        mSlotOwners[slot] = index;
+        FillSlot(mNodes[index], slot);
+        ++mStatistics.uploads;
+    }
+    std::chrono::duration<double, std::milli> uploadTime = std::chrono::steady_clock::now() - uploadBegin;
+    mStatistics.uploadMilliseconds = uploadTime.count();
+    mStatistics.nodesSelected = mSelected.size();
+}
+
+
+void HeightmapTerrain::Draw(){
+    glBindVertexArray(mVertexArrayObject);
+    glEnable(GL_PRIMITIVE_RESTART);
+    glPrimitiveRestartIndex(kRestartIndex);
+    for (int index : mSelected) {
+        glDrawElementsBaseVertex(GL_TRIANGLE_STRIP, mIndexCount, GL_UNSIGNED_SHORT, (void*)0,
+                                 mNodes[index].slot * kSlotVertices);
+    }
+    glDisable(GL_PRIMITIVE_RESTART);
+    glBindVertexArray(0);
+    mStatistics.trianglesDrawn = mSelected.size() * kTrianglesPerNode;
+}
+
+
+void HeightmapTerrain::Destroy(){
+    if (mIndexBufferObject) glDeleteBuffers(1, &mIndexBufferObject);
+    if (mVertexBufferObject) glDeleteBuffers(1, &mVertexBufferObject);
+    if (mVertexArrayObject) glDeleteVertexArrays(1, &mVertexArrayObject);
+    mIndexBufferObject = 0;
+    mVertexBufferObject = 0;
+    mVertexArrayObject = 0;
+}
+
+
+// Smooth value noise in [0,1] on an integer lattice
+static float ValueNoise(float x, float z, unsigned int seed){
+    auto lattice = [seed](int xi, int zi){
+        unsigned int h = static_cast<unsigned int>(xi) * 374761393u + static_cast<unsigned int>(zi) * 668265263u + seed * 2246822519u;
+        h = (h ^ (h >> 13)) * 1274126177u;
+        return ((h ^ (h >> 16)) & 0xFFFF) / 65535.0f;
+    };
+    int xi = static_cast<int>(std::floor(x));
+    int zi = static_cast<int>(std::floor(z));
+    float fx = x - xi;
+    float fz = z - zi;
+    fx = fx * fx * (3.0f - 2.0f * fx);
+    fz = fz * fz * (3.0f - 2.0f * fz);
+    float top = lattice(xi, zi) + (lattice(xi + 1, zi) - lattice(xi, zi)) * fx;
+    float bottom = lattice(xi, zi + 1) + (lattice(xi + 1, zi + 1) - lattice(xi, zi + 1)) * fx;
+    return top + (bottom - top) * fz;
+}
+
+
+/**
+* Writes a size x size grey PPM of fractal value noise, e.g. 4097 for a 4k terrain
+*
+* @return void
+*/
+void HeightmapTerrain::GenerateHeightmap(const std::string& filename, int size){
+    std::vector<float> heights(static_cast<size_t>(size) * size);
+    float minHeight = 1e30f;
+    float maxHeight = -1e30f;
+    for (int z = 0; z < size; ++z) {
+        for (int x = 0; x < size; ++x) {
+            float height = 0.0f;
+            float amplitude = 1.0f;
+            float frequency = 8.0f / size;
+            for (int octave = 0; octave < 10; ++octave) {
+                height += amplitude * ValueNoise(x * frequency, z * frequency, octave);
+                amplitude *= 0.5f;
+                frequency *= 2.0f;
+            }
+            heights[static_cast<size_t>(z) * size + x] = height;
+            minHeight = std::min(minHeight, height);
+            maxHeight = std::max(maxHeight, height);
+        }
+    }
+
+    PPM image(size, size);
+    for (int z = 0; z < size; ++z) {
+        for (int x = 0; x < size; ++x) {
+            float t = (heights[static_cast<size_t>(z) * size + x] - minHeight) / (maxHeight - minHeight);
+            // Flatten the valleys a little
+            uint8_t value = static_cast<uint8_t>(std::pow(t, 1.5f) * 255.0f + 0.5f);
+            image.setPixel(x, z, value, value, value);
+        }
+    }
+    image.savePPM(filename);
+    std::cout << "Wrote " << size << "x" << size << " heightmap to " << filename << std::endl;
+}
@@ -0,0 +1,361 @@
+#include "StreamingTerrain.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+// Ends a triangle strip
+static const GLushort kRestartIndex = 0xFFFF;
+
+
+// Constructor
+StreamingTerrain::StreamingTerrain(){
+
+}
+
+
+/**
+* Creates the vertex buffer, the shared index buffer and the texture array with
+* one slot for every tile that can be wanted at the same time.
+*
+* @param texelSize Distance between two height samples in world units
+* @param heightScale Height of the largest height value
+* @param viewRadiusTiles Tiles whose center is this many tiles from the eye are drawn
+* @return void
+*/
+void StreamingTerrain::Initialize(TerrainPageCache* cache, float texelSize, float heightScale, int viewRadiusTiles){
+    mCache = cache;
+    mTileSize = cache->GetTileSize();
+    mVerticesPerTile = (mTileSize + 1) * (mTileSize + 1);
+    mTexelSize = texelSize;
+    mHeightScale = heightScale;
+    mViewRadius = viewRadiusTiles;
+    mMipLevels = 1 + static_cast<int>(std::floor(std::log2(static_cast<float>(mTileSize))));
+
+    // The wanted tiles are always inside a circle one tile larger around the eye's tile
+    int slotCount = 0;
+    for (int dy = -mViewRadius - 1; dy <= mViewRadius + 1; ++dy) {
+        for (int dx = -mViewRadius - 1; dx <= mViewRadius + 1; ++dx) {
+            if (dx * dx + dy * dy <= (mViewRadius + 1) * (mViewRadius + 1)) {
+                ++slotCount;
+            }
+        }
+    }
+    mSlots.assign(slotCount, Slot());
+    mSlotOfTile.clear();
+    mScratch.resize(mVerticesPerTile);
+
+    std::vector<GLushort> indices;
+    for (int a = 0; a < mTileSize; ++a) {
+        if (a > 0) {
+            indices.push_back(kRestartIndex);
+        }
+        for (int b = 0; b <= mTileSize; ++b) {
+            indices.push_back(static_cast<GLushort>(a * (mTileSize + 1) + b));
+            indices.push_back(static_cast<GLushort>((a + 1) * (mTileSize + 1) + b));
+        }
+    }
+    mIndexCount = static_cast<GLsizei>(indices.size());
+
+    glGenVertexArrays(1, &mVertexArrayObject);
+    glBindVertexArray(mVertexArrayObject);
+    glGenBuffers(1, &mVertexBufferObject);
+    glGenBuffers(1, &mIndexBufferObject);
+    glBindBuffer(GL_ARRAY_BUFFER, mVertexBufferObject);
+    glBufferData(GL_ARRAY_BUFFER, mSlots.size() * mVerticesPerTile * sizeof(Vertex), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBufferObject);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
+
+    // Position information (x,y,z)
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    // Color information (r,g,b)
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(sizeof(GL_FLOAT)*3));
+    // Normal information (nx,ny,nz)
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(sizeof(GL_FLOAT)*6));
+    glBindVertexArray(0);
+
+    // One layer with a full mip chain per slot
+    glGenTextures(1, &mTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, mTexture);
+    for (int level = 0; level < mMipLevels; ++level) {
+        int size = std::max(1, mTileSize >> level);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGB8, size, size, static_cast<GLsizei>(mSlots.size()),
+                     0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+    }
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, mMipLevels - 1);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    std::cout << "Streaming terrain: view radius " << mViewRadius << " tiles, " << mSlots.size() << " GPU slots, "
+              << mSlots.size() * mVerticesPerTile * sizeof(Vertex) / 1024 << " KB vertices" << std::endl;
+}
+
+
+glm::vec2 StreamingTerrain::GetTileOrigin(int x, int y) const{
+    // The terrain is centered on the origin
+    return glm::vec2((x * mTileSize - (mCache->GetWidth() - 1) * 0.5f) * mTexelSize,
+                     (y * mTileSize - (mCache->GetHeight() - 1) * 0.5f) * mTexelSize);
+}
+
+
+float StreamingTerrain::GetWorldWidth() const{
+    return mCache->GetTilesX() * mTileSize * mTexelSize;
+}
+
+
+float StreamingTerrain::GetWorldDepth() const{
+    return mCache->GetTilesY() * mTileSize * mTexelSize;
+}
+
+
+int StreamingTerrain::AcquireSlot(){
+    int oldest = -1;
+    for (size_t slot = 0; slot < mSlots.size(); ++slot) {
+        if (mSlots[slot].tile < 0) {
+            return static_cast<int>(slot);
+        }
+        if (mSlots[slot].lastUsedFrame != mFrame &&
+            (oldest < 0 || mSlots[slot].lastUsedFrame < mSlots[oldest].lastUsedFrame)) {
+            oldest = static_cast<int>(slot);
+        }
+    }
+    if (oldest >= 0) {
+        mSlotOfTile.erase(static_cast<uint32_t>(mSlots[oldest].tile));
+        mSlots[oldest].tile = -1;
+        ++mStatistics.gpuEvictionsTotal;
+    }
+    return oldest;
+}
+
+
+/**
+* Builds the vertex grid of a tile from its heights, the border texels give the
+* normals at the tile edges, and copies its color and mip chain into the slot's layer.
+*
+* @return void
+*/
+void StreamingTerrain::Upload(const TerrainTile& tile, int slot){
+    int border = mTileSize + 3;
+    float scale = mHeightScale / 65535.0f;
+    auto height = [&](int x, int y){ return tile.heights[y * border + x] * scale; };
+    glm::vec2 origin = GetTileOrigin(tile.x, tile.y);
+
+    Slot& target = mSlots[slot];
+    target.minY = mHeightScale;
+    target.maxY = 0.0f;
+    for (int j = 0; j <= mTileSize; ++j) {
+        for (int i = 0; i <= mTileSize; ++i) {
+            float y = height(i + 1, j + 1);
+            glm::vec3 normal = glm::normalize(glm::vec3(height(i, j + 1) - height(i + 2, j + 1), 2.0f * mTexelSize,
+                                                        height(i + 1, j) - height(i + 1, j + 2)));
+            mScratch[j * (mTileSize + 1) + i] = {origin.x + i * mTexelSize, y, origin.y + j * mTexelSize,
+                                                 1.0f, 1.0f, 1.0f, normal.x, normal.y, normal.z};
+            target.minY = std::min(target.minY, y);
+            target.maxY = std::max(target.maxY, y);
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, mVertexBufferObject);
+    glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(slot) * mVerticesPerTile * sizeof(Vertex),
+                    mVerticesPerTile * sizeof(Vertex), mScratch.data());
+
+    // Box filter the mip chain on the CPU, every level goes into the same layer
+    glBindTexture(GL_TEXTURE_2D_ARRAY, mTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    const uint8_t* level = tile.diffuse.data();
+    int size = mTileSize;
+    mMipScratch.resize(tile.diffuse.size() / 2);
+    for (int mip = 0; mip < mMipLevels; ++mip) {
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, mip, 0, 0, slot, size, size, 1, GL_RGB, GL_UNSIGNED_BYTE, level);
+        if (mip + 1 == mMipLevels) {
+            break;
+        }
+        int next = std::max(1, size / 2);
+        uint8_t* output = (level == mMipScratch.data()) ? mMipScratch.data() + mMipScratch.size() / 2 : mMipScratch.data();
+        for (int y = 0; y < next; ++y) {
+            for (int x = 0; x < next; ++x) {
+                for (int c = 0; c < 3; ++c) {
+                    int x1 = std::min(2 * x + 1, size - 1);
+                    int y1 = std::min(2 * y + 1, size - 1);
+                    int sum = level[(2 * y * size + 2 * x) * 3 + c] + level[(2 * y * size + x1) * 3 + c] +
+                              level[(y1 * size + 2 * x) * 3 + c] + level[(y1 * size + x1) * 3 + c];
+                    output[(y * next + x) * 3 + c] = static_cast<uint8_t>(sum / 4);
+                }
+            }
+        }
+        level = output;
+        size = next;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+
+/**
+* Collects the tiles around the eye, hands them to the page cache and uploads
+* the closest resident ones that are not on the GPU yet.
+*
+* @param maxUploads Most tiles uploaded this frame
+* @param waitForLoads Block until the cache has read every requested tile
+* @return void
+*/
+void StreamingTerrain::Update(const glm::vec3& eyePosition, int maxUploads, bool waitForLoads){
+    ++mFrame;
+    mStatistics.uploads = 0;
+    mStatistics.uploadMilliseconds = 0.0;
+
+    // Eye position in tiles
+    float tileWorldSize = mTileSize * mTexelSize;
+    glm::vec2 origin = GetTileOrigin(0, 0);
+    float eyeX = (eyePosition.x - origin.x) / tileWorldSize;
+    float eyeY = (eyePosition.z - origin.y) / tileWorldSize;
+
+    std::vector<std::pair<float, uint32_t>> candidates;
+    int x0 = std::max(0, static_cast<int>(std::floor(eyeX)) - mViewRadius);
+    int x1 = std::min(mCache->GetTilesX() - 1, static_cast<int>(std::floor(eyeX)) + mViewRadius);
+    int y0 = std::max(0, static_cast<int>(std::floor(eyeY)) - mViewRadius);
+    int y1 = std::min(mCache->GetTilesY() - 1, static_cast<int>(std::floor(eyeY)) + mViewRadius);
+    for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+            float dx = x + 0.5f - eyeX;
+            float dy = y + 0.5f - eyeY;
+            float distance = dx * dx + dy * dy;
+            if (distance <= static_cast<float>(mViewRadius * mViewRadius)) {
+                candidates.push_back({distance, mCache->GetTileId(x, y)});
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    mWanted.clear();
+    for (const auto& candidate : candidates) {
+        mWanted.push_back(candidate.second);
+    }
+
+    mCache->Request(mWanted);
+    if (waitForLoads) {
+        mCache->WaitForPending();
+    }
+
+    // Keep the slots of wanted tiles, then fill new ones closest first
+    for (uint32_t tile : mWanted) {
+        auto found = mSlotOfTile.find(tile);
+        if (found != mSlotOfTile.end()) {
+            mSlots[found->second].lastUsedFrame = mFrame;
+        }
+    }
+    auto uploadBegin = std::chrono::steady_clock::now();
+    mStatistics.tilesMissing = 0;
+    for (uint32_t tile : mWanted) {
+        if (mSlotOfTile.count(tile)) {
+            continue;
+        }
+        const TerrainTile* resident = (static_cast<int>(mStatistics.uploads) < maxUploads) ? mCache->Find(tile) : nullptr;
+        int slot = resident ? AcquireSlot() : -1;
+        if (slot < 0) {
+            ++mStatistics.tilesMissing;
+            continue;
+        }
+        Upload(*resident, slot);
+        mSlots[slot].tile = tile;
+        mSlots[slot].lastUsedFrame = mFrame;
+        mSlotOfTile[tile] = slot;
+        ++mStatistics.uploads;
+    }
+    std::chrono::duration<double, std::milli> uploadTime = std::chrono::steady_clock::now() - uploadBegin;
+    mStatistics.uploadMilliseconds = uploadTime.count();
+    mStatistics.uploadsTotal += mStatistics.uploads;
+    mStatistics.tilesWanted = mWanted.size();
+}
+
+
+void StreamingTerrain::Draw(GLuint program, const glm::mat4& viewProjection){
+    glm::vec4 planes[6];
+    ExtractFrustumPlanes(viewProjection, planes);
+    float tileWorldSize = mTileSize * mTexelSize;
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, mTexture);
+    glUniform1i(glGetUniformLocation(program, "u_Diffuse"), 0);
+    glUniform1f(glGetUniformLocation(program, "u_TileSize"), tileWorldSize);
+    GLint originLocation = glGetUniformLocation(program, "u_TileOrigin");
+    GLint layerLocation = glGetUniformLocation(program, "u_Layer");
+
+    glBindVertexArray(mVertexArrayObject);
+    glEnable(GL_PRIMITIVE_RESTART);
+    glPrimitiveRestartIndex(kRestartIndex);
+    mStatistics.tilesDrawn = 0;
+    mStatistics.tilesCulled = 0;
+    for (uint32_t tile : mWanted) {
+        auto found = mSlotOfTile.find(tile);
+        if (found == mSlotOfTile.end()) {
+            continue;
+        }
+        const Slot& slot = mSlots[found->second];
+        glm::vec2 origin = GetTileOrigin(tile % mCache->GetTilesX(), tile / mCache->GetTilesX());
+        if (IsBoxOutsideFrustum(planes, glm::vec3(origin.x, slot.minY, origin.y),
+                                glm::vec3(origin.x + tileWorldSize, slot.maxY, origin.y + tileWorldSize))) {
+            ++mStatistics.tilesCulled;
+            continue;
+        }
+        // Texel centers sit half a texel inside the tile
+        glUniform2f(originLocation, origin.x - 0.5f * mTexelSize, origin.y - 0.5f * mTexelSize);
+        glUniform1f(layerLocation, static_cast<float>(found->second));
+        glDrawElementsBaseVertex(GL_TRIANGLE_STRIP, mIndexCount, GL_UNSIGNED_SHORT, (void*)0,
+                                 found->second * mVerticesPerTile);
+        ++mStatistics.tilesDrawn;
+    }
+    glDisable(GL_PRIMITIVE_RESTART);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+
+/**
+* Bilinear height from the tile under a position, read from the page cache
+*
+* @return false if the tile is outside the terrain or not resident
+*/
+bool StreamingTerrain::GetHeight(float x, float z, float& height){
+    glm::vec2 origin = GetTileOrigin(0, 0);
+    float tx = (x - origin.x) / mTexelSize;
+    float tz = (z - origin.y) / mTexelSize;
+    int tileX = static_cast<int>(std::floor(tx / mTileSize));
+    int tileY = static_cast<int>(std::floor(tz / mTileSize));
+    if (tileX < 0 || tileY < 0 || tileX >= mCache->GetTilesX() || tileY >= mCache->GetTilesY()) {
+        return false;
+    }
+    float fx = tx - tileX * mTileSize;
+    float fz = tz - tileY * mTileSize;
+    int ix = std::min(static_cast<int>(fx), mTileSize - 1);
+    int iz = std::min(static_cast<int>(fz), mTileSize - 1);
+    fx -= ix;
+    fz -= iz;
+    // Copied under the cache lock: the tile under the camera may not be
+    // requested this frame, so a loader can evict it at any time
+    uint16_t heights[4];
+    if (!mCache->ReadHeights(mCache->GetTileId(tileX, tileY), ix, iz, heights)) {
+        return false;
+    }
+    float top = heights[0] + (heights[1] - heights[0]) * fx;
+    float bottom = heights[2] + (heights[3] - heights[2]) * fx;
+    height = (top + (bottom - top) * fz) * (mHeightScale / 65535.0f);
+    return true;
+}
+
+
+void StreamingTerrain::Destroy(){
+    if (mTexture) glDeleteTextures(1, &mTexture);
+    if (mIndexBufferObject) glDeleteBuffers(1, &mIndexBufferObject);
+    if (mVertexBufferObject) glDeleteBuffers(1, &mVertexBufferObject);
+    if (mVertexArrayObject) glDeleteVertexArrays(1, &mVertexArrayObject);
+    mTexture = 0;
+    mIndexBufferObject = 0;
+    mVertexBufferObject = 0;
+    mVertexArrayObject = 0;
+}
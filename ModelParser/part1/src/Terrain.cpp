@@ -0,0 +1,361 @@
+#include "Terrain.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <set>
+#include <utility>
+
+// Ends a triangle strip, one strip per row of cells
+static const GLushort kRestartIndex = 0xFFFF;
+
+
+/**
+* Frustum planes from the rows of the matrix (Gribb/Hartmann)
+*
+* @return void
+*/
+void ExtractFrustumPlanes(const glm::mat4& viewProjection, glm::vec4 planes[6]){
+    glm::vec4 rows[4];
+    for (int r = 0; r < 4; ++r) {
+        rows[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+    }
+    planes[0] = rows[3] + rows[0];
+    planes[1] = rows[3] - rows[0];
+    planes[2] = rows[3] + rows[1];
+    planes[3] = rows[3] - rows[1];
+    planes[4] = rows[3] + rows[2];
+    planes[5] = rows[3] - rows[2];
+}
+
+
+bool IsBoxOutsideFrustum(const glm::vec4 planes[6], const glm::vec3& boundsMin, const glm::vec3& boundsMax){
+    for (int i = 0; i < 6; ++i) {
+        const glm::vec4& plane = planes[i];
+        // Corner of the box farthest along the plane normal
+        glm::vec3 corner(plane.x >= 0.0f ? boundsMax.x : boundsMin.x,
+                         plane.y >= 0.0f ? boundsMax.y : boundsMin.y,
+                         plane.z >= 0.0f ? boundsMax.z : boundsMin.z);
+        if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// Constructor
+Terrain::Terrain(){
+
+}
+
+
+/**
+* Creates the vertex array object with the Vertex layout used by the shaders
+*
+* @return void
+*/
+void Terrain::Initialize(){
+    glGenVertexArrays(1, &mVertexArrayObject);
+    glBindVertexArray(mVertexArrayObject);
+    glGenBuffers(1, &mVertexBufferObject);
+    glGenBuffers(1, &mIndexBufferObject);
+
+    glBindBuffer(GL_ARRAY_BUFFER, mVertexBufferObject);
+    // The index buffer binding is part of the vertex array state
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBufferObject);
+
+    // Position information (x,y,z)
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    // Color information (r,g,b)
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(sizeof(GL_FLOAT)*3));
+    // Normal information (nx,ny,nz)
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(sizeof(GL_FLOAT)*6));
+
+    glBindVertexArray(0);
+}
+
+
+/**
+* Builds a flat grid of the given resolution and uploads vertices and indices
+*
+* @param resolution Number of cells along x and z
+* @return void
+*/
+void Terrain::Generate(size_t resolution){
+    mResolution = resolution;
+    mHeights.assign((resolution + 1) * (resolution + 1), -0.5f);
+    CreateChunks();
+    for (Chunk& chunk : mChunks) {
+        BuildChunk(chunk);
+        chunk.dirty = false;
+    }
+
+    glBindVertexArray(mVertexArrayObject);
+    glBindBuffer(GL_ARRAY_BUFFER, mVertexBufferObject);
+    glBufferData(GL_ARRAY_BUFFER, mVertices.size() * sizeof(Vertex), mVertices.data(), GL_DYNAMIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mIndices.size() * sizeof(GLushort), mIndices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
+
+    std::cout << "Resolution " << resolution << ": " << mChunks.size() << " chunks, "
+              << mVertices.size() << " vertices, " << mIndices.size() << " indices, "
+              << (mVertices.size() * sizeof(Vertex) + mIndices.size() * sizeof(GLushort)) / 1024 << " KB on the GPU"
+              << " (triangle soup: " << resolution * resolution * 6 * sizeof(Vertex) / 1024 << " KB)" << std::endl;
+}
+
+
+/**
+* Splits the grid into chunks of kChunkCells cells and writes one strip pattern
+* per distinct chunk size; only the last row and column of chunks can be smaller.
+*
+* @return void
+*/
+void Terrain::CreateChunks(){
+    mChunks.clear();
+    mIndices.clear();
+    std::map<std::pair<size_t, size_t>, std::pair<size_t, GLsizei>> patterns;
+
+    size_t firstVertex = 0;
+    for (size_t i0 = 0; i0 < mResolution; i0 += kChunkCells) {
+        for (size_t j0 = 0; j0 < mResolution; j0 += kChunkCells) {
+            Chunk chunk;
+            chunk.i0 = i0;
+            chunk.j0 = j0;
+            chunk.cellsX = std::min(kChunkCells, mResolution - i0);
+            chunk.cellsZ = std::min(kChunkCells, mResolution - j0);
+            chunk.firstVertex = firstVertex;
+            firstVertex += (chunk.cellsX + 1) * (chunk.cellsZ + 1);
+
+            auto key = std::make_pair(chunk.cellsX, chunk.cellsZ);
+            auto found = patterns.find(key);
+            if (found == patterns.end()) {
+                size_t offset = mIndices.size();
+                GLushort rowLength = static_cast<GLushort>(chunk.cellsZ + 1);
+                for (size_t a = 0; a < chunk.cellsX; ++a) {
+                    if (a > 0) {
+                        mIndices.push_back(kRestartIndex);
+                    }
+                    for (size_t b = 0; b <= chunk.cellsZ; ++b) {
+                        mIndices.push_back(static_cast<GLushort>(a * rowLength + b));
+                        mIndices.push_back(static_cast<GLushort>((a + 1) * rowLength + b));
+                    }
+                }
+                found = patterns.emplace(key, std::make_pair(offset, static_cast<GLsizei>(mIndices.size() - offset))).first;
+            }
+            chunk.indexOffset = found->second.first;
+            chunk.indexCount = found->second.second;
+            chunk.dirty = true;
+            mChunks.push_back(chunk);
+        }
+    }
+    mVertices.resize(firstVertex);
+}
+
+
+float Terrain::HeightAt(long i, long j) const{
+    long last = static_cast<long>(mResolution);
+    i = std::min(std::max(i, 0L), last);
+    j = std::min(std::max(j, 0L), last);
+    return mHeights[i * (mResolution + 1) + j];
+}
+
+
+/**
+* Fills the vertices of one chunk from the height grid. Normals come from central
+* differences and are baked into the color as simple diffuse lighting.
+*
+* @param chunk Chunk to rebuild
+* @return void
+*/
+void Terrain::BuildChunk(Chunk& chunk){
+    float spacing = 2.0f / mResolution;
+    glm::vec3 lightDirection = glm::normalize(glm::vec3(0.5f, 1.0f, 0.3f));
+    chunk.boundsMin = glm::vec3(1e30f);
+    chunk.boundsMax = glm::vec3(-1e30f);
+
+    Vertex* v = &mVertices[chunk.firstVertex];
+    for (size_t a = 0; a <= chunk.cellsX; ++a) {
+        for (size_t b = 0; b <= chunk.cellsZ; ++b, ++v) {
+            long i = static_cast<long>(chunk.i0 + a);
+            long j = static_cast<long>(chunk.j0 + b);
+            v->x = -1.0f + i * spacing;
+            v->y = HeightAt(i, j);
+            v->z = -1.0f + j * spacing;
+
+            glm::vec3 normal = glm::normalize(glm::vec3((HeightAt(i - 1, j) - HeightAt(i + 1, j)) / (2.0f * spacing),
+                                                        1.0f,
+                                                        (HeightAt(i, j - 1) - HeightAt(i, j + 1)) / (2.0f * spacing)));
+            v->nx = normal.x;
+            v->ny = normal.y;
+            v->nz = normal.z;
+            // Dark green, lit from above
+            float light = 0.4f + 0.6f * std::max(glm::dot(normal, lightDirection), 0.0f);
+            v->r = 0.0f;
+            v->g = 0.5f * light;
+            v->b = 0.0f;
+
+            chunk.boundsMin = glm::min(chunk.boundsMin, glm::vec3(v->x, v->y, v->z));
+            chunk.boundsMax = glm::max(chunk.boundsMax, glm::vec3(v->x, v->y, v->z));
+        }
+    }
+}
+
+
+/**
+* Raises the terrain with a cosine falloff and marks the chunks whose vertices,
+* including normals, change as dirty
+*
+* @return void
+*/
+void Terrain::RaiseHill(float x, float z, float radius, float height){
+    if (mResolution == 0) {
+        return;
+    }
+    float spacing = 2.0f / mResolution;
+    long last = static_cast<long>(mResolution);
+    long iMin = std::max(0L, static_cast<long>(std::floor((x - radius + 1.0f) / spacing)));
+    long iMax = std::min(last, static_cast<long>(std::ceil((x + radius + 1.0f) / spacing)));
+    long jMin = std::max(0L, static_cast<long>(std::floor((z - radius + 1.0f) / spacing)));
+    long jMax = std::min(last, static_cast<long>(std::ceil((z + radius + 1.0f) / spacing)));
+    if (iMin > iMax || jMin > jMax) {
+        return;
+    }
+
+    for (long i = iMin; i <= iMax; ++i) {
+        for (long j = jMin; j <= jMax; ++j) {
+            float dx = -1.0f + i * spacing - x;
+            float dz = -1.0f + j * spacing - z;
+            float distance = std::sqrt(dx * dx + dz * dz);
+            if (distance < radius) {
+                mHeights[i * (mResolution + 1) + j] += height * 0.5f * (1.0f + std::cos(3.14159265f * distance / radius));
+            }
+        }
+    }
+
+    // Normals of the neighbouring points change as well
+    iMin -= 1; iMax += 1; jMin -= 1; jMax += 1;
+    for (Chunk& chunk : mChunks) {
+        long ci0 = static_cast<long>(chunk.i0);
+        long cj0 = static_cast<long>(chunk.j0);
+        if (ci0 <= iMax && ci0 + static_cast<long>(chunk.cellsX) >= iMin &&
+            cj0 <= jMax && cj0 + static_cast<long>(chunk.cellsZ) >= jMin) {
+            chunk.dirty = true;
+        }
+    }
+}
+
+
+/**
+* Rebuilds and uploads only the dirty chunks, each with one glBufferSubData
+*
+* @return void
+*/
+void Terrain::Update(){
+    glBindBuffer(GL_ARRAY_BUFFER, mVertexBufferObject);
+    for (Chunk& chunk : mChunks) {
+        if (!chunk.dirty) {
+            continue;
+        }
+        BuildChunk(chunk);
+        size_t vertexCount = (chunk.cellsX + 1) * (chunk.cellsZ + 1);
+        glBufferSubData(GL_ARRAY_BUFFER, chunk.firstVertex * sizeof(Vertex), vertexCount * sizeof(Vertex),
+                        &mVertices[chunk.firstVertex]);
+        chunk.dirty = false;
+    }
+}
+
+
+/**
+* Draws every chunk whose bounding box is not completely outside one of the
+* frustum planes
+*
+* @param viewProjection Projection * view matrix of the camera
+* @return number of chunks drawn
+*/
+size_t Terrain::Draw(const glm::mat4& viewProjection) const{
+    glm::vec4 planes[6];
+    ExtractFrustumPlanes(viewProjection, planes);
+
+    glBindVertexArray(mVertexArrayObject);
+    glEnable(GL_PRIMITIVE_RESTART);
+    glPrimitiveRestartIndex(kRestartIndex);
+    size_t drawn = 0;
+    for (const Chunk& chunk : mChunks) {
+        if (IsBoxOutsideFrustum(planes, chunk.boundsMin, chunk.boundsMax)) {
+            continue;
+        }
+        glDrawElementsBaseVertex(GL_TRIANGLE_STRIP, chunk.indexCount, GL_UNSIGNED_SHORT,
+                                 (void*)(chunk.indexOffset * sizeof(GLushort)),
+                                 static_cast<GLint>(chunk.firstVertex));
+        ++drawn;
+    }
+    glDisable(GL_PRIMITIVE_RESTART);
+    glBindVertexArray(0);
+    return drawn;
+}
+
+
+void Terrain::Destroy(){
+    if (mIndexBufferObject) glDeleteBuffers(1, &mIndexBufferObject);
+    if (mVertexBufferObject) glDeleteBuffers(1, &mVertexBufferObject);
+    if (mVertexArrayObject) glDeleteVertexArrays(1, &mVertexArrayObject);
+    mIndexBufferObject = 0;
+    mVertexBufferObject = 0;
+    mVertexArrayObject = 0;
+}
+
+
+/**
+* Compares the memory of the chunked, indexed grid with the old generatePlane
+* path, which kept a vector<vector<Vertex>> grid, two Triangle structs per cell
+* and the flattened float array at the same time before uploading the floats.
+*
+* @param resolution Number of cells along x and z
+* @return void
+*/
+void Terrain::PrintMemoryComparison(size_t resolution){
+    double megabyte = 1024.0 * 1024.0;
+    double cells = static_cast<double>(resolution) * resolution;
+
+    // Old path, the vectors' capacity growth from push_back is not counted
+    double soupGrid = (resolution + 1.0) * (resolution + 1.0) * sizeof(Vertex);
+    double soupTriangles = cells * 2.0 * 3.0 * sizeof(Vertex);
+    double soupFloats = cells * 6.0 * 9.0 * sizeof(float);
+    double soupVertices = cells * 6.0;
+
+    // Chunked grid: vertices are duplicated on chunk borders, indices exist once per chunk size
+    size_t chunks = (resolution + kChunkCells - 1) / kChunkCells;
+    size_t lastCells = resolution - (chunks - 1) * kChunkCells;
+    double vertices = 0.0;
+    for (size_t a = 0; a < chunks; ++a) {
+        size_t cellsX = (a + 1 < chunks) ? kChunkCells : lastCells;
+        for (size_t b = 0; b < chunks; ++b) {
+            size_t cellsZ = (b + 1 < chunks) ? kChunkCells : lastCells;
+            vertices += (cellsX + 1.0) * (cellsZ + 1.0);
+        }
+    }
+    std::set<std::pair<size_t, size_t>> patterns;
+    for (size_t cellsX : {std::min(kChunkCells, resolution), lastCells}) {
+        for (size_t cellsZ : {std::min(kChunkCells, resolution), lastCells}) {
+            patterns.insert(std::make_pair(cellsX, cellsZ));
+        }
+    }
+    double indices = 0.0;
+    for (const std::pair<size_t, size_t>& pattern : patterns) {
+        indices += pattern.first * (2.0 * (pattern.second + 1.0)) + (pattern.first - 1.0);
+    }
+    double gridVertexBytes = vertices * sizeof(Vertex);
+    double gridIndexBytes = indices * sizeof(GLushort);
+    double heightBytes = (resolution + 1.0) * (resolution + 1.0) * sizeof(float);
+
+    std::cout << "Resolution " << resolution << " (" << chunks * chunks << " chunks):\n"
+              << "  triangle soup: " << static_cast<size_t>(soupVertices) << " vertices, GPU " << soupFloats / megabyte
+              << " MB, CPU peak while generating " << (soupGrid + soupTriangles + soupFloats) / megabyte << " MB\n"
+              << "  indexed grid:  " << static_cast<size_t>(vertices) << " vertices, GPU " << (gridVertexBytes + gridIndexBytes) / megabyte
+              << " MB, CPU " << (gridVertexBytes + gridIndexBytes + heightBytes) / megabyte << " MB (kept for chunk updates)\n"
+              << "  GPU memory saved: " << 100.0 * (1.0 - (gridVertexBytes + gridIndexBytes) / soupFloats) << "%" << std::endl;
+}
@@ -0,0 +1,315 @@
+#include "TerrainPageCache.hpp"
+#include "PPM.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+static const char kMagic[4] = {'T', 'T', 'R', 'N'};
+static const uint32_t kVersion = 1;
+// magic, version, width, height, tileSize, tilesX, tilesY
+static const size_t kHeaderBytes = 4 + 6 * sizeof(uint32_t);
+
+
+// Constructor
+TerrainPageCache::TerrainPageCache(){
+
+}
+
+
+// Destructor
+TerrainPageCache::~TerrainPageCache(){
+    Close();
+}
+
+
+size_t TerrainPageCache::GetTileBytes() const{
+    size_t border = mTileSize + 3;
+    return border * border * sizeof(uint16_t) + static_cast<size_t>(mTileSize) * mTileSize * 3;
+}
+
+
+/**
+* Reads the header of a tiled file and starts the workers
+*
+* @param memoryBudgetBytes Tiles kept in memory, tiles wanted in one frame are never evicted
+* @param threadCount Number of worker threads reading tiles
+* @return false if the file is missing or not a tiled terrain
+*/
+bool TerrainPageCache::Open(const std::string& filename, size_t memoryBudgetBytes, unsigned int threadCount){
+    Close();
+    std::ifstream file(filename, std::ios::binary);
+    char magic[4];
+    uint32_t header[6];
+    if (!file.read(magic, 4) || std::memcmp(magic, kMagic, 4) != 0 ||
+        !file.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != kVersion) {
+        std::cout << "Not a tiled terrain file: " << filename << std::endl;
+        return false;
+    }
+    mFilename = filename;
+    mWidth = static_cast<int>(header[1]);
+    mHeight = static_cast<int>(header[2]);
+    mTileSize = static_cast<int>(header[3]);
+    mTilesX = static_cast<int>(header[4]);
+    mTilesY = static_cast<int>(header[5]);
+    mMemoryBudget = memoryBudgetBytes;
+    mStatistics = Statistics();
+    mFrame = 0;
+
+    mRunning = true;
+    for (unsigned int i = 0; i < std::max(1u, threadCount); ++i) {
+        mWorkers.emplace_back(&TerrainPageCache::WorkerThread, this);
+    }
+    std::cout << "Terrain tiles: " << mTilesX << "x" << mTilesY << " tiles of " << mTileSize << " texels, "
+              << GetTileBytes() / 1024 << " KB each, budget " << mMemoryBudget / (1024 * 1024) << " MB, "
+              << mWorkers.size() << " loader threads" << std::endl;
+    return true;
+}
+
+
+void TerrainPageCache::Close(){
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mRunning = false;
+        mQueue.clear();
+    }
+    mWorkAvailable.notify_all();
+    for (std::thread& worker : mWorkers) {
+        worker.join();
+    }
+    mWorkers.clear();
+    mTiles.clear();
+    mInFlight.clear();
+}
+
+
+bool TerrainPageCache::ReadTile(std::ifstream& file, uint32_t id, TerrainTile& tile) const{
+    size_t border = mTileSize + 3;
+    tile.x = static_cast<int>(id % mTilesX);
+    tile.y = static_cast<int>(id / mTilesX);
+    tile.heights.resize(border * border);
+    tile.diffuse.resize(static_cast<size_t>(mTileSize) * mTileSize * 3);
+    file.clear();
+    file.seekg(static_cast<std::streamoff>(kHeaderBytes + id * GetTileBytes()));
+    file.read(reinterpret_cast<char*>(tile.heights.data()), tile.heights.size() * sizeof(uint16_t));
+    file.read(reinterpret_cast<char*>(tile.diffuse.data()), tile.diffuse.size());
+    return static_cast<bool>(file);
+}
+
+
+/**
+* Takes the closest queued tile, reads it without holding the lock and makes it resident
+*
+* @return void
+*/
+void TerrainPageCache::WorkerThread(){
+    std::ifstream file(mFilename, std::ios::binary);
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mWorkAvailable.wait(lock, [this]{ return !mRunning || !mQueue.empty(); });
+        if (!mRunning) {
+            return;
+        }
+        uint32_t id = mQueue.front();
+        mQueue.erase(mQueue.begin());
+        // The queue only holds tiles of the current frame
+        mInFlight[id] = mFrame;
+
+        lock.unlock();
+        auto begin = std::chrono::steady_clock::now();
+        TerrainTile tile;
+        bool loaded = ReadTile(file, id, tile);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+        lock.lock();
+
+        // Not mFrame: a tile no longer requested must not be protected from eviction
+        unsigned int requested = mInFlight[id];
+        mInFlight.erase(id);
+        mStatistics.loadMilliseconds += elapsed.count();
+        if (loaded) {
+            Entry& entry = mTiles[id];
+            entry.tile = std::move(tile);
+            entry.lastRequested = requested;
+            ++mStatistics.loads;
+            EvictToBudget();
+        } else {
+            std::cout << "Could not read terrain tile " << id << std::endl;
+        }
+        mWorkDone.notify_all();
+    }
+}
+
+
+void TerrainPageCache::EvictToBudget(){
+    size_t tileBytes = GetTileBytes();
+    while (mTiles.size() * tileBytes > mMemoryBudget) {
+        auto oldest = mTiles.end();
+        for (auto entry = mTiles.begin(); entry != mTiles.end(); ++entry) {
+            if (entry->second.lastRequested == mFrame) {
+                continue;
+            }
+            if (oldest == mTiles.end() || entry->second.lastRequested < oldest->second.lastRequested ||
+                (entry->second.lastRequested == oldest->second.lastRequested && entry->first < oldest->first)) {
+                oldest = entry;
+            }
+        }
+        if (oldest == mTiles.end()) {
+            break;
+        }
+        mTiles.erase(oldest);
+        ++mStatistics.evictions;
+    }
+    mStatistics.peakBytesResident = std::max(mStatistics.peakBytesResident, mTiles.size() * tileBytes);
+}
+
+
+/**
+* Replaces the queue with the missing tiles of this frame in the given order, so
+* the loaders always work on the closest tiles first and stop loading tiles the
+* camera has moved away from.
+*
+* @param tiles Tile ids, highest priority first
+* @return void
+*/
+void TerrainPageCache::Request(const std::vector<uint32_t>& tiles){
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        ++mFrame;
+        // A tile still waiting from an earlier frame was already counted as a miss
+        std::vector<uint32_t> queued;
+        queued.swap(mQueue);
+        for (uint32_t id : tiles) {
+            auto found = mTiles.find(id);
+            if (found != mTiles.end()) {
+                ++mStatistics.hits;
+                found->second.lastRequested = mFrame;
+            } else {
+                auto reading = mInFlight.find(id);
+                if (reading != mInFlight.end()) {
+                    reading->second = mFrame;
+                } else {
+                    if (std::find(queued.begin(), queued.end(), id) == queued.end()) {
+                        ++mStatistics.misses;
+                    }
+                    mQueue.push_back(id);
+                }
+            }
+        }
+    }
+    mWorkAvailable.notify_all();
+}
+
+
+const TerrainTile* TerrainPageCache::Find(uint32_t tile){
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto found = mTiles.find(tile);
+    return (found != mTiles.end()) ? &found->second.tile : nullptr;
+}
+
+
+bool TerrainPageCache::ReadHeights(uint32_t tile, int x, int y, uint16_t heights[4]){
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto found = mTiles.find(tile);
+    if (found == mTiles.end()) {
+        return false;
+    }
+    // Skip the border
+    size_t border = mTileSize + 3;
+    const uint16_t* row0 = &found->second.tile.heights[(y + 1) * border + x + 1];
+    const uint16_t* row1 = row0 + border;
+    heights[0] = row0[0];
+    heights[1] = row0[1];
+    heights[2] = row1[0];
+    heights[3] = row1[1];
+    return true;
+}
+
+
+void TerrainPageCache::WaitForPending(){
+    std::unique_lock<std::mutex> lock(mMutex);
+    mWorkDone.wait(lock, [this]{ return mQueue.empty() && mInFlight.empty(); });
+}
+
+
+TerrainPageCache::Statistics TerrainPageCache::GetStatistics(){
+    std::lock_guard<std::mutex> lock(mMutex);
+    Statistics statistics = mStatistics;
+    statistics.tilesResident = mTiles.size();
+    statistics.bytesResident = mTiles.size() * GetTileBytes();
+    statistics.pending = mQueue.size() + mInFlight.size();
+    return statistics;
+}
+
+
+/**
+* Cuts a heightmap into tiles of tileSize x tileSize cells. Without a diffuse
+* texture the color is baked from the height (grass, rock, snow).
+*
+* @return true if the file was written
+*/
+bool TerrainPageCache::WriteTiledFile(const std::string& heightmapFile, const std::string& diffuseFile,
+                                      const std::string& outputFile, int tileSize){
+    PPM heightmap(heightmapFile);
+    int width = heightmap.getWidth();
+    int height = heightmap.getHeight();
+    if (width <= tileSize || height <= tileSize) {
+        std::cout << "Heightmap " << heightmapFile << " is missing or smaller than one tile" << std::endl;
+        return false;
+    }
+    PPM diffuse = diffuseFile.empty() ? PPM(width, height) : PPM(diffuseFile);
+    bool bakeColors = diffuseFile.empty();
+    if (!bakeColors && (diffuse.getWidth() != width || diffuse.getHeight() != height)) {
+        std::cout << "Diffuse texture " << diffuseFile << " does not match the heightmap size" << std::endl;
+        return false;
+    }
+
+    uint32_t tilesX = static_cast<uint32_t>((width - 1) / tileSize);
+    uint32_t tilesY = static_cast<uint32_t>((height - 1) / tileSize);
+    std::ofstream file(outputFile, std::ios::binary);
+    uint32_t header[6] = {kVersion, static_cast<uint32_t>(width), static_cast<uint32_t>(height),
+                          static_cast<uint32_t>(tileSize), tilesX, tilesY};
+    file.write(kMagic, 4);
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    const unsigned char* heights = heightmap.pixelData();
+    const unsigned char* colors = diffuse.pixelData();
+    int border = tileSize + 3;
+    std::vector<uint16_t> tileHeights(static_cast<size_t>(border) * border);
+    std::vector<uint8_t> tileColors(static_cast<size_t>(tileSize) * tileSize * 3);
+    for (uint32_t ty = 0; ty < tilesY; ++ty) {
+        for (uint32_t tx = 0; tx < tilesX; ++tx) {
+            for (int y = 0; y < border; ++y) {
+                for (int x = 0; x < border; ++x) {
+                    int sx = std::min(std::max(static_cast<int>(tx) * tileSize + x - 1, 0), width - 1);
+                    int sy = std::min(std::max(static_cast<int>(ty) * tileSize + y - 1, 0), height - 1);
+                    tileHeights[y * border + x] = static_cast<uint16_t>(heights[(static_cast<size_t>(sy) * width + sx) * 3] * 257);
+                }
+            }
+            for (int y = 0; y < tileSize; ++y) {
+                for (int x = 0; x < tileSize; ++x) {
+                    size_t source = (static_cast<size_t>(ty * tileSize + y) * width + tx * tileSize + x) * 3;
+                    uint8_t* color = &tileColors[(y * tileSize + x) * 3];
+                    if (bakeColors) {
+                        float t = heights[source] / 255.0f;
+                        float grass[3] = {0.1f, 0.45f, 0.1f}, rock[3] = {0.45f, 0.35f, 0.2f}, snow[3] = {0.9f, 0.9f, 0.9f};
+                        for (int c = 0; c < 3; ++c) {
+                            float value = (t < 0.5f) ? grass[c] + (rock[c] - grass[c]) * t * 2.0f
+                                                     : rock[c] + (snow[c] - rock[c]) * std::max(0.0f, t - 0.6f) * 2.5f;
+                            color[c] = static_cast<uint8_t>(std::min(value, 1.0f) * 255.0f);
+                        }
+                    } else {
+                        color[0] = colors[source];
+                        color[1] = colors[source + 1];
+                        color[2] = colors[source + 2];
+                    }
+                }
+            }
+            file.write(reinterpret_cast<const char*>(tileHeights.data()), tileHeights.size() * sizeof(uint16_t));
+            file.write(reinterpret_cast<const char*>(tileColors.data()), tileColors.size());
+        }
+    }
+    std::cout << "Wrote " << tilesX << "x" << tilesY << " tiles of " << tileSize << " texels to " << outputFile << std::endl;
+    return static_cast<bool>(file);
+}
@@ -12,6 +12,13 @@
 #include <fstream>
 
 #include "Camera.hpp"
+#include "Terrain.hpp"
+#include "HeightmapTerrain.hpp"
+#include "StreamingTerrain.hpp"
+#include "TerrainPageCache.hpp"
+
+#include <chrono>
+#include <cmath>
 
 // Screen Dimensions
 int gScreenWidth 						= 640;
@@ -25,11 +32,30 @@ bool gQuit = false;
 // shader
 GLuint gGraphicsPipelineShaderProgram	= 0;
 
-// OpenGL Objects
-// Vertex Array Object (VAO)
-GLuint gVertexArrayObjectFloor= 0;
-// Vertex Buffer Object (VBO)
-GLuint  gVertexBufferObjectFloor            = 0;
+// Chunked terrain grid (vertex array, vertex and index buffers)
+Terrain gTerrain;
+
+// Heightmap terrain with quadtree LOD, used instead of the grid with --heightmap
+HeightmapTerrain gHeightmapTerrain;
+std::string gHeightmapFile;
+size_t gTriangleBudget = 500000;
+float gPixelError = 2.0f;
+
+// Tiled terrain paged in from disk, used instead of the grid with --streaming.
+// --stream-bench flies a fixed path in a hidden window and prints the counters.
+TerrainPageCache gTerrainPageCache;
+StreamingTerrain gStreamingTerrain;
+std::string gStreamingFile;
+bool gStreamBenchmark = false;
+unsigned int gBenchmarkFrames = 600;
+size_t gCacheMegabytes = 32;
+unsigned int gLoaderThreads = 2;
+// Tile uploads to the GPU per frame
+int gTileUploadsPerFrame = 8;
+// Distance between height samples and height of the largest value, in world units
+const float kStreamingTexelSize = 0.1f;
+const float kStreamingHeightScale = 15.0f;
+const int kStreamingViewRadius = 5;
 
 // Camera
 Camera gCamera;
@@ -40,7 +66,10 @@ GLenum gPolygonMode = GL_FILL;
 
 // Floor resolution
 size_t gFloorResolution = 10;
-size_t gFloorTriangles  = 0;
+
+// Camera speed and far plane, larger for the heightmap terrain
+float gCameraSpeed = 0.002f;
+float gFarPlane = 20.0f;
 
 
 
@@ -187,8 +216,10 @@ GLuint CreateShaderProgram(const std::string& vertexShaderSource, const std::str
 */
 void CreateGraphicsPipeline(){
 
-    std::string vertexShaderSource      = LoadShaderAsString("./shaders/vert.glsl");
-    std::string fragmentShaderSource    = LoadShaderAsString("./shaders/frag.glsl");
+    // The streaming terrain samples its tile textures
+    bool streaming = !gStreamingFile.empty();
+    std::string vertexShaderSource      = LoadShaderAsString(streaming ? "./shaders/terrain_vert.glsl" : "./shaders/vert.glsl");
+    std::string fragmentShaderSource    = LoadShaderAsString(streaming ? "./shaders/terrain_frag.glsl" : "./shaders/frag.glsl");
 
 	gGraphicsPipelineShaderProgram = CreateShaderProgram(vertexShaderSource,fragmentShaderSource);
 }
@@ -221,7 +252,7 @@ void InitializeProgram(){
 													SDL_WINDOWPOS_UNDEFINED,
 													gScreenWidth,
 													gScreenHeight,
-													SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN );
+													SDL_WINDOW_OPENGL | (gStreamBenchmark ? SDL_WINDOW_HIDDEN : SDL_WINDOW_SHOWN) );
 
 	// Check if Window created.
 	if( gGraphicsApplicationWindow == nullptr ){
@@ -245,147 +276,44 @@ void InitializeProgram(){
 }
 
 
-struct Vertex{
-    float x,y,z;    // position
-	float r,g,b; 	// color
-	float nx,ny,nz; // normals
-};  
-
-struct Triangle{
-    Vertex vertices[3]; // 3 vertices per triangle
-};
-
-
-
-// Return a value that is a mapping between the current range and a new range.
-float map_linear(float x, float in_min, float in_max, float out_min, float out_max){
-    return (x-in_min) * (out_max - out_min) / (in_max - in_min) + out_min;;
-}
-
-// Pass in an unsigned integer representing the number of rows and columns in the plane
-std::vector<Triangle> generatePlane(size_t resolution=0){
-    // Store the resulting plane
-    std::vector<Triangle> result;
-
-    // If resolution is 0, return empty vector
-    if (resolution == 0)
-        return result;
-
-    // Generate the vertices
-    std::vector<std::vector<Vertex>> vertices(resolution + 1, std::vector<Vertex>(resolution + 1));
-
-    // For i from 0 to resolution
-    for (size_t i = 0; i <= resolution; ++i) {
-        for (size_t j = 0; j <= resolution; ++j) {
-            float x = map_linear(i, 0, resolution, -1.0f, 1.0f);
-            float z = map_linear(j, 0, resolution, -1.0f, 1.0f);
-            float y = -0.5f;
-
-            Vertex v;
-            v.x = x;
-            v.y = y;
-            v.z = z;
-            // Set color to dark green
-            v.r = 0.0f;
-            v.g = 0.5f;
-            v.b = 0.0f;
-
-            vertices[i][j] = v;
-        }
-    }
-
-    // generate triangles
-    for (size_t i = 0; i < resolution; ++i) {
-        for (size_t j = 0; j < resolution; ++j) {
-            // First triangle
-            Triangle tri1;
-            tri1.vertices[0] = vertices[i][j];
-            tri1.vertices[1] = vertices[i + 1][j];
-            tri1.vertices[2] = vertices[i + 1][j + 1];
-
-            // Second triangle
-            Triangle tri2;
-            tri2.vertices[0] = vertices[i][j];
-            tri2.vertices[1] = vertices[i + 1][j + 1];
-            tri2.vertices[2] = vertices[i][j + 1];
-
-            result.push_back(tri1);
-            result.push_back(tri2);
-        }
-    }
-
-    return result;
-}
-
-
-
-
-// Regenerate the flat plane
-void GeneratePlaneBufferData(){
-    // Generate a plane with the resolution 
-    std::vector<Triangle> mesh = generatePlane(gFloorResolution); 
-
-	std::vector<GLfloat> vertexDataFloor;
-    // For each triangle
-    for (const Triangle& tri : mesh) {
-        // For each vertex in triangle
-        for (int i = 0; i < 3; ++i) {
-            const Vertex& v = tri.vertices[i];
-            // position x, y, z
-            vertexDataFloor.push_back(v.x);
-            vertexDataFloor.push_back(v.y);
-            vertexDataFloor.push_back(v.z);
-            // color r, g, b
-            vertexDataFloor.push_back(v.r);
-            vertexDataFloor.push_back(v.g);
-            vertexDataFloor.push_back(v.b);
-            // normal nx, ny, nz
-            vertexDataFloor.push_back(v.nx);
-            vertexDataFloor.push_back(v.ny);
-            vertexDataFloor.push_back(v.nz);
-        }
-    }
-
-    // Store size in a global so you can later determine how many vertices to draw in glDrawArrays
-    gFloorTriangles = vertexDataFloor.size() / 9; // Number of vertices
-
-
-		glBindBuffer(GL_ARRAY_BUFFER, gVertexBufferObjectFloor);
-		glBufferData(GL_ARRAY_BUFFER,
-							 vertexDataFloor.size() * sizeof(GL_FLOAT),
-							 vertexDataFloor.data(),
-							 GL_STATIC_DRAW);
-}
-
 /**
 * Setup geometry during the vertex specification step
 *
 * @return void
 */
 void VertexSpecification(){
+    if (!gStreamingFile.empty()) {
+        if (!gTerrainPageCache.Open(gStreamingFile, gCacheMegabytes * 1024 * 1024, gLoaderThreads)) {
+            exit(EXIT_FAILURE);
+        }
+        gStreamingTerrain.Initialize(&gTerrainPageCache, kStreamingTexelSize, kStreamingHeightScale, kStreamingViewRadius);
+        gCamera.SetCameraEyePosition(0.0f, kStreamingHeightScale + 1.0f, 0.0f);
+        gCameraSpeed = 0.1f;
+        gFarPlane = (kStreamingViewRadius * gTerrainPageCache.GetTileSize()) * kStreamingTexelSize;
+        return;
+    }
+    if (!gHeightmapFile.empty()) {
+        // 20 units wide and up to 3 units high
+        if (!gHeightmapTerrain.Load(gHeightmapFile, 20.0f, 3.0f)) {
+            exit(EXIT_FAILURE);
+        }
+        gHeightmapTerrain.Initialize(gTriangleBudget);
+        gCamera.SetCameraEyePosition(0.0f, gHeightmapTerrain.GetHeight(0.0f, 9.0f) + 1.5f, 9.0f);
+        gCameraSpeed = 0.05f;
+        gFarPlane = 40.0f;
+        return;
+    }
+    gTerrain.Initialize();
+    gTerrain.Generate(gFloorResolution);
+}
+
 
-	// Vertex Arrays Object (VAO) Setup
-	glGenVertexArrays(1, &gVertexArrayObjectFloor);
-	glBindVertexArray(gVertexArrayObjectFloor);
-	// Vertex Buffer Object (VBO) creation
-	glGenBuffers(1, &gVertexBufferObjectFloor);
-
-    // Generate our data for the buffer
-    GeneratePlaneBufferData();
- 
-	glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,sizeof(GL_FLOAT)*9,(void*)0);
-    // Color information (r,g,b)
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,sizeof(GL_FLOAT)*9,(GLvoid*)(sizeof(GL_FLOAT)*3));
-    // Normal information (nx,ny,nz)
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE,sizeof(GL_FLOAT)*9, (GLvoid*)(sizeof(GL_FLOAT)*6));
-
-	glBindVertexArray(0);
-	glDisableVertexAttribArray(0);
-	glDisableVertexAttribArray(1);
-	glDisableVertexAttribArray(2);
+// Projection matrix (in perspective) shared by drawing and chunk culling
+glm::mat4 GetProjectionMatrix(){
+    return glm::perspective(glm::radians(45.0f),
+                            (float)gScreenWidth/(float)gScreenHeight,
+                            0.1f,
+                            gFarPlane);
 }
 
 
@@ -441,10 +369,7 @@ void PreDraw(){
 
 
     // Projection matrix (in perspective) 
-    glm::mat4 perspective = glm::perspective(glm::radians(45.0f),
-                                             (float)gScreenWidth/(float)gScreenHeight,
-                                             0.1f,
-                                             20.0f);
+    glm::mat4 perspective = GetProjectionMatrix();
 
     // Retrieve location of perspective matrix uniform 
     GLint u_ProjectionLocation= glGetUniformLocation( gGraphicsPipelineShaderProgram,"u_Projection");
@@ -464,11 +389,49 @@ void PreDraw(){
 * @return void
 */
 void Draw(){
-    // Enable attributes
-	glBindVertexArray(gVertexArrayObjectFloor);
+    if (!gStreamingFile.empty()) {
+        glm::vec3 eye(gCamera.GetEyeXPosition(), gCamera.GetEyeYPosition(), gCamera.GetEyeZPosition());
+        // The benchmark waits for the loaders, so every run sees the same tiles
+        gStreamingTerrain.Update(eye, gTileUploadsPerFrame, gStreamBenchmark);
+        gStreamingTerrain.Draw(gGraphicsPipelineShaderProgram, GetProjectionMatrix() * gCamera.GetViewMatrix());
+        glUseProgram(0);
+
+        static unsigned int frame = 0;
+        if (!gStreamBenchmark && frame++ % 120 == 0) {
+            const StreamingTerrain::Statistics& statistics = gStreamingTerrain.GetStatistics();
+            TerrainPageCache::Statistics cache = gTerrainPageCache.GetStatistics();
+            std::cout << "Streaming: " << statistics.tilesDrawn << " of " << statistics.tilesWanted << " tiles drawn, "
+                      << statistics.tilesMissing << " missing, " << cache.hits << " hits, " << cache.misses << " misses, "
+                      << cache.tilesResident << " tiles (" << cache.bytesResident / (1024 * 1024) << " MB) resident, "
+                      << cache.pending << " pending" << std::endl;
+        }
+        return;
+    }
+    if (!gHeightmapFile.empty()) {
+        glm::vec3 eye(gCamera.GetEyeXPosition(), gCamera.GetEyeYPosition(), gCamera.GetEyeZPosition());
+        gHeightmapTerrain.Update(eye, GetProjectionMatrix() * gCamera.GetViewMatrix(),
+                                 glm::radians(45.0f), (float)gScreenHeight, gPixelError);
+        gHeightmapTerrain.Draw();
+        glUseProgram(0);
+
+        // Print the LOD statistics about every two seconds
+        static unsigned int frame = 0;
+        if (frame++ % 120 == 0) {
+            const HeightmapTerrain::Statistics& statistics = gHeightmapTerrain.GetStatistics();
+            std::cout << "Terrain: LOD selection " << statistics.selectMilliseconds << " ms, "
+                      << statistics.nodesSelected << " nodes (" << statistics.nodesCulled << " culled), "
+                      << statistics.trianglesDrawn << " triangles of " << gTriangleBudget
+                      << (statistics.budgetLimited ? " (budget limited)" : "") << ", "
+                      << statistics.uploads << " node uploads in " << statistics.uploadMilliseconds << " ms" << std::endl;
+        }
+        return;
+    }
 
-    //Render data
-    glDrawArrays(GL_TRIANGLES,0,gFloorTriangles);
+    // Upload chunks changed since the last frame
+    gTerrain.Update();
+
+    // Render the chunks in view
+    gTerrain.Draw(GetProjectionMatrix() * gCamera.GetViewMatrix());
 
     glUseProgram(0);
 }
@@ -516,35 +479,61 @@ void Input(){
 
     // Retrieve keyboard state
     const Uint8 *state = SDL_GetKeyboardState(NULL);
-    if (state[SDL_SCANCODE_UP]) {
+    bool flatTerrain = gHeightmapFile.empty() && gStreamingFile.empty();
+    if (state[SDL_SCANCODE_UP] && flatTerrain) {
         SDL_Delay(250);
         gFloorResolution+=1;
         std::cout << "Resolution:" << gFloorResolution << std::endl;
-        GeneratePlaneBufferData();
+        gTerrain.Generate(gFloorResolution);
     }
-    if (state[SDL_SCANCODE_DOWN]) {
+    if (state[SDL_SCANCODE_DOWN] && flatTerrain) {
         SDL_Delay(250); 
         gFloorResolution-=1;
         if(gFloorResolution<=1){
             gFloorResolution=1;
         }
         std::cout << "Resolution:" << gFloorResolution << std::endl;
-        GeneratePlaneBufferData();
+        gTerrain.Generate(gFloorResolution);
     }
 
     // Camera
     // Update our position of the camera
     if (state[SDL_SCANCODE_W]) {
-        gCamera.MoveForward(0.002f);
+        gCamera.MoveForward(gCameraSpeed);
     }
     if (state[SDL_SCANCODE_S]) {
-        gCamera.MoveBackward(0.002f);
+        gCamera.MoveBackward(gCameraSpeed);
+    }
+    if (!gHeightmapFile.empty()) {
+        // Stay above the ground
+        float x = gCamera.GetEyeXPosition();
+        float z = gCamera.GetEyeZPosition();
+        float ground = gHeightmapTerrain.GetHeight(x, z) + 0.3f;
+        if (gCamera.GetEyeYPosition() < ground) {
+            gCamera.SetCameraEyePosition(x, ground, z);
+        }
+    }
+    if (!gStreamingFile.empty()) {
+        float x = gCamera.GetEyeXPosition();
+        float z = gCamera.GetEyeZPosition();
+        float ground = 0.0f;
+        if (gStreamingTerrain.GetHeight(x, z, ground) && gCamera.GetEyeYPosition() < ground + 0.3f) {
+            gCamera.SetCameraEyePosition(x, ground + 0.3f, z);
+        }
     }
     if (state[SDL_SCANCODE_A]) {
     }
     if (state[SDL_SCANCODE_D]) {
     }
 
+    if (state[SDL_SCANCODE_R] && flatTerrain) {
+        SDL_Delay(250);
+        // Raise a hill a little in front of the camera, only the chunks under it are re-uploaded
+        float x = gCamera.GetEyeXPosition() + gCamera.GetViewXDirection() * 0.5f;
+        float z = gCamera.GetEyeZPosition() + gCamera.GetViewZDirection() * 0.5f;
+        gTerrain.RaiseHill(x, z, 0.2f, 0.05f);
+    }
+
     if (state[SDL_SCANCODE_TAB]) {
         SDL_Delay(250);
         if(gPolygonMode== GL_FILL){
@@ -577,6 +566,49 @@ void MainLoop(){
 
 
 
+/**
+* Flies over the streaming terrain on a fixed path, from the near edge to the far
+* edge in a slow S curve at a fixed height, and prints frame times and the page
+* cache counters. The loaders are waited for every frame, so the counters only
+* depend on the path and the cache budget.
+*
+* @return void
+*/
+void StreamBenchmarkLoop(){
+    float width = gStreamingTerrain.GetWorldWidth();
+    float depth = gStreamingTerrain.GetWorldDepth();
+    double totalMilliseconds = 0.0;
+    double worstMilliseconds = 0.0;
+    for (unsigned int frame = 0; frame < gBenchmarkFrames; ++frame) {
+        float t = frame / static_cast<float>(std::max(1u, gBenchmarkFrames - 1));
+        gCamera.SetCameraEyePosition(0.25f * width * std::sin(6.2831853f * t), kStreamingHeightScale + 1.0f,
+                                     0.45f * depth * (1.0f - 2.0f * t));
+
+        auto begin = std::chrono::steady_clock::now();
+        PreDraw();
+        Draw();
+        glFinish();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+        SDL_GL_SwapWindow(gGraphicsApplicationWindow);
+        totalMilliseconds += elapsed.count();
+        worstMilliseconds = std::max(worstMilliseconds, elapsed.count());
+    }
+
+    const StreamingTerrain::Statistics& statistics = gStreamingTerrain.GetStatistics();
+    TerrainPageCache::Statistics cache = gTerrainPageCache.GetStatistics();
+    size_t requests = cache.hits + cache.misses;
+    std::cout << "Stream benchmark: " << gBenchmarkFrames << " frames, "
+              << totalMilliseconds / std::max(1u, gBenchmarkFrames) << " ms average, " << worstMilliseconds << " ms worst\n"
+              << "  cache: " << cache.hits << " hits, " << cache.misses << " misses ("
+              << (requests ? 100.0 * cache.hits / requests : 0.0) << "% hit rate), " << cache.loads << " loads in "
+              << cache.loadMilliseconds << " ms, " << cache.evictions << " evictions\n"
+              << "  resident: " << cache.tilesResident << " tiles, " << cache.bytesResident / (1024 * 1024) << " MB, peak "
+              << cache.peakBytesResident / (1024 * 1024) << " MB of " << gCacheMegabytes << " MB budget\n"
+              << "  gpu: " << statistics.uploadsTotal << " tile uploads, " << statistics.gpuEvictionsTotal
+              << " slot reuses, " << statistics.tilesDrawn << " tiles drawn in the last frame" << std::endl;
+}
+
+
 /**
 * Destroy any global objects.
 *
@@ -588,8 +620,10 @@ void CleanUp(){
 	gGraphicsApplicationWindow = nullptr;
 
     // Delete OpenGL Objects
-    glDeleteBuffers(1, &gVertexBufferObjectFloor);
-    glDeleteVertexArrays(1, &gVertexArrayObjectFloor);
+    gTerrain.Destroy();
+    gHeightmapTerrain.Destroy();
+    gStreamingTerrain.Destroy();
+    gTerrainPageCache.Close();
 
 	// Delete Graphics pipeline
     glDeleteProgram(gGraphicsPipelineShaderProgram);
@@ -607,16 +641,59 @@ void CleanUp(){
 int main( int argc, char* args[] ){
     std::cout << "Use w and s keys to move forward and back\n";
     std::cout << "Use up and down to change tessellation\n";
+    std::cout << "Use r to raise a hill in front of the camera\n";
     std::cout << "Use 1 to toggle wireframe\n";
     std::cout << "Press ESC to quit\n";
 
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = args[i];
+        if (arg == "--memory-report") {
+            // Memory of the chunked grid against the old triangle soup, no window needed
+            for (size_t resolution : {10, 256, 1024, 2048}) {
+                Terrain::PrintMemoryComparison(resolution);
+            }
+            return 0;
+        } else if (arg == "--make-heightmap" && i + 2 < argc) {
+            // Test data, e.g. --make-heightmap terrain.ppm 4097
+            HeightmapTerrain::GenerateHeightmap(args[i + 1], std::stoi(args[i + 2]));
+            return 0;
+        } else if (arg == "--make-tiles" && i + 2 < argc) {
+            // e.g. --make-tiles terrain.ppm terrain.tiles [diffuse.ppm]
+            std::string diffuse = (i + 3 < argc && std::string(args[i + 3]).rfind("--", 0) != 0) ? args[i + 3] : "";
+            return TerrainPageCache::WriteTiledFile(args[i + 1], diffuse, args[i + 2], 64) ? 0 : 1;
+        } else if (arg == "--streaming" && i + 1 < argc) {
+            gStreamingFile = args[++i];
+        } else if (arg == "--stream-bench" && i + 1 < argc) {
+            gStreamingFile = args[++i];
+            gStreamBenchmark = true;
+        } else if (arg == "--frames" && i + 1 < argc) {
+            gBenchmarkFrames = std::stoul(args[++i]);
+        } else if (arg == "--cache-mb" && i + 1 < argc) {
+            gCacheMegabytes = std::stoul(args[++i]);
+        } else if (arg == "--loader-threads" && i + 1 < argc) {
+            gLoaderThreads = std::stoul(args[++i]);
+        } else if (arg == "--uploads-per-frame" && i + 1 < argc) {
+            gTileUploadsPerFrame = std::stoi(args[++i]);
+        } else if (arg == "--heightmap" && i + 1 < argc) {
+            gHeightmapFile = args[++i];
+        } else if (arg == "--budget" && i + 1 < argc) {
+            gTriangleBudget = std::stoul(args[++i]);
+        } else if (arg == "--pixel-error" && i + 1 < argc) {
+            gPixelError = std::stof(args[++i]);
+        }
+    }
+
 	InitializeProgram();
 	
 	VertexSpecification();
 	
 	CreateGraphicsPipeline();
 	
-	MainLoop();	
+	if (gStreamBenchmark) {
+		StreamBenchmarkLoop();
+	} else {
+		MainLoop();
+	}
 
 	CleanUp();
 
@@ -16,7 +16,7 @@ LIBRARIES=""            # What libraries
 if platform.system()=="Linux":
     ARGUMENTS="-D LINUX"
     INCLUDE_DIR="-I ./include/ -I ./../common/thirdparty/glm/"
-    LIBRARIES="-lSDL2 -ldl"
+    LIBRARIES="-lSDL2 -ldl -lpthread"
 elif platform.system()=="Darwin":
     ARGUMENTS="-D MAC"
     INCLUDE_DIR="-I ./include/ -I/Library/Frameworks/SDL2.framework/Headers -I./../common/thirdparty/old/glm"
@@ -8,6 +8,11 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
 
 int gScreenWidth = 640;
 int gScreenHeight = 640;
@@ -162,12 +167,38 @@ struct Model {
     size_t indexCount;
     size_t edgeIndexCount;
     size_t vertexCount; // Number of vertices
+    bool loaded = false; // Set once the buffers are uploaded
+};
+
+// A model parsed on a loader thread, waiting for its upload on the main thread
+struct ParsedModel {
+    size_t slot; // Index in gModels, the command line order
+    OBJ objData;
+    std::vector<GLuint> edgeIndices;
+    double parseMilliseconds;
 };
 
 std::vector<Model> gModels;
-int gCurrentModelIndex = 0;
+// -1 until the first model is uploaded
+int gCurrentModelIndex = -1;
 size_t gCubeIndexCount = 0;
 
+// Background loading: the loader threads take the paths in order and hand
+// the parsed models to the main thread in the order they finish
+std::vector<std::string> gModelPaths;
+std::vector<std::thread> gLoaderThreads;
+std::atomic<size_t> gNextModelToParse{0};
+std::atomic<bool> gLoadFailed{false};
+std::mutex gParsedModelsMutex;
+std::vector<ParsedModel*> gParsedModels;
+size_t gModelsUploaded = 0;
+std::chrono::steady_clock::time_point gLoadStart;
+bool gFirstFrameShown = false;
+// --sequential parses and uploads one model after the other before the first frame
+bool gSequentialLoading = false;
+// --quit-after-load leaves once every model is on screen, for timing the loading
+bool gQuitAfterLoad = false;
+
 // Wireframe mode toggle
 bool gWireframeMode = false;
 
@@ -184,88 +215,183 @@ std::string readShaderFile(const std::string& filePath) {
     return shaderStream.str();
 }
 
-void LoadModels(const std::vector<std::string>& objFilePaths) {
-    gModels.clear();
+double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
 
-    for (const auto& path : objFilePaths) {
-        Model model;
-        if (!model.objData.load(path)) {
-            std::cerr << "Failed to load OBJ file: " << path << std::endl;
-            exit(1);
-        }
+// Two indices per triangle edge, for the wireframe
+std::vector<GLuint> GenerateEdgeIndices(const std::vector<GLuint>& indexData) {
+    std::vector<GLuint> edgeIndices;
+    edgeIndices.reserve(indexData.size() * 2);
+    for (size_t i = 0; i < indexData.size(); i += 3) {
+        GLuint idx0 = indexData[i];
+        GLuint idx1 = indexData[i + 1];
+        GLuint idx2 = indexData[i + 2];
 
-        model.indexCount = model.objData.indexCount;
+        edgeIndices.push_back(idx0);
+        edgeIndices.push_back(idx1);
 
-        // Generate edge indices
-        std::vector<GLuint> edgeIndices;
-        for (size_t i = 0; i < model.objData.indexData.size(); i += 3) {
-            GLuint idx0 = model.objData.indexData[i];
-            GLuint idx1 = model.objData.indexData[i + 1];
-            GLuint idx2 = model.objData.indexData[i + 2];
+        edgeIndices.push_back(idx1);
+        edgeIndices.push_back(idx2);
 
-            edgeIndices.push_back(idx0);
-            edgeIndices.push_back(idx1);
+        edgeIndices.push_back(idx2);
+        edgeIndices.push_back(idx0);
+    }
+    return edgeIndices;
+}
 
-            edgeIndices.push_back(idx1);
-            edgeIndices.push_back(idx2);
+// CPU part of loading a model, safe on any thread: parse, dedup, pack the vertices and build the edges
+ParsedModel* ParseModel(size_t slot) {
+    auto start = std::chrono::steady_clock::now();
+    ParsedModel* parsed = new ParsedModel();
+    parsed->slot = slot;
+    if (!parsed->objData.load(gModelPaths[slot])) {
+        std::cerr << "Failed to load OBJ file: " << gModelPaths[slot] << std::endl;
+        delete parsed;
+        return nullptr;
+    }
+    parsed->edgeIndices = GenerateEdgeIndices(parsed->objData.indexData);
+    parsed->parseMilliseconds = MillisecondsSince(start);
+    return parsed;
+}
 
-            edgeIndices.push_back(idx2);
-            edgeIndices.push_back(idx0);
+// Body of the loader threads
+void LoaderThread() {
+    for (size_t slot = gNextModelToParse++; slot < gModelPaths.size() && !gLoadFailed; slot = gNextModelToParse++) {
+        ParsedModel* parsed = ParseModel(slot);
+        if (parsed == nullptr) {
+            gLoadFailed = true;
+            return;
         }
-        model.edgeIndexCount = edgeIndices.size();
-
-        // Generate and bind VAO
-        glGenVertexArrays(1, &model.VAO);
-        glBindVertexArray(model.VAO);
-
-        // Generate and bind VBO
-        glGenBuffers(1, &model.VBO);
-        glBindBuffer(GL_ARRAY_BUFFER, model.VBO);
-        glBufferData(GL_ARRAY_BUFFER, model.objData.vertexData.size() * sizeof(GLfloat),
-                     model.objData.vertexData.data(), GL_STATIC_DRAW);
-
-        // Generate and bind EBO for filled model
-        glGenBuffers(1, &model.EBO);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model.EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, model.objData.indexData.size() * sizeof(GLuint),
-                     model.objData.indexData.data(), GL_STATIC_DRAW);
-
-        // Generate and bind EBO for edges
-        glGenBuffers(1, &model.edgeEBO);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model.edgeEBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, edgeIndices.size() * sizeof(GLuint),
-                     edgeIndices.data(), GL_STATIC_DRAW);
+        std::lock_guard<std::mutex> lock(gParsedModelsMutex);
+        gParsedModels.push_back(parsed);
+    }
+}
 
-        GLsizei stride = 9 * sizeof(GLfloat); // 9 floats per vertex
+// GL part of loading a model, on the main thread
+void UploadModel(ParsedModel* parsed) {
+    Model& model = gModels[parsed->slot];
+    model.objData = std::move(parsed->objData);
+    model.indexCount = model.objData.indexCount;
+    model.edgeIndexCount = parsed->edgeIndices.size();
+
+    // Generate and bind VAO
+    glGenVertexArrays(1, &model.VAO);
+    glBindVertexArray(model.VAO);
+
+    // Generate and bind VBO
+    glGenBuffers(1, &model.VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, model.VBO);
+    glBufferData(GL_ARRAY_BUFFER, model.objData.vertexData.size() * sizeof(GLfloat),
+                 model.objData.vertexData.data(), GL_STATIC_DRAW);
+
+    // Generate and bind EBO for filled model
+    glGenBuffers(1, &model.EBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model.EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, model.objData.indexData.size() * sizeof(GLuint),
+                 model.objData.indexData.data(), GL_STATIC_DRAW);
+
+    // Generate and bind EBO for edges
+    glGenBuffers(1, &model.edgeEBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model.edgeEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, parsed->edgeIndices.size() * sizeof(GLuint),
+                 parsed->edgeIndices.data(), GL_STATIC_DRAW);
+
+    GLsizei stride = 9 * sizeof(GLfloat); // 9 floats per vertex
+
+    // Position attribute (location = 0)
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+
+    // Color attribute (location = 1)
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(GLfloat)));
+
+    // Normal attribute (location = 2)
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(GLfloat)));
 
-        // Position attribute (location = 0)
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+    // Unbind VAO
+    glBindVertexArray(0);
 
-        // Color attribute (location = 1)
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(GLfloat)));
+    model.vertexCount = model.objData.vertexCount;
+    model.loaded = true;
 
-        // Normal attribute (location = 2)
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(GLfloat)));
+    std::cout << "Loaded " << gModelPaths[parsed->slot] << " (" << model.vertexCount << " vertices, "
+              << model.indexCount / 3 << " triangles): parsed in " << parsed->parseMilliseconds << " ms, ready after "
+              << MillisecondsSince(gLoadStart) << " ms" << std::endl;
 
-        // Unbind VAO
-        glBindVertexArray(0);
+    // The first model that is ready is shown right away
+    if (gCurrentModelIndex < 0) {
+        gCurrentModelIndex = static_cast<int>(parsed->slot);
+        gCubeIndexCount = model.indexCount;
+    }
+    ++gModelsUploaded;
+    delete parsed;
+}
 
-        model.vertexCount = model.objData.vertexCount;
+// Upload the models the loader threads have finished since the last call, in the order they finished
+void UploadParsedModels() {
+    if (gModelsUploaded == gModels.size()) {
+        return;
+    }
+    std::vector<ParsedModel*> parsedModels;
+    {
+        std::lock_guard<std::mutex> lock(gParsedModelsMutex);
+        parsedModels.swap(gParsedModels);
+    }
+    for (ParsedModel* parsed : parsedModels) {
+        UploadModel(parsed);
+    }
 
-        gModels.push_back(model);
+    if (gLoadFailed) {
+        for (std::thread& thread : gLoaderThreads) {
+            thread.join();
+        }
+        exit(1);
+    }
+    if (gModelsUploaded == gModels.size()) {
+        for (std::thread& thread : gLoaderThreads) {
+            thread.join();
+        }
+        gLoaderThreads.clear();
+        std::cout << "All " << gModels.size() << " models loaded in " << MillisecondsSince(gLoadStart) << " ms" << std::endl;
     }
+}
 
-    if (gModels.empty()) {
+// Start loading the models: one loader thread per hardware thread (at most one per model),
+// or every model right here with --sequential
+void LoadModels(const std::vector<std::string>& objFilePaths) {
+    if (objFilePaths.empty()) {
         std::cerr << "No models loaded." << std::endl;
         exit(1);
     }
+    gModels.clear();
+    gModels.resize(objFilePaths.size());
+    gModelPaths = objFilePaths;
+    gNextModelToParse = 0;
+    gModelsUploaded = 0;
+    gCurrentModelIndex = -1;
+    gLoadStart = std::chrono::steady_clock::now();
+
+    if (gSequentialLoading) {
+        for (size_t slot = 0; slot < gModelPaths.size(); ++slot) {
+            ParsedModel* parsed = ParseModel(slot);
+            if (parsed == nullptr) {
+                exit(1);
+            }
+            UploadModel(parsed);
+        }
+        std::cout << "All " << gModels.size() << " models loaded in " << MillisecondsSince(gLoadStart) << " ms" << std::endl;
+        return;
+    }
 
-    // Set initial model index and index count
-    gCurrentModelIndex = 0;
-    gCubeIndexCount = gModels[gCurrentModelIndex].indexCount;
+    unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+    threadCount = std::min(threadCount, static_cast<unsigned int>(gModelPaths.size()));
+    for (unsigned int i = 0; i < threadCount; ++i) {
+        gLoaderThreads.emplace_back(LoaderThread);
+    }
+    std::cout << "Loading " << gModelPaths.size() << " models on " << threadCount << " threads" << std::endl;
 }
 
 
@@ -383,7 +509,7 @@ void Input() {
                     // Check if a number key from 1 to 9 was pressed
                     if ((e.key.keysym.sym >= SDLK_1 && e.key.keysym.sym <= SDLK_9)) {
                         int index = e.key.keysym.sym - SDLK_1;
-                        if (index < gModels.size()) {
+                        if (index < gModels.size() && gModels[index].loaded) {
                             gCurrentModelIndex = index;
                         }
                     }
@@ -438,6 +564,10 @@ void PreDraw() {
 }
 
 void Draw() {
+    // Nothing to draw until the first model is uploaded
+    if (gCurrentModelIndex < 0) {
+        return;
+    }
     Model& currentModel = gModels[gCurrentModelIndex];
 
     // Bind the VAO of the current model
@@ -466,15 +596,35 @@ void Draw() {
 
 void MainLoop() {
     while (!gQuit) {
+        UploadParsedModels();
         Input();
         PreDraw();
         Draw();
         SDL_GL_SwapWindow(gGraphicsApplicationWindow);
+
+        if (!gFirstFrameShown && gCurrentModelIndex >= 0) {
+            gFirstFrameShown = true;
+            std::cout << "First frame with a model after " << MillisecondsSince(gLoadStart) << " ms" << std::endl;
+        }
+        if (gQuitAfterLoad && gModelsUploaded == gModels.size()) {
+            gQuit = true;
+        }
     }
 }
 
 void CleanUp() {
+    // No further models are started, the loader threads finish the ones they parse
+    gNextModelToParse = gModelPaths.size();
+    for (std::thread& thread : gLoaderThreads) {
+        thread.join();
+    }
+    for (ParsedModel* parsed : gParsedModels) {
+        delete parsed;
+    }
     for (auto& model : gModels) {
+        if (!model.loaded) {
+            continue;
+        }
         glDeleteVertexArrays(1, &model.VAO);
         glDeleteBuffers(1, &model.VBO);
         glDeleteBuffers(1, &model.EBO);
@@ -493,18 +643,24 @@ int WinMain(int argc, char* argv[])
 int main(int argc, char* argv[])
 {
 #endif
+    // Store OBJ file paths, up to nine for the number keys
+    std::vector<std::string> objFilePaths;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--sequential") {
+            gSequentialLoading = true;
+        } else if (arg == "--quit-after-load") {
+            gQuitAfterLoad = true;
+        } else if (objFilePaths.size() < 9) {
+            objFilePaths.push_back(arg);
+        }
+    }
     // Check the OBJ file path
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <path_to_obj_file>" << std::endl;
+    if (objFilePaths.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--sequential] [--quit-after-load] <path_to_obj_file>..." << std::endl;
         return 1;
     }
-    // Store OBJ file paths
-    std::vector<std::string> objFilePaths;
-    for (int i = 1; i < argc && i <= 9; ++i) {
-        objFilePaths.push_back(argv[i]);
-    }
 
-    std::string objFilePath = argv[1];
     InitializeProgram();
     LoadModels(objFilePaths);
     CreateGraphicsPipeline();
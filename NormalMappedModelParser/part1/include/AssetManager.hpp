@@ -0,0 +1,101 @@
+#ifndef ASSETMANAGER_HPP
+#define ASSETMANAGER_HPP
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+
+class Object;
+class Texture;
+
+// Reference counted handles to shared assets
+typedef std::shared_ptr<Object> MeshHandle;
+typedef std::shared_ptr<Texture> TextureHandle;
+
+// Registry of the loaded meshes and textures keyed by a hash of the file
+// content, so a mesh or texture is parsed, decoded and uploaded once however
+// many command line paths, objects or materials refer to it (also under
+// different file names). The registry keeps a handle to every asset itself:
+// an asset nobody else uses stays cached until Trim() frees the least
+// recently used ones to fit the budget.
+//
+// AcquireTexture() decodes on the calling thread, and a thread that asks for a
+// texture another thread is decoding waits for it; decoding never waits for
+// jobs, so this is safe on pool threads. Meshes are constructed by the caller,
+// which may wait for jobs in the meantime: FindMesh() first, AddMesh() after a
+// miss (LoadObjects() also merges equal files of one load).
+class AssetManager{
+public:
+    typedef uint64_t Hash;
+
+    struct Statistics{
+        size_t meshes{0};
+        size_t textures{0};
+        // Lookups and the ones that found the asset loaded
+        size_t requests{0};
+        size_t hits{0};
+        // CPU and GPU bytes of the cached assets, and what the hits would have loaded again
+        size_t bytes{0};
+        size_t bytesSaved{0};
+        size_t evictions{0};
+        size_t evictedBytes{0};
+    };
+
+    static const size_t kDefaultBudget = 512 * 1024 * 1024;
+
+    AssetManager() = default;
+    AssetManager(const AssetManager&) = delete;
+    AssetManager& operator=(const AssetManager&) = delete;
+
+    // 64-bit FNV-1a of the file content, 0 if the file cannot be read
+    static Hash HashFile(const std::string& filepath);
+
+    // The mesh with this content or nullptr, counted as a hit or a miss
+    MeshHandle FindMesh(Hash hash);
+    // Register a mesh constructed after a miss
+    void AddMesh(Hash hash, const MeshHandle& mesh);
+    // The decoded texture with the content of the file; thread safe
+    TextureHandle AcquireTexture(const std::string& filepath);
+
+    // Bytes of cached assets Trim() aims for
+    void SetBudget(size_t bytes) { mBudget = bytes; }
+    // Free unused assets, least recently used first, while the cache is over budget.
+    // Deletes OpenGL objects, call on the main thread.
+    void Trim();
+    // Free every asset, before the OpenGL context goes away
+    void Clear();
+
+    // Call on the main thread when no asset is being loaded
+    Statistics GetStatistics() const;
+    void PrintStatistics() const;
+private:
+    struct Entry{
+        // One of the two is set
+        MeshHandle mesh;
+        TextureHandle texture;
+        std::string filepath;
+        std::once_flag decoded;
+        size_t hits{0};
+        // Value of mClock at the last lookup
+        uint64_t lastUse{0};
+    };
+    typedef std::unordered_map<Hash, std::shared_ptr<Entry>> EntryMap;
+
+    static size_t GetBytes(const Entry& entry);
+    // Only referenced by the registry
+    static bool IsUnused(const Entry& entry);
+
+    mutable std::mutex mMutex;
+    EntryMap mMeshes;
+    EntryMap mTextures;
+    uint64_t mClock{0};
+    size_t mBudget{kDefaultBudget};
+    size_t mRequests{0};
+    size_t mHits{0};
+    size_t mEvictions{0};
+    size_t mEvictedBytes{0};
+};
+
+#endif
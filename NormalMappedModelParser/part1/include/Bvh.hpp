@@ -0,0 +1,64 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// A ray with a maximum distance. The inverse direction is cached for the slab test.
+struct Ray{
+    glm::vec3 origin;
+    glm::vec3 direction;
+    glm::vec3 inverseDirection;
+    float maxDistance;
+    Ray(const glm::vec3& o, const glm::vec3& d, float tMax)
+        : origin(o), direction(d), inverseDirection(1.0f / d), maxDistance(tMax) {}
+};
+
+// Closest intersection found by Bvh::Intersect
+struct Hit{
+    float distance;
+    float u, v;             // Barycentrics of vertex 1 and 2
+    uint32_t triangle;      // Index into the triangles passed to Build()
+};
+
+// Bounding volume hierarchy over triangles, built with the surface area
+// heuristic over 16 bins per axis. Nodes are stored depth first in one array,
+// the two children of an interior node are next to each other.
+class Bvh{
+public:
+    // Build over triangles given as three corners each
+    void Build(const std::vector<glm::vec3>& corners);
+    // Closest hit along the ray, returns false on a miss
+    bool Intersect(const Ray& ray, Hit& hit) const;
+    // Returns true if anything is hit closer than ray.maxDistance (shadow rays)
+    bool Occluded(const Ray& ray) const;
+    // Number of nodes, for statistics
+    size_t GetNodeCount() const { return mNodes.size(); }
+private:
+    // 32 bytes, two nodes per cache line
+    struct Node{
+        glm::vec3 boundsMin;
+        uint32_t leftFirst;     // Left child for interior nodes, first triangle for leaves
+        glm::vec3 boundsMax;
+        uint32_t count;         // Number of triangles, 0 for interior nodes
+    };
+    // Triangle in the form the intersection test wants it
+    struct BuildTriangle{
+        glm::vec3 v0, edge1, edge2;
+    };
+
+    // Split a node or leave it as a leaf, depth is 0 for the root
+    void Subdivide(uint32_t nodeIndex, int depth, const std::vector<glm::vec3>& centroids);
+    // Fit the bounds of a node around its triangles
+    void UpdateBounds(uint32_t nodeIndex);
+    // Ray against a node's box, returns the entry distance or a huge value on a miss
+    static float IntersectBounds(const Ray& ray, const Node& node, float maxDistance);
+
+    std::vector<Node> mNodes;
+    std::vector<BuildTriangle> mTriangles;
+    // Triangle order of the leaves, maps back to the input index
+    std::vector<uint32_t> mTriangleIndices;
+};
+
+#endif
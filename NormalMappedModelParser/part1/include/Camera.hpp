@@ -19,6 +19,8 @@ public:
     void MoveDown(float speed);
     // Set the position for the camera
     void SetCameraEyePosition(float x, float y, float z);
+    // Set the direction the camera is looking at
+    void SetViewDirection(const glm::vec3& direction);
     // Returns the Camera X Position where the eye is 
     float GetEyeXPosition();
     // Returns the Camera Y Position where the eye is 
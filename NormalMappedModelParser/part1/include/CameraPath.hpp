@@ -0,0 +1,31 @@
+#ifndef CAMERAPATH_HPP
+#define CAMERAPATH_HPP
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// A scripted camera path used for reproducible benchmark runs.
+// Keyframes are spread evenly over the run and linearly interpolated.
+class CameraPath{
+public:
+    // Constructor creates an empty path
+    CameraPath();
+    // Loads keyframes from a text file, one "eyeX eyeY eyeZ dirX dirY dirZ" per line.
+    // Lines starting with '#' are comments.
+    bool Load(const std::string& filepath);
+    // Fills the path with a deterministic orbit around the origin
+    void CreateOrbit(float radius, float height, unsigned int keyframes);
+    // Eye position and view direction at t in [0,1]
+    void Evaluate(float t, glm::vec3& eyePosition, glm::vec3& viewDirection) const;
+    // Number of keyframes
+    size_t GetKeyframeCount() const { return mKeyframes.size(); }
+private:
+    struct Keyframe{
+        glm::vec3 eyePosition;
+        glm::vec3 viewDirection;
+    };
+    std::vector<Keyframe> mKeyframes;
+};
+
+#endif
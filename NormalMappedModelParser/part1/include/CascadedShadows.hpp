@@ -0,0 +1,97 @@
+#ifndef CASCADEDSHADOWS_HPP
+#define CASCADEDSHADOWS_HPP
+
+#include <vector>
+#include <cstdint>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "Memory.hpp"
+
+// Directional shadows of the scene light (--shadows) in kCascades cascades
+// that share one depth texture array, one layer per cascade.
+//
+// The view range up to the shadow distance is split with the practical split
+// scheme, a blend of logarithmic and uniform splits. Each cascade is fitted
+// around the bounding sphere of its slice of the view frustum, so its size
+// does not change when the camera turns, and the projection is moved in whole
+// shadow map texels, so edges do not shimmer when the camera moves. The depth
+// range reaches back to the scene bounds to catch casters outside the slice.
+//
+// Casters are culled on the CPU per cascade with the cascade matrix and drawn
+// with a depth only program. Shading samples the array with hardware depth
+// comparison and a PCF kernel of 1x1, 3x3 or 5x5 bilinear taps.
+class CascadedShadows{
+public:
+    static const int kCascades = 4;
+    // Texture unit used by Bind(), after the clustered light buffers
+    static const int kTextureUnit = 5;
+
+    // Resolution and filter size
+    enum class Quality{
+        Low,
+        Medium,
+        High
+    };
+
+    // Counters of the last frame, per cascade
+    struct Statistics{
+        float splitFar[kCascades]{0.0f, 0.0f, 0.0f, 0.0f};
+        size_t casters[kCascades]{0, 0, 0, 0};
+        size_t drawCalls[kCascades]{0, 0, 0, 0};
+        double cullMilliseconds{0.0};
+    };
+
+    CascadedShadows() = default;
+    ~CascadedShadows();
+
+    // Shadow map resolution and PCF kernel width of a quality level
+    static void GetSettings(Quality quality, int& resolution, int& kernelSize);
+
+    // Create the depth array and the depth only program, needs an OpenGL context
+    void Initialize(Quality quality);
+    void Destroy();
+    bool IsInitialized() const { return mTexture != 0; }
+
+    // Fit the cascades to the camera; lightDirection points from the light into the scene
+    void Update(const glm::mat4& view, float fovY, float aspect, float nearPlane, const glm::vec3& lightDirection,
+                const glm::vec3& sceneMin, const glm::vec3& sceneMax);
+    const glm::mat4& GetViewProjection(int cascade) const { return mViewProjection[cascade]; }
+
+    // Render one cascade: attach its layer, clear it and bind the depth program
+    void BeginCascade(int cascade);
+    // Record the draw calls and caster count of the cascade
+    void EndCascade(int cascade, size_t casters, size_t drawCalls);
+    // Restore the state changed by BeginCascade()
+    void EndShadowPass();
+    void SetCullMilliseconds(double milliseconds) { mStatistics.cullMilliseconds = milliseconds; }
+
+    // Bind the shadow map and set the shadow uniforms of a program that is in use.
+    // Programs are always given the texture unit, shadows are off until Initialize()
+    void Bind(GLuint program, const glm::mat4& cameraView) const;
+
+    GLuint GetFramebuffer() const { return mFramebuffer; }
+    int GetResolution() const { return mResolution; }
+    int GetKernelSize() const { return mKernelSize; }
+    double GetMegabytes() const;
+    const Statistics& GetStatistics() const { return mStatistics; }
+
+    // Depth only program, exposed for shader hot-reload
+    GLuint mShaderID{0};
+private:
+    int mResolution{0};
+    int mKernelSize{1};
+    // How far the shadows reach and the weight of logarithmic splits
+    float mShadowDistance{30.0f};
+    float mSplitLambda{0.75f};
+    GLuint mTexture{0};
+    GLuint mFramebuffer{0};
+    GLint mPreviousFramebuffer{0};
+    TrackedMemory mTracked{Memory::Category::FrameGpu};
+
+    glm::mat4 mViewProjection[kCascades];
+    // Size of a shadow map texel in world units, for the normal offset
+    float mTexelWorldSize[kCascades]{0.0f, 0.0f, 0.0f, 0.0f};
+    Statistics mStatistics;
+};
+
+#endif
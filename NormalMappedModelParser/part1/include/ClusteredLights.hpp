@@ -0,0 +1,105 @@
+#ifndef CLUSTEREDLIGHTS_HPP
+#define CLUSTEREDLIGHTS_HPP
+
+#include <vector>
+#include <cstdint>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "ThreadPool.hpp"
+#include "Memory.hpp"
+
+// Point light with a hard range, the light fades to zero at the radius
+struct PointLight{
+    glm::vec3 position;
+    float radius;
+    glm::vec3 color;
+};
+
+// Assigns point lights to the cells of a grid over the view frustum so every
+// fragment only shades the lights that can reach it.
+//
+// The frustum is cut into kClustersX x kClustersY screen tiles and kClustersZ
+// depth slices that grow exponentially with the distance. Each frame the
+// lights are moved to view space and tested against the view space box of
+// every cluster, one depth slice per thread pool job. The result goes to the
+// GPU as three buffer textures (OpenGL 4.1 has no storage buffers): the light
+// data, an (offset, count) pair per cluster and the concatenated light index
+// lists. frag.glsl finds its cluster from gl_FragCoord and the view depth.
+class ClusteredLights{
+public:
+    static const int kClustersX = 16;
+    static const int kClustersY = 9;
+    static const int kClustersZ = 24;
+    static const int kClusterCount = kClustersX * kClustersY * kClustersZ;
+    // Texture units used by Bind()
+    static const int kFirstTextureUnit = 2;
+
+    // Counters of the last Assign() and Upload()
+    struct Statistics{
+        size_t lights{0};
+        size_t lightsInView{0};
+        size_t indices{0};
+        size_t occupiedClusters{0};
+        size_t maxLightsPerCluster{0};
+        // Light references dropped because the index buffer was full
+        size_t dropped{0};
+        double assignMilliseconds{0.0};
+        double uploadMilliseconds{0.0};
+    };
+
+    ClusteredLights() = default;
+    ~ClusteredLights();
+
+    // Create the buffer textures, needs an OpenGL context
+    void Initialize();
+    // Delete the buffer textures
+    void Destroy();
+    // Replace the lights, the next Assign() and Upload() take them into account
+    void SetLights(const std::vector<PointLight>& lights);
+    const std::vector<PointLight>& GetLights() const { return mLights; }
+    // Rebuild the per cluster light lists for this camera, threadPool may be null
+    void Assign(const glm::mat4& view, float fovY, float aspect, float nearPlane, float farPlane, ThreadPool* threadPool);
+    // Send the light data and lists of the last Assign() to the GPU
+    void Upload();
+    // Bind the buffer textures and set the cluster uniforms of a program that is in use
+    void Bind(GLuint program, int screenWidth, int screenHeight) const;
+
+    // Light indices of one cluster after Assign(), for checks
+    void GetClusterLights(int x, int y, int z, std::vector<uint32_t>& lights) const;
+    const Statistics& GetStatistics() const { return mStatistics; }
+private:
+    // View space boxes of the clusters for a projection
+    void BuildClusterBounds(float fovY, float aspect, float nearPlane, float farPlane);
+    // Fill the lists of the clusters of one depth slice
+    void AssignSlice(int slice);
+
+    std::vector<PointLight> mLights;
+
+    // Projection the cluster boxes were built for
+    float mFovY{0.0f};
+    float mAspect{0.0f};
+    float mNearPlane{0.0f};
+    float mFarPlane{0.0f};
+    std::vector<glm::vec3> mClusterMin;
+    std::vector<glm::vec3> mClusterMax;
+
+    // View space position and radius of the lights of the current Assign()
+    std::vector<glm::vec4> mViewLights;
+    // Per slice: lights reaching the slice, then the lists of its clusters
+    std::vector<std::vector<uint32_t>> mSliceLights;
+    std::vector<std::vector<uint32_t>> mSliceIndices;
+    std::vector<std::vector<uint32_t>> mSliceCounts;
+    // (offset, count) of every cluster into mIndices
+    std::vector<uint32_t> mGrid;
+    std::vector<uint32_t> mIndices;
+    size_t mMaxIndices{65536};
+
+    // Buffer and texture of the light data, the grid and the indices
+    GLuint mBuffers[3]{0, 0, 0};
+    GLuint mTextures[3]{0, 0, 0};
+    TrackedMemory mTracked{Memory::Category::FrameGpu};
+    Statistics mStatistics;
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef DEFERREDRENDERER_HPP
+#define DEFERREDRENDERER_HPP
+
+#include <vector>
+#include <cstdint>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "ClusteredLights.hpp"
+#include "CascadedShadows.hpp"
+#include "Memory.hpp"
+
+// Deferred shading (--deferred): objects are drawn once into a G-buffer and
+// the lights are applied afterwards in screen space.
+//
+// G-buffer layout, 12 bytes per pixel:
+//   0: RGBA8  albedo, alpha packs specular intensity (high 4 bits) and gloss (low 4 bits)
+//   1: RG16   octahedral encoded world normal
+//   depth: DEPTH24_STENCIL8, positions are rebuilt from it with the inverse view-projection
+// The lighting pass shades the main light over the whole screen and copies the
+// depth into the target, then every point light is drawn as an instanced
+// sphere. Only back faces that are behind the stored depth pass the depth test,
+// so a light only touches pixels whose surface can lie inside its sphere.
+class DeferredRenderer{
+public:
+    // Bytes of one G-buffer pixel: albedo, normal and depth
+    static const int kBytesPerPixel = 12;
+
+    // Fragment counts of the last resolved frame and the traffic estimated from them
+    struct Statistics{
+        uint64_t geometrySamples{0};
+        uint64_t volumeSamples{0};
+        size_t lightVolumes{0};
+        double megabytesWritten{0.0};
+        double megabytesRead{0.0};
+    };
+
+    DeferredRenderer() = default;
+    ~DeferredRenderer();
+
+    // Create the G-buffer, shaders and the light sphere, needs an OpenGL context
+    void Initialize(int width, int height);
+    void Destroy();
+
+    // Bind and clear the G-buffer, objects are then drawn with mGeometryShaderID
+    void BeginGeometryPass();
+    // Return to the framebuffer that was bound before BeginGeometryPass()
+    void EndGeometryPass();
+    // Shade the main light with its shadows and the background into the target and write the G-buffer depth into it
+    void LightingPass(const glm::mat4& view, const glm::mat4& viewProjection, const glm::vec3& eye, const glm::vec3& lightPosition,
+                      const glm::vec3& backgroundColor, const CascadedShadows& shadows);
+    // Add the point lights with one instanced draw of light spheres
+    void LightVolumePass(const glm::mat4& viewProjection, const glm::vec3& eye, const std::vector<PointLight>& lights);
+
+    const Statistics& GetStatistics() const { return mStatistics; }
+    // Size of the G-buffer in megabytes
+    double GetMegabytes() const;
+
+    // Programs, exposed for shader hot-reload
+    GLuint mGeometryShaderID{0};
+    GLuint mLightingShaderID{0};
+    GLuint mVolumeShaderID{0};
+private:
+    // Bind the G-buffer textures to units 0 to 2 and set the shared uniforms
+    void BindGBuffer(GLuint program, const glm::mat4& viewProjection, const glm::vec3& eye) const;
+    // Read the sample counts of the queries issued two frames ago
+    void ResolveQueries();
+
+    int mWidth{0};
+    int mHeight{0};
+    GLuint mFramebuffer{0};
+    GLuint mAlbedoTexture{0};
+    GLuint mNormalTexture{0};
+    GLuint mDepthTexture{0};
+    // Framebuffer bound before the geometry pass
+    GLint mTargetFramebuffer{0};
+
+    // Empty vertex array for the full screen triangle
+    GLuint mScreenVAO{0};
+    // Sphere mesh plus one (position, radius) and one color per instance
+    GLuint mSphereVAO{0};
+    GLuint mSphereVBO{0};
+    GLuint mSphereIBO{0};
+    GLuint mInstanceVBO{0};
+    GLsizei mSphereIndexCount{0};
+    // G-buffer and light volume buffers
+    TrackedMemory mTracked{Memory::Category::FrameGpu};
+
+    // GL_SAMPLES_PASSED queries of the geometry and volume passes, two frames in flight
+    GLuint mQueries[2][2]{{0, 0}, {0, 0}};
+    bool mQueriesIssued[2]{false, false};
+    size_t mLightVolumes[2]{0, 0};
+    unsigned long mFrame{0};
+    Statistics mStatistics;
+};
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef FRAMEGRAPH_HPP
+#define FRAMEGRAPH_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <glad/glad.h>
+
+#include "RenderTargetPool.hpp"
+
+// Frame graph: the passes of a frame declare which images they read and
+// write, and the graph works out the rest.
+//
+// The frame is rebuilt every frame: Reset(), declare resources and passes,
+// Compile(), Execute(). Compile() is pure CPU work and needs no OpenGL context,
+// --framegraph-report prints its result without opening a window. It
+//   - culls passes whose results are never used; passes that write an
+//     imported resource (the window) are always kept
+//   - records for every pass the passes it depends on (read after write,
+//     write after write and write after read), passes run in declaration
+//     order, which satisfies all of them
+//   - computes the first and last pass that uses every transient resource
+//   - gives transient resources with the same description and lifetimes that
+//     do not overlap the same physical render target
+//   - lists the transitions from render target to texture; OpenGL orders
+//     them itself, an explicit API would need a barrier there
+// Execute() takes the physical targets from the RenderTargetPool at their first
+// use and returns them after their last, binds the first written resource as
+// the framebuffer of each pass and calls the pass.
+class FrameGraph{
+public:
+    typedef int Resource;
+    static const Resource kInvalidResource = -1;
+
+    struct TextureDescription{
+        int width{0};
+        int height{0};
+        GLenum format{GL_RGBA8};
+        bool depth{false};
+    };
+
+    struct Statistics{
+        size_t passes{0};
+        size_t culledPasses{0};
+        size_t resources{0};
+        size_t physicalTargets{0};
+        size_t transitions{0};
+        // Bytes of all transient resources and of the targets they are placed in
+        size_t declaredBytes{0};
+        size_t allocatedBytes{0};
+        double compileMilliseconds{0.0};
+    };
+
+    FrameGraph() = default;
+
+    // Forget the passes and resources of the last frame, pooled targets stay
+    void Reset();
+    // A render target that only lives within this frame
+    Resource CreateTexture(const std::string& name, const TextureDescription& description);
+    // A framebuffer owned outside the graph, such as the window
+    Resource ImportFramebuffer(const std::string& name, GLint framebuffer, int width, int height);
+    // Resources may be both read and written, e.g. drawing on top of an image
+    void AddPass(const std::string& name, const std::vector<Resource>& reads, const std::vector<Resource>& writes,
+                 std::function<void()> execute);
+
+    // Cull, order, compute lifetimes and aliasing, no OpenGL calls
+    void Compile();
+    // Run the passes that survived culling
+    void Execute();
+
+    // Texture and size of a resource, valid while its passes execute
+    GLuint GetTexture(Resource resource) const;
+    int GetWidth(Resource resource) const;
+    int GetHeight(Resource resource) const;
+
+    const Statistics& GetStatistics() const { return mStatistics; }
+    const RenderTargetPool& GetPool() const { return mPool; }
+    // Passes, resources, lifetimes and memory of the last Compile()
+    std::string GetReport() const;
+    void Destroy();
+private:
+    struct ResourceNode{
+        std::string name;
+        TextureDescription description;
+        bool imported{false};
+        GLint framebuffer{0};
+        // Filled by Compile()
+        int firstPass{-1};
+        int lastPass{-1};
+        int physical{-1};
+        // Set while executing
+        RenderTarget* target{nullptr};
+    };
+
+    struct PassNode{
+        std::string name;
+        std::vector<Resource> reads;
+        std::vector<Resource> writes;
+        std::function<void()> execute;
+        // Filled by Compile()
+        bool culled{false};
+        std::vector<int> dependencies;
+        // Resources read here that an earlier pass wrote as render target
+        std::vector<Resource> transitions;
+        // Physical targets to acquire before and release after the pass
+        std::vector<int> acquires;
+        std::vector<int> releases;
+    };
+
+    struct PhysicalTarget{
+        TextureDescription description;
+        int lastPass{-1};
+        RenderTarget* target{nullptr};
+    };
+
+    static size_t GetBytes(const TextureDescription& description);
+
+    std::vector<ResourceNode> mResources;
+    std::vector<PassNode> mPasses;
+    std::vector<PhysicalTarget> mPhysical;
+    RenderTargetPool mPool;
+    Statistics mStatistics;
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef FRUSTUMCULLER_HPP
+#define FRUSTUMCULLER_HPP
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "ThreadPool.hpp"
+
+// Tests world space axis aligned boxes against the view frustum.
+//
+// The boxes are kept as six float arrays (min x, min y, ... max z) so four
+// boxes are tested against a plane with a handful of SSE instructions: per
+// plane only the corner farthest along the plane normal is checked, and which
+// array holds that corner only depends on the signs of the plane. Large box
+// counts are split into blocks that are culled on the thread pool; the indices
+// of the visible boxes come out in increasing order either way.
+class FrustumCuller{
+public:
+    // Boxes per block handed to one thread
+    static constexpr size_t kBlockSize = 4096;
+    // Fewer boxes than this are culled on the calling thread only
+    static constexpr size_t kParallelThreshold = 4 * kBlockSize;
+
+    // Counters of the last Cull()
+    struct Statistics{
+        size_t tested{0};
+        size_t visible{0};
+        size_t culled{0};
+        double milliseconds{0.0};
+        unsigned int threads{0};
+    };
+
+    // Set the number of boxes, existing boxes are kept
+    void Resize(size_t count);
+    size_t GetBoxCount() const { return mMinX.size(); }
+    void SetBox(size_t index, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+    void GetBox(size_t index, glm::vec3& boundsMin, glm::vec3& boundsMax) const{
+        boundsMin = glm::vec3(mMinX[index], mMinY[index], mMinZ[index]);
+        boundsMax = glm::vec3(mMaxX[index], mMaxY[index], mMaxZ[index]);
+    }
+    // Store the world box around a local box transformed by a matrix
+    void SetTransformedBox(size_t index, const glm::mat4& matrix, const glm::vec3& localMin, const glm::vec3& localMax);
+    // Write the indices of the boxes inside or touching the frustum, threadPool may be null
+    void Cull(const glm::mat4& viewProjection, ThreadPool* threadPool, std::vector<uint32_t>& visible);
+    // Same test one box at a time, for comparison
+    void CullScalar(const glm::mat4& viewProjection, std::vector<uint32_t>& visible);
+    const Statistics& GetStatistics() const { return mStatistics; }
+
+    // Planes (xyz normal pointing inside, w distance) of a view-projection matrix
+    static void ExtractPlanes(const glm::mat4& viewProjection, glm::vec4 planes[6]);
+private:
+    // Cull boxes [begin,end) and append the visible ones
+    void CullRange(const glm::vec4 planes[6], size_t begin, size_t end, std::vector<uint32_t>& visible) const;
+
+    std::vector<float> mMinX, mMinY, mMinZ;
+    std::vector<float> mMaxX, mMaxY, mMaxZ;
+    // Visible indices of every block, concatenated after a parallel cull
+    std::vector<std::vector<uint32_t>> mBlockVisible;
+    Statistics mStatistics;
+};
+
+#endif
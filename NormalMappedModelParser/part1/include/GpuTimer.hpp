@@ -0,0 +1,79 @@
+#ifndef GPUTIMER_HPP
+#define GPUTIMER_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <glad/glad.h>
+
+// Keeps the last samples of a measurement and reports min/avg/p99
+class RollingStats{
+public:
+    static const size_t kWindow = 120;
+    // Add one sample in milliseconds
+    void Add(double milliseconds);
+    // Statistics over the window
+    double GetMin() const;
+    double GetAverage() const;
+    double GetPercentile(double percentile) const;
+    // Most recent sample
+    double GetLast() const;
+    // Samples in the order they were added, oldest first
+    std::vector<double> GetHistory() const;
+private:
+    double mSamples[kWindow] = {0.0};
+    size_t mCount{0};
+    size_t mNext{0};
+};
+
+// Measures GPU time of render passes with GL_TIME_ELAPSED queries.
+// Every pass owns two queries that are used on alternating frames, so the
+// result of a frame is read back two frames later without stalling the pipeline.
+class GpuTimer{
+public:
+    struct Pass{
+        std::string name;
+        GLuint queries[2]{0, 0};
+        bool issued[2]{false, false};
+        RollingStats stats;
+    };
+
+    // Constructor
+    GpuTimer();
+    // Destructor
+    ~GpuTimer();
+    // Turn measuring on or off
+    void SetEnabled(bool enabled);
+    bool IsEnabled() const { return mEnabled; }
+    // Start writing one CSV row per resolved frame
+    void OpenCsv(const std::string& filepath);
+    // Collect the results of the previous use of this frame's queries
+    void BeginFrame();
+    // Bracket a render pass, passes cannot be nested (GL_TIME_ELAPSED restriction)
+    void Begin(const char* name);
+    void End();
+    // Record the CPU side of the frame
+    void EndFrame(double cpuFrameMilliseconds, double cpuSubmitMilliseconds);
+    // Accessors for the overlay
+    const std::vector<Pass>& GetPasses() const { return mPasses; }
+    const RollingStats& GetCpuFrameStats() const { return mCpuFrame; }
+    const RollingStats& GetCpuSubmitStats() const { return mCpuSubmit; }
+    // One line summary of all passes
+    std::string GetSummary() const;
+    // Delete all query objects
+    void Destroy();
+private:
+    bool mEnabled{false};
+    unsigned long mFrame{0};
+    int mActivePass{-1};
+    std::vector<Pass> mPasses;
+    RollingStats mCpuFrame;
+    RollingStats mCpuSubmit;
+    // CPU times of the frames whose queries are still in flight
+    double mCpuFrameInFlight[2]{0.0, 0.0};
+    double mCpuSubmitInFlight[2]{0.0, 0.0};
+    std::ofstream mCsv;
+    bool mCsvHeaderWritten{false};
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef HEADLESS_HPP
+#define HEADLESS_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <glad/glad.h>
+#include "Memory.hpp"
+
+// An OpenGL context without a visible window that renders into an offscreen
+// framebuffer. On Linux this is an EGL surfaceless context (works with Mesa's
+// software rasterizer on machines without a GPU or display), elsewhere a hidden SDL window.
+class HeadlessContext{
+public:
+    // Constructor
+    HeadlessContext();
+    // Creates the context, loads OpenGL functions and the offscreen framebuffer
+    bool Initialize(int width, int height);
+    // Loader to pass to glad and to anything else that resolves GL functions
+    GLADloadproc GetLoader() const;
+    // Bind the offscreen framebuffer as the render target
+    void Bind() const;
+    // Read the rendered image back as tightly packed RGB rows, top row first
+    void ReadPixels(std::vector<uint8_t>& pixels) const;
+    // Destroys the framebuffer and the context
+    void Destroy();
+private:
+    int mWidth{0};
+    int mHeight{0};
+    GLuint mFramebuffer{0};
+    GLuint mColorRenderbuffer{0};
+    GLuint mDepthRenderbuffer{0};
+    TrackedMemory mTracked{Memory::Category::FrameGpu};
+    // Platform handles (EGLDisplay/EGLContext or SDL_Window/SDL_GLContext)
+    void* mDisplay{nullptr};
+    void* mContext{nullptr};
+};
+
+#endif
@@ -3,14 +3,16 @@
 
 #include <string>
 
+class Arena;
+
 class Image {
 public:
     // Constructor for creating an image
     Image (std::string filepath);
     // Destructor
     ~Image();
-    // Loads a PPM from memory.
-    void LoadPPM(bool flip);
+    // Loads a PPM from memory, the file is read through a buffer in scratch.
+    void LoadPPM(bool flip, Arena& scratch);
     // Return the width
     inline int GetWidth(){
         return m_width;
@@ -0,0 +1,114 @@
+#ifndef IMAGEBASEDLIGHTING_HPP
+#define IMAGEBASEDLIGHTING_HPP
+
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "ThreadPool.hpp"
+#include "Memory.hpp"
+
+// Lookup tables of the physically based path (--pbr) for lighting by the sky
+// with the split-sum approximation: the GGX specular integral is split into
+// the environment prefiltered per roughness and a BRDF table of scale and bias
+// on F0 over (NdotV, roughness).
+//
+// All tables are computed on the CPU, never on the GPU: the BRDF table, one
+// prefiltered cube map mip per roughness step and a small cosine weighted
+// irradiance cube map for the diffuse part. Texels are computed 8 at a time
+// with Float8, one row per thread pool job, from the same importance samples
+// (Hammersley points) in every lane. LoadOrPrecompute() keeps them in a file
+// per setting, so a start with a warm cache only reads and uploads them.
+class ImageBasedLighting{
+public:
+    // Texture units used by Bind(), after the shadow map (5) and the specular map (6)
+    static const int kBrdfTextureUnit = 7;
+    static const int kSpecularTextureUnit = 8;
+    static const int kIrradianceTextureUnit = 9;
+    // Prefiltered mips, from roughness 0 to 1; the smallest is 2x2 at the default size
+    static const int kMaxSpecularLevels = 6;
+
+    struct Settings{
+        int brdfSize{128};
+        // Face size of the sharpest prefiltered level and of the irradiance map
+        int environmentSize{64};
+        int irradianceSize{16};
+        // Importance samples per texel
+        int samples{512};
+    };
+
+    // RGB and RG floats, faces in OpenGL order (+X, -X, +Y, -Y, +Z, -Z)
+    struct Tables{
+        // Scale and bias on F0, NdotV along a row and roughness from row to row
+        std::vector<float> brdf;
+        std::vector<std::vector<float>> specular;
+        // Cosine weighted mean radiance, the irradiance divided by pi
+        std::vector<float> irradiance;
+    };
+
+    // Cost of the last LoadOrPrecompute() or Precompute()
+    struct Statistics{
+        double brdfMilliseconds{0.0};
+        double specularMilliseconds{0.0};
+        double irradianceMilliseconds{0.0};
+        // Reading the cache file, when the tables came from it
+        double loadMilliseconds{0.0};
+        bool fromCache{false};
+        unsigned int threads{1};
+    };
+
+    ImageBasedLighting() = default;
+    ~ImageBasedLighting();
+
+    // Light from the sky in a direction, the horizon to zenith gradient the path tracer uses
+    static glm::vec3 SkyRadiance(const glm::vec3& direction);
+    // Unit direction through the center of texel (x, y) of a cube map face
+    static glm::vec3 CubeDirection(int face, int x, int y, int size);
+    // Roughness of a prefiltered level
+    static float GetLevelRoughness(int level, int levels) { return levels > 1 ? static_cast<float>(level) / (levels - 1) : 0.0f; }
+
+    // Compute all tables with Float8, on the pool threads if one is given
+    void Precompute(const Settings& settings, ThreadPool* threadPool);
+    // The same tables one texel at a time on the calling thread, for comparison
+    void PrecomputeScalar(const Settings& settings);
+    // Read the tables of these settings from the cache directory, or compute and store them
+    void LoadOrPrecompute(const Settings& settings, const std::string& directory, ThreadPool* threadPool);
+
+    // One texel of each table in double precision, for validating the tables with many samples
+    static glm::dvec2 ReferenceBrdf(double NdotV, double roughness, int samples);
+    static glm::dvec3 ReferenceSpecular(const glm::vec3& direction, double roughness, int samples);
+    static glm::dvec3 ReferenceIrradiance(const glm::vec3& normal, int samples);
+
+    // Create the textures from the tables, needs an OpenGL context
+    void Upload();
+    void Destroy();
+    bool IsInitialized() const { return mTextures[0] != 0; }
+    // Bind the tables and set the uniforms of a program that is in use.
+    // Samplers always get their units, the physically based path is off until Upload()
+    void Bind(GLuint program) const;
+
+    const Settings& GetSettings() const { return mSettings; }
+    const Tables& GetTables() const { return mTables; }
+    const Statistics& GetStatistics() const { return mStatistics; }
+    int GetSpecularLevels() const { return static_cast<int>(mTables.specular.size()); }
+    // Size of the tables, also the size of the cache file without its header
+    size_t GetBytes() const;
+    std::string GetCachePath(const std::string& directory) const;
+private:
+    // Fill mTables, with Float8 or one texel at a time
+    void ComputeTables(const Settings& settings, ThreadPool* threadPool, bool vectorized);
+    bool Load(const std::string& filepath);
+    void Store(const std::string& filepath) const;
+
+    Settings mSettings;
+    Tables mTables;
+    Statistics mStatistics;
+    // Weight of the sky against the lights, about the 0.1 ambient of the Phong path
+    float mIntensity{0.2f};
+    // BRDF table, prefiltered environment, irradiance
+    GLuint mTextures[3]{0, 0, 0};
+    TrackedMemory mTracked{Memory::Category::TextureGpu};
+};
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef IMAGECOMPARE_HPP
+#define IMAGECOMPARE_HPP
+
+#include <cstddef>
+#include "PPM.hpp"
+
+// Result of comparing two images channel by channel
+struct ImageCompareResult{
+    bool sameSize{false};
+    int maxDifference{0};               // Largest difference of a single channel
+    double meanDifference{0.0};         // Mean absolute difference over all channels
+    double psnr{0.0};                   // Peak signal to noise ratio in dB (infinite if equal)
+    size_t pixelsOverTolerance{0};      // Pixels with any channel off by more than the tolerance
+    size_t pixelCount{0};
+};
+
+// Compare two images, e.g. a software reference render against an OpenGL frame.
+// If diff is not nullptr it is filled with a picture of the differences:
+// dark gray where the images agree, scaled error in green, red over the tolerance.
+ImageCompareResult CompareImages(const PPM& a, const PPM& b, int tolerance, PPM* diff);
+
+#endif
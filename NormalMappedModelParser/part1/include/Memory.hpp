@@ -0,0 +1,269 @@
+#ifndef MEMORY_HPP
+#define MEMORY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <new>
+
+// Allocators for load time scratch memory and counters of the global heap.
+//
+// Arena hands out memory by moving an offset through large blocks; nothing is
+// freed on its own, a Reset(), Rewind() or the destructor releases everything
+// at once. PoolAllocator keeps a free list of equal sized blocks, for nodes of
+// std::map and the like. ArenaAllocator and PoolStdAllocator adapt both to the
+// standard containers. Neither allocator is thread safe, every loader job uses
+// its own.
+//
+// The global operator new and delete, over-aligned forms included, are
+// replaced to count allocations and live bytes (see Memory::GetHeapCounters()),
+// which is how the loaders were measured before and after moving their
+// temporaries into arenas.
+//
+// On top of the heap counters, memory is accounted by what it is used for:
+// owners of meshes, images, OpenGL buffers and textures and arena blocks add
+// their bytes to a Memory::Category through a TrackedMemory member. GPU sizes
+// are computed from the arguments of glBufferData and glTexImage, not asked
+// from the driver. PrintReport() lists live and peak bytes per category.
+namespace Memory{
+    // Totals since startup, peakBytes since the last ResetHeapPeak()
+    struct HeapCounters{
+        size_t allocations{0};
+        size_t frees{0};
+        size_t bytes{0};
+        size_t peakBytes{0};
+    };
+
+    HeapCounters GetHeapCounters();
+    // Start measuring the peak from the live bytes of now
+    void ResetHeapPeak();
+
+    // What tracked memory holds
+    enum class Category{
+        MeshCpu,
+        MeshGpu,
+        TextureCpu,
+        TextureGpu,
+        // What renders a frame: render targets, shadow maps, light lists
+        FrameGpu,
+        // Arena blocks and pool chunks
+        Scratch,
+        Count
+    };
+
+    struct CategoryCounters{
+        size_t bytes{0};
+        size_t peakBytes{0};
+    };
+
+    // Add bytes to a category, negative when they are freed; thread safe
+    void Track(Category category, int64_t bytes);
+    CategoryCounters GetCategoryCounters(Category category);
+    const char* GetCategoryName(Category category);
+    // Bytes of an OpenGL texture with the given internal format, with all mip levels if asked.
+    // Unsized and three channel 8 bit formats count four bytes per texel, as drivers pad them.
+    size_t GetTextureBytes(unsigned int internalFormat, size_t width, size_t height, size_t layers = 1, bool mipmaps = false);
+    // Live and peak bytes of every category and the heap, on std::cout
+    void PrintReport();
+
+    // Cuts the next whitespace separated token out of a line in place and moves the
+    // cursor past it, nullptr at the end of the line
+    char* NextToken(char*& cursor);
+}
+
+
+// Bytes one owner has tracked in a category, released by Set(0) or the destructor
+class TrackedMemory{
+public:
+    explicit TrackedMemory(Memory::Category category) : mCategory(category) {}
+    ~TrackedMemory() { Set(0); }
+    TrackedMemory(const TrackedMemory&) = delete;
+    TrackedMemory& operator=(const TrackedMemory&) = delete;
+
+    void Add(size_t bytes);
+    // Track the difference to the bytes tracked so far
+    void Set(size_t bytes);
+    size_t Get() const { return mBytes; }
+private:
+    Memory::Category mCategory;
+    size_t mBytes{0};
+};
+
+
+class Arena{
+public:
+    static const size_t kDefaultBlockSize = 64 * 1024;
+
+    // Position of the arena, see GetMarker()
+    struct Marker{
+        size_t block{0};
+        size_t offset{0};
+    };
+
+    explicit Arena(size_t blockSize = kDefaultBlockSize);
+    ~Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Memory for size bytes, requests bigger than a block get a block of their own
+    void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+    template<typename T>
+    T* AllocateArray(size_t count) { return static_cast<T*>(Allocate(count * sizeof(T), alignof(T))); }
+
+    Marker GetMarker() const;
+    // Free everything allocated after the marker was taken
+    void Rewind(const Marker& marker);
+    // Free everything, the blocks are kept for the next use
+    void Reset() { Rewind(Marker()); }
+    // Give the blocks back to the heap
+    void Release();
+
+    size_t GetBytesUsed() const;
+    size_t GetPeakBytes() const { return mPeakBytes; }
+    size_t GetCapacity() const;
+    size_t GetBlockCount() const { return mBlocks.size(); }
+private:
+    struct Block{
+        uint8_t* data;
+        size_t size;
+    };
+    std::vector<Block> mBlocks;
+    size_t mBlockSize;
+    // Block being filled and the offset in it
+    size_t mCurrent{0};
+    size_t mOffset{0};
+    size_t mPeakBytes{0};
+    TrackedMemory mTracked{Memory::Category::Scratch};
+};
+
+
+// Rewinds an arena to where it was on construction
+class ArenaScope{
+public:
+    explicit ArenaScope(Arena& arena) : mArena(arena), mMarker(arena.GetMarker()) {}
+    ~ArenaScope() { mArena.Rewind(mMarker); }
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+private:
+    Arena& mArena;
+    Arena::Marker mMarker;
+};
+
+
+class PoolAllocator{
+public:
+    // Blocks are rounded up to the default new alignment
+    explicit PoolAllocator(size_t blockSize, size_t blocksPerChunk = 1024);
+    ~PoolAllocator();
+    PoolAllocator(const PoolAllocator&) = delete;
+    PoolAllocator& operator=(const PoolAllocator&) = delete;
+
+    void* Allocate();
+    void Free(void* block);
+
+    size_t GetBlockSize() const { return mBlockSize; }
+    size_t GetBlocksInUse() const { return mBlocksInUse; }
+    size_t GetChunkCount() const { return mChunks.size(); }
+private:
+    struct FreeBlock{
+        FreeBlock* next;
+    };
+    size_t mBlockSize;
+    size_t mBlocksPerChunk;
+    std::vector<uint8_t*> mChunks;
+    FreeBlock* mFreeList{nullptr};
+    size_t mBlocksInUse{0};
+    TrackedMemory mTracked{Memory::Category::Scratch};
+};
+
+
+// Reads a text file line by line through a fixed buffer in an arena, for files
+// too big to keep in memory at once next to what is decoded from them
+class LineReader{
+public:
+    static const size_t kDefaultBufferSize = 64 * 1024;
+
+    LineReader(const std::string& filepath, Arena& arena, size_t bufferSize = kDefaultBufferSize);
+    bool IsOpen() const { return mFile.is_open(); }
+    // Next line without its line break, valid until the next call, nullptr at the end.
+    // Lines longer than the buffer come in pieces.
+    char* NextLine();
+    // Start over at the beginning of the file
+    void Rewind();
+private:
+    std::ifstream mFile;
+    char* mBuffer;
+    size_t mBufferSize;
+    // Unread part of the buffer
+    size_t mBegin{0};
+    size_t mEnd{0};
+    bool mEndOfFile{false};
+};
+
+
+// Standard allocator on an arena, deallocate() does nothing
+template<typename T>
+class ArenaAllocator{
+public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(Arena& arena) noexcept : mArena(&arena) {}
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : mArena(other.GetArena()) {}
+
+    T* allocate(size_t count) { return mArena->AllocateArray<T>(count); }
+    void deallocate(T*, size_t) noexcept {}
+    Arena* GetArena() const noexcept { return mArena; }
+private:
+    Arena* mArena;
+};
+
+template<typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) noexcept { return a.GetArena() == b.GetArena(); }
+template<typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) noexcept { return a.GetArena() != b.GetArena(); }
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+
+// Standard allocator that takes single objects that fit from a pool and
+// anything else from the heap, meant for node based containers
+template<typename T>
+class PoolStdAllocator{
+public:
+    typedef T value_type;
+
+    explicit PoolStdAllocator(PoolAllocator& pool) noexcept : mPool(&pool) {}
+    template<typename U>
+    PoolStdAllocator(const PoolStdAllocator<U>& other) noexcept : mPool(other.GetPool()) {}
+
+    T* allocate(size_t count){
+        if (FromPool(count)) {
+            return static_cast<T*>(mPool->Allocate());
+        }
+        return static_cast<T*>(::operator new(count * sizeof(T)));
+    }
+    void deallocate(T* pointer, size_t count) noexcept{
+        if (FromPool(count)) {
+            mPool->Free(pointer);
+        } else {
+            ::operator delete(pointer);
+        }
+    }
+    PoolAllocator* GetPool() const noexcept { return mPool; }
+private:
+    bool FromPool(size_t count) const noexcept{
+        return count == 1 && sizeof(T) <= mPool->GetBlockSize() && alignof(T) <= alignof(std::max_align_t);
+    }
+    PoolAllocator* mPool;
+};
+
+template<typename T, typename U>
+bool operator==(const PoolStdAllocator<T>& a, const PoolStdAllocator<U>& b) noexcept { return a.GetPool() == b.GetPool(); }
+template<typename T, typename U>
+bool operator!=(const PoolStdAllocator<T>& a, const PoolStdAllocator<U>& b) noexcept { return a.GetPool() != b.GetPool(); }
+
+#endif
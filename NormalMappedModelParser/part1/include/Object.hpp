@@ -6,9 +6,25 @@
 #include <string>
 #include <glad/glad.h>
 #include "Texture.hpp"
+#include "ThreadPool.hpp"
+#include "Memory.hpp"
+#include "AssetManager.hpp"
 #include <glm/glm.hpp>
 
 class Object {
+public:
+    // Triangles per chunk, chunks are culled one by one
+    static const unsigned int kTrianglesPerChunk = 1024;
+    // Largest triangles kept as the occluder of the object
+    static const unsigned int kOccluderTriangles = 256;
+
+    // A range of the index buffer and the bounds of its triangles
+    struct Chunk {
+        unsigned int firstIndex;
+        unsigned int indexCount;
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+    };
 private:
     std::string mFilepath;
     std::string mDirectory;
@@ -29,24 +45,75 @@ private:
     GLuint mVBO_Tangents = 0;
     GLuint mVBO_Bitangents = 0;
 
-    // Texture
-    Texture mTexture;
-    Texture mNormalMapTexture;
+    // Textures, shared with every material that uses the same image; empty until a map is loaded
+    TextureHandle mTexture{std::make_shared<Texture>()};
+    TextureHandle mNormalMapTexture{std::make_shared<Texture>()};
+    // map_Ks, only loaded for the physically based path
+    TextureHandle mSpecularTexture{std::make_shared<Texture>()};
     std::string mTextureFilepath;
     std::vector<glm::vec3> mTangents;
     std::vector<glm::vec3> mBitangents;
 
-    // Parse functions
-    void parseOBJ(const std::string& filepath);
-    void parseMTL(const std::string& filepath);
+    // Bounds of the whole mesh and of every chunk, in model space
+    glm::vec3 mBoundsMin{0.0f};
+    glm::vec3 mBoundsMax{0.0f};
+    std::vector<Chunk> mChunks;
+    // Three model space corners per triangle, a subset of the mesh
+    std::vector<glm::vec3> mOccluder;
+
+    // Parse functions, all temporaries go to the arena
+    void parseOBJ(const std::string& filepath, Arena& arena);
+    void parseMTL(const std::string& filepath, Arena& arena);
+    // Acquire a texture from g.gAssets as a child of mImageJobs
+    void LoadImage(TextureHandle& texture, const std::string& filepath);
+    // Parent of the image decodes, only set during construction
+    ThreadPool::Job* mImageJobs{nullptr};
+    // Index count for Draw(), also after DropCpuCopies()
+    size_t mIndexCount{0};
+    // Bytes of the CPU arrays and of the OpenGL buffers
+    TrackedMemory mCpuMemory{Memory::Category::MeshCpu};
+    TrackedMemory mGpuMemory{Memory::Category::MeshGpu};
+    void TrackCpuMemory();
+    // Sort the triangles into spatially compact chunks, compute their bounds and pick the occluder
+    void ComputeBounds();
 
 public:
     Object(const std::string& filepath);
     ~Object();
+    // ComputeTangentSpace() and Upload()
     void Initialize();
-    void PreDraw();
+    // Create the program, buffers and textures; the only part that needs the OpenGL context
+    void Upload();
+    // Free the mesh arrays and images after Upload(), for OpenGL rendering only (--drop-cpu-copies)
+    void DropCpuCopies();
+    // Bind the program and textures and set the uniforms, model is the world matrix of the scene node
+    void PreDraw(const glm::mat4& model, GLuint program);
     void Draw();
+    // Draw only the given chunks, in increasing order; neighbouring chunks share a draw call
+    void DrawChunks(const std::vector<unsigned int>& chunks);
+    // Same draws with the program left bound, returns the number of draw calls
+    size_t DrawChunkRanges(const std::vector<unsigned int>& chunks);
     void ComputeTangentSpace();
+
+    // Mesh data for renderers that do not go through OpenGL
+    const std::vector<glm::vec3>& GetVertices() const { return mVertices; }
+    const std::vector<glm::vec2>& GetTexCoords() const { return mTexCoords; }
+    const std::vector<glm::vec3>& GetNormals() const { return mNormals; }
+    const std::vector<glm::vec3>& GetTangents() const { return mTangents; }
+    const std::vector<glm::vec3>& GetBitangents() const { return mBitangents; }
+    const std::vector<unsigned int>& GetIndices() const { return mIndices; }
+    const glm::vec3& GetBoundsMin() const { return mBoundsMin; }
+    const glm::vec3& GetBoundsMax() const { return mBoundsMax; }
+    const std::vector<Chunk>& GetChunks() const { return mChunks; }
+    const std::vector<glm::vec3>& GetOccluder() const { return mOccluder; }
+    const Texture& GetDiffuseTexture() const { return *mTexture; }
+    const Texture& GetNormalMapTexture() const { return *mNormalMapTexture; }
+    const Texture& GetSpecularTexture() const { return *mSpecularTexture; }
+    // The shared textures, for caches that must not outlive them
+    const TextureHandle& GetDiffuseTextureHandle() const { return mTexture; }
+    const TextureHandle& GetNormalMapTextureHandle() const { return mNormalMapTexture; }
+    // CPU and GPU bytes of the mesh, the textures are counted on their own
+    size_t GetBytes() const { return mCpuMemory.Get() + mGpuMemory.Get(); }
 };
 
 #endif
@@ -0,0 +1,100 @@
+#ifndef OCCLUSIONCULLER_HPP
+#define OCCLUSIONCULLER_HPP
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "FrustumCuller.hpp"
+#include "ThreadPool.hpp"
+
+// Hides boxes that are behind other geometry, using a small depth buffer drawn
+// on the CPU.
+//
+// A few occluders (simplified meshes, see Object::GetOccluder()) are
+// rasterized with SSE into a low resolution buffer that stores, per pixel, the
+// farthest depth of the nearest occluder triangle. A mip pyramid then keeps the
+// farthest depth of every 2x2 block, so a box covering many pixels is tested
+// against a handful of texels of a coarse level: it is hidden if its nearest
+// depth is behind all of them. The work runs as a job on the thread pool
+// between Start() and Wait(), while the caller keeps submitting the rest of
+// the frame.
+class OcclusionCuller{
+public:
+    // Occluder mesh (three corners per triangle) and its world matrix
+    struct Occluder{
+        const std::vector<glm::vec3>* triangles;
+        glm::mat4 model;
+    };
+
+    // Counters of the last job
+    struct Statistics{
+        size_t occluderTriangles{0};
+        size_t tested{0};
+        size_t occluded{0};
+        double rasterMilliseconds{0.0};
+        double testMilliseconds{0.0};
+        // Time the calling thread spent blocked in Wait()
+        double waitMilliseconds{0.0};
+    };
+
+    OcclusionCuller() = default;
+    ~OcclusionCuller();
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+    // Allocate the depth pyramid; jobs run on the pool, or on the calling thread without one
+    void Initialize(int width, int height, ThreadPool* threadPool);
+    // Wait for a started job and free the pyramid
+    void Shutdown();
+    bool IsInitialized() const { return !mLevels.empty(); }
+
+    // Start a job that keeps the candidate boxes not hidden by the occluders.
+    // The boxes and the candidate list are read by the job, they must not
+    // change before Wait() returns.
+    void Start(const glm::mat4& viewProjection, const std::vector<Occluder>& occluders,
+               const FrustumCuller& boxes, const std::vector<uint32_t>& candidates);
+    // Block until the job is done and return the visible candidates in their original order
+    const std::vector<uint32_t>& Wait();
+
+    // Run a job on the calling thread
+    void Run(const glm::mat4& viewProjection, const std::vector<Occluder>& occluders,
+             const FrustumCuller& boxes, const std::vector<uint32_t>& candidates);
+    const Statistics& GetStatistics() const { return mStatistics; }
+    // Write the depth buffer of the last job as a grayscale PPM
+    void WriteDepthImage(const std::string& filePath) const;
+private:
+    // Clear the depth buffer and draw every occluder into it
+    void Rasterize();
+    // Draw one triangle given in clip space
+    void RasterizeTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+    // Fill the coarser levels from level 0
+    void BuildPyramid();
+    // True if the box may be visible
+    bool TestBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+    // Rasterize and test the boxes of the current job
+    void Execute();
+
+    // Level 0 is the depth buffer, every level halves the previous one
+    struct Level{
+        int width{0};
+        int height{0};
+        std::vector<float> depth;
+    };
+    std::vector<Level> mLevels;
+
+    // Current job
+    glm::mat4 mViewProjection{1.0f};
+    std::vector<Occluder> mOccluders;
+    const FrustumCuller* mBoxes{nullptr};
+    const std::vector<uint32_t>* mCandidates{nullptr};
+    std::vector<uint32_t> mVisible;
+    Statistics mStatistics;
+
+    ThreadPool* mThreadPool{nullptr};
+    // The started job, until Wait()
+    ThreadPool::Job* mJob{nullptr};
+};
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef PATHTRACER_HPP
+#define PATHTRACER_HPP
+
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "Object.hpp"
+#include "Image.hpp"
+#include "PPM.hpp"
+#include "Bvh.hpp"
+#include "SoftwareShading.hpp"
+
+// Progressive CPU path tracer over the triangles of loaded Objects.
+//
+// Every pass adds one sample per pixel to an accumulation buffer. The image is
+// split into 32x32 tiles that are dealt out to the threads up front; a thread
+// that runs out of tiles steals from the back of another thread's queue. Rays
+// are traced one at a time through a Bvh. Surfaces are diffuse, textured with
+// map_Kd and bent by map_Bump like the rasterized paths, and are lit by the
+// point light (with shadow rays) and a sky gradient.
+class PathTracer{
+public:
+    static const int kTileSize = 32;
+    static const int kMaxBounces = 4;
+
+    // Counters of the last pass
+    struct Statistics{
+        size_t samples{0};
+        size_t rays{0};             // Camera, bounce and shadow rays
+        size_t steals{0};           // Tiles taken from another thread's queue
+        double milliseconds{0.0};
+    };
+
+    // Constructor
+    PathTracer();
+    // Copy the triangles of an object into the scene, in world space
+    void AddObject(const Object& object, const glm::mat4& model);
+    // Build the Bvh, call after the last AddObject
+    void Build();
+    // Allocate the accumulation buffer and clear it
+    void Initialize(int width, int height);
+    // Throw away all accumulated samples, for example after the camera moved
+    void Reset();
+    // Add one sample per pixel using threadCount threads
+    void RenderPass(const glm::mat4& view, const glm::mat4& projection,
+                    const glm::vec3& eyePosition, const glm::vec3& lightPosition,
+                    unsigned int threadCount);
+    // Average of all passes so far, gamma corrected, into an image of the same size
+    void Resolve(PPM& image) const;
+    // Number of passes since the last Reset
+    unsigned int GetSampleCount() const { return mSampleCount; }
+    size_t GetTriangleCount() const { return mCorners.size() / 3; }
+    size_t GetNodeCount() const { return mBvh.GetNodeCount(); }
+    // Counters of the last pass
+    const Statistics& GetStatistics() const { return mStatistics; }
+private:
+    // Textures of the triangles of one object
+    struct Material{
+        const MipTexture* diffuse;
+        const MipTexture* normalMap;
+    };
+    // What a ray hit, in world space
+    struct Surface{
+        glm::vec3 position;
+        glm::vec3 geometricNormal;  // Facing the incoming ray
+        glm::vec3 shadingNormal;    // Interpolated and normal mapped
+        glm::vec3 albedo;
+    };
+
+    // Mip chain of a texture, built the first time an object uses it
+    const MipTexture* GetMipTexture(const TextureHandle& texture);
+    // Interpolate the attributes of a hit
+    void GetSurface(const Ray& ray, const Hit& hit, Surface& surface) const;
+    // Follow one path from the camera, returns the radiance it carries
+    glm::vec3 TracePath(Ray ray, uint32_t& randomState, size_t& rays) const;
+    // Trace every pixel of one tile once
+    void RenderTile(int tileIndex, size_t& rays);
+
+    // Scene, three entries per triangle
+    std::vector<glm::vec3> mCorners;
+    std::vector<glm::vec3> mNormals;
+    std::vector<glm::vec3> mTangents;
+    std::vector<glm::vec3> mBitangents;
+    std::vector<glm::vec2> mTexCoords;
+    // One entry per triangle
+    std::vector<uint32_t> mMaterialIndices;
+    std::vector<Material> mMaterials;
+    Bvh mBvh;
+    // Mip chains keyed by their texture. The handle keeps the texture alive, an
+    // image pointer could be reused by another texture once the assets are trimmed.
+    std::map<TextureHandle, MipTexture> mMipTextures;
+
+    int mWidth{0};
+    int mHeight{0};
+    int mTilesX{0};
+    int mTilesY{0};
+    std::vector<glm::vec3> mAccumulation;
+    unsigned int mSampleCount{0};
+
+    // Pass state
+    glm::mat4 mInverseViewProjection;
+    glm::vec3 mEyePosition;
+    glm::vec3 mLightPosition;
+
+    Statistics mStatistics;
+};
+
+#endif
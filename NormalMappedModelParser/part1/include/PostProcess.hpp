@@ -0,0 +1,89 @@
+#ifndef POSTPROCESS_HPP
+#define POSTPROCESS_HPP
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <glad/glad.h>
+
+#include "FrameGraph.hpp"
+#include "GpuTimer.hpp"
+
+// Post-processing (--post) as a list of full screen passes that read and write
+// named images. "scene" is the HDR color the scene was drawn into and "screen"
+// the framebuffer the last pass writes to.
+//
+// Compile() groups the passes into draws: runs of pointwise passes (a color
+// in, a color out, same resolution) are merged into one generated shader, so
+// the intermediate image is never written; --no-merge keeps one draw per pass
+// for comparison. AddToGraph() then adds the draws to the frame graph, which
+// places the images in pooled render targets. Passes can run at 1/2 or 1/4
+// resolution (downscale 2 or 4).
+class PostProcess{
+public:
+    static const char* const kScene;
+    static const char* const kScreen;
+
+    struct Input{
+        std::string resource;
+        std::string sampler;
+    };
+
+    struct Pass{
+        std::string name;
+        // For pointwise passes the first input is the color handed to the function
+        std::vector<Input> inputs;
+        std::string output;
+        // 1 for full, 2 for half and 4 for quarter resolution
+        int downscale{1};
+        GLenum format{GL_RGBA16F};
+        // A fragment shader, or for pointwise passes a snippet that defines
+        // vec4 <name>(vec4 color, vec2 uv)
+        std::string shaderPath;
+        bool pointwise{false};
+        // Sets the pass uniforms on the program that is in use, may be empty
+        std::function<void(GLuint program)> setUniforms;
+    };
+
+    PostProcess() = default;
+    ~PostProcess();
+
+    void AddPass(const Pass& pass);
+    // Group the passes into draws, pure CPU
+    void Plan(bool merge);
+    // Plan() and build the programs, needs an OpenGL context
+    void Compile(bool merge);
+    // Add one frame graph pass per draw, reading scene and writing screen at the end
+    void AddToGraph(FrameGraph& graph, FrameGraph::Resource scene, FrameGraph::Resource screen, GpuTimer& gpuTimer);
+    void Destroy();
+
+    // Number of passes before and after merging
+    size_t GetPassCount() const { return mPasses.size(); }
+    size_t GetDrawCount() const { return mSteps.size(); }
+    // Names of the passes that are drawn, merged ones joined with '+'
+    std::string GetSummary() const;
+private:
+    // One draw of the compiled frame
+    struct Step{
+        std::string name;
+        // "Post <name>", the pass name of the GPU timer
+        std::string timerName;
+        std::vector<size_t> passes;
+        std::vector<Input> inputs;
+        std::string output;
+        int downscale{1};
+        GLenum format{GL_RGBA16F};
+        GLuint program{0};
+    };
+
+    // Generated fragment shader that applies pointwise passes in order
+    std::string BuildPointwiseShader(const std::vector<size_t>& passes) const;
+    // Bind the inputs, set the uniforms and draw one step into the bound framebuffer
+    void Draw(const Step& step, const FrameGraph& graph, const std::vector<FrameGraph::Resource>& inputs) const;
+
+    std::vector<Pass> mPasses;
+    std::vector<Step> mSteps;
+    GLuint mScreenVAO{0};
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <string>
+#include <cstdint>
+#include <atomic>
+
+// Low-overhead CPU profiler. Scoped zones are recorded into a per-thread ring
+// buffer without taking locks and can be dumped as a Chrome trace
+// (load the JSON file in chrome://tracing or https://ui.perfetto.dev).
+//
+// Usage:
+//      void Object::parseOBJ(...){
+//          PROFILE_SCOPE("parseOBJ");
+//          ...
+//      }
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+
+// One completed zone
+struct ProfileEvent{
+    const char* name;   // Must be a string literal (only the pointer is stored)
+    uint64_t start;     // Timestamp in ticks
+    uint64_t end;       // Timestamp in ticks
+};
+
+namespace Profiler{
+    // Number of zones each thread keeps before the oldest ones are overwritten
+    const uint32_t kEventsPerThread = 1 << 16;
+
+    // Calibrate the timer, call once at startup
+    void Initialize();
+    // Current timestamp in ticks
+    uint64_t Now();
+    // Name shown for the calling thread in the trace
+    void SetThreadName(const std::string& name);
+    // Store a finished zone for the calling thread
+    void Record(const char* name, uint64_t start, uint64_t end);
+    // Write all recorded zones of all threads as Chrome trace_event JSON
+    bool WriteChromeTrace(const std::string& filepath);
+}
+
+// RAII marker: measures the lifetime of the enclosing scope
+class ProfileScope{
+public:
+    explicit ProfileScope(const char* name) : mName(name), mStart(Profiler::Now()) {}
+    ~ProfileScope() { Profiler::Record(mName, mStart, Profiler::Now()); }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+private:
+    const char* mName;
+    uint64_t mStart;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef RENDERTARGETPOOL_HPP
+#define RENDERTARGETPOOL_HPP
+
+#include <vector>
+#include <glad/glad.h>
+#include "Memory.hpp"
+
+// A texture with its framebuffer, optionally with a depth renderbuffer
+struct RenderTarget{
+    GLuint framebuffer{0};
+    GLuint texture{0};
+    GLuint depthRenderbuffer{0};
+    int width{0};
+    int height{0};
+    GLenum format{0};
+    bool inUse{false};
+};
+
+// Hands out render targets and takes them back, so passes that do not overlap
+// in time share the same textures. A released target is given to the next
+// request with the same size, format and depth; new targets are only created
+// when none is free, so after the first frame nothing is allocated.
+class RenderTargetPool{
+public:
+    RenderTargetPool() = default;
+    ~RenderTargetPool();
+    RenderTargetPool(const RenderTargetPool&) = delete;
+    RenderTargetPool& operator=(const RenderTargetPool&) = delete;
+
+    // A free target of this size and color format, created if needed
+    RenderTarget* Acquire(int width, int height, GLenum format, bool depth = false);
+    // Return a target to the pool, it stays allocated
+    void Release(RenderTarget* target);
+    // Delete every target
+    void Destroy();
+
+    size_t GetTargetCount() const { return mTargets.size(); }
+    // Bytes of all textures and renderbuffers in the pool
+    size_t GetBytes() const;
+    // Bytes per pixel of a color format
+    static size_t GetBytesPerPixel(GLenum format);
+private:
+    // Pointers stay valid while the vector grows
+    std::vector<RenderTarget*> mTargets;
+    TrackedMemory mTracked{Memory::Category::FrameGpu};
+};
+
+#endif
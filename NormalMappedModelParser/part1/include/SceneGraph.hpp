@@ -0,0 +1,77 @@
+#ifndef SCENEGRAPH_HPP
+#define SCENEGRAPH_HPP
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// Handle of a node, stays valid when the nodes are re-sorted
+typedef uint32_t NodeHandle;
+static const NodeHandle kInvalidNode = 0xFFFFFFFFu;
+
+// Nodes with a local translation, rotation and scale below an optional parent.
+//
+// Every property lives in its own array (structure of arrays) and the arrays
+// are sorted by depth, so a parent is always stored before its children and
+// the world matrices can be computed in one linear pass. Setting a property
+// only marks the node dirty; Update() starts at the first dirty node and
+// recomputes exactly the dirty nodes and everything below them, the rest of
+// the pass only reads one flag byte per node. Renderers read the world
+// matrices and mesh indices straight from the arrays.
+class SceneGraph{
+public:
+    // Counters of the last Update()
+    struct Statistics{
+        size_t nodesUpdated{0};
+        size_t nodesScanned{0};
+        double milliseconds{0.0};
+    };
+
+    // Add a node below parent (or a root), with an identity transform and no mesh
+    NodeHandle CreateNode(NodeHandle parent = kInvalidNode);
+    // Remove all nodes
+    void Clear();
+    void SetTranslation(NodeHandle node, const glm::vec3& translation);
+    void SetRotation(NodeHandle node, const glm::quat& rotation);
+    void SetScale(NodeHandle node, const glm::vec3& scale);
+    // Mesh drawn with the node's world matrix, -1 for none
+    void SetMesh(NodeHandle node, int mesh);
+    const glm::vec3& GetTranslation(NodeHandle node) const { return mTranslations[mIndices[node]]; }
+    const glm::quat& GetRotation(NodeHandle node) const { return mRotations[mIndices[node]]; }
+    // World matrix as of the last Update()
+    const glm::mat4& GetWorldMatrix(NodeHandle node) const { return mWorldMatrices[mIndices[node]]; }
+    // Sort if nodes were added out of depth order and propagate dirty transforms
+    void Update();
+
+    size_t GetNodeCount() const { return mParents.size(); }
+    // Per node arrays in storage (depth) order
+    const std::vector<glm::mat4>& GetWorldMatrices() const { return mWorldMatrices; }
+    const std::vector<int>& GetMeshes() const { return mMeshes; }
+    const Statistics& GetStatistics() const { return mStatistics; }
+private:
+    // Mark a node for the next Update()
+    void MarkDirty(uint32_t index);
+    // Stable sort of every array by depth
+    void SortByDepth();
+
+    // Storage index of the parent, kInvalidNode for roots
+    std::vector<uint32_t> mParents;
+    std::vector<uint32_t> mDepths;
+    std::vector<glm::vec3> mTranslations;
+    std::vector<glm::quat> mRotations;
+    std::vector<glm::vec3> mScales;
+    std::vector<glm::mat4> mWorldMatrices;
+    std::vector<int> mMeshes;
+    // 1 if the local transform changed since the last Update()
+    std::vector<uint8_t> mDirty;
+    // Handle of every storage index, and storage index of every handle
+    std::vector<NodeHandle> mHandles;
+    std::vector<uint32_t> mIndices;
+
+    size_t mFirstDirty{0};
+    bool mNeedsSort{false};
+    Statistics mStatistics;
+};
+
+#endif
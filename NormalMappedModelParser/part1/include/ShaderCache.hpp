@@ -0,0 +1,59 @@
+#ifndef SHADERCACHE_HPP
+#define SHADERCACHE_HPP
+
+#include <string>
+#include <cstdint>
+#include <glad/glad.h>
+
+// Caches linked program binaries on disk so that the next start of the
+// application can skip compiling GLSL from text (GL 4.1 / ARB_get_program_binary).
+class ShaderCache{
+public:
+    // Constructor
+    ShaderCache();
+    // Resolves the program binary entry points and builds the driver key.
+    // Must be called after an OpenGL context exists.
+    void Initialize(GLADloadproc loader, const std::string& directory);
+    // Turn the cache on or off (e.g. from the command line)
+    void SetEnabled(bool enabled);
+    // Returns true if the driver supports program binaries and the cache is on
+    bool IsActive() const;
+    // Returns a linked program for the given sources, or 0 on a cache miss.
+    GLuint LoadProgram(const std::string& vertexShaderSource, const std::string& fragmentShaderSource);
+    // Must be called on a program before glLinkProgram so the driver keeps the binary around
+    void PrepareForLink(GLuint program) const;
+    // Store the binary of a linked program for the given sources
+    void StoreProgram(const std::string& vertexShaderSource, const std::string& fragmentShaderSource, GLuint program);
+    // Record how long it took to create a program
+    void RecordProgramTime(double milliseconds, bool hit);
+    // Print hits, misses and the time spent creating programs
+    void PrintStatistics() const;
+private:
+    // Build the cache key from the shader text and the driver strings
+    uint64_t ComputeKey(const std::string& vertexShaderSource, const std::string& fragmentShaderSource) const;
+    // Location of the binary for a key
+    std::string GetFilepath(uint64_t key) const;
+
+    // Program binary entry points (not part of our GL 3.3 glad loader)
+    typedef void (APIENTRYP PFNGETPROGRAMBINARYPROC)(GLuint, GLsizei, GLsizei*, GLenum*, void*);
+    typedef void (APIENTRYP PFNPROGRAMBINARYPROC)(GLuint, GLenum, const void*, GLsizei);
+    typedef void (APIENTRYP PFNPROGRAMPARAMETERIPROC)(GLuint, GLenum, GLint);
+    PFNGETPROGRAMBINARYPROC m_getProgramBinary{nullptr};
+    PFNPROGRAMBINARYPROC m_programBinary{nullptr};
+    PFNPROGRAMPARAMETERIPROC m_programParameteri{nullptr};
+
+    // Directory the binaries are written to
+    std::string m_directory;
+    // Vendor, renderer and version strings, part of every key
+    std::string m_driverString;
+    bool m_supported{false};
+    bool m_enabled{true};
+
+    // Statistics
+    unsigned int m_hits{0};
+    unsigned int m_misses{0};
+    double m_hitMilliseconds{0.0};
+    double m_missMilliseconds{0.0};
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef SHADERRELOADER_HPP
+#define SHADERRELOADER_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <glad/glad.h>
+
+// Watches the shader directory on a background thread and rebuilds the
+// programs that use a changed file. A rebuilt program only replaces the
+// live one after it linked successfully, so a typo keeps the old shader.
+class ShaderReloader{
+public:
+    // Constructor
+    ShaderReloader();
+    // Destructor stops the watcher thread
+    ~ShaderReloader();
+    // Start watching a directory, must be called after an OpenGL context exists
+    void Initialize(GLADloadproc loader, const std::string& directory);
+    // Register a program handle that is built from the given shader files.
+    // The handle is replaced in place when a rebuild succeeds.
+    void Watch(GLuint* program, const std::string& vertexShaderPath, const std::string& fragmentShaderPath);
+    // Called once per frame on the main thread: starts rebuilds and swaps finished programs
+    void Update();
+    // Stop the watcher thread
+    void Shutdown();
+private:
+    // A program that is registered for reloading
+    struct WatchedProgram{
+        GLuint* program;
+        std::string vertexShaderPath;
+        std::string fragmentShaderPath;
+    };
+    // A rebuild that has been submitted to the driver but may not be finished yet
+    struct PendingBuild{
+        size_t watchedIndex;
+        GLuint program;
+        GLuint vertexShader;
+        GLuint fragmentShader;
+        // Sources the build was started from, used as the shader cache key
+        std::string vertexShaderSource;
+        std::string fragmentShaderSource;
+    };
+
+    // Body of the background thread
+    void WatchThread();
+    // Submit compile and link of a watched program without waiting for it
+    void StartBuild(size_t watchedIndex);
+    // Returns true once the driver is done with a build
+    bool IsBuildComplete(const PendingBuild& build) const;
+    // Swap in or discard a completed build
+    void FinishBuild(const PendingBuild& build);
+    // Returns just the filename part of a path
+    static std::string GetFilename(const std::string& path);
+
+    std::string m_directory;
+    std::vector<WatchedProgram> m_watched;
+    std::vector<PendingBuild> m_pending;
+
+    // Latest text of every shader file, filled in by the watcher thread
+    std::map<std::string, std::string> m_sources;
+    // Files that changed since the last Update()
+    std::vector<std::string> m_changedFiles;
+    std::mutex m_mutex;
+
+    std::thread m_thread;
+    std::atomic<bool> m_running{false};
+
+    // GL_KHR_parallel_shader_compile lets the driver compile on its own threads
+    bool m_parallelCompile{false};
+};
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef SOFTWARERASTERIZER_HPP
+#define SOFTWARERASTERIZER_HPP
+
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "Object.hpp"
+#include "Image.hpp"
+#include "PPM.hpp"
+#include "ThreadPool.hpp"
+#include "SoftwareShading.hpp"
+
+// Renders Objects on the CPU, for machines without a GPU.
+//
+// Submitted triangles are transformed, clipped against the near plane and
+// sorted into 64x64 pixel tiles. Every tile is then rasterized and shaded by
+// a single thread, so threads never write to the same pixels. Rasterization
+// tests 4 pixels at a time with SSE edge functions and skips 8x8 blocks whose
+// farthest depth is already closer than the triangle. Visible pixels only store
+// a triangle id and barycentrics. After all triangles of a tile are rasterized
+// the visible pixels are shaded 8 at a time with the normal mapped Phong model
+// of shaders/frag.glsl, sampling textures with trilinear filtering.
+class SoftwareRasterizer{
+public:
+    static const int kTileSize = 64;
+    static const int kBlockSize = 8;
+
+    // Counters of the last frame
+    struct Statistics{
+        size_t trianglesSubmitted{0};
+        size_t trianglesVisible{0};     // After culling and clipping
+        size_t binEntries{0};           // Triangle/tile pairs
+        size_t blocksTested{0};
+        size_t blocksSkippedByDepth{0};
+        size_t pixelsShaded{0};
+        double vertexMilliseconds{0.0}; // Transform, clipping and binning
+        double tileMilliseconds{0.0};   // Rasterizing and shading all tiles
+        double shadeMilliseconds{0.0};  // Shading only, summed over all threads
+    };
+
+    // Constructor
+    SoftwareRasterizer();
+    // Allocate the framebuffer, the thread pool must outlive the rasterizer
+    void Initialize(int width, int height, ThreadPool* threadPool);
+    // Start a frame with the camera and light used for all objects of this frame
+    void BeginFrame(const glm::mat4& view, const glm::mat4& projection,
+                    const glm::vec3& eyePosition, const glm::vec3& lightPosition,
+                    const glm::vec3& clearColor);
+    // Transform and bin the triangles of an object
+    void Submit(const Object& object, const glm::mat4& model);
+    // Rasterize and shade every tile
+    void EndFrame();
+    // Copy the finished frame into an image of the same size
+    void Resolve(PPM& image) const;
+    // Counters of the last frame
+    const Statistics& GetStatistics() const { return mStatistics; }
+private:
+    // Output of the vertex stage
+    struct Vertex{
+        glm::vec4 clip;
+        glm::vec3 position;
+        glm::vec3 normal;
+        glm::vec3 tangent;
+        glm::vec3 bitangent;
+        glm::vec2 texCoord;
+    };
+    // A screen space triangle ready for rasterization
+    struct Triangle{
+        // Edge functions E(x,y) = a*x + b*y + c, positive inside
+        float edgeA[3];
+        float edgeB[3];
+        float edgeC[3];
+        // Smallest value that counts as inside (top-left fill rule)
+        float edgeThreshold[3];
+        float invArea;
+        // Depth plane z(x,y) = zA*x + zB*y + zC and its nearest value
+        float zA, zB, zC;
+        float minZ;
+        // Pixel bounding box, inclusive
+        int minX, minY, maxX, maxY;
+        // Attributes for perspective correct interpolation
+        float invW[3];
+        glm::vec3 position[3];
+        glm::vec3 normal[3];
+        glm::vec3 tangent[3];
+        glm::vec3 bitangent[3];
+        glm::vec2 texCoord[3];
+        glm::vec3 faceNormal;
+        // Screen space derivatives of texCoord/w and 1/w, used to pick the mip level
+        glm::vec2 texCoordOverWdx, texCoordOverWdy;
+        float invWdx, invWdy;
+        // nullptr if the object has no such texture
+        const MipTexture* diffuse;
+        const MipTexture* normalMap;
+    };
+    // Triangles set up by one job together with their tile bins.
+    // A triangle id is chunk * kChunkCapacity + index in the chunk.
+    struct Chunk{
+        std::vector<Triangle> triangles;
+        std::vector<std::vector<uint32_t>> bins;
+    };
+    static const uint32_t kTrianglesPerChunk = 2048;
+    // Near plane clipping can turn one triangle into two
+    static const uint32_t kChunkCapacity = 2 * kTrianglesPerChunk;
+    static const uint32_t kNoTriangle = 0xFFFFFFFFu;
+
+    // Per-thread counters, padded so threads do not share cache lines
+    struct alignas(64) ThreadStatistics{
+        size_t binEntries{0};
+        size_t blocksTested{0};
+        size_t blocksSkippedByDepth{0};
+        size_t pixelsShaded{0};
+        double shadeMilliseconds{0.0};
+    };
+    // Textures of the triangles of one object
+    struct Material{
+        const MipTexture* diffuse;
+        const MipTexture* normalMap;
+    };
+
+    // Mip chain of a texture, built the first time the texture is drawn
+    const MipTexture* GetMipTexture(const TextureHandle& texture);
+    // Clip against the near plane and set up the resulting triangles
+    void ClipAndSetup(const Vertex& v0, const Vertex& v1, const Vertex& v2, const Material& material, Chunk& chunk);
+    // Project, cull and bin one triangle that lies in front of the near plane
+    void SetupTriangle(const Vertex& v0, const Vertex& v1, const Vertex& v2, const Material& material, Chunk& chunk);
+    // Clear, rasterize and shade one tile
+    void ProcessTile(int tileIndex, ThreadStatistics& statistics);
+    // Write depth, triangle id and barycentrics of the covered pixels of one tile
+    void RasterizeTriangle(const Triangle& triangle, uint32_t id,
+                           int tileX0, int tileY0, int tileX1, int tileY1,
+                           ThreadStatistics& statistics);
+    // Turn triangle ids and barycentrics into colors
+    void ShadeTile(int tileX0, int tileY0, int tileX1, int tileY1, ThreadStatistics& statistics);
+
+    ThreadPool* mThreadPool{nullptr};
+    int mWidth{0};
+    int mHeight{0};
+    // Buffers are padded to whole 8x8 blocks
+    int mPitch{0};
+    int mTilesX{0};
+    int mTilesY{0};
+    int mBlocksX{0};
+
+    // Per pixel
+    std::vector<float> mDepth;
+    std::vector<uint32_t> mTriangleIds;
+    std::vector<float> mBarycentric1;
+    std::vector<float> mBarycentric2;
+    std::vector<uint8_t> mColor;
+    // Farthest depth of every 8x8 block
+    std::vector<float> mBlockMaxDepth;
+
+    // Frame state
+    glm::mat4 mViewProjection;
+    glm::vec3 mEyePosition;
+    glm::vec3 mLightPosition;
+    glm::vec3 mClearColor;
+    std::vector<Vertex> mVertices;
+    std::vector<Chunk> mChunks;
+    size_t mChunkCount{0};
+
+    // Mip chains keyed by their texture. The handle keeps the texture alive, an
+    // image pointer could be reused by another texture once the assets are trimmed.
+    std::map<TextureHandle, MipTexture> mMipTextures;
+
+    Statistics mStatistics;
+    std::vector<ThreadStatistics> mThreadStatistics;
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef SOFTWARESHADING_HPP
+#define SOFTWARESHADING_HPP
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "Image.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define SOFTWARESHADING_SSE
+#endif
+
+// Eight floats that are processed together. Two SSE registers where
+// available, a plain array otherwise.
+struct Float8{
+#if defined(SOFTWARESHADING_SSE)
+    __m128 lo, hi;
+    Float8() {}
+    Float8(__m128 l, __m128 h) : lo(l), hi(h) {}
+    Float8(float value) : lo(_mm_set1_ps(value)), hi(_mm_set1_ps(value)) {}
+    static Float8 Load(const float* p) { return Float8(_mm_loadu_ps(p), _mm_loadu_ps(p + 4)); }
+    void Store(float* p) const { _mm_storeu_ps(p, lo); _mm_storeu_ps(p + 4, hi); }
+    friend Float8 operator+(const Float8& a, const Float8& b) { return Float8(_mm_add_ps(a.lo, b.lo), _mm_add_ps(a.hi, b.hi)); }
+    friend Float8 operator-(const Float8& a, const Float8& b) { return Float8(_mm_sub_ps(a.lo, b.lo), _mm_sub_ps(a.hi, b.hi)); }
+    friend Float8 operator*(const Float8& a, const Float8& b) { return Float8(_mm_mul_ps(a.lo, b.lo), _mm_mul_ps(a.hi, b.hi)); }
+    friend Float8 operator/(const Float8& a, const Float8& b) { return Float8(_mm_div_ps(a.lo, b.lo), _mm_div_ps(a.hi, b.hi)); }
+    friend Float8 Min(const Float8& a, const Float8& b) { return Float8(_mm_min_ps(a.lo, b.lo), _mm_min_ps(a.hi, b.hi)); }
+    friend Float8 Max(const Float8& a, const Float8& b) { return Float8(_mm_max_ps(a.lo, b.lo), _mm_max_ps(a.hi, b.hi)); }
+    friend Float8 Sqrt(const Float8& a) { return Float8(_mm_sqrt_ps(a.lo), _mm_sqrt_ps(a.hi)); }
+#else
+    float v[8];
+    Float8() {}
+    Float8(float value) { for (int i = 0; i < 8; ++i) v[i] = value; }
+    static Float8 Load(const float* p) { Float8 r; for (int i = 0; i < 8; ++i) r.v[i] = p[i]; return r; }
+    void Store(float* p) const { for (int i = 0; i < 8; ++i) p[i] = v[i]; }
+    friend Float8 operator+(const Float8& a, const Float8& b) { Float8 r; for (int i = 0; i < 8; ++i) r.v[i] = a.v[i] + b.v[i]; return r; }
+    friend Float8 operator-(const Float8& a, const Float8& b) { Float8 r; for (int i = 0; i < 8; ++i) r.v[i] = a.v[i] - b.v[i]; return r; }
+    friend Float8 operator*(const Float8& a, const Float8& b) { Float8 r; for (int i = 0; i < 8; ++i) r.v[i] = a.v[i] * b.v[i]; return r; }
+    friend Float8 operator/(const Float8& a, const Float8& b) { Float8 r; for (int i = 0; i < 8; ++i) r.v[i] = a.v[i] / b.v[i]; return r; }
+    friend Float8 Min(const Float8& a, const Float8& b) { Float8 r; for (int i = 0; i < 8; ++i) r.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return r; }
+    friend Float8 Max(const Float8& a, const Float8& b) { Float8 r; for (int i = 0; i < 8; ++i) r.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return r; }
+    friend Float8 Sqrt(const Float8& a);
+#endif
+};
+
+// A texture with its full mip chain, sampled like OpenGL does with
+// GL_LINEAR / GL_LINEAR_MIPMAP_LINEAR and GL_CLAMP_TO_EDGE.
+class MipTexture{
+public:
+    // Build all mip levels from an image (2x2 box filter per level)
+    void Build(Image* image);
+    // Bilinear sample of one level, uv in [0,1], rgb in [0,1]
+    void SampleBilinear(int level, float u, float v, float* rgb) const;
+    // Trilinear sample, lod is log2 of the texels covered by one pixel
+    void SampleTrilinear(float u, float v, float lod, float* rgb) const;
+    // Size of the base level
+    int GetWidth() const { return mLevels.empty() ? 0 : mLevels[0].width; }
+    int GetHeight() const { return mLevels.empty() ? 0 : mLevels[0].height; }
+private:
+    struct Level{
+        int width;
+        int height;
+        std::vector<uint8_t> texels;
+    };
+    std::vector<Level> mLevels;
+};
+
+// Fragments shaded together, one lane per fragment (structure of arrays).
+// All vectors are in world space.
+struct FragmentBatch{
+    static const int kWidth = 8;
+    float positionX[kWidth], positionY[kWidth], positionZ[kWidth];
+    float tangentX[kWidth], tangentY[kWidth], tangentZ[kWidth];
+    float bitangentX[kWidth], bitangentY[kWidth], bitangentZ[kWidth];
+    float normalX[kWidth], normalY[kWidth], normalZ[kWidth];
+    // Sampled textures in [0,1]. Without a normal map use (0.5, 0.5, 1.0),
+    // which leaves the interpolated normal unchanged.
+    float albedoR[kWidth], albedoG[kWidth], albedoB[kWidth];
+    float normalMapX[kWidth], normalMapY[kWidth], normalMapZ[kWidth];
+};
+
+// Normal mapped Phong shading of shaders/frag.glsl for 8 fragments at once.
+// Writes 8 RGB results to rgb (24 bytes).
+void ShadeNormalMappedPhong(const FragmentBatch& batch, const glm::vec3& lightPosition,
+                            const glm::vec3& eyePosition, uint8_t* rgb);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef STATSOVERLAY_HPP
+#define STATSOVERLAY_HPP
+
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "GpuTimer.hpp"
+
+// Draws frame statistics as bars and a frame time graph on top of the scene.
+// All quads are collected into one vertex buffer and drawn with a single call.
+//
+// Rows from top to bottom: CPU frame, CPU submit, then every GPU pass in the
+// order the passes were first timed (same order as GpuTimer::GetSummary()).
+// Each row shows the average as a bar, min as a dark tick and p99 as a red tick.
+class StatsOverlay{
+public:
+    // Constructor
+    StatsOverlay();
+    // Create the shader and buffers, called after OpenGL has been setup
+    void Initialize();
+    // Draw the statistics collected by the timer
+    void Draw(const GpuTimer& timer, int screenWidth, int screenHeight);
+    // Delete the OpenGL objects
+    void Destroy();
+    // Program handle, exposed for shader hot-reload
+    GLuint mShaderID{0};
+private:
+    // Append two triangles covering a rectangle given in pixels
+    void AddQuad(float x, float y, float width, float height, const glm::vec4& color);
+    // Append one statistics row
+    void AddRow(int row, const RollingStats& stats, const glm::vec4& color);
+
+    GLuint mVAO{0};
+    GLuint mVBO{0};
+    // x, y, r, g, b, a per vertex
+    std::vector<GLfloat> mVertices;
+};
+
+#endif
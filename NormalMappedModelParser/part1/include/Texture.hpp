@@ -2,6 +2,7 @@
 #define TEXTURE_HPP
 
 #include "Image.hpp"
+#include "Memory.hpp"
 
 #include <glad/glad.h>
 #include <string>
@@ -14,15 +15,30 @@ public:
     ~Texture();
 	// Loads and sets up an actual texture
     void LoadTexture(const std::string filepath);
+    // Decode the image only, safe on any thread
+    void LoadImage(const std::string filepath);
+    // Create the OpenGL texture from the decoded image, on the thread with the context
+    void Upload();
     void Bind(unsigned int slot=0) const;
     void Unbind();
+    // Image data kept on the CPU, nullptr if no texture was loaded or it was dropped
+    Image* GetImage() const { return m_image; }
+    // Free the image once it is uploaded, the texture stays usable for OpenGL
+    void DropImage();
+    // Whether a texture was loaded, also after DropImage()
+    bool IsLoaded() const { return m_image != nullptr || m_textureID != 0; }
+    // CPU and GPU bytes of the texture
+    size_t GetBytes() const { return m_cpuMemory.Get() + m_gpuMemory.Get(); }
 private:
     // Store a unique ID for the texture
-    GLuint m_textureID;
+    GLuint m_textureID{0};
 	// Filepath to the image loaded
     std::string m_filepath;
     // Store image data inside our texture class.
-    Image* m_image;
+    Image* m_image{nullptr};
+    // Bytes of the image and of the OpenGL texture with its mipmaps
+    TrackedMemory m_cpuMemory{Memory::Category::TextureCpu};
+    TrackedMemory m_gpuMemory{Memory::Category::TextureGpu};
 };
 
 
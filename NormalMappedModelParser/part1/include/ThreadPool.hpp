@@ -0,0 +1,117 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+
+// The job system: a fixed set of worker threads that run jobs, shared by
+// loading, culling and the CPU renderers.
+//
+// Every thread owns a Chase-Lev deque. A thread pushes and pops its own jobs
+// at the bottom (last in, first out, so nested work stays in cache) and idle
+// threads steal from the top of a random other deque. A job counts itself and
+// its unfinished children, so Wait() on a parent is a fork-join: the waiting
+// thread runs other jobs until the counter drops to zero. Jobs marked for the
+// main thread (OpenGL calls) go to a separate queue that only thread 0 runs,
+// in Wait() and ProcessMainThreadJobs().
+//
+// Jobs live in a ring of kMaxJobsPerThread slots per creating thread instead
+// of being allocated one by one (std::function still allocates captures too
+// big for its inline buffer); a thread may have at most that many jobs in
+// flight. Only thread 0 (the thread that calls Initialize()) and the workers
+// may create, run and wait for jobs, and a worker must not wait for a job that
+// needs the main thread.
+class ThreadPool{
+public:
+    // Jobs in flight per creating thread, also the size of every deque
+    static const unsigned int kMaxJobsPerThread = 4096;
+    // ParallelFor() cuts a loop into about this many jobs per thread unless given a grain
+    static const unsigned int kJobsPerThread = 4;
+
+    // Opaque job handle, valid until the job has finished
+    struct Job;
+
+    // Counters of one thread since ResetStatistics()
+    struct ThreadStatistics{
+        size_t jobs{0};
+        // Jobs taken from another thread's deque
+        size_t steals{0};
+        // Time a worker spent without a job, spinning or asleep (not measured for thread 0)
+        double idleMilliseconds{0.0};
+    };
+
+    // Constructor, the pool runs jobs on the calling thread until Initialize()
+    ThreadPool();
+    // Destructor stops the workers
+    ~ThreadPool();
+    // Start the workers, 0 uses one thread per hardware thread
+    void Initialize(unsigned int threadCount);
+    // Number of threads that run jobs, including the calling thread
+    unsigned int GetThreadCount() const { return static_cast<unsigned int>(mThreads.size()) + 1; }
+    // Index of the calling thread in [0,GetThreadCount()), 0 for thread 0
+    unsigned int GetThreadIndex() const;
+
+    // Create a job; with a parent, the parent only finishes after this job
+    Job* CreateJob(std::function<void()> function, Job* parent = nullptr);
+    // Create a job that only runs on thread 0, e.g. for OpenGL calls
+    Job* CreateMainThreadJob(std::function<void()> function, Job* parent = nullptr);
+    // Queue a job; every created job must be run once
+    void Run(Job* job);
+    // Run other jobs until the job and all its children have finished
+    void Wait(Job* job);
+    // Run the jobs queued for the main thread, call on thread 0
+    void ProcessMainThreadJobs();
+
+    // Run job(index, threadIndex) for every index in [0,count) and wait for all of them.
+    // Indices are cut into ranges of grain items (0 picks one from the count), and the
+    // ranges are handed out by splitting in halves. May be called from inside a job.
+    void ParallelFor(size_t count, const std::function<void(size_t, unsigned int)>& job, size_t grain = 0);
+    // Stop and join the workers
+    void Shutdown();
+
+    // One entry per thread, thread 0 first
+    std::vector<ThreadStatistics> GetStatistics() const;
+    // Time since ResetStatistics(), the window of the idle times
+    double GetStatisticsMilliseconds() const;
+    void ResetStatistics();
+private:
+    struct ThreadData;
+
+    // Body of every worker
+    void WorkerThread(unsigned int threadIndex);
+    // A job from the main thread queue (thread 0 only), the own deque or another thread's deque
+    Job* FindJob(unsigned int threadIndex);
+    void Execute(Job* job, unsigned int threadIndex);
+    // Count the job as done, and its parents whose last child it was
+    void Finish(Job* job);
+    Job* AllocateJob();
+    // Hand out the upper halves of [begin,end) as jobs and run the rest
+    void RunRange(size_t begin, size_t end, size_t grain, const std::function<void(size_t, unsigned int)>* job, Job* parent);
+
+    std::vector<std::thread> mThreads;
+    std::vector<std::unique_ptr<ThreadData>> mThreadData;
+
+    // Workers sleep here when no deque has work
+    std::mutex mMutex;
+    std::condition_variable mWakeWorkers;
+    std::atomic<int> mQueuedJobs{0};
+    std::atomic<int> mSleepingWorkers{0};
+    std::atomic<bool> mRunning{false};
+
+    std::mutex mMainThreadMutex;
+    std::deque<Job*> mMainThreadJobs;
+    std::atomic<int> mMainThreadJobCount{0};
+
+    // Start of the statistics window in steady clock nanoseconds, read by the workers
+    std::atomic<int64_t> mStatisticsBegin{0};
+};
+
+#endif
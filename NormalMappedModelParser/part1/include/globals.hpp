@@ -8,11 +8,31 @@
 #endif
 
 #include <string>
+#include <vector>
 #include "Camera.hpp"
 #include "Object.hpp"
 #include "Texture.hpp"
 #include "Image.hpp"
 #include "Light.hpp"
+#include "ShaderCache.hpp"
+#include "ShaderReloader.hpp"
+#include "Headless.hpp"
+#include "CameraPath.hpp"
+#include "GpuTimer.hpp"
+#include "StatsOverlay.hpp"
+#include "ThreadPool.hpp"
+#include "SoftwareRasterizer.hpp"
+#include "PathTracer.hpp"
+#include "SceneGraph.hpp"
+#include "FrustumCuller.hpp"
+#include "OcclusionCuller.hpp"
+#include "ClusteredLights.hpp"
+#include "DeferredRenderer.hpp"
+#include "PostProcess.hpp"
+#include "FrameGraph.hpp"
+#include "CascadedShadows.hpp"
+#include "ImageBasedLighting.hpp"
+#include "AssetManager.hpp"
 
 
 struct Global{
@@ -25,8 +45,49 @@ struct Global{
 		// shader
 		GLuint gGraphicsPipelineShaderProgram	= 0;
 
+		// On-disk cache of linked shader programs
+		ShaderCache gShaderCache;
+		bool gShaderCacheEnabled = true;
+
+		// Rebuilds programs when a file in ./shaders changes
+		ShaderReloader gShaderReloader;
+
 		// Main loop flag
 		bool gQuit = false;
+
+		// Headless benchmark mode (--headless)
+		bool gHeadless = false;
+		HeadlessContext gHeadlessContext;
+		// Scripted camera path and how many frames to play it over
+		CameraPath gCameraPath;
+		std::string gCameraPathFile;
+		unsigned int gHeadlessFrames = 300;
+		// Write every n-th frame to a PPM (0 disables dumps)
+		unsigned int gDumpEveryNFrames = 0;
+		std::string gFrameTimesFile = "frame_times.csv";
+
+		// Chrome trace written on exit and when pressing P
+		std::string gProfileTraceFile = "profile_trace.json";
+
+		// GPU pass timings and the on-screen statistics (toggled with G)
+		GpuTimer gGpuTimer;
+		StatsOverlay gStatsOverlay;
+		bool gShowStats = false;
+		std::string gGpuTimesFile = "gpu_times.csv";
+
+		// CPU rendering without an OpenGL context (--software)
+		bool gSoftwareRenderer = false;
+		// Free the mesh arrays and images once they are uploaded (--drop-cpu-copies)
+		bool gDropCpuCopies = false;
+		unsigned int gThreadCount = 0;
+		ThreadPool gThreadPool;
+		SoftwareRasterizer gSoftwareRasterizer;
+		// Progressive CPU path tracing (--pathtrace), also sets gSoftwareRenderer
+		bool gPathTrace = false;
+		unsigned int gPathTraceSamples = 64;
+		unsigned int gSnapshotEveryNSamples = 0;
+		bool gPathTraceScaling = false;
+		PathTracer gPathTracer;
 		
 		bool gWireframeMode = false;
 
@@ -34,19 +95,57 @@ struct Global{
 		Camera gCamera;
 
 		// Texture
-		Texture gTexture;
-		Texture gNormalMap;
+		TextureHandle gTexture;
+		TextureHandle gNormalMap;
 
 		// Draw wireframe mode
 		GLenum gPolygonMode = GL_FILL;
 
-		// Object to render
-		Object* gObject = nullptr;
+		// Meshes and textures by content (--asset-budget), shared by all objects and materials
+		AssetManager gAssets;
+
+		// Objects to render, one per OBJ file on the command line; equal files share one object
+		std::vector<MeshHandle> gObjects;
 		
-		// OBJ file path
-		std::string objFilePath;
+		// OBJ file paths
+		std::vector<std::string> gObjFilePaths;
+
+		// Transforms of everything that is drawn. The objects hang below one
+		// root that is moved and rotated with the arrow keys.
+		SceneGraph gScene;
+		NodeHandle gSceneRoot = kInvalidNode;
+		// Rows and columns of copies of the objects (--grid)
+		unsigned int gSceneGrid = 1;
+
+		// Object chunks outside the view are not drawn (toggle with C, --no-culling)
+		FrustumCuller gFrustumCuller;
+		bool gFrustumCulling = true;
+		// Chunks hidden behind nearby objects are not drawn (toggle with O, --no-occlusion)
+		OcclusionCuller gOcclusionCuller;
+		bool gOcclusionCulling = true;
 
 		Light gLight;
+		// Cascaded shadow maps of the main light (--shadows [low|medium|high])
+		bool gShadows = false;
+		CascadedShadows::Quality gShadowQuality = CascadedShadows::Quality::Medium;
+		CascadedShadows gCascadedShadows;
+		// Physically based shading lit by the sky (--pbr), forward path only
+		bool gPbr = false;
+		ImageBasedLighting gImageBasedLighting;
+		// Random point lights around the scene (--lights), shaded per cluster
+		ClusteredLights gClusteredLights;
+		unsigned int gPointLightCount = 0;
+
+		// G-buffer and screen space lighting instead of forward shading (--deferred)
+		bool gDeferred = false;
+		DeferredRenderer gDeferredRenderer;
+
+		// Bloom, tonemapping, vignette and FXAA after the scene (--post, --no-merge)
+		bool gPostProcessing = false;
+		bool gPostMerge = true;
+		PostProcess gPostProcess;
+		// Passes and render targets of the frame, rebuilt every frame
+		FrameGraph gFrameGraph;
 		
 		float g_uOffset=-2.0f;
 		float g_uRotate=0.0f;
@@ -38,7 +38,17 @@ std::string LoadShaderAsString(const std::string& filename);
 GLuint CompileShader(GLuint type, const std::string& source);
 
 /**
-* Creates a graphics program object (i.e. graphics pipeline) with a Vertex Shader and a Fragment Shader
+* Compiles and links a graphics program object with a Vertex Shader and a Fragment Shader, bypassing the shader cache.
+*
+* @param vertexShaderSource Vertex source code as a string
+* @param fragmentShaderSource Fragment shader source code as a string
+* @return id of the program Object
+*/
+GLuint LinkShaderProgram(const std::string& vertexShaderSource, const std::string& fragmentShaderSource);
+
+/**
+* Creates a graphics program object (i.e. graphics pipeline) with a Vertex Shader and a Fragment Shader.
+* Uses a cached program binary when one is available for these sources.
 *
 * @param vertexShaderSource Vertex source code as a string
 * @param fragmentShaderSource Fragment shader source code as a string
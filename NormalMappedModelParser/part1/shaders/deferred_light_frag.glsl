@@ -0,0 +1,101 @@
+#version 410 core
+
+uniform sampler2D u_GAlbedo;
+uniform sampler2D u_GNormal;
+uniform sampler2D u_GDepth;
+uniform mat4 u_InverseViewProjection;
+uniform vec2 u_ScreenSize;
+uniform vec3 u_ViewPos;
+
+// Inverse of EncodeNormal() in gbuffer_frag.glsl
+vec3 DecodeNormal(vec2 encoded)
+{
+    encoded = encoded * 2.0 - 1.0;
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float t = clamp(-n.z, 0.0, 1.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+// World position of a pixel from its depth
+vec3 ReconstructPosition(vec2 uv, float depth)
+{
+    vec4 position = u_InverseViewProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    return position.xyz / position.w;
+}
+
+// Specular intensity and exponent packed into the albedo alpha
+vec2 UnpackSpecular(float packedSpecular)
+{
+    float value = floor(packedSpecular * 255.0 + 0.5);
+    float gloss = mod(value, 16.0);
+    return vec2(floor(value / 16.0) / 15.0, exp2(1.0 + 0.5 * gloss));
+}
+
+uniform vec3 u_LightPos;
+uniform vec3 u_BackgroundColor;
+// Camera view matrix, gives the view depth that selects the shadow cascade
+uniform mat4 u_ShadowCameraView;
+
+// Same shadow lookup as frag.glsl
+uniform sampler2DArrayShadow u_ShadowMap;
+uniform int u_ShadowsEnabled;
+uniform mat4 u_ShadowMatrices[4];
+uniform vec4 u_CascadeSplits;       // far distance of every cascade
+uniform vec4 u_CascadeTexelSizes;   // world size of a shadow map texel
+uniform int u_ShadowKernelRadius;
+
+// 1 where the main light reaches the point, 0 in full shadow
+float ShadowFactor(vec3 position, vec3 normal, float viewDepth)
+{
+    if (u_ShadowsEnabled == 0 || viewDepth > u_CascadeSplits.w) {
+        return 1.0;
+    }
+    int cascade = (viewDepth > u_CascadeSplits.x ? 1 : 0) + (viewDepth > u_CascadeSplits.y ? 1 : 0) +
+                  (viewDepth > u_CascadeSplits.z ? 1 : 0);
+    // Moving the point about a texel along the normal keeps surfaces from shadowing themselves
+    vec3 offsetPosition = position + normal * u_CascadeTexelSizes[cascade] * 1.5;
+    vec4 shadowPosition = u_ShadowMatrices[cascade] * vec4(offsetPosition, 1.0);
+    vec3 coords = shadowPosition.xyz / shadowPosition.w * 0.5 + 0.5;
+    vec2 texelSize = 1.0 / vec2(textureSize(u_ShadowMap, 0).xy);
+    float lit = 0.0;
+    for (int y = -u_ShadowKernelRadius; y <= u_ShadowKernelRadius; ++y) {
+        for (int x = -u_ShadowKernelRadius; x <= u_ShadowKernelRadius; ++x) {
+            lit += texture(u_ShadowMap, vec4(coords.xy + vec2(x, y) * texelSize, float(cascade), coords.z));
+        }
+    }
+    float taps = float(2 * u_ShadowKernelRadius + 1);
+    return lit / (taps * taps);
+}
+
+out vec4 color;
+
+void main()
+{
+    vec2 uv = gl_FragCoord.xy / u_ScreenSize;
+    float depth = texture(u_GDepth, uv).r;
+    // The target gets the scene depth so later passes can test against it
+    gl_FragDepth = depth;
+    if (depth >= 1.0) {
+        color = vec4(u_BackgroundColor, 1.0);
+        return;
+    }
+
+    vec4 albedoSpecular = texture(u_GAlbedo, uv);
+    vec3 albedo = albedoSpecular.rgb;
+    vec2 specular = UnpackSpecular(albedoSpecular.a);
+    vec3 normal = DecodeNormal(texture(u_GNormal, uv).rg);
+    vec3 position = ReconstructPosition(uv, depth);
+
+    // Same terms as the forward shader
+    vec3 lightDir = normalize(u_LightPos - position);
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 viewDir = normalize(u_ViewPos - position);
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), specular.y);
+
+    float viewDepth = -(u_ShadowCameraView * vec4(position, 1.0)).z;
+    float shadow = ShadowFactor(position, normal, viewDepth);
+    vec3 finalColor = 0.1 * albedo + shadow * (diff * albedo + spec * specular.x * vec3(1.0));
+    color = vec4(finalColor, 1.0);
+}
@@ -3,13 +3,132 @@
 in vec2 v_TexCoord;
 in vec3 v_FragPos;
 in mat3 v_TBN;
+in float v_ViewDepth;
 
 uniform sampler2D u_DiffuseTexture;
 uniform sampler2D u_NormalMap;
+uniform sampler2D u_SpecularMap;
+uniform int u_HasSpecularMap;
 
 uniform vec3 u_LightPos;
 uniform vec3 u_ViewPos;
 
+// Point lights binned into a grid over the view frustum (ClusteredLights)
+uniform samplerBuffer u_LightData;      // position and radius, then color
+uniform usamplerBuffer u_ClusterGrid;   // offset and count into u_LightIndices
+uniform usamplerBuffer u_LightIndices;
+uniform ivec3 u_ClusterCounts;
+uniform vec2 u_ClusterTileSize;
+uniform float u_ClusterDepthScale;
+uniform float u_ClusterDepthBias;
+
+// Cascaded shadow map of the main light (CascadedShadows)
+uniform sampler2DArrayShadow u_ShadowMap;
+uniform int u_ShadowsEnabled;
+uniform mat4 u_ShadowMatrices[4];
+uniform vec4 u_CascadeSplits;       // far distance of every cascade
+uniform vec4 u_CascadeTexelSizes;   // world size of a shadow map texel
+uniform int u_ShadowKernelRadius;
+
+// 1 where the main light reaches the point, 0 in full shadow
+float ShadowFactor(vec3 position, vec3 normal, float viewDepth)
+{
+    if (u_ShadowsEnabled == 0 || viewDepth > u_CascadeSplits.w) {
+        return 1.0;
+    }
+    int cascade = (viewDepth > u_CascadeSplits.x ? 1 : 0) + (viewDepth > u_CascadeSplits.y ? 1 : 0) +
+                  (viewDepth > u_CascadeSplits.z ? 1 : 0);
+    // Moving the point about a texel along the normal keeps surfaces from shadowing themselves
+    vec3 offsetPosition = position + normal * u_CascadeTexelSizes[cascade] * 1.5;
+    vec4 shadowPosition = u_ShadowMatrices[cascade] * vec4(offsetPosition, 1.0);
+    vec3 coords = shadowPosition.xyz / shadowPosition.w * 0.5 + 0.5;
+    vec2 texelSize = 1.0 / vec2(textureSize(u_ShadowMap, 0).xy);
+    float lit = 0.0;
+    for (int y = -u_ShadowKernelRadius; y <= u_ShadowKernelRadius; ++y) {
+        for (int x = -u_ShadowKernelRadius; x <= u_ShadowKernelRadius; ++x) {
+            lit += texture(u_ShadowMap, vec4(coords.xy + vec2(x, y) * texelSize, float(cascade), coords.z));
+        }
+    }
+    float taps = float(2 * u_ShadowKernelRadius + 1);
+    return lit / (taps * taps);
+}
+
+// Split-sum image based lighting of the physically based path (ImageBasedLighting)
+uniform int u_PbrEnabled;
+uniform sampler2D u_BrdfLut;                // F0 scale and bias over (NdotV, roughness)
+uniform samplerCube u_SpecularEnvironment;  // Sky prefiltered per roughness, one per mip
+uniform samplerCube u_IrradianceEnvironment;
+uniform float u_EnvironmentMaxLod;
+uniform float u_EnvironmentIntensity;
+
+const float PI = 3.14159265;
+
+// Offset and count of the point lights of this fragment's cluster in u_LightIndices
+uvec2 ClusterLightRange()
+{
+    ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy / u_ClusterTileSize),
+                          int(floor(log(max(v_ViewDepth, 1e-4)) * u_ClusterDepthScale - u_ClusterDepthBias)));
+    cluster = clamp(cluster, ivec3(0), u_ClusterCounts - 1);
+    int clusterIndex = cluster.x + u_ClusterCounts.x * (cluster.y + u_ClusterCounts.y * cluster.z);
+    return texelFetch(u_ClusterGrid, clusterIndex).rg;
+}
+
+// One light of unit strength: Lambert diffuse plus GGX specular with Smith visibility
+// and Schlick Fresnel. Scaled by pi, so the diffuse part matches the Phong path.
+vec3 LightPhysicallyBased(vec3 normal, vec3 viewDir, vec3 lightDir, vec3 albedo, vec3 F0, float roughness)
+{
+    float NdotL = max(dot(normal, lightDir), 0.0);
+    float NdotV = max(dot(normal, viewDir), 1e-4);
+    vec3 halfway = normalize(viewDir + lightDir);
+    float NdotH = max(dot(normal, halfway), 0.0);
+    float alpha = roughness * roughness;
+    float alpha2 = alpha * alpha;
+    float d = NdotH * NdotH * (alpha2 - 1.0) + 1.0;
+    float distribution = alpha2 / (PI * d * d);
+    float k = (roughness + 1.0) * (roughness + 1.0) / 8.0;
+    float visibility = 0.25 / ((NdotV * (1.0 - k) + k) * (NdotL * (1.0 - k) + k));
+    vec3 fresnel = F0 + (1.0 - F0) * pow(1.0 - max(dot(viewDir, halfway), 0.0), 5.0);
+    return ((1.0 - fresnel) * albedo + PI * distribution * visibility * fresnel) * NdotL;
+}
+
+// Physically based shading (--pbr) with a spec/gloss material from the specular map:
+// brighter texels reflect more at normal incidence and are glossier
+vec3 ShadePhysicallyBased(vec3 normal)
+{
+    vec3 albedo = texture(u_DiffuseTexture, v_TexCoord).rgb;
+    float specularMap = (u_HasSpecularMap != 0) ? texture(u_SpecularMap, v_TexCoord).r : 0.5;
+    vec3 F0 = vec3(mix(0.02, 0.08, specularMap));
+    float roughness = mix(0.9, 0.3, specularMap);
+    vec3 viewDir = normalize(u_ViewPos - v_FragPos);
+
+    // Main light, the only one that casts shadows
+    vec3 lightDir = normalize(u_LightPos - v_FragPos);
+    vec3 direct = LightPhysicallyBased(normal, viewDir, lightDir, albedo, F0, roughness) *
+                  ShadowFactor(v_FragPos, normalize(v_TBN[2]), v_ViewDepth);
+
+    uvec2 lightRange = ClusterLightRange();
+    for (uint i = 0u; i < lightRange.y; ++i) {
+        int light = int(texelFetch(u_LightIndices, int(lightRange.x + i)).r);
+        vec4 positionRadius = texelFetch(u_LightData, light * 2);
+        vec3 lightColor = texelFetch(u_LightData, light * 2 + 1).rgb;
+        vec3 toLight = positionRadius.xyz - v_FragPos;
+        float distanceSquared = dot(toLight, toLight);
+        float falloff = clamp(1.0 - distanceSquared / (positionRadius.w * positionRadius.w), 0.0, 1.0);
+        falloff *= falloff;
+        vec3 pointDir = toLight * inversesqrt(max(distanceSquared, 1e-8));
+        direct += falloff * lightColor * LightPhysicallyBased(normal, viewDir, pointDir, albedo, F0, roughness);
+    }
+
+    // Sky: irradiance for the diffuse part, prefiltered sky times the BRDF table for the specular part
+    float NdotV = max(dot(normal, viewDir), 1e-4);
+    vec3 fresnel = F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(1.0 - NdotV, 5.0);
+    vec2 brdf = texture(u_BrdfLut, vec2(NdotV, roughness)).rg;
+    vec3 prefiltered = textureLod(u_SpecularEnvironment, reflect(-viewDir, normal), roughness * u_EnvironmentMaxLod).rgb;
+    vec3 irradiance = texture(u_IrradianceEnvironment, normal).rgb;
+    vec3 ambient = (1.0 - fresnel) * albedo * irradiance + prefiltered * (F0 * brdf.x + brdf.y);
+    return direct + u_EnvironmentIntensity * ambient;
+}
+
 out vec4 color;
 
 void main()
@@ -19,6 +138,11 @@ void main()
     normal = normalize(normal * 2.0 - 1.0);
     normal = normalize(v_TBN * normal);
 
+    if (u_PbrEnabled != 0) {
+        color = vec4(ShadePhysicallyBased(normal), 1.0);
+        return;
+    }
+
     // Lighting calculations
     vec3 lightDir = normalize(u_LightPos - v_FragPos);
     float diff = max(dot(normal, lightDir), 0.0);
@@ -33,6 +157,29 @@ void main()
     vec3 diffuse = diff * texture(u_DiffuseTexture, v_TexCoord).rgb;
     vec3 specular = spec * vec3(1.0); // White specular highlight
 
+    // Only the main light casts shadows
+    float shadow = ShadowFactor(v_FragPos, normalize(v_TBN[2]), v_ViewDepth);
+    diffuse *= shadow;
+    specular *= shadow;
+
+    // Point lights of this fragment's cluster
+    uvec2 lightRange = ClusterLightRange();
+    for (uint i = 0u; i < lightRange.y; ++i) {
+        int light = int(texelFetch(u_LightIndices, int(lightRange.x + i)).r);
+        vec4 positionRadius = texelFetch(u_LightData, light * 2);
+        vec3 lightColor = texelFetch(u_LightData, light * 2 + 1).rgb;
+        vec3 toLight = positionRadius.xyz - v_FragPos;
+        float distanceSquared = dot(toLight, toLight);
+        // Smooth falloff that reaches zero at the radius
+        float falloff = clamp(1.0 - distanceSquared / (positionRadius.w * positionRadius.w), 0.0, 1.0);
+        falloff *= falloff;
+        vec3 pointDir = toLight * inversesqrt(max(distanceSquared, 1e-8));
+        float pointDiff = max(dot(normal, pointDir), 0.0);
+        float pointSpec = pow(max(dot(viewDir, reflect(-pointDir, normal)), 0.0), 32.0);
+        diffuse += falloff * pointDiff * lightColor * texture(u_DiffuseTexture, v_TexCoord).rgb;
+        specular += falloff * pointSpec * lightColor;
+    }
+
     vec3 finalColor = ambient + diffuse + specular;
 
     color = vec4(finalColor, 1.0);
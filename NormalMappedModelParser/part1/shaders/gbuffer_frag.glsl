@@ -0,0 +1,41 @@
+#version 410 core
+
+in vec2 v_TexCoord;
+in vec3 v_FragPos;
+in mat3 v_TBN;
+in float v_ViewDepth;
+
+uniform sampler2D u_DiffuseTexture;
+uniform sampler2D u_NormalMap;
+
+// Albedo with packed specular, and the octahedral normal (DeferredRenderer)
+layout(location = 0) out vec4 g_Albedo;
+layout(location = 1) out vec2 g_Normal;
+
+// Folds the lower hemisphere of the octahedron over the upper one
+vec2 OctahedronWrap(vec2 v)
+{
+    return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// Unit vector to [0,1]^2
+vec2 EncodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 encoded = n.z >= 0.0 ? n.xy : OctahedronWrap(n.xy);
+    return encoded * 0.5 + 0.5;
+}
+
+void main()
+{
+    // Same normal as the forward shader
+    vec3 normal = texture(u_NormalMap, v_TexCoord).rgb;
+    normal = normalize(normal * 2.0 - 1.0);
+    normal = normalize(v_TBN * normal);
+
+    // Specular intensity 1 (15 of 15) and gloss 8, an exponent of exp2(1 + 0.5 * 8) = 32
+    float specularIntensity = 15.0;
+    float gloss = 8.0;
+    g_Albedo = vec4(texture(u_DiffuseTexture, v_TexCoord).rgb, (specularIntensity * 16.0 + gloss) / 255.0);
+    g_Normal = EncodeNormal(normal);
+}
@@ -0,0 +1,67 @@
+#version 410 core
+
+flat in vec4 v_LightPositionRadius;
+flat in vec3 v_LightColor;
+
+uniform sampler2D u_GAlbedo;
+uniform sampler2D u_GNormal;
+uniform sampler2D u_GDepth;
+uniform mat4 u_InverseViewProjection;
+uniform vec2 u_ScreenSize;
+uniform vec3 u_ViewPos;
+
+// Inverse of EncodeNormal() in gbuffer_frag.glsl
+vec3 DecodeNormal(vec2 encoded)
+{
+    encoded = encoded * 2.0 - 1.0;
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float t = clamp(-n.z, 0.0, 1.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+// World position of a pixel from its depth
+vec3 ReconstructPosition(vec2 uv, float depth)
+{
+    vec4 position = u_InverseViewProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    return position.xyz / position.w;
+}
+
+// Specular intensity and exponent packed into the albedo alpha
+vec2 UnpackSpecular(float packedSpecular)
+{
+    float value = floor(packedSpecular * 255.0 + 0.5);
+    float gloss = mod(value, 16.0);
+    return vec2(floor(value / 16.0) / 15.0, exp2(1.0 + 0.5 * gloss));
+}
+
+out vec4 color;
+
+void main()
+{
+    vec2 uv = gl_FragCoord.xy / u_ScreenSize;
+    float depth = texture(u_GDepth, uv).r;
+    if (depth >= 1.0) {
+        discard;
+    }
+    vec3 position = ReconstructPosition(uv, depth);
+    vec3 toLight = v_LightPositionRadius.xyz - position;
+    float distanceSquared = dot(toLight, toLight);
+    float radiusSquared = v_LightPositionRadius.w * v_LightPositionRadius.w;
+    if (distanceSquared >= radiusSquared) {
+        discard;
+    }
+
+    vec4 albedoSpecular = texture(u_GAlbedo, uv);
+    vec2 specular = UnpackSpecular(albedoSpecular.a);
+    vec3 normal = DecodeNormal(texture(u_GNormal, uv).rg);
+    vec3 viewDir = normalize(u_ViewPos - position);
+
+    // Same falloff and terms as the clustered lights of the forward shader
+    float falloff = 1.0 - distanceSquared / radiusSquared;
+    falloff *= falloff;
+    vec3 pointDir = toLight * inversesqrt(max(distanceSquared, 1e-8));
+    float pointDiff = max(dot(normal, pointDir), 0.0);
+    float pointSpec = pow(max(dot(viewDir, reflect(-pointDir, normal)), 0.0), specular.y);
+    color = vec4(falloff * (pointDiff * albedoSpecular.rgb + pointSpec * specular.x) * v_LightColor, 1.0);
+}
@@ -0,0 +1,20 @@
+#version 410 core
+
+layout(location = 0) in vec3 aPos;
+// Per light instance
+layout(location = 1) in vec4 aLightPositionRadius;
+layout(location = 2) in vec4 aLightColor;
+
+uniform mat4 u_ViewProjection;
+
+flat out vec4 v_LightPositionRadius;
+flat out vec3 v_LightColor;
+
+void main()
+{
+    // The sphere mesh encloses the unit sphere
+    vec3 worldPos = aLightPositionRadius.xyz + aPos * aLightPositionRadius.w;
+    gl_Position = u_ViewProjection * vec4(worldPos, 1.0);
+    v_LightPositionRadius = aLightPositionRadius;
+    v_LightColor = aLightColor.rgb;
+}
@@ -0,0 +1,17 @@
+#version 410 core
+
+layout(location = 0) in vec2 aPosition;
+layout(location = 1) in vec4 aColor;
+
+// Size of the framebuffer in pixels
+uniform vec2 u_ScreenSize;
+
+out vec4 v_Color;
+
+void main()
+{
+    // Positions are given in pixels with the origin in the top left corner
+    vec2 ndc = (aPosition / u_ScreenSize) * 2.0 - 1.0;
+    gl_Position = vec4(ndc.x, -ndc.y, 0.0, 1.0);
+    v_Color = aColor;
+}
@@ -0,0 +1,25 @@
+#version 410 core
+
+in vec2 v_UV;
+out vec4 fragColor;
+
+uniform sampler2D u_Input;
+// Size of one texel of u_Input
+uniform vec2 u_TexelSize;
+// (1, 0) for the horizontal and (0, 1) for the vertical pass
+uniform vec2 u_Direction;
+
+// 9 tap Gaussian folded into 5 bilinear taps
+const float kOffsets[3] = float[](0.0, 1.3846153846, 3.2307692308);
+const float kWeights[3] = float[](0.2270270270, 0.3162162162, 0.0702702703);
+
+void main()
+{
+    vec2 step = u_Direction * u_TexelSize;
+    vec3 color = texture(u_Input, v_UV).rgb * kWeights[0];
+    for (int i = 1; i < 3; ++i) {
+        color += texture(u_Input, v_UV + step * kOffsets[i]).rgb * kWeights[i];
+        color += texture(u_Input, v_UV - step * kOffsets[i]).rgb * kWeights[i];
+    }
+    fragColor = vec4(color, 1.0);
+}
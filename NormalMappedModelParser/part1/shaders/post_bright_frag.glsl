@@ -0,0 +1,28 @@
+#version 410 core
+
+in vec2 v_UV;
+out vec4 fragColor;
+
+uniform sampler2D u_Scene;
+// Size of one texel of u_Scene
+uniform vec2 u_TexelSize;
+// Luminance where bloom starts and the width of the soft knee
+uniform float u_Threshold;
+uniform float u_Knee;
+
+// Half resolution: averages 4 bilinear taps (16 scene texels) and keeps the bright part
+void main()
+{
+    vec2 offset = u_TexelSize;
+    vec3 color = texture(u_Scene, v_UV + vec2(-offset.x, -offset.y)).rgb;
+    color += texture(u_Scene, v_UV + vec2(offset.x, -offset.y)).rgb;
+    color += texture(u_Scene, v_UV + vec2(-offset.x, offset.y)).rgb;
+    color += texture(u_Scene, v_UV + vec2(offset.x, offset.y)).rgb;
+    color *= 0.25;
+
+    float brightness = max(color.r, max(color.g, color.b));
+    float soft = clamp(brightness - u_Threshold + u_Knee, 0.0, 2.0 * u_Knee);
+    soft = soft * soft / (4.0 * u_Knee + 1e-4);
+    float contribution = max(soft, brightness - u_Threshold) / max(brightness, 1e-4);
+    fragColor = vec4(color * contribution, 1.0);
+}
@@ -0,0 +1,19 @@
+#version 410 core
+
+in vec2 v_UV;
+out vec4 fragColor;
+
+uniform sampler2D u_Input;
+// Size of one texel of u_Input
+uniform vec2 u_TexelSize;
+
+// Halves the resolution with 4 bilinear taps
+void main()
+{
+    vec2 offset = u_TexelSize;
+    vec3 color = texture(u_Input, v_UV + vec2(-offset.x, -offset.y)).rgb;
+    color += texture(u_Input, v_UV + vec2(offset.x, -offset.y)).rgb;
+    color += texture(u_Input, v_UV + vec2(-offset.x, offset.y)).rgb;
+    color += texture(u_Input, v_UV + vec2(offset.x, offset.y)).rgb;
+    fragColor = vec4(color * 0.25, 1.0);
+}
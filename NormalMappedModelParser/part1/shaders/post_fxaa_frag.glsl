@@ -0,0 +1,42 @@
+#version 410 core
+
+in vec2 v_UV;
+out vec4 fragColor;
+
+uniform sampler2D u_Input;
+// Size of one texel of u_Input
+uniform vec2 u_TexelSize;
+
+const float kReduceMin = 1.0 / 128.0;
+const float kReduceMul = 1.0 / 8.0;
+const float kSpanMax = 8.0;
+
+float Luma(vec3 color)
+{
+    return dot(color, vec3(0.299, 0.587, 0.114));
+}
+
+// FXAA in the spirit of Lottes' console version: blurs along the edge found from the luma gradient
+void main()
+{
+    vec3 colorM = texture(u_Input, v_UV).rgb;
+    float lumaNW = Luma(texture(u_Input, v_UV + vec2(-1.0, -1.0) * u_TexelSize).rgb);
+    float lumaNE = Luma(texture(u_Input, v_UV + vec2(1.0, -1.0) * u_TexelSize).rgb);
+    float lumaSW = Luma(texture(u_Input, v_UV + vec2(-1.0, 1.0) * u_TexelSize).rgb);
+    float lumaSE = Luma(texture(u_Input, v_UV + vec2(1.0, 1.0) * u_TexelSize).rgb);
+    float lumaM = Luma(colorM);
+    float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));
+    float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));
+
+    vec2 direction = vec2(-((lumaNW + lumaNE) - (lumaSW + lumaSE)), (lumaNW + lumaSW) - (lumaNE + lumaSE));
+    float reduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * 0.25 * kReduceMul, kReduceMin);
+    float scale = 1.0 / (min(abs(direction.x), abs(direction.y)) + reduce);
+    direction = clamp(direction * scale, vec2(-kSpanMax), vec2(kSpanMax)) * u_TexelSize;
+
+    vec3 colorA = 0.5 * (texture(u_Input, v_UV + direction * (1.0 / 3.0 - 0.5)).rgb +
+                         texture(u_Input, v_UV + direction * (2.0 / 3.0 - 0.5)).rgb);
+    vec3 colorB = colorA * 0.5 + 0.25 * (texture(u_Input, v_UV - direction * 0.5).rgb +
+                                         texture(u_Input, v_UV + direction * 0.5).rgb);
+    float lumaB = Luma(colorB);
+    fragColor = vec4((lumaB < lumaMin || lumaB > lumaMax) ? colorA : colorB, 1.0);
+}
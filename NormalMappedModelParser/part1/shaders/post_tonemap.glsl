@@ -0,0 +1,13 @@
+// Pointwise pass, combined with its neighbours into one shader by PostProcess
+
+uniform sampler2D u_Bloom;
+uniform float u_Exposure;
+uniform float u_BloomStrength;
+
+// Adds the bloom and maps HDR to [0, 1] with the ACES fit of Narkowicz, then gamma
+vec4 Tonemap(vec4 color, vec2 uv)
+{
+    vec3 hdr = (color.rgb + texture(u_Bloom, uv).rgb * u_BloomStrength) * u_Exposure;
+    vec3 mapped = clamp((hdr * (2.51 * hdr + 0.03)) / (hdr * (2.43 * hdr + 0.59) + 0.14), 0.0, 1.0);
+    return vec4(pow(mapped, vec3(1.0 / 2.2)), 1.0);
+}
@@ -0,0 +1,11 @@
+#version 410 core
+
+out vec2 v_UV;
+
+// One triangle that covers the target, no vertex buffer needed
+void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    v_UV = corner;
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,11 @@
+// Pointwise pass, combined with its neighbours into one shader by PostProcess
+
+uniform float u_VignetteStrength;
+
+// Darkens the corners
+vec4 Vignette(vec4 color, vec2 uv)
+{
+    vec2 centered = uv - 0.5;
+    float falloff = 1.0 - u_VignetteStrength * dot(centered, centered) * 2.0;
+    return vec4(color.rgb * clamp(falloff, 0.0, 1.0), color.a);
+}
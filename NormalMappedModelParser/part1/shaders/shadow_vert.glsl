@@ -0,0 +1,12 @@
+#version 410 core
+
+layout(location = 0) in vec3 aPos;
+
+uniform mat4 u_ModelMatrix;
+uniform mat4 u_LightViewProjection;
+
+// Depth only, the cascade projection comes from CascadedShadows
+void main()
+{
+    gl_Position = u_LightViewProjection * u_ModelMatrix * vec4(aPos, 1.0);
+}
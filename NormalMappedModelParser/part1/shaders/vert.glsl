@@ -13,12 +13,16 @@ uniform mat4 u_Projection;
 out vec2 v_TexCoord;
 out vec3 v_FragPos;
 out mat3 v_TBN;
+out float v_ViewDepth;
 
 void main()
 {
     // Transform position
     vec4 worldPos = u_ModelMatrix * vec4(aPos, 1.0);
-    gl_Position = u_Projection * u_ViewMatrix * worldPos;
+    vec4 viewPos = u_ViewMatrix * worldPos;
+    gl_Position = u_Projection * viewPos;
+    // Distance along the view direction, selects the depth slice of the light clusters
+    v_ViewDepth = -viewPos.z;
 
     // Pass texture coordinates
     v_TexCoord = aTexCoord;
@@ -0,0 +1,188 @@
+#include "AssetManager.hpp"
+#include "Object.hpp"
+#include "Texture.hpp"
+#include "Profiler.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+
+
+/**
+ * @brief 64-bit FNV-1a over the bytes of the file, read in blocks.
+ */
+AssetManager::Hash AssetManager::HashFile(const std::string& filepath){
+    PROFILE_SCOPE("HashFile");
+    std::ifstream file(filepath, std::ios::binary);
+    if (!file.is_open()) {
+        return 0;
+    }
+    Hash hash = 14695981039346656037ull;
+    std::vector<char> buffer(64 * 1024);
+    while (file) {
+        file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        std::streamsize count = file.gcount();
+        for (std::streamsize i = 0; i < count; ++i) {
+            hash ^= static_cast<unsigned char>(buffer[i]);
+            hash *= 1099511628211ull;
+        }
+    }
+    // 0 stands for a missing file
+    return hash != 0 ? hash : 1;
+}
+
+
+MeshHandle AssetManager::FindMesh(Hash hash){
+    std::lock_guard<std::mutex> lock(mMutex);
+    ++mRequests;
+    EntryMap::iterator found = mMeshes.find(hash);
+    if (hash == 0 || found == mMeshes.end()) {
+        return nullptr;
+    }
+    ++mHits;
+    ++found->second->hits;
+    found->second->lastUse = ++mClock;
+    return found->second->mesh;
+}
+
+
+void AssetManager::AddMesh(Hash hash, const MeshHandle& mesh){
+    if (hash == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::shared_ptr<Entry>& entry = mMeshes[hash];
+    if (entry == nullptr) {
+        entry = std::make_shared<Entry>();
+        entry->mesh = mesh;
+    }
+    entry->lastUse = ++mClock;
+}
+
+
+/**
+ * @brief Returns the cached texture of the file content, decoding it on the first request.
+ *
+ * A file that cannot be read gets a texture of its own that is not cached,
+ * so the error is reported like before.
+ */
+TextureHandle AssetManager::AcquireTexture(const std::string& filepath){
+    Hash hash = HashFile(filepath);
+    if (hash == 0) {
+        TextureHandle texture = std::make_shared<Texture>();
+        texture->LoadImage(filepath);
+        return texture;
+    }
+
+    std::shared_ptr<Entry> entry;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        ++mRequests;
+        std::shared_ptr<Entry>& slot = mTextures[hash];
+        if (slot != nullptr) {
+            ++mHits;
+            ++slot->hits;
+        } else {
+            slot = std::make_shared<Entry>();
+            slot->texture = std::make_shared<Texture>();
+            slot->filepath = filepath;
+        }
+        slot->lastUse = ++mClock;
+        entry = slot;
+    }
+    // The first caller decodes, callers at the same time wait for it
+    std::call_once(entry->decoded, [&entry]{ entry->texture->LoadImage(entry->filepath); });
+    return entry->texture;
+}
+
+
+/**
+ * @brief Evicts the least recently used unused asset until the cache fits the budget or nothing unused is left.
+ *
+ * Evicting a mesh can leave its textures unused, so they are candidates in
+ * the next round.
+ */
+void AssetManager::Trim(){
+    PROFILE_SCOPE("AssetManager::Trim");
+    std::lock_guard<std::mutex> lock(mMutex);
+    size_t bytes = 0;
+    for (const EntryMap* entries : {&mMeshes, &mTextures}) {
+        for (const auto& entry : *entries) {
+            bytes += GetBytes(*entry.second);
+        }
+    }
+    while (bytes > mBudget) {
+        EntryMap* oldestMap = nullptr;
+        EntryMap::iterator oldest;
+        for (EntryMap* entries : {&mMeshes, &mTextures}) {
+            for (EntryMap::iterator entry = entries->begin(); entry != entries->end(); ++entry) {
+                if (IsUnused(*entry->second) && (oldestMap == nullptr || entry->second->lastUse < oldest->second->lastUse)) {
+                    oldestMap = entries;
+                    oldest = entry;
+                }
+            }
+        }
+        if (oldestMap == nullptr) {
+            break;
+        }
+        size_t entryBytes = GetBytes(*oldest->second);
+        bytes -= entryBytes;
+        mEvictedBytes += entryBytes;
+        ++mEvictions;
+        oldestMap->erase(oldest);
+    }
+}
+
+
+void AssetManager::Clear(){
+    std::lock_guard<std::mutex> lock(mMutex);
+    // Meshes first, they hold textures
+    mMeshes.clear();
+    mTextures.clear();
+}
+
+
+AssetManager::Statistics AssetManager::GetStatistics() const{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Statistics statistics;
+    statistics.meshes = mMeshes.size();
+    statistics.textures = mTextures.size();
+    statistics.requests = mRequests;
+    statistics.hits = mHits;
+    statistics.evictions = mEvictions;
+    statistics.evictedBytes = mEvictedBytes;
+    for (const EntryMap* entries : {&mMeshes, &mTextures}) {
+        for (const auto& entry : *entries) {
+            size_t bytes = GetBytes(*entry.second);
+            statistics.bytes += bytes;
+            statistics.bytesSaved += entry.second->hits * bytes;
+        }
+    }
+    return statistics;
+}
+
+
+void AssetManager::PrintStatistics() const{
+    Statistics statistics = GetStatistics();
+    const double megabyte = 1024.0 * 1024.0;
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(2)
+       << "Assets: " << statistics.meshes << " meshes and " << statistics.textures << " textures cached in "
+       << statistics.bytes / megabyte << " MB, " << statistics.hits << " of " << statistics.requests << " requests hit ("
+       << (statistics.requests > 0 ? 100.0 * statistics.hits / statistics.requests : 0.0) << "%), "
+       << statistics.bytesSaved / megabyte << " MB not loaded twice, " << statistics.evictions << " evicted ("
+       << statistics.evictedBytes / megabyte << " MB)";
+    std::cout << ss.str() << std::endl;
+}
+
+
+size_t AssetManager::GetBytes(const Entry& entry){
+    return entry.mesh != nullptr ? entry.mesh->GetBytes() : entry.texture->GetBytes();
+}
+
+
+bool AssetManager::IsUnused(const Entry& entry){
+    return entry.mesh != nullptr ? entry.mesh.use_count() == 1 : entry.texture.use_count() == 1;
+}
@@ -0,0 +1,326 @@
+#include "Bvh.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cfloat>
+
+static const int kBins = 16;
+// Traversal stack; Subdivide() limits the depth so that it never overflows
+static const int kStackSize = 64;
+
+// Surface area of a box, used by the SAH
+static float Area(const glm::vec3& boundsMin, const glm::vec3& boundsMax){
+    glm::vec3 extent = boundsMax - boundsMin;
+    return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+
+/**
+ * @brief Builds the hierarchy.
+ *
+ * @param corners Three corners per triangle, hits report the index of the triangle in this list.
+ */
+void Bvh::Build(const std::vector<glm::vec3>& corners){
+    PROFILE_SCOPE("Bvh::Build");
+    size_t triangleCount = corners.size() / 3;
+    mNodes.clear();
+    mTriangles.resize(triangleCount);
+    mTriangleIndices.resize(triangleCount);
+    std::vector<glm::vec3> centroids(triangleCount);
+    for (size_t i = 0; i < triangleCount; ++i) {
+        const glm::vec3& v0 = corners[i * 3];
+        const glm::vec3& v1 = corners[i * 3 + 1];
+        const glm::vec3& v2 = corners[i * 3 + 2];
+        mTriangles[i] = {v0, v1 - v0, v2 - v0};
+        mTriangleIndices[i] = static_cast<uint32_t>(i);
+        centroids[i] = (v0 + v1 + v2) * (1.0f / 3.0f);
+    }
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // A binary tree over n leaves has at most 2n - 1 nodes
+    mNodes.reserve(triangleCount * 2);
+    Node root;
+    root.leftFirst = 0;
+    root.count = static_cast<uint32_t>(triangleCount);
+    mNodes.push_back(root);
+    UpdateBounds(0);
+    Subdivide(0, 0, centroids);
+
+    // Store the triangles in leaf order so a leaf reads consecutive memory
+    std::vector<BuildTriangle> ordered(triangleCount);
+    for (size_t i = 0; i < triangleCount; ++i) {
+        ordered[i] = mTriangles[mTriangleIndices[i]];
+    }
+    mTriangles.swap(ordered);
+}
+
+
+void Bvh::UpdateBounds(uint32_t nodeIndex){
+    Node& node = mNodes[nodeIndex];
+    node.boundsMin = glm::vec3(FLT_MAX);
+    node.boundsMax = glm::vec3(-FLT_MAX);
+    for (uint32_t i = 0; i < node.count; ++i) {
+        const BuildTriangle& triangle = mTriangles[mTriangleIndices[node.leftFirst + i]];
+        glm::vec3 v1 = triangle.v0 + triangle.edge1;
+        glm::vec3 v2 = triangle.v0 + triangle.edge2;
+        node.boundsMin = glm::min(node.boundsMin, glm::min(triangle.v0, glm::min(v1, v2)));
+        node.boundsMax = glm::max(node.boundsMax, glm::max(triangle.v0, glm::max(v1, v2)));
+    }
+}
+
+
+/**
+ * @brief Splits a node where the binned surface area heuristic is lowest.
+ *
+ * Stays a leaf if no split is cheaper than intersecting all of its triangles.
+ * Nodes at depth kStackSize - 2 stay leaves as well: Intersect() keeps at most
+ * one node per level on its stack and Occluded() one more, so a lopsided mesh
+ * gets a few large leaves instead of nodes that traversal cannot reach.
+ */
+void Bvh::Subdivide(uint32_t nodeIndex, int depth, const std::vector<glm::vec3>& centroids){
+    uint32_t first = mNodes[nodeIndex].leftFirst;
+    uint32_t count = mNodes[nodeIndex].count;
+    if (count <= 2 || depth >= kStackSize - 2) {
+        return;
+    }
+
+    glm::vec3 centroidMin(FLT_MAX);
+    glm::vec3 centroidMax(-FLT_MAX);
+    for (uint32_t i = 0; i < count; ++i) {
+        centroidMin = glm::min(centroidMin, centroids[mTriangleIndices[first + i]]);
+        centroidMax = glm::max(centroidMax, centroids[mTriangleIndices[first + i]]);
+    }
+
+    int bestAxis = -1;
+    int bestSplit = 0;
+    float bestCost = count * Area(mNodes[nodeIndex].boundsMin, mNodes[nodeIndex].boundsMax);
+    for (int axis = 0; axis < 3; ++axis) {
+        float extent = centroidMax[axis] - centroidMin[axis];
+        if (extent <= 0.0f) {
+            continue;
+        }
+        float scale = kBins / extent;
+
+        uint32_t binCount[kBins] = {0};
+        glm::vec3 binMin[kBins];
+        glm::vec3 binMax[kBins];
+        std::fill(binMin, binMin + kBins, glm::vec3(FLT_MAX));
+        std::fill(binMax, binMax + kBins, glm::vec3(-FLT_MAX));
+        for (uint32_t i = 0; i < count; ++i) {
+            uint32_t index = mTriangleIndices[first + i];
+            int bin = std::min(kBins - 1, static_cast<int>((centroids[index][axis] - centroidMin[axis]) * scale));
+            const BuildTriangle& triangle = mTriangles[index];
+            glm::vec3 v1 = triangle.v0 + triangle.edge1;
+            glm::vec3 v2 = triangle.v0 + triangle.edge2;
+            ++binCount[bin];
+            binMin[bin] = glm::min(binMin[bin], glm::min(triangle.v0, glm::min(v1, v2)));
+            binMax[bin] = glm::max(binMax[bin], glm::max(triangle.v0, glm::max(v1, v2)));
+        }
+
+        // Sweep from both sides to get the cost of every split plane
+        float leftArea[kBins - 1], rightArea[kBins - 1];
+        uint32_t leftCount[kBins - 1], rightCount[kBins - 1];
+        glm::vec3 leftMin(FLT_MAX), leftMax(-FLT_MAX), rightMin(FLT_MAX), rightMax(-FLT_MAX);
+        uint32_t leftSum = 0, rightSum = 0;
+        for (int i = 0; i < kBins - 1; ++i) {
+            leftSum += binCount[i];
+            leftCount[i] = leftSum;
+            if (binCount[i] > 0) {
+                leftMin = glm::min(leftMin, binMin[i]);
+                leftMax = glm::max(leftMax, binMax[i]);
+            }
+            leftArea[i] = leftSum > 0 ? Area(leftMin, leftMax) : 0.0f;
+
+            int j = kBins - 1 - i;
+            rightSum += binCount[j];
+            rightCount[j - 1] = rightSum;
+            if (binCount[j] > 0) {
+                rightMin = glm::min(rightMin, binMin[j]);
+                rightMax = glm::max(rightMax, binMax[j]);
+            }
+            rightArea[j - 1] = rightSum > 0 ? Area(rightMin, rightMax) : 0.0f;
+        }
+        for (int i = 0; i < kBins - 1; ++i) {
+            float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+            if (leftCount[i] > 0 && rightCount[i] > 0 && cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = i;
+            }
+        }
+    }
+    if (bestAxis < 0) {
+        return;
+    }
+
+    // Partition the triangle indices around the chosen plane
+    float scale = kBins / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+    uint32_t* begin = &mTriangleIndices[first];
+    uint32_t* middle = std::partition(begin, begin + count, [&](uint32_t index){
+        int bin = std::min(kBins - 1, static_cast<int>((centroids[index][bestAxis] - centroidMin[bestAxis]) * scale));
+        return bin <= bestSplit;
+    });
+    uint32_t leftCount = static_cast<uint32_t>(middle - begin);
+    if (leftCount == 0 || leftCount == count) {
+        return;
+    }
+
+    uint32_t leftIndex = static_cast<uint32_t>(mNodes.size());
+    Node left, right;
+    left.leftFirst = first;
+    left.count = leftCount;
+    right.leftFirst = first + leftCount;
+    right.count = count - leftCount;
+    mNodes.push_back(left);
+    mNodes.push_back(right);
+    mNodes[nodeIndex].leftFirst = leftIndex;
+    mNodes[nodeIndex].count = 0;
+
+    UpdateBounds(leftIndex);
+    UpdateBounds(leftIndex + 1);
+    Subdivide(leftIndex, depth + 1, centroids);
+    Subdivide(leftIndex + 1, depth + 1, centroids);
+}
+
+
+float Bvh::IntersectBounds(const Ray& ray, const Node& node, float maxDistance){
+    glm::vec3 t0 = (node.boundsMin - ray.origin) * ray.inverseDirection;
+    glm::vec3 t1 = (node.boundsMax - ray.origin) * ray.inverseDirection;
+    glm::vec3 tNear = glm::min(t0, t1);
+    glm::vec3 tFar = glm::max(t0, t1);
+    float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+    float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+    return (enter <= exit) ? enter : FLT_MAX;
+}
+
+
+/**
+ * @brief Finds the closest triangle along a ray (single ray, nearest child first).
+ */
+bool Bvh::Intersect(const Ray& ray, Hit& hit) const{
+    if (mNodes.empty()) {
+        return false;
+    }
+    hit.distance = ray.maxDistance;
+    bool found = false;
+
+    uint32_t stack[kStackSize];
+    int stackSize = 0;
+    uint32_t nodeIndex = 0;
+    if (IntersectBounds(ray, mNodes[0], hit.distance) == FLT_MAX) {
+        return false;
+    }
+    while (true) {
+        const Node& node = mNodes[nodeIndex];
+        if (node.count > 0) {
+            // Moeller-Trumbore against every triangle of the leaf
+            for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+                const BuildTriangle& triangle = mTriangles[i];
+                glm::vec3 p = glm::cross(ray.direction, triangle.edge2);
+                float determinant = glm::dot(triangle.edge1, p);
+                if (std::abs(determinant) < 1e-12f) {
+                    continue;
+                }
+                float inverseDeterminant = 1.0f / determinant;
+                glm::vec3 s = ray.origin - triangle.v0;
+                float u = glm::dot(s, p) * inverseDeterminant;
+                if (u < 0.0f || u > 1.0f) {
+                    continue;
+                }
+                glm::vec3 q = glm::cross(s, triangle.edge1);
+                float v = glm::dot(ray.direction, q) * inverseDeterminant;
+                if (v < 0.0f || u + v > 1.0f) {
+                    continue;
+                }
+                float t = glm::dot(triangle.edge2, q) * inverseDeterminant;
+                if (t > 1e-4f && t < hit.distance) {
+                    hit.distance = t;
+                    hit.u = u;
+                    hit.v = v;
+                    hit.triangle = mTriangleIndices[i];
+                    found = true;
+                }
+            }
+        } else {
+            uint32_t near = node.leftFirst;
+            uint32_t far = node.leftFirst + 1;
+            float nearDistance = IntersectBounds(ray, mNodes[near], hit.distance);
+            float farDistance = IntersectBounds(ray, mNodes[far], hit.distance);
+            if (farDistance < nearDistance) {
+                std::swap(near, far);
+                std::swap(nearDistance, farDistance);
+            }
+            if (nearDistance != FLT_MAX) {
+                if (farDistance != FLT_MAX) {
+                    stack[stackSize++] = far;
+                }
+                nodeIndex = near;
+                continue;
+            }
+        }
+
+        // Pop the next node that is still closer than the best hit
+        bool next = false;
+        while (stackSize > 0) {
+            nodeIndex = stack[--stackSize];
+            if (IntersectBounds(ray, mNodes[nodeIndex], hit.distance) != FLT_MAX) {
+                next = true;
+                break;
+            }
+        }
+        if (!next) {
+            break;
+        }
+    }
+    return found;
+}
+
+
+/**
+ * @brief Any hit test, stops at the first triangle closer than ray.maxDistance.
+ */
+bool Bvh::Occluded(const Ray& ray) const{
+    if (mNodes.empty()) {
+        return false;
+    }
+    uint32_t stack[kStackSize];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        const Node& node = mNodes[stack[--stackSize]];
+        if (IntersectBounds(ray, node, ray.maxDistance) == FLT_MAX) {
+            continue;
+        }
+        if (node.count == 0) {
+            stack[stackSize++] = node.leftFirst;
+            stack[stackSize++] = node.leftFirst + 1;
+            continue;
+        }
+        for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+            const BuildTriangle& triangle = mTriangles[i];
+            glm::vec3 p = glm::cross(ray.direction, triangle.edge2);
+            float determinant = glm::dot(triangle.edge1, p);
+            if (std::abs(determinant) < 1e-12f) {
+                continue;
+            }
+            float inverseDeterminant = 1.0f / determinant;
+            glm::vec3 s = ray.origin - triangle.v0;
+            float u = glm::dot(s, p) * inverseDeterminant;
+            if (u < 0.0f || u > 1.0f) {
+                continue;
+            }
+            glm::vec3 q = glm::cross(s, triangle.edge1);
+            float v = glm::dot(ray.direction, q) * inverseDeterminant;
+            if (v < 0.0f || u + v > 1.0f) {
+                continue;
+            }
+            float t = glm::dot(triangle.edge2, q) * inverseDeterminant;
+            if (t > 1e-4f && t < ray.maxDistance) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
@@ -57,6 +57,11 @@ void Camera::SetCameraEyePosition(float x, float y, float z){
     m_eyePosition.z = z;
 }
 
+// Set the direction the camera is looking at
+void Camera::SetViewDirection(const glm::vec3& direction){
+    m_viewDirection = glm::normalize(direction);
+}
+
 float Camera::GetEyeXPosition(){
     return m_eyePosition.x;
 }
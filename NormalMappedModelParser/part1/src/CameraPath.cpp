@@ -0,0 +1,97 @@
+#include "CameraPath.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cmath>
+
+// Constructor
+CameraPath::CameraPath(){
+
+}
+
+
+/**
+ * @brief Loads camera keyframes from a text file.
+ *
+ * Each non-comment line holds an eye position followed by a view direction.
+ *
+ * @param filepath Path to the camera path file.
+ * @return true if at least one keyframe was read.
+ */
+bool CameraPath::Load(const std::string& filepath){
+    std::ifstream pathFile(filepath);
+    if (!pathFile.is_open()) {
+        std::cerr << "Failed to open camera path file: " << filepath << std::endl;
+        return false;
+    }
+
+    mKeyframes.clear();
+    std::string line;
+    while (std::getline(pathFile, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::stringstream ss(line);
+        Keyframe keyframe;
+        ss >> keyframe.eyePosition.x >> keyframe.eyePosition.y >> keyframe.eyePosition.z
+           >> keyframe.viewDirection.x >> keyframe.viewDirection.y >> keyframe.viewDirection.z;
+        if (ss.fail()) {
+            std::cerr << "Skipping malformed camera path line: " << line << std::endl;
+            continue;
+        }
+        keyframe.viewDirection = glm::normalize(keyframe.viewDirection);
+        mKeyframes.push_back(keyframe);
+    }
+
+    std::cout << "Camera path keyframes loaded: " << mKeyframes.size() << std::endl;
+    return !mKeyframes.empty();
+}
+
+
+/**
+ * @brief Builds a circular path around the origin that always looks at the origin.
+ *
+ * @param radius Distance from the y axis.
+ * @param height Height of the eye.
+ * @param keyframes Number of keyframes on the circle (the last one closes the loop).
+ */
+void CameraPath::CreateOrbit(float radius, float height, unsigned int keyframes){
+    mKeyframes.clear();
+    for (unsigned int i = 0; i <= keyframes; ++i) {
+        float angle = 2.0f * static_cast<float>(M_PI) * i / keyframes;
+        Keyframe keyframe;
+        keyframe.eyePosition = glm::vec3(std::sin(angle) * radius, height, std::cos(angle) * radius);
+        keyframe.viewDirection = glm::normalize(-keyframe.eyePosition);
+        mKeyframes.push_back(keyframe);
+    }
+}
+
+
+/**
+ * @brief Samples the path.
+ *
+ * @param t Position along the path, 0 is the first keyframe and 1 the last.
+ * @param eyePosition Receives the interpolated eye position.
+ * @param viewDirection Receives the interpolated (normalized) view direction.
+ */
+void CameraPath::Evaluate(float t, glm::vec3& eyePosition, glm::vec3& viewDirection) const{
+    if (mKeyframes.empty()) {
+        return;
+    }
+    if (mKeyframes.size() == 1) {
+        eyePosition = mKeyframes[0].eyePosition;
+        viewDirection = mKeyframes[0].viewDirection;
+        return;
+    }
+
+    t = glm::clamp(t, 0.0f, 1.0f);
+    float segment = t * (mKeyframes.size() - 1);
+    size_t index = std::min(static_cast<size_t>(segment), mKeyframes.size() - 2);
+    float blend = segment - index;
+
+    const Keyframe& a = mKeyframes[index];
+    const Keyframe& b = mKeyframes[index + 1];
+    eyePosition = glm::mix(a.eyePosition, b.eyePosition, blend);
+    viewDirection = glm::normalize(glm::mix(a.viewDirection, b.viewDirection, blend));
+}
@@ -0,0 +1,222 @@
+#include "CascadedShadows.hpp"
+#include "Profiler.hpp"
+#include "util.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+
+
+CascadedShadows::~CascadedShadows(){
+    Destroy();
+}
+
+
+void CascadedShadows::GetSettings(Quality quality, int& resolution, int& kernelSize){
+    switch (quality) {
+        case Quality::Low:      resolution = 1024; kernelSize = 1; break;
+        case Quality::Medium:   resolution = 2048; kernelSize = 3; break;
+        case Quality::High:     resolution = 3072; kernelSize = 5; break;
+    }
+}
+
+
+void CascadedShadows::Initialize(Quality quality){
+    PROFILE_SCOPE("CascadedShadows::Initialize");
+    Destroy();
+    GetSettings(quality, mResolution, mKernelSize);
+
+    // Linear filtering with depth comparison gives a 2x2 PCF per tap
+    glGenTextures(1, &mTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, mTexture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, mResolution, mResolution, kCascades, 0,
+                 GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    mTracked.Set(Memory::GetTextureBytes(GL_DEPTH_COMPONENT32F, mResolution, mResolution, kCascades));
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGenFramebuffers(1, &mFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, mTexture, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "Shadow map framebuffer is incomplete" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+
+    mShaderID = CreateShaderProgram(LoadShaderAsString("./shaders/shadow_vert.glsl"),
+                                    LoadShaderAsString("./shaders/shadow_frag.glsl"));
+    for (glm::mat4& viewProjection : mViewProjection) {
+        viewProjection = glm::mat4(1.0f);
+    }
+}
+
+
+void CascadedShadows::Destroy(){
+    if (mTexture == 0) {
+        return;
+    }
+    glDeleteTextures(1, &mTexture);
+    glDeleteFramebuffers(1, &mFramebuffer);
+    glDeleteProgram(mShaderID);
+    mTracked.Set(0);
+    mTexture = 0;
+    mFramebuffer = 0;
+    mShaderID = 0;
+}
+
+
+double CascadedShadows::GetMegabytes() const{
+    return static_cast<double>(mResolution) * mResolution * kCascades * 4.0 / (1024.0 * 1024.0);
+}
+
+
+/**
+ * @brief Splits the view range and fits a texel snapped orthographic projection around every slice.
+ *
+ * All cascades share the light rotation. The bounding sphere of a slice only
+ * depends on its near and far distance, and its center is moved to whole
+ * texels in light space, so a static scene gives the same shadow map texels
+ * from frame to frame.
+ */
+void CascadedShadows::Update(const glm::mat4& view, float fovY, float aspect, float nearPlane, const glm::vec3& lightDirection,
+                             const glm::vec3& sceneMin, const glm::vec3& sceneMax){
+    glm::vec3 up = (std::fabs(lightDirection.y) > 0.99f) ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), lightDirection, up);
+
+    // Depth range of the whole scene, casters outside a slice still throw shadows into it
+    float sceneNear = -FLT_MAX, sceneFar = FLT_MAX;
+    for (int corner = 0; corner < 8; ++corner) {
+        glm::vec3 point((corner & 1) ? sceneMax.x : sceneMin.x, (corner & 2) ? sceneMax.y : sceneMin.y,
+                        (corner & 4) ? sceneMax.z : sceneMin.z);
+        float z = (lightView * glm::vec4(point, 1.0f)).z;
+        sceneNear = std::max(sceneNear, z);
+        sceneFar = std::min(sceneFar, z);
+    }
+
+    float splits[kCascades + 1];
+    splits[0] = nearPlane;
+    for (int i = 1; i <= kCascades; ++i) {
+        float fraction = static_cast<float>(i) / kCascades;
+        float logarithmic = nearPlane * std::pow(mShadowDistance / nearPlane, fraction);
+        float uniform = nearPlane + (mShadowDistance - nearPlane) * fraction;
+        splits[i] = mSplitLambda * logarithmic + (1.0f - mSplitLambda) * uniform;
+    }
+
+    glm::mat4 inverseView = glm::inverse(view);
+    float tanY = std::tan(0.5f * fovY);
+    float tanX = tanY * aspect;
+    for (int cascade = 0; cascade < kCascades; ++cascade) {
+        glm::vec3 corners[8];
+        glm::vec3 center(0.0f);
+        for (int corner = 0; corner < 8; ++corner) {
+            float depth = (corner & 4) ? splits[cascade + 1] : splits[cascade];
+            glm::vec4 viewCorner((corner & 1) ? tanX * depth : -tanX * depth, (corner & 2) ? tanY * depth : -tanY * depth,
+                                 -depth, 1.0f);
+            corners[corner] = glm::vec3(inverseView * viewCorner);
+            center += corners[corner] / 8.0f;
+        }
+        float radius = 0.0f;
+        for (const glm::vec3& corner : corners) {
+            radius = std::max(radius, glm::length(corner - center));
+        }
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+
+        float texel = 2.0f * radius / mResolution;
+        glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+        lightCenter.x = std::floor(lightCenter.x / texel) * texel;
+        lightCenter.y = std::floor(lightCenter.y / texel) * texel;
+        // From the scene side nearest to the light to the farthest receiver in the slice
+        float zNear = sceneNear + texel;
+        float zFar = std::min(std::max(sceneFar, lightCenter.z - radius), zNear - texel);
+        glm::mat4 projection = glm::ortho(lightCenter.x - radius, lightCenter.x + radius, lightCenter.y - radius,
+                                          lightCenter.y + radius, -zNear, -zFar);
+        mViewProjection[cascade] = projection * lightView;
+        mTexelWorldSize[cascade] = texel;
+        mStatistics.splitFar[cascade] = splits[cascade + 1];
+    }
+}
+
+
+void CascadedShadows::BeginCascade(int cascade){
+    if (cascade == 0) {
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &mPreviousFramebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+        glViewport(0, 0, mResolution, mResolution);
+        // Casters in front of the near plane are clamped to it instead of being clipped
+        glEnable(GL_DEPTH_CLAMP);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(1.5f, 2.0f);
+        glDisable(GL_CULL_FACE);
+        glUseProgram(mShaderID);
+    }
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, mTexture, 0, cascade);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glUniformMatrix4fv(glGetUniformLocation(mShaderID, "u_LightViewProjection"), 1, GL_FALSE, &mViewProjection[cascade][0][0]);
+}
+
+
+void CascadedShadows::EndCascade(int cascade, size_t casters, size_t drawCalls){
+    mStatistics.casters[cascade] = casters;
+    mStatistics.drawCalls[cascade] = drawCalls;
+}
+
+
+void CascadedShadows::EndShadowPass(){
+    glDisable(GL_DEPTH_CLAMP);
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glEnable(GL_CULL_FACE);
+    glBindFramebuffer(GL_FRAMEBUFFER, mPreviousFramebuffer);
+}
+
+
+void CascadedShadows::Bind(GLuint program, const glm::mat4& cameraView) const{
+    GLint location = glGetUniformLocation(program, "u_ShadowMap");
+    if (location >= 0) {
+        // A sampler left on unit 0 would clash with the diffuse texture, so it always gets its own unit
+        glUniform1i(location, kTextureUnit);
+    }
+    location = glGetUniformLocation(program, "u_ShadowsEnabled");
+    if (location >= 0) {
+        glUniform1i(location, mTexture != 0 ? 1 : 0);
+    }
+    if (mTexture == 0) {
+        return;
+    }
+
+    glActiveTexture(GL_TEXTURE0 + kTextureUnit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, mTexture);
+    glActiveTexture(GL_TEXTURE0);
+    location = glGetUniformLocation(program, "u_ShadowMatrices");
+    if (location >= 0) {
+        glUniformMatrix4fv(location, kCascades, GL_FALSE, &mViewProjection[0][0][0]);
+    }
+    location = glGetUniformLocation(program, "u_CascadeSplits");
+    if (location >= 0) {
+        glUniform4fv(location, 1, mStatistics.splitFar);
+    }
+    location = glGetUniformLocation(program, "u_CascadeTexelSizes");
+    if (location >= 0) {
+        glUniform4fv(location, 1, mTexelWorldSize);
+    }
+    location = glGetUniformLocation(program, "u_ShadowKernelRadius");
+    if (location >= 0) {
+        glUniform1i(location, mKernelSize / 2);
+    }
+    location = glGetUniformLocation(program, "u_ShadowCameraView");
+    if (location >= 0) {
+        glUniformMatrix4fv(location, 1, GL_FALSE, &cameraView[0][0]);
+    }
+}
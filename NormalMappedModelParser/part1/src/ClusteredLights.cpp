@@ -0,0 +1,274 @@
+#include "ClusteredLights.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+
+ClusteredLights::~ClusteredLights(){
+    Destroy();
+}
+
+
+/**
+ * @brief Creates one buffer and one buffer texture each for the light data, the grid and the index lists.
+ */
+void ClusteredLights::Initialize(){
+    Destroy();
+    glGenBuffers(3, mBuffers);
+    glGenTextures(3, mTextures);
+    GLint maxTexels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    mMaxIndices = static_cast<size_t>(std::max(maxTexels, 65536));
+    mGrid.assign(kClusterCount * 2, 0);
+    Upload();
+}
+
+
+void ClusteredLights::Destroy(){
+    if (mBuffers[0] != 0) {
+        glDeleteTextures(3, mTextures);
+        glDeleteBuffers(3, mBuffers);
+        mTracked.Set(0);
+        for (int i = 0; i < 3; ++i) {
+            mBuffers[i] = 0;
+            mTextures[i] = 0;
+        }
+    }
+}
+
+
+/**
+ * @brief Replaces the lights. Without lights the grid is cleared and uploaded right away, since Assign() is skipped then.
+ */
+void ClusteredLights::SetLights(const std::vector<PointLight>& lights){
+    mLights = lights;
+    if (mLights.empty()) {
+        mGrid.assign(kClusterCount * 2, 0);
+        mIndices.clear();
+        mStatistics = Statistics();
+        if (mBuffers[0] != 0) {
+            Upload();
+        }
+    }
+}
+
+
+/**
+ * @brief Cluster boxes in view space. Slice k covers view depths near * (far / near)^(k / kClustersZ) to the next slice.
+ */
+void ClusteredLights::BuildClusterBounds(float fovY, float aspect, float nearPlane, float farPlane){
+    mFovY = fovY;
+    mAspect = aspect;
+    mNearPlane = nearPlane;
+    mFarPlane = farPlane;
+    mClusterMin.resize(kClusterCount);
+    mClusterMax.resize(kClusterCount);
+
+    float tanY = std::tan(0.5f * fovY);
+    float tanX = tanY * aspect;
+    for (int z = 0; z < kClustersZ; ++z) {
+        float depthNear = nearPlane * std::pow(farPlane / nearPlane, static_cast<float>(z) / kClustersZ);
+        float depthFar = nearPlane * std::pow(farPlane / nearPlane, static_cast<float>(z + 1) / kClustersZ);
+        for (int y = 0; y < kClustersY; ++y) {
+            float ndcY0 = -1.0f + 2.0f * y / kClustersY;
+            float ndcY1 = -1.0f + 2.0f * (y + 1) / kClustersY;
+            for (int x = 0; x < kClustersX; ++x) {
+                float ndcX0 = -1.0f + 2.0f * x / kClustersX;
+                float ndcX1 = -1.0f + 2.0f * (x + 1) / kClustersX;
+                glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+                for (float depth : {depthNear, depthFar}) {
+                    for (float ndcX : {ndcX0, ndcX1}) {
+                        for (float ndcY : {ndcY0, ndcY1}) {
+                            glm::vec3 corner(ndcX * tanX * depth, ndcY * tanY * depth, -depth);
+                            low = glm::min(low, corner);
+                            high = glm::max(high, corner);
+                        }
+                    }
+                }
+                int cluster = x + kClustersX * (y + kClustersY * z);
+                mClusterMin[cluster] = low;
+                mClusterMax[cluster] = high;
+            }
+        }
+    }
+}
+
+
+/**
+ * @brief Lists the lights whose sphere touches each cluster box of a slice, in increasing light order.
+ */
+void ClusteredLights::AssignSlice(int slice){
+    std::vector<uint32_t>& sliceLights = mSliceLights[slice];
+    std::vector<uint32_t>& indices = mSliceIndices[slice];
+    std::vector<uint32_t>& counts = mSliceCounts[slice];
+    sliceLights.clear();
+    indices.clear();
+    counts.assign(kClustersX * kClustersY, 0);
+
+    // The z range of a slice is the same for all its clusters
+    int firstCluster = kClustersX * kClustersY * slice;
+    float sliceMinZ = mClusterMin[firstCluster].z;
+    float sliceMaxZ = mClusterMax[firstCluster].z;
+    for (size_t light = 0; light < mViewLights.size(); ++light) {
+        const glm::vec4& sphere = mViewLights[light];
+        if (sphere.z - sphere.w <= sliceMaxZ && sphere.z + sphere.w >= sliceMinZ) {
+            sliceLights.push_back(static_cast<uint32_t>(light));
+        }
+    }
+
+    for (int tile = 0; tile < kClustersX * kClustersY; ++tile) {
+        const glm::vec3& low = mClusterMin[firstCluster + tile];
+        const glm::vec3& high = mClusterMax[firstCluster + tile];
+        for (uint32_t light : sliceLights) {
+            const glm::vec4& sphere = mViewLights[light];
+            glm::vec3 center(sphere);
+            glm::vec3 closest = glm::clamp(center, low, high);
+            glm::vec3 offset = closest - center;
+            if (glm::dot(offset, offset) <= sphere.w * sphere.w) {
+                indices.push_back(light);
+                ++counts[tile];
+            }
+        }
+    }
+}
+
+
+/**
+ * @brief Moves the lights to view space, fills the slices in parallel and concatenates their lists.
+ */
+void ClusteredLights::Assign(const glm::mat4& view, float fovY, float aspect, float nearPlane, float farPlane, ThreadPool* threadPool){
+    PROFILE_SCOPE("ClusteredLights::Assign");
+    auto begin = std::chrono::steady_clock::now();
+    if (fovY != mFovY || aspect != mAspect || nearPlane != mNearPlane || farPlane != mFarPlane) {
+        BuildClusterBounds(fovY, aspect, nearPlane, farPlane);
+    }
+
+    mViewLights.resize(mLights.size());
+    for (size_t i = 0; i < mLights.size(); ++i) {
+        mViewLights[i] = glm::vec4(glm::vec3(view * glm::vec4(mLights[i].position, 1.0f)), mLights[i].radius);
+    }
+
+    mSliceLights.resize(kClustersZ);
+    mSliceIndices.resize(kClustersZ);
+    mSliceCounts.resize(kClustersZ);
+    if (threadPool != nullptr && threadPool->GetThreadCount() > 1 && !mLights.empty()) {
+        threadPool->ParallelFor(kClustersZ, [this](size_t slice, unsigned int){ AssignSlice(static_cast<int>(slice)); });
+    } else {
+        for (int slice = 0; slice < kClustersZ; ++slice) {
+            AssignSlice(slice);
+        }
+    }
+
+    mGrid.resize(kClusterCount * 2);
+    mIndices.clear();
+    std::vector<uint8_t> inView(mLights.size(), 0);
+    size_t occupied = 0;
+    size_t maxLights = 0;
+    size_t dropped = 0;
+    for (int slice = 0; slice < kClustersZ; ++slice) {
+        const std::vector<uint32_t>& indices = mSliceIndices[slice];
+        size_t read = 0;
+        for (int tile = 0; tile < kClustersX * kClustersY; ++tile) {
+            size_t count = mSliceCounts[slice][tile];
+            size_t kept = std::min(count, mMaxIndices - mIndices.size());
+            int cluster = kClustersX * kClustersY * slice + tile;
+            mGrid[cluster * 2] = static_cast<uint32_t>(mIndices.size());
+            mGrid[cluster * 2 + 1] = static_cast<uint32_t>(kept);
+            for (size_t i = 0; i < kept; ++i) {
+                inView[indices[read + i]] = 1;
+            }
+            mIndices.insert(mIndices.end(), indices.begin() + read, indices.begin() + read + kept);
+            read += count;
+            dropped += count - kept;
+            occupied += (count > 0) ? 1 : 0;
+            maxLights = std::max(maxLights, count);
+        }
+    }
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+    mStatistics.lights = mLights.size();
+    mStatistics.lightsInView = std::count(inView.begin(), inView.end(), 1);
+    mStatistics.indices = mIndices.size();
+    mStatistics.occupiedClusters = occupied;
+    mStatistics.maxLightsPerCluster = maxLights;
+    mStatistics.dropped = dropped;
+    mStatistics.assignMilliseconds = elapsed.count();
+}
+
+
+/**
+ * @brief Replaces the contents of the three buffers. Empty buffers get one element so every texture is valid.
+ */
+void ClusteredLights::Upload(){
+    PROFILE_SCOPE("ClusteredLights::Upload");
+    auto begin = std::chrono::steady_clock::now();
+
+    // Two texels per light: position and radius, then color
+    std::vector<glm::vec4> lightData(std::max<size_t>(1, mLights.size() * 2), glm::vec4(0.0f));
+    for (size_t i = 0; i < mLights.size(); ++i) {
+        lightData[i * 2] = glm::vec4(mLights[i].position, mLights[i].radius);
+        lightData[i * 2 + 1] = glm::vec4(mLights[i].color, 0.0f);
+    }
+    uint32_t noIndex = 0;
+    const GLsizeiptr sizes[3] = {static_cast<GLsizeiptr>(lightData.size() * sizeof(glm::vec4)),
+                                 static_cast<GLsizeiptr>(mGrid.size() * sizeof(uint32_t)),
+                                 static_cast<GLsizeiptr>(std::max<size_t>(1, mIndices.size()) * sizeof(uint32_t))};
+    const void* data[3] = {lightData.data(), mGrid.data(), mIndices.empty() ? &noIndex : mIndices.data()};
+    const GLenum formats[3] = {GL_RGBA32F, GL_RG32UI, GL_R32UI};
+    for (int i = 0; i < 3; ++i) {
+        glBindBuffer(GL_TEXTURE_BUFFER, mBuffers[i]);
+        // Orphan the old storage so the upload does not wait for draws still reading it
+        glBufferData(GL_TEXTURE_BUFFER, sizes[i], nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, sizes[i], data[i]);
+        glBindTexture(GL_TEXTURE_BUFFER, mTextures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, formats[i], mBuffers[i]);
+    }
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    mTracked.Set(static_cast<size_t>(sizes[0] + sizes[1] + sizes[2]));
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+    mStatistics.uploadMilliseconds = elapsed.count();
+}
+
+
+void ClusteredLights::Bind(GLuint program, int screenWidth, int screenHeight) const{
+    static const char* samplers[3] = {"u_LightData", "u_ClusterGrid", "u_LightIndices"};
+    for (int i = 0; i < 3; ++i) {
+        glActiveTexture(GL_TEXTURE0 + kFirstTextureUnit + i);
+        glBindTexture(GL_TEXTURE_BUFFER, mTextures[i]);
+        GLint location = glGetUniformLocation(program, samplers[i]);
+        if (location >= 0) {
+            glUniform1i(location, kFirstTextureUnit + i);
+        }
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    // slice = log(depth) * scale - bias, the grid is empty until the first Assign()
+    float logRatio = (mNearPlane > 0.0f) ? std::log(mFarPlane / mNearPlane) : 0.0f;
+    GLint location = glGetUniformLocation(program, "u_ClusterCounts");
+    if (location >= 0) {
+        glUniform3i(location, kClustersX, kClustersY, kClustersZ);
+    }
+    location = glGetUniformLocation(program, "u_ClusterTileSize");
+    if (location >= 0) {
+        glUniform2f(location, static_cast<float>(screenWidth) / kClustersX, static_cast<float>(screenHeight) / kClustersY);
+    }
+    location = glGetUniformLocation(program, "u_ClusterDepthScale");
+    if (location >= 0) {
+        glUniform1f(location, (logRatio > 0.0f) ? kClustersZ / logRatio : 0.0f);
+    }
+    location = glGetUniformLocation(program, "u_ClusterDepthBias");
+    if (location >= 0) {
+        glUniform1f(location, (logRatio > 0.0f) ? kClustersZ * std::log(mNearPlane) / logRatio : 0.0f);
+    }
+}
+
+
+void ClusteredLights::GetClusterLights(int x, int y, int z, std::vector<uint32_t>& lights) const{
+    int cluster = x + kClustersX * (y + kClustersY * z);
+    lights.assign(mIndices.begin() + mGrid[cluster * 2], mIndices.begin() + mGrid[cluster * 2] + mGrid[cluster * 2 + 1]);
+}
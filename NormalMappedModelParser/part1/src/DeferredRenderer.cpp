@@ -0,0 +1,294 @@
+#include "DeferredRenderer.hpp"
+#include "Profiler.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+
+DeferredRenderer::~DeferredRenderer(){
+    Destroy();
+}
+
+
+/**
+ * @brief Icosahedron split once, scaled so that its faces lie outside the unit sphere.
+ */
+static void CreateLightSphere(std::vector<glm::vec3>& vertices, std::vector<GLuint>& indices){
+    const float t = (1.0f + std::sqrt(5.0f)) * 0.5f;
+    vertices = {
+        {-1, t, 0}, {1, t, 0}, {-1, -t, 0}, {1, -t, 0},
+        {0, -1, t}, {0, 1, t}, {0, -1, -t}, {0, 1, -t},
+        {t, 0, -1}, {t, 0, 1}, {-t, 0, -1}, {-t, 0, 1}
+    };
+    std::vector<GLuint> faces = {
+        0, 11, 5,  0, 5, 1,  0, 1, 7,  0, 7, 10,  0, 10, 11,
+        1, 5, 9,  5, 11, 4,  11, 10, 2,  10, 7, 6,  7, 1, 8,
+        3, 9, 4,  3, 4, 2,  3, 2, 6,  3, 6, 8,  3, 8, 9,
+        4, 9, 5,  2, 4, 11,  6, 2, 10,  8, 6, 7,  9, 8, 1
+    };
+    for (glm::vec3& vertex : vertices) {
+        vertex = glm::normalize(vertex);
+    }
+
+    // Every triangle becomes four, the new corners are pushed onto the sphere
+    indices.clear();
+    for (size_t i = 0; i < faces.size(); i += 3) {
+        GLuint corner[3] = {faces[i], faces[i + 1], faces[i + 2]};
+        GLuint middle[3];
+        for (int e = 0; e < 3; ++e) {
+            middle[e] = static_cast<GLuint>(vertices.size());
+            vertices.push_back(glm::normalize(vertices[corner[e]] + vertices[corner[(e + 1) % 3]]));
+        }
+        indices.insert(indices.end(), {corner[0], middle[0], middle[2],
+                                       corner[1], middle[1], middle[0],
+                                       corner[2], middle[2], middle[1],
+                                       middle[0], middle[1], middle[2]});
+    }
+
+    float nearestFace = 1.0f;
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        const glm::vec3& a = vertices[indices[i]];
+        glm::vec3 normal = glm::normalize(glm::cross(vertices[indices[i + 1]] - a, vertices[indices[i + 2]] - a));
+        nearestFace = std::min(nearestFace, std::fabs(glm::dot(normal, a)));
+    }
+    for (glm::vec3& vertex : vertices) {
+        vertex /= nearestFace;
+    }
+}
+
+
+void DeferredRenderer::Initialize(int width, int height){
+    Destroy();
+    mWidth = width;
+    mHeight = height;
+
+    auto createTexture = [width, height](GLenum internalFormat, GLenum format, GLenum type){
+        GLuint texture = 0;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return texture;
+    };
+    mAlbedoTexture = createTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+    mNormalTexture = createTexture(GL_RG16, GL_RG, GL_UNSIGNED_SHORT);
+    mDepthTexture = createTexture(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8);
+    mTracked.Set(Memory::GetTextureBytes(GL_RGBA8, width, height) + Memory::GetTextureBytes(GL_RG16, width, height) +
+                 Memory::GetTextureBytes(GL_DEPTH24_STENCIL8, width, height));
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGenFramebuffers(1, &mFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mAlbedoTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, mNormalTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, mDepthTexture, 0);
+    const GLenum drawBuffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(2, drawBuffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "G-buffer framebuffer is incomplete" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+
+    mGeometryShaderID = CreateShaderProgram(LoadShaderAsString("./shaders/vert.glsl"),
+                                            LoadShaderAsString("./shaders/gbuffer_frag.glsl"));
+    mLightingShaderID = CreateShaderProgram(LoadShaderAsString("./shaders/deferred_light_vert.glsl"),
+                                            LoadShaderAsString("./shaders/deferred_light_frag.glsl"));
+    mVolumeShaderID = CreateShaderProgram(LoadShaderAsString("./shaders/light_volume_vert.glsl"),
+                                          LoadShaderAsString("./shaders/light_volume_frag.glsl"));
+
+    glGenVertexArrays(1, &mScreenVAO);
+
+    std::vector<glm::vec3> sphereVertices;
+    std::vector<GLuint> sphereIndices;
+    CreateLightSphere(sphereVertices, sphereIndices);
+    mSphereIndexCount = static_cast<GLsizei>(sphereIndices.size());
+    glGenVertexArrays(1, &mSphereVAO);
+    glBindVertexArray(mSphereVAO);
+    glGenBuffers(1, &mSphereVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, mSphereVBO);
+    glBufferData(GL_ARRAY_BUFFER, sphereVertices.size() * sizeof(glm::vec3), sphereVertices.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+    glGenBuffers(1, &mSphereIBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mSphereIBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sphereIndices.size() * sizeof(GLuint), sphereIndices.data(), GL_STATIC_DRAW);
+
+    // Per instance: position and radius, then color
+    glGenBuffers(1, &mInstanceVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, mInstanceVBO);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec4), (void*)0);
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec4), (void*)sizeof(glm::vec4));
+    glVertexAttribDivisor(2, 1);
+    glBindVertexArray(0);
+
+    glGenQueries(4, &mQueries[0][0]);
+}
+
+
+void DeferredRenderer::Destroy(){
+    if (mFramebuffer == 0) {
+        return;
+    }
+    glDeleteFramebuffers(1, &mFramebuffer);
+    GLuint textures[3] = {mAlbedoTexture, mNormalTexture, mDepthTexture};
+    glDeleteTextures(3, textures);
+    glDeleteProgram(mGeometryShaderID);
+    glDeleteProgram(mLightingShaderID);
+    glDeleteProgram(mVolumeShaderID);
+    glDeleteVertexArrays(1, &mScreenVAO);
+    glDeleteVertexArrays(1, &mSphereVAO);
+    GLuint buffers[3] = {mSphereVBO, mSphereIBO, mInstanceVBO};
+    glDeleteBuffers(3, buffers);
+    glDeleteQueries(4, &mQueries[0][0]);
+    mTracked.Set(0);
+    mFramebuffer = 0;
+}
+
+
+double DeferredRenderer::GetMegabytes() const{
+    return static_cast<double>(mWidth) * mHeight * kBytesPerPixel / (1024.0 * 1024.0);
+}
+
+
+/**
+ * @brief Turns the sample counts into bytes moved, assuming every sample reads or writes the whole pixel.
+ *
+ * Written: G-buffer pixels of the geometry pass (color and depth), the color and
+ * depth of the lighting pass, and one blended color per light volume sample.
+ * Read: the full G-buffer in the lighting pass, and per light volume sample the
+ * G-buffer, the target depth and the color that is blended onto.
+ */
+void DeferredRenderer::ResolveQueries(){
+    size_t slot = mFrame % 2;
+    if (!mQueriesIssued[slot]) {
+        return;
+    }
+    GLuint64 geometrySamples = 0, volumeSamples = 0;
+    glGetQueryObjectui64v(mQueries[slot][0], GL_QUERY_RESULT, &geometrySamples);
+    glGetQueryObjectui64v(mQueries[slot][1], GL_QUERY_RESULT, &volumeSamples);
+    double pixels = static_cast<double>(mWidth) * mHeight;
+    double written = geometrySamples * static_cast<double>(kBytesPerPixel) + pixels * 8.0 + volumeSamples * 4.0;
+    double read = pixels * kBytesPerPixel + volumeSamples * (kBytesPerPixel + 8.0);
+    mStatistics.geometrySamples = geometrySamples;
+    mStatistics.volumeSamples = volumeSamples;
+    mStatistics.lightVolumes = mLightVolumes[slot];
+    mStatistics.megabytesWritten = written / (1024.0 * 1024.0);
+    mStatistics.megabytesRead = read / (1024.0 * 1024.0);
+}
+
+
+void DeferredRenderer::BeginGeometryPass(){
+    PROFILE_SCOPE("DeferredRenderer::GeometryPass");
+    ResolveQueries();
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &mTargetFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+    glViewport(0, 0, mWidth, mHeight);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    glBeginQuery(GL_SAMPLES_PASSED, mQueries[mFrame % 2][0]);
+}
+
+
+void DeferredRenderer::EndGeometryPass(){
+    glEndQuery(GL_SAMPLES_PASSED);
+    glBindFramebuffer(GL_FRAMEBUFFER, mTargetFramebuffer);
+}
+
+
+void DeferredRenderer::BindGBuffer(GLuint program, const glm::mat4& viewProjection, const glm::vec3& eye) const{
+    const GLuint textures[3] = {mAlbedoTexture, mNormalTexture, mDepthTexture};
+    const char* samplers[3] = {"u_GAlbedo", "u_GNormal", "u_GDepth"};
+    for (int i = 0; i < 3; ++i) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glUniform1i(glGetUniformLocation(program, samplers[i]), i);
+    }
+    glm::mat4 inverseViewProjection = glm::inverse(viewProjection);
+    glUniformMatrix4fv(glGetUniformLocation(program, "u_InverseViewProjection"), 1, GL_FALSE, &inverseViewProjection[0][0]);
+    glUniform2f(glGetUniformLocation(program, "u_ScreenSize"), static_cast<float>(mWidth), static_cast<float>(mHeight));
+    glUniform3f(glGetUniformLocation(program, "u_ViewPos"), eye.x, eye.y, eye.z);
+}
+
+
+/**
+ * @brief Full screen triangle that shades every pixel once and writes the G-buffer depth.
+ */
+void DeferredRenderer::LightingPass(const glm::mat4& view, const glm::mat4& viewProjection, const glm::vec3& eye,
+                                    const glm::vec3& lightPosition, const glm::vec3& backgroundColor,
+                                    const CascadedShadows& shadows){
+    PROFILE_SCOPE("DeferredRenderer::LightingPass");
+    glUseProgram(mLightingShaderID);
+    BindGBuffer(mLightingShaderID, viewProjection, eye);
+    glUniform3f(glGetUniformLocation(mLightingShaderID, "u_LightPos"), lightPosition.x, lightPosition.y, lightPosition.z);
+    glUniform3f(glGetUniformLocation(mLightingShaderID, "u_BackgroundColor"), backgroundColor.r, backgroundColor.g, backgroundColor.b);
+    shadows.Bind(mLightingShaderID, view);
+
+    glDepthFunc(GL_ALWAYS);
+    glBindVertexArray(mScreenVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glDepthFunc(GL_LESS);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+
+/**
+ * @brief Draws the back faces of all light spheres with additive blending.
+ *
+ * A back face behind the stored depth means the surface is in front of the far
+ * side of the sphere; pixels with the surface beyond the sphere fail the depth
+ * test. Depth clamping keeps spheres that reach past the far plane.
+ */
+void DeferredRenderer::LightVolumePass(const glm::mat4& viewProjection, const glm::vec3& eye, const std::vector<PointLight>& lights){
+    PROFILE_SCOPE("DeferredRenderer::LightVolumePass");
+    size_t slot = mFrame % 2;
+    glBeginQuery(GL_SAMPLES_PASSED, mQueries[slot][1]);
+    if (!lights.empty()) {
+        std::vector<glm::vec4> instances(lights.size() * 2);
+        for (size_t i = 0; i < lights.size(); ++i) {
+            instances[i * 2] = glm::vec4(lights[i].position, lights[i].radius);
+            instances[i * 2 + 1] = glm::vec4(lights[i].color, 0.0f);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, mInstanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(glm::vec4), instances.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glUseProgram(mVolumeShaderID);
+        BindGBuffer(mVolumeShaderID, viewProjection, eye);
+        glUniformMatrix4fv(glGetUniformLocation(mVolumeShaderID, "u_ViewProjection"), 1, GL_FALSE, &viewProjection[0][0]);
+
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glDepthMask(GL_FALSE);
+        glDepthFunc(GL_GEQUAL);
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_FRONT);
+        glEnable(GL_DEPTH_CLAMP);
+
+        glBindVertexArray(mSphereVAO);
+        glDrawElementsInstanced(GL_TRIANGLES, mSphereIndexCount, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(lights.size()));
+        glBindVertexArray(0);
+
+        glDisable(GL_DEPTH_CLAMP);
+        glCullFace(GL_BACK);
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+        glDisable(GL_BLEND);
+        glActiveTexture(GL_TEXTURE0);
+    }
+    glEndQuery(GL_SAMPLES_PASSED);
+    mQueriesIssued[slot] = true;
+    mLightVolumes[slot] = lights.size();
+    ++mFrame;
+}
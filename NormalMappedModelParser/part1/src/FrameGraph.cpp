@@ -0,0 +1,332 @@
+#include "FrameGraph.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+
+void FrameGraph::Reset(){
+    mResources.clear();
+    mPasses.clear();
+    mPhysical.clear();
+    mStatistics = Statistics();
+}
+
+
+void FrameGraph::Destroy(){
+    Reset();
+    mPool.Destroy();
+}
+
+
+FrameGraph::Resource FrameGraph::CreateTexture(const std::string& name, const TextureDescription& description){
+    ResourceNode node;
+    node.name = name;
+    node.description = description;
+    mResources.push_back(node);
+    return static_cast<Resource>(mResources.size() - 1);
+}
+
+
+FrameGraph::Resource FrameGraph::ImportFramebuffer(const std::string& name, GLint framebuffer, int width, int height){
+    ResourceNode node;
+    node.name = name;
+    node.description.width = width;
+    node.description.height = height;
+    node.imported = true;
+    node.framebuffer = framebuffer;
+    mResources.push_back(node);
+    return static_cast<Resource>(mResources.size() - 1);
+}
+
+
+void FrameGraph::AddPass(const std::string& name, const std::vector<Resource>& reads, const std::vector<Resource>& writes,
+                         std::function<void()> execute){
+    PassNode node;
+    node.name = name;
+    node.reads = reads;
+    node.writes = writes;
+    node.execute = execute;
+    mPasses.push_back(node);
+}
+
+
+size_t FrameGraph::GetBytes(const TextureDescription& description){
+    size_t pixels = static_cast<size_t>(description.width) * description.height;
+    return pixels * (RenderTargetPool::GetBytesPerPixel(description.format) + (description.depth ? 4 : 0));
+}
+
+
+/**
+ * @brief Culls unused passes, then finds dependencies, transitions, lifetimes and the physical target of every resource.
+ *
+ * Culling counts the readers of every resource and the used outputs of every
+ * pass. Resources nobody reads take a reference from their writers; a writer
+ * without references left is culled and releases what it reads in turn.
+ */
+void FrameGraph::Compile(){
+    PROFILE_SCOPE("FrameGraph::Compile");
+    auto compileBegin = std::chrono::steady_clock::now();
+    const int passCount = static_cast<int>(mPasses.size());
+    const int resourceCount = static_cast<int>(mResources.size());
+    auto contains = [](const std::vector<Resource>& list, Resource resource){
+        return std::find(list.begin(), list.end(), resource) != list.end();
+    };
+
+    // A pass that reads what it writes does not keep its own output alive
+    std::vector<int> readers(resourceCount, 0);
+    std::vector<int> outputs(passCount, 0);
+    for (int i = 0; i < passCount; ++i) {
+        PassNode& pass = mPasses[i];
+        pass.culled = false;
+        for (Resource resource : pass.reads) {
+            readers[resource] += contains(pass.writes, resource) ? 0 : 1;
+        }
+        outputs[i] = static_cast<int>(pass.writes.size());
+    }
+    auto isRoot = [this](const PassNode& pass){
+        if (pass.writes.empty()) {
+            return true;
+        }
+        for (Resource resource : pass.writes) {
+            if (mResources[resource].imported) {
+                return true;
+            }
+        }
+        return false;
+    };
+    std::vector<Resource> unused;
+    for (Resource resource = 0; resource < resourceCount; ++resource) {
+        if (readers[resource] == 0 && !mResources[resource].imported) {
+            unused.push_back(resource);
+        }
+    }
+    while (!unused.empty()) {
+        Resource resource = unused.back();
+        unused.pop_back();
+        for (int i = 0; i < passCount; ++i) {
+            PassNode& pass = mPasses[i];
+            if (pass.culled || !contains(pass.writes, resource) || isRoot(pass) || --outputs[i] > 0) {
+                continue;
+            }
+            pass.culled = true;
+            for (Resource input : pass.reads) {
+                if (!contains(pass.writes, input) && --readers[input] == 0 && !mResources[input].imported) {
+                    unused.push_back(input);
+                }
+            }
+        }
+    }
+
+    // Dependencies and transitions in declaration order
+    std::vector<int> lastWriter(resourceCount, -1);
+    std::vector<std::vector<int>> readersSinceWrite(resourceCount);
+    for (ResourceNode& resource : mResources) {
+        resource.firstPass = -1;
+        resource.lastPass = -1;
+        resource.physical = -1;
+    }
+    for (int i = 0; i < passCount; ++i) {
+        PassNode& pass = mPasses[i];
+        pass.dependencies.clear();
+        pass.transitions.clear();
+        pass.acquires.clear();
+        pass.releases.clear();
+        if (pass.culled) {
+            continue;
+        }
+        auto depend = [&pass, i](int other){
+            if (other >= 0 && other != i && std::find(pass.dependencies.begin(), pass.dependencies.end(), other) == pass.dependencies.end()) {
+                pass.dependencies.push_back(other);
+            }
+        };
+        auto use = [this, i](Resource resource){
+            ResourceNode& node = mResources[resource];
+            node.firstPass = (node.firstPass < 0) ? i : node.firstPass;
+            node.lastPass = i;
+        };
+        for (Resource resource : pass.reads) {
+            if (lastWriter[resource] < 0 && !mResources[resource].imported) {
+                std::cout << "Frame graph pass " << pass.name << " reads " << mResources[resource].name
+                          << " before it is written" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            depend(lastWriter[resource]);
+            if (lastWriter[resource] >= 0 && !contains(pass.writes, resource)) {
+                pass.transitions.push_back(resource);
+            }
+            readersSinceWrite[resource].push_back(i);
+            use(resource);
+        }
+        for (Resource resource : pass.writes) {
+            depend(lastWriter[resource]);
+            for (int reader : readersSinceWrite[resource]) {
+                depend(reader);
+            }
+            lastWriter[resource] = i;
+            readersSinceWrite[resource].clear();
+            use(resource);
+        }
+    }
+
+    // Place transient resources in order of first use into the first free matching target
+    std::vector<Resource> order;
+    for (Resource resource = 0; resource < resourceCount; ++resource) {
+        if (!mResources[resource].imported && mResources[resource].firstPass >= 0) {
+            order.push_back(resource);
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [this](Resource a, Resource b){
+        return mResources[a].firstPass < mResources[b].firstPass;
+    });
+    mPhysical.clear();
+    size_t declaredBytes = 0;
+    for (Resource resource : order) {
+        ResourceNode& node = mResources[resource];
+        declaredBytes += GetBytes(node.description);
+        for (size_t p = 0; p < mPhysical.size() && node.physical < 0; ++p) {
+            const TextureDescription& description = mPhysical[p].description;
+            if (mPhysical[p].lastPass < node.firstPass && description.width == node.description.width &&
+                description.height == node.description.height && description.format == node.description.format &&
+                description.depth == node.description.depth) {
+                node.physical = static_cast<int>(p);
+            }
+        }
+        if (node.physical < 0) {
+            PhysicalTarget physical;
+            physical.description = node.description;
+            mPhysical.push_back(physical);
+            node.physical = static_cast<int>(mPhysical.size() - 1);
+            mPasses[node.firstPass].acquires.push_back(node.physical);
+        }
+        mPhysical[node.physical].lastPass = node.lastPass;
+    }
+    size_t allocatedBytes = 0;
+    for (size_t p = 0; p < mPhysical.size(); ++p) {
+        mPasses[mPhysical[p].lastPass].releases.push_back(static_cast<int>(p));
+        allocatedBytes += GetBytes(mPhysical[p].description);
+    }
+
+    mStatistics.passes = mPasses.size();
+    mStatistics.culledPasses = 0;
+    mStatistics.transitions = 0;
+    for (const PassNode& pass : mPasses) {
+        mStatistics.culledPasses += pass.culled ? 1 : 0;
+        mStatistics.transitions += pass.transitions.size();
+    }
+    mStatistics.resources = order.size();
+    mStatistics.physicalTargets = mPhysical.size();
+    mStatistics.declaredBytes = declaredBytes;
+    mStatistics.allocatedBytes = allocatedBytes;
+    std::chrono::duration<double, std::milli> compileTime = std::chrono::steady_clock::now() - compileBegin;
+    mStatistics.compileMilliseconds = compileTime.count();
+}
+
+
+void FrameGraph::Execute(){
+    PROFILE_SCOPE("FrameGraph::Execute");
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    for (PassNode& pass : mPasses) {
+        if (pass.culled) {
+            continue;
+        }
+        for (int physical : pass.acquires) {
+            const TextureDescription& description = mPhysical[physical].description;
+            mPhysical[physical].target = mPool.Acquire(description.width, description.height, description.format, description.depth);
+        }
+        if (!pass.writes.empty()) {
+            const ResourceNode& output = mResources[pass.writes.front()];
+            glBindFramebuffer(GL_FRAMEBUFFER, output.imported ? output.framebuffer : mPhysical[output.physical].target->framebuffer);
+            glViewport(0, 0, output.description.width, output.description.height);
+        }
+        if (pass.execute) {
+            pass.execute();
+        }
+        for (int physical : pass.releases) {
+            mPool.Release(mPhysical[physical].target);
+            mPhysical[physical].target = nullptr;
+        }
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+}
+
+
+GLuint FrameGraph::GetTexture(Resource resource) const{
+    const ResourceNode& node = mResources[resource];
+    if (node.imported || node.physical < 0 || mPhysical[node.physical].target == nullptr) {
+        return 0;
+    }
+    return mPhysical[node.physical].target->texture;
+}
+
+
+int FrameGraph::GetWidth(Resource resource) const{
+    return mResources[resource].description.width;
+}
+
+
+int FrameGraph::GetHeight(Resource resource) const{
+    return mResources[resource].description.height;
+}
+
+
+/**
+ * @brief One line per pass and per resource, then the memory saved by sharing targets.
+ */
+std::string FrameGraph::GetReport() const{
+    std::string report;
+    char line[256];
+    auto names = [this](const std::vector<Resource>& resources){
+        std::string list;
+        for (Resource resource : resources) {
+            list += (list.empty() ? "" : ",") + mResources[resource].name;
+        }
+        return list.empty() ? std::string("-") : list;
+    };
+
+    snprintf(line, sizeof(line), "Frame graph: %zu passes (%zu culled), %zu transient resources in %zu targets, compiled in %.3f ms\n",
+             mStatistics.passes, mStatistics.culledPasses, mStatistics.resources, mStatistics.physicalTargets,
+             mStatistics.compileMilliseconds);
+    report += line;
+    snprintf(line, sizeof(line), "  %-3s %-26s %-22s %-14s %-10s %s\n", "#", "pass", "reads", "writes", "after", "transitions");
+    report += line;
+    for (size_t i = 0; i < mPasses.size(); ++i) {
+        const PassNode& pass = mPasses[i];
+        std::string after;
+        for (int dependency : pass.dependencies) {
+            after += (after.empty() ? "" : ",") + std::to_string(dependency);
+        }
+        snprintf(line, sizeof(line), "  %-3zu %-26s %-22s %-14s %-10s %s%s\n", i, pass.name.c_str(), names(pass.reads).c_str(),
+                 names(pass.writes).c_str(), after.empty() ? "-" : after.c_str(), names(pass.transitions).c_str(),
+                 pass.culled ? "  (culled)" : "");
+        report += line;
+    }
+
+    snprintf(line, sizeof(line), "  %-12s %-12s %-10s %-8s %-8s %s\n", "resource", "size", "format", "passes", "target", "MB");
+    report += line;
+    for (const ResourceNode& node : mResources) {
+        const TextureDescription& description = node.description;
+        std::string size = std::to_string(description.width) + "x" + std::to_string(description.height);
+        std::string format = node.imported ? "imported" :
+                             description.format == GL_RGBA16F ? "RGBA16F" :
+                             description.format == GL_RGBA8 ? "RGBA8" : std::to_string(description.format);
+        if (description.depth) {
+            format += "+D";
+        }
+        std::string passes = (node.firstPass < 0) ? "unused" : std::to_string(node.firstPass) + "-" + std::to_string(node.lastPass);
+        std::string physical = (node.physical < 0) ? "-" : std::to_string(node.physical);
+        snprintf(line, sizeof(line), "  %-12s %-12s %-10s %-8s %-8s %.2f\n", node.name.c_str(), size.c_str(), format.c_str(),
+                 passes.c_str(), physical.c_str(), node.imported ? 0.0 : GetBytes(description) / (1024.0 * 1024.0));
+        report += line;
+    }
+
+    double declared = mStatistics.declaredBytes / (1024.0 * 1024.0);
+    double allocated = mStatistics.allocatedBytes / (1024.0 * 1024.0);
+    snprintf(line, sizeof(line), "Memory: %.2f MB declared, %.2f MB allocated, %.2f MB (%.0f%%) saved by sharing targets\n",
+             declared, allocated, declared - allocated, declared > 0.0 ? 100.0 * (declared - allocated) / declared : 0.0);
+    report += line;
+    return report;
+}
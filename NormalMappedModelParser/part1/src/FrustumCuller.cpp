@@ -0,0 +1,180 @@
+#include "FrustumCuller.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+#if defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define FRUSTUMCULLER_SSE
+#endif
+
+
+/**
+ * @brief Gribb/Hartmann plane extraction, the planes are not normalized since only signs are tested.
+ */
+void FrustumCuller::ExtractPlanes(const glm::mat4& viewProjection, glm::vec4 planes[6]){
+    glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+    glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+    glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+    glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+    planes[0] = row3 + row0;    // Left
+    planes[1] = row3 - row0;    // Right
+    planes[2] = row3 + row1;    // Bottom
+    planes[3] = row3 - row1;    // Top
+    planes[4] = row3 + row2;    // Near
+    planes[5] = row3 - row2;    // Far
+}
+
+
+void FrustumCuller::Resize(size_t count){
+    mMinX.resize(count);
+    mMinY.resize(count);
+    mMinZ.resize(count);
+    mMaxX.resize(count);
+    mMaxY.resize(count);
+    mMaxZ.resize(count);
+}
+
+
+void FrustumCuller::SetBox(size_t index, const glm::vec3& boundsMin, const glm::vec3& boundsMax){
+    mMinX[index] = boundsMin.x;
+    mMinY[index] = boundsMin.y;
+    mMinZ[index] = boundsMin.z;
+    mMaxX[index] = boundsMax.x;
+    mMaxY[index] = boundsMax.y;
+    mMaxZ[index] = boundsMax.z;
+}
+
+
+/**
+ * @brief Transforms the center of the box and grows the half size by the absolute matrix.
+ */
+void FrustumCuller::SetTransformedBox(size_t index, const glm::mat4& matrix, const glm::vec3& localMin, const glm::vec3& localMax){
+    glm::vec3 center = glm::vec3(matrix * glm::vec4(0.5f * (localMin + localMax), 1.0f));
+    glm::vec3 halfSize = 0.5f * (localMax - localMin);
+    glm::vec3 extent = glm::abs(glm::vec3(matrix[0])) * halfSize.x +
+                       glm::abs(glm::vec3(matrix[1])) * halfSize.y +
+                       glm::abs(glm::vec3(matrix[2])) * halfSize.z;
+    SetBox(index, center - extent, center + extent);
+}
+
+
+/**
+ * @brief Tests boxes [begin,end) against the planes, four at a time.
+ *
+ * A box is outside if its corner farthest along the normal of some plane is
+ * behind that plane. Boxes that cross a plane are kept.
+ */
+void FrustumCuller::CullRange(const glm::vec4 planes[6], size_t begin, size_t end, std::vector<uint32_t>& visible) const{
+    // Per plane, the arrays that hold the farthest corner
+    const float* cornerX[6];
+    const float* cornerY[6];
+    const float* cornerZ[6];
+    for (int p = 0; p < 6; ++p) {
+        cornerX[p] = (planes[p].x >= 0.0f) ? mMaxX.data() : mMinX.data();
+        cornerY[p] = (planes[p].y >= 0.0f) ? mMaxY.data() : mMinY.data();
+        cornerZ[p] = (planes[p].z >= 0.0f) ? mMaxZ.data() : mMinZ.data();
+    }
+
+    size_t i = begin;
+#if defined(FRUSTUMCULLER_SSE)
+    __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+    for (int p = 0; p < 6; ++p) {
+        planeX[p] = _mm_set1_ps(planes[p].x);
+        planeY[p] = _mm_set1_ps(planes[p].y);
+        planeZ[p] = _mm_set1_ps(planes[p].z);
+        planeW[p] = _mm_set1_ps(planes[p].w);
+    }
+    const __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= end; i += 4) {
+        __m128 outside = zero;
+        for (int p = 0; p < 6; ++p) {
+            __m128 distance = _mm_add_ps(_mm_mul_ps(planeX[p], _mm_loadu_ps(cornerX[p] + i)), planeW[p]);
+            distance = _mm_add_ps(distance, _mm_mul_ps(planeY[p], _mm_loadu_ps(cornerY[p] + i)));
+            distance = _mm_add_ps(distance, _mm_mul_ps(planeZ[p], _mm_loadu_ps(cornerZ[p] + i)));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, zero));
+        }
+        int insideMask = ~_mm_movemask_ps(outside) & 0xF;
+        while (insideMask) {
+            int lane = __builtin_ctz(insideMask);
+            visible.push_back(static_cast<uint32_t>(i + lane));
+            insideMask &= insideMask - 1;
+        }
+    }
+#endif
+    // Remainder, or everything without SSE
+    for (; i < end; ++i) {
+        bool outside = false;
+        for (int p = 0; p < 6 && !outside; ++p) {
+            outside = planes[p].x * cornerX[p][i] + planes[p].y * cornerY[p][i] + planes[p].z * cornerZ[p][i] + planes[p].w < 0.0f;
+        }
+        if (!outside) {
+            visible.push_back(static_cast<uint32_t>(i));
+        }
+    }
+}
+
+
+/**
+ * @brief Culls every box, on the thread pool if there are many.
+ *
+ * @param threadPool Pool to split large box counts over, or nullptr.
+ * @param visible Receives the indices of the visible boxes in increasing order.
+ */
+void FrustumCuller::Cull(const glm::mat4& viewProjection, ThreadPool* threadPool, std::vector<uint32_t>& visible){
+    PROFILE_SCOPE("FrustumCuller::Cull");
+    auto begin = std::chrono::steady_clock::now();
+    glm::vec4 planes[6];
+    ExtractPlanes(viewProjection, planes);
+
+    size_t count = GetBoxCount();
+    visible.clear();
+    mStatistics.threads = 1;
+    if (threadPool == nullptr || threadPool->GetThreadCount() < 2 || count < kParallelThreshold) {
+        CullRange(planes, 0, count, visible);
+    } else {
+        size_t blocks = (count + kBlockSize - 1) / kBlockSize;
+        mBlockVisible.resize(blocks);
+        threadPool->ParallelFor(blocks, [&](size_t block, unsigned int){
+            mBlockVisible[block].clear();
+            CullRange(planes, block * kBlockSize, std::min(count, (block + 1) * kBlockSize), mBlockVisible[block]);
+        });
+        for (size_t block = 0; block < blocks; ++block) {
+            visible.insert(visible.end(), mBlockVisible[block].begin(), mBlockVisible[block].end());
+        }
+        mStatistics.threads = threadPool->GetThreadCount();
+    }
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+    mStatistics.tested = count;
+    mStatistics.visible = visible.size();
+    mStatistics.culled = count - visible.size();
+    mStatistics.milliseconds = elapsed.count();
+}
+
+
+void FrustumCuller::CullScalar(const glm::mat4& viewProjection, std::vector<uint32_t>& visible){
+    auto begin = std::chrono::steady_clock::now();
+    glm::vec4 planes[6];
+    ExtractPlanes(viewProjection, planes);
+    visible.clear();
+    for (size_t i = 0; i < GetBoxCount(); ++i) {
+        bool outside = false;
+        for (int p = 0; p < 6 && !outside; ++p) {
+            glm::vec3 corner((planes[p].x >= 0.0f) ? mMaxX[i] : mMinX[i],
+                             (planes[p].y >= 0.0f) ? mMaxY[i] : mMinY[i],
+                             (planes[p].z >= 0.0f) ? mMaxZ[i] : mMinZ[i]);
+            outside = glm::dot(glm::vec3(planes[p]), corner) + planes[p].w < 0.0f;
+        }
+        if (!outside) {
+            visible.push_back(static_cast<uint32_t>(i));
+        }
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+    mStatistics.tested = GetBoxCount();
+    mStatistics.visible = visible.size();
+    mStatistics.culled = GetBoxCount() - visible.size();
+    mStatistics.milliseconds = elapsed.count();
+    mStatistics.threads = 1;
+}
@@ -0,0 +1,203 @@
+#include "GpuTimer.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+
+void RollingStats::Add(double milliseconds){
+    mSamples[mNext] = milliseconds;
+    mNext = (mNext + 1) % kWindow;
+    mCount = std::min(mCount + 1, kWindow);
+}
+
+double RollingStats::GetMin() const{
+    if (mCount == 0) return 0.0;
+    return *std::min_element(mSamples, mSamples + mCount);
+}
+
+double RollingStats::GetAverage() const{
+    if (mCount == 0) return 0.0;
+    double sum = 0.0;
+    for (size_t i = 0; i < mCount; ++i) {
+        sum += mSamples[i];
+    }
+    return sum / mCount;
+}
+
+double RollingStats::GetPercentile(double percentile) const{
+    if (mCount == 0) return 0.0;
+    std::vector<double> sorted(mSamples, mSamples + mCount);
+    size_t index = std::min(mCount - 1, static_cast<size_t>(percentile / 100.0 * mCount));
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+    return sorted[index];
+}
+
+double RollingStats::GetLast() const{
+    if (mCount == 0) return 0.0;
+    return mSamples[(mNext + kWindow - 1) % kWindow];
+}
+
+std::vector<double> RollingStats::GetHistory() const{
+    std::vector<double> history;
+    size_t first = (mCount < kWindow) ? 0 : mNext;
+    for (size_t i = 0; i < mCount; ++i) {
+        history.push_back(mSamples[(first + i) % kWindow]);
+    }
+    return history;
+}
+
+
+// Constructor
+GpuTimer::GpuTimer(){
+
+}
+
+
+// Destructor
+GpuTimer::~GpuTimer(){
+}
+
+
+void GpuTimer::SetEnabled(bool enabled){
+    mEnabled = enabled;
+}
+
+
+void GpuTimer::OpenCsv(const std::string& filepath){
+    mCsv.open(filepath);
+    if (!mCsv.is_open()) {
+        std::cout << "GpuTimer: unable to write " << filepath << std::endl;
+    }
+}
+
+
+/**
+ * @brief Reads back the queries that were issued two frames ago.
+ *
+ * The queries of this frame's slot were issued a full frame earlier, so their
+ * results are normally available. If the GPU is further behind the sample is
+ * dropped instead of waiting for it.
+ */
+void GpuTimer::BeginFrame(){
+    if (!mEnabled) {
+        return;
+    }
+
+    int slot = mFrame % 2;
+    bool resolved = false;
+    std::vector<double> passMilliseconds(mPasses.size(), -1.0);
+    for (size_t i = 0; i < mPasses.size(); ++i) {
+        Pass& pass = mPasses[i];
+        if (!pass.issued[slot]) {
+            continue;
+        }
+        pass.issued[slot] = false;
+
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(pass.queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available == GL_FALSE) {
+            continue;
+        }
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(pass.queries[slot], GL_QUERY_RESULT, &nanoseconds);
+        passMilliseconds[i] = nanoseconds / 1.0e6;
+        // The first frame pays for lazy uploads and driver warm-up, keep it out of the stats
+        if (mFrame > 2) {
+            pass.stats.Add(passMilliseconds[i]);
+        }
+        resolved = true;
+    }
+
+    if (resolved && mCsv.is_open()) {
+        if (!mCsvHeaderWritten) {
+            mCsv << "frame,cpu_frame_ms,cpu_submit_ms";
+            for (const Pass& pass : mPasses) {
+                mCsv << ",gpu_" << pass.name << "_ms";
+            }
+            mCsv << "\n";
+            mCsvHeaderWritten = true;
+        }
+        mCsv << (mFrame - 2) << "," << mCpuFrameInFlight[slot] << "," << mCpuSubmitInFlight[slot];
+        for (double milliseconds : passMilliseconds) {
+            mCsv << ",";
+            if (milliseconds >= 0.0) mCsv << milliseconds;
+        }
+        mCsv << "\n";
+    }
+}
+
+
+/**
+ * @brief Starts timing a pass, creating its queries the first time it is seen.
+ *
+ * @param name Pass name, used in the overlay and as CSV column.
+ */
+void GpuTimer::Begin(const char* name){
+    if (!mEnabled) {
+        return;
+    }
+
+    int index = -1;
+    for (size_t i = 0; i < mPasses.size(); ++i) {
+        if (mPasses[i].name == name) {
+            index = static_cast<int>(i);
+            break;
+        }
+    }
+    if (index < 0) {
+        Pass pass;
+        pass.name = name;
+        glGenQueries(2, pass.queries);
+        mPasses.push_back(pass);
+        index = static_cast<int>(mPasses.size() - 1);
+    }
+
+    int slot = mFrame % 2;
+    glBeginQuery(GL_TIME_ELAPSED, mPasses[index].queries[slot]);
+    mActivePass = index;
+}
+
+
+void GpuTimer::End(){
+    if (!mEnabled || mActivePass < 0) {
+        return;
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    mPasses[mActivePass].issued[mFrame % 2] = true;
+    mActivePass = -1;
+}
+
+
+void GpuTimer::EndFrame(double cpuFrameMilliseconds, double cpuSubmitMilliseconds){
+    mCpuFrame.Add(cpuFrameMilliseconds);
+    mCpuSubmit.Add(cpuSubmitMilliseconds);
+    int slot = mFrame % 2;
+    mCpuFrameInFlight[slot] = cpuFrameMilliseconds;
+    mCpuSubmitInFlight[slot] = cpuSubmitMilliseconds;
+    ++mFrame;
+}
+
+
+/**
+ * @brief Builds a short text with avg and p99 of every pass and the CPU frame.
+ */
+std::string GpuTimer::GetSummary() const{
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(2);
+    ss << "CPU " << mCpuFrame.GetAverage() << "ms (min " << mCpuFrame.GetMin()
+       << " p99 " << mCpuFrame.GetPercentile(99.0) << ")";
+    for (const Pass& pass : mPasses) {
+        ss << " | " << pass.name << " " << pass.stats.GetAverage() << "ms (min " << pass.stats.GetMin()
+           << " p99 " << pass.stats.GetPercentile(99.0) << ")";
+    }
+    return ss.str();
+}
+
+
+void GpuTimer::Destroy(){
+    for (Pass& pass : mPasses) {
+        glDeleteQueries(2, pass.queries);
+    }
+    mPasses.clear();
+}
@@ -0,0 +1,184 @@
+#include "Headless.hpp"
+
+#include <iostream>
+
+#if defined(LINUX)
+    #define EGL_NO_X11
+    #include <EGL/egl.h>
+    #include <EGL/eglext.h>
+#elif defined(MINGW)
+    #include <SDL2/SDL.h>
+#else
+    #include <SDL.h>
+#endif
+
+#if defined(LINUX)
+// eglGetProcAddress has the signature glad expects once cast
+static void* HeadlessGetProcAddress(const char* name){
+    return reinterpret_cast<void*>(eglGetProcAddress(name));
+}
+#else
+static void* HeadlessGetProcAddress(const char* name){
+    return SDL_GL_GetProcAddress(name);
+}
+#endif
+
+
+// Constructor
+HeadlessContext::HeadlessContext(){
+
+}
+
+
+/**
+ * @brief Creates an OpenGL 4.1 core context that is not tied to a window.
+ *
+ * @param width Width of the offscreen framebuffer.
+ * @param height Height of the offscreen framebuffer.
+ * @return true on success.
+ */
+bool HeadlessContext::Initialize(int width, int height){
+    mWidth = width;
+    mHeight = height;
+
+#if defined(LINUX)
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    EGLDisplay display = EGL_NO_DISPLAY;
+    if (getPlatformDisplay) {
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if (display == EGL_NO_DISPLAY) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+        std::cout << "Headless: unable to initialize EGL" << std::endl;
+        return false;
+    }
+    eglBindAPI(EGL_OPENGL_API);
+
+    const EGLint configAttributes[] = {
+        EGL_SURFACE_TYPE,    EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint numConfigs = 0;
+    eglChooseConfig(display, configAttributes, &config, 1, &numConfigs);
+
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 1,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, numConfigs > 0 ? config : (EGLConfig)0, EGL_NO_CONTEXT, contextAttributes);
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        std::cout << "Headless: unable to create a surfaceless OpenGL context" << std::endl;
+        return false;
+    }
+    mDisplay = display;
+    mContext = context;
+#else
+    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+        std::cout << "SDL could not initialize! SDL Error: " << SDL_GetError() << "\n";
+        return false;
+    }
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+    SDL_Window* window = SDL_CreateWindow("Headless", 0, 0, width, height, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+    SDL_GLContext context = window ? SDL_GL_CreateContext(window) : nullptr;
+    if (context == nullptr) {
+        std::cout << "Headless: unable to create a hidden OpenGL window! SDL Error: " << SDL_GetError() << "\n";
+        return false;
+    }
+    mDisplay = window;
+    mContext = context;
+#endif
+
+    if (!gladLoadGLLoader(GetLoader())) {
+        std::cout << "glad did not initialize" << std::endl;
+        return false;
+    }
+
+    // Offscreen render target that stands in for the window
+    glGenRenderbuffers(1, &mColorRenderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, mColorRenderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+    glGenRenderbuffers(1, &mDepthRenderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, mDepthRenderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    mTracked.Set(Memory::GetTextureBytes(GL_RGBA8, width, height) + Memory::GetTextureBytes(GL_DEPTH_COMPONENT24, width, height));
+
+    glGenFramebuffers(1, &mFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mColorRenderbuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mDepthRenderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "Headless: offscreen framebuffer is incomplete" << std::endl;
+        return false;
+    }
+
+    std::cout << "Headless: rendering offscreen at " << width << "x" << height
+              << " on " << glGetString(GL_RENDERER) << std::endl;
+    return true;
+}
+
+
+GLADloadproc HeadlessContext::GetLoader() const{
+    return HeadlessGetProcAddress;
+}
+
+
+void HeadlessContext::Bind() const{
+    glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+}
+
+
+/**
+ * @brief Copies the offscreen color buffer into a tightly packed RGB array.
+ *
+ * OpenGL returns the bottom row first, the rows are flipped so the result
+ * can be written out as an image directly.
+ */
+void HeadlessContext::ReadPixels(std::vector<uint8_t>& pixels) const{
+    std::vector<uint8_t> rows(mWidth * mHeight * 3);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, mFramebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, mWidth, mHeight, GL_RGB, GL_UNSIGNED_BYTE, rows.data());
+
+    pixels.resize(rows.size());
+    size_t rowSize = mWidth * 3;
+    for (int y = 0; y < mHeight; ++y) {
+        std::copy(rows.begin() + (mHeight - 1 - y) * rowSize,
+                  rows.begin() + (mHeight - y) * rowSize,
+                  pixels.begin() + y * rowSize);
+    }
+}
+
+
+void HeadlessContext::Destroy(){
+    if (mFramebuffer) glDeleteFramebuffers(1, &mFramebuffer);
+    if (mColorRenderbuffer) glDeleteRenderbuffers(1, &mColorRenderbuffer);
+    if (mDepthRenderbuffer) glDeleteRenderbuffers(1, &mDepthRenderbuffer);
+    mFramebuffer = mColorRenderbuffer = mDepthRenderbuffer = 0;
+    mTracked.Set(0);
+
+#if defined(LINUX)
+    if (mDisplay) {
+        eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(mDisplay, mContext);
+        eglTerminate(mDisplay);
+    }
+#else
+    if (mContext) SDL_GL_DeleteContext(mContext);
+    if (mDisplay) SDL_DestroyWindow(static_cast<SDL_Window*>(mDisplay));
+#endif
+    mDisplay = nullptr;
+    mContext = nullptr;
+}
@@ -1,8 +1,11 @@
 #include "Image.hpp"
-#include <fstream>
+#include "Profiler.hpp"
+#include "Memory.hpp"
+#include <algorithm>
 #include <iostream>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <memory>
 
 // Constructor
@@ -20,17 +23,19 @@ Image::~Image (){
 
 // Load the pixel data from a PPM image.
 // flip: flip the pixels upside down in the data if you use this be consistent.
-void Image::LoadPPM(bool flip){
+// scratch: holds the read buffer, rewound before returning.
+void Image::LoadPPM(bool flip, Arena& scratch){
+  PROFILE_SCOPE("LoadPPM");
+  ArenaScope scope(scratch);
 
-  // Open an input file stream for reading a file
-  std::ifstream ppmFile(m_filepath.c_str());
-  if (ppmFile.is_open()){
-      // line will store one line of input
-      std::string line;
+  // The file is streamed, one value per line makes it several times bigger than the pixels
+  LineReader ppmFile(m_filepath, scratch);
+  if (ppmFile.IsOpen()){
       std::cout << "Reading in ppm file: " << m_filepath << std::endl;
       unsigned int iteration = 0;
       unsigned int pos = 0;
-      while ( getline (ppmFile,line) ){
+      unsigned int count = 0;
+      while (char* line = ppmFile.NextLine()){
          // Ignore comments in the file
          if (line[0]=='#'){
             continue;
@@ -38,14 +43,14 @@ void Image::LoadPPM(bool flip){
          if(line[0]=='P'){
             magicNumber = line;
          }else if(iteration==1){
-            // Returns first token 
-            char *token = strtok((char*)line.c_str(), " "); 
-            m_width = atoi(token);
-            token = strtok(NULL, " ");
-            m_height = atoi(token);
+            // Width and height; strtol keeps no hidden state like strtok, images are decoded on several threads
+            char *end = nullptr;
+            m_width = static_cast<int>(strtol(line, &end, 10));
+            m_height = static_cast<int>(strtol(end, nullptr, 10));
             std::cout << "PPM width,height=" << m_width << "," << m_height << "\n";	
             if(m_width > 0 && m_height > 0){
-                m_pixelData = new uint8_t[m_width*m_height*3];
+                count = m_width*m_height*3;
+                m_pixelData = new uint8_t[count];
                 if(m_pixelData==NULL){
                     std::cout << "Unable to allocate memory for ppm" << std::endl;
                     exit(1);
@@ -57,34 +62,27 @@ void Image::LoadPPM(bool flip){
          }else if(iteration==2){
             // max color range is stored here
             // Can be stored optionally
-         }else{
-            m_pixelData[pos] = (uint8_t)atoi(line.c_str());
+         }else if(pos < count){
+            m_pixelData[pos] = (uint8_t)atoi(line);
             ++pos;
          }
           iteration++;
     }             
-    ppmFile.close();
   }
   else{
       std::cout << "Unable to open ppm file:" << m_filepath << std::endl;
   } 
 
-    // Flip all of the pixels
+    // Flip all of the pixels by swapping the first and the last ones, in place
     if(flip){
-        // Copy all of the data to a temporary stack-allocated array
-        uint8_t* copyData = new uint8_t[m_width*m_height*3];
-        for(int i =0; i < m_width*m_height*3; ++i){
-            copyData[i]=m_pixelData[i];
+        int pixels = m_width*m_height;
+        for(int i =0; i < pixels/2; ++i){
+            uint8_t* first = m_pixelData + i*3;
+            uint8_t* last = m_pixelData + (pixels-1-i)*3;
+            std::swap(first[0],last[0]);
+            std::swap(first[1],last[1]);
+            std::swap(first[2],last[2]);
         }
-        //memcpy(copyData,m_pixelData,(m_width*m_height*3)*sizeof(uint8_t));
-        unsigned int pos = (m_width*m_height*3)-1;
-        for(int i =0; i < m_width*m_height*3; i+=3){
-            m_pixelData[pos]=copyData[i+2];
-            m_pixelData[pos-1]=copyData[i+1];
-            m_pixelData[pos-2]=copyData[i];
-            pos-=3;
-        }
-        delete[] copyData;
     }
 }
 
@@ -0,0 +1,621 @@
+#include "ImageBasedLighting.hpp"
+#include "Profiler.hpp"
+#include "SoftwareShading.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+
+// Header written in front of the tables
+struct ImageBasedLightingHeader{
+    char     magic[4];      // "IBLT"
+    uint32_t version;       // Bumped whenever the file layout or the sky changes
+    uint32_t brdfSize;
+    uint32_t environmentSize;
+    uint32_t irradianceSize;
+    uint32_t samples;
+    uint32_t specularLevels;
+};
+
+static const uint32_t kImageBasedLightingVersion = 1;
+// Sky looking straight down and straight up
+static const glm::vec3 kSkyNadir(0.6f, 0.6f, 0.6f);
+static const glm::vec3 kSkyZenith(0.3f, 0.45f, 0.7f);
+
+
+ImageBasedLighting::~ImageBasedLighting(){
+    Destroy();
+}
+
+
+glm::vec3 ImageBasedLighting::SkyRadiance(const glm::vec3& direction){
+    float t = 0.5f * (direction.y + 1.0f);
+    return glm::mix(kSkyNadir, kSkyZenith, t);
+}
+
+
+// SkyRadiance() of 8 directions; the sky only changes with height
+static void SkyRadiance8(const Float8& directionY, Float8& r, Float8& g, Float8& b){
+    Float8 t = Float8(0.5f) * (directionY + Float8(1.0f));
+    r = Float8(kSkyNadir.r) + Float8(kSkyZenith.r - kSkyNadir.r) * t;
+    g = Float8(kSkyNadir.g) + Float8(kSkyZenith.g - kSkyNadir.g) * t;
+    b = Float8(kSkyNadir.b) + Float8(kSkyZenith.b - kSkyNadir.b) * t;
+}
+
+
+glm::vec3 ImageBasedLighting::CubeDirection(int face, int x, int y, int size){
+    float s = 2.0f * (x + 0.5f) / size - 1.0f;
+    float t = 2.0f * (y + 0.5f) / size - 1.0f;
+    glm::vec3 direction;
+    switch (face) {
+        case 0:  direction = glm::vec3(1.0f, -t, -s); break;
+        case 1:  direction = glm::vec3(-1.0f, -t, s); break;
+        case 2:  direction = glm::vec3(s, 1.0f, t); break;
+        case 3:  direction = glm::vec3(s, -1.0f, -t); break;
+        case 4:  direction = glm::vec3(s, -t, 1.0f); break;
+        default: direction = glm::vec3(-s, -t, -1.0f); break;
+    }
+    return glm::normalize(direction);
+}
+
+
+// Second coordinate of the i-th Hammersley point, the bits of i mirrored
+static double RadicalInverse(uint32_t bits){
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return bits * 2.3283064365386963e-10;
+}
+
+
+// Half vector around +Z for a Hammersley point, distributed like GGX with alpha = roughness^2
+static glm::dvec3 SampleGgx(int index, int count, double roughness){
+    double alpha = roughness * roughness;
+    double phi = 2.0 * 3.14159265358979323846 * index / count;
+    double u = RadicalInverse(static_cast<uint32_t>(index));
+    double cosTheta = std::sqrt((1.0 - u) / (1.0 + (alpha * alpha - 1.0) * u));
+    double sinTheta = std::sqrt(1.0 - cosTheta * cosTheta);
+    return glm::dvec3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+}
+
+
+// Direction around +Z for a Hammersley point, distributed like the cosine
+static glm::dvec3 SampleCosine(int index, int count){
+    double phi = 2.0 * 3.14159265358979323846 * index / count;
+    double u = RadicalInverse(static_cast<uint32_t>(index));
+    double sinTheta = std::sqrt(u);
+    return glm::dvec3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), std::sqrt(1.0 - u));
+}
+
+
+// Tangent and bitangent of a unit normal without branches (Duff et al. 2017)
+static void OrthonormalBasis(const glm::vec3& n, glm::vec3& tangent, glm::vec3& bitangent){
+    float sign = std::copysign(1.0f, n.z);
+    float a = -1.0f / (sign + n.z);
+    float b = n.x * n.y * a;
+    tangent = glm::vec3(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+    bitangent = glm::vec3(b, sign + n.y * n.y * a, -n.y);
+}
+
+
+// Directions of a tangent space sample set, xyz, and its weight in w
+typedef std::vector<glm::vec4> SampleSet;
+
+
+// Light directions of a prefiltered level, for view = normal = reflection (the split-sum assumption).
+// Only directions above the surface are kept, weighted by NdotL.
+static void BuildSpecularSamples(double roughness, int count, SampleSet& samples){
+    samples.clear();
+    for (int i = 0; i < count; ++i) {
+        glm::dvec3 h = SampleGgx(i, count, roughness);
+        glm::dvec3 l = 2.0 * h.z * h - glm::dvec3(0.0, 0.0, 1.0);
+        if (l.z > 0.0) {
+            samples.push_back(glm::vec4(glm::vec3(l), static_cast<float>(l.z)));
+        }
+    }
+}
+
+
+/**
+ * @brief Split-sum BRDF of one row (one roughness), one texel at a time.
+ *
+ * Per texel the view is (sqrt(1 - NdotV^2), 0, NdotV) and the normal +Z; the
+ * Smith visibility uses k = alpha / 2 as usual for image based lighting.
+ */
+static void BrdfRowScalar(float roughness, int size, const std::vector<glm::vec3>& halfVectors, float* row){
+    float k = roughness * roughness * 0.5f;
+    for (int x = 0; x < size; ++x) {
+        float NdotV = (x + 0.5f) / size;
+        glm::vec3 view(std::sqrt(1.0f - NdotV * NdotV), 0.0f, NdotV);
+        float viewTerm = 1.0f / (NdotV * (1.0f - k) + k);
+        float scale = 0.0f, bias = 0.0f;
+        for (const glm::vec3& h : halfVectors) {
+            float VdotH = std::max(glm::dot(view, h), 0.0f);
+            glm::vec3 l = 2.0f * VdotH * h - view;
+            float NdotL = std::max(l.z, 0.0f);
+            float lightTerm = NdotL / (NdotL * (1.0f - k) + k);
+            float visibility = viewTerm * lightTerm * VdotH / h.z;
+            float m = 1.0f - VdotH;
+            float fresnel = m * m * m * m * m;
+            scale += (1.0f - fresnel) * visibility;
+            bias += fresnel * visibility;
+        }
+        row[x * 2] = scale / halfVectors.size();
+        row[x * 2 + 1] = bias / halfVectors.size();
+    }
+}
+
+
+/**
+ * @brief The same row with 8 texels (8 NdotV) per Float8, every lane walks the same half vectors.
+ */
+static void BrdfRow8(float roughness, int size, const std::vector<glm::vec3>& halfVectors, float* row){
+    const Float8 one(1.0f), zero(0.0f);
+    float k = roughness * roughness * 0.5f;
+    const Float8 oneMinusK(1.0f - k), kk(k);
+    float lanes[8];
+    for (int x = 0; x < size; x += 8) {
+        for (int i = 0; i < 8; ++i) {
+            lanes[i] = (std::min(x + i, size - 1) + 0.5f) / size;
+        }
+        Float8 NdotV = Float8::Load(lanes);
+        Float8 viewX = Sqrt(Max(one - NdotV * NdotV, zero));
+        Float8 viewTerm = one / (NdotV * oneMinusK + kk);
+        Float8 scale(0.0f), bias(0.0f);
+        for (const glm::vec3& h : halfVectors) {
+            Float8 VdotH = Max(viewX * Float8(h.x) + NdotV * Float8(h.z), zero);
+            Float8 NdotL = Max(Float8(2.0f * h.z) * VdotH - NdotV, zero);
+            Float8 lightTerm = NdotL / (NdotL * oneMinusK + kk);
+            Float8 visibility = viewTerm * lightTerm * VdotH * Float8(1.0f / h.z);
+            Float8 m = one - VdotH;
+            Float8 m2 = m * m;
+            Float8 fresnel = m2 * m2 * m;
+            scale = scale + (one - fresnel) * visibility;
+            bias = bias + fresnel * visibility;
+        }
+        float scales[8], biases[8];
+        scale.Store(scales);
+        bias.Store(biases);
+        for (int i = 0; i < 8 && x + i < size; ++i) {
+            row[(x + i) * 2] = scales[i] / halfVectors.size();
+            row[(x + i) * 2 + 1] = biases[i] / halfVectors.size();
+        }
+    }
+}
+
+
+/**
+ * @brief Weighted mean of the sky over a sample set around every texel normal of one cube map row.
+ */
+static void ConvolveRowScalar(int face, int y, int size, const SampleSet& samples, float* row){
+    float totalWeight = 0.0f;
+    for (const glm::vec4& sample : samples) {
+        totalWeight += sample.w;
+    }
+    for (int x = 0; x < size; ++x) {
+        glm::vec3 normal = ImageBasedLighting::CubeDirection(face, x, y, size);
+        glm::vec3 tangent, bitangent;
+        OrthonormalBasis(normal, tangent, bitangent);
+        glm::vec3 sum(0.0f);
+        for (const glm::vec4& sample : samples) {
+            glm::vec3 direction = tangent * sample.x + bitangent * sample.y + normal * sample.z;
+            sum += sample.w * ImageBasedLighting::SkyRadiance(direction);
+        }
+        sum /= totalWeight;
+        row[x * 3] = sum.r;
+        row[x * 3 + 1] = sum.g;
+        row[x * 3 + 2] = sum.b;
+    }
+}
+
+
+/**
+ * @brief The same row with 8 texels per Float8. The basis of every lane is built
+ * once, the sample loop is then only multiplies and adds. As the sky only
+ * changes with height, only the y components of the directions are formed.
+ */
+static void ConvolveRow8(int face, int y, int size, const SampleSet& samples, float* row){
+    float totalWeight = 0.0f;
+    for (const glm::vec4& sample : samples) {
+        totalWeight += sample.w;
+    }
+    // Height of the tangent, bitangent and normal of every lane
+    float basis[3][8];
+    for (int x = 0; x < size; x += 8) {
+        for (int i = 0; i < 8; ++i) {
+            glm::vec3 normal = ImageBasedLighting::CubeDirection(face, std::min(x + i, size - 1), y, size);
+            glm::vec3 tangent, bitangent;
+            OrthonormalBasis(normal, tangent, bitangent);
+            basis[0][i] = tangent.y;
+            basis[1][i] = bitangent.y;
+            basis[2][i] = normal.y;
+        }
+        Float8 tangentY = Float8::Load(basis[0]);
+        Float8 bitangentY = Float8::Load(basis[1]);
+        Float8 normalY = Float8::Load(basis[2]);
+        Float8 sumR(0.0f), sumG(0.0f), sumB(0.0f);
+        for (const glm::vec4& sample : samples) {
+            // Only the height of the direction enters the sky
+            Float8 directionY = tangentY * Float8(sample.x) + bitangentY * Float8(sample.y) + normalY * Float8(sample.z);
+            Float8 weight(sample.w);
+            Float8 r, g, b;
+            SkyRadiance8(directionY, r, g, b);
+            sumR = sumR + weight * r;
+            sumG = sumG + weight * g;
+            sumB = sumB + weight * b;
+        }
+        float rs[8], gs[8], bs[8];
+        sumR.Store(rs);
+        sumG.Store(gs);
+        sumB.Store(bs);
+        for (int i = 0; i < 8 && x + i < size; ++i) {
+            row[(x + i) * 3] = rs[i] / totalWeight;
+            row[(x + i) * 3 + 1] = gs[i] / totalWeight;
+            row[(x + i) * 3 + 2] = bs[i] / totalWeight;
+        }
+    }
+}
+
+
+// Prefiltered levels down to 1x1 or kMaxSpecularLevels
+static int CountSpecularLevels(int environmentSize){
+    int levels = 1;
+    while ((environmentSize >> levels) > 0 && levels < ImageBasedLighting::kMaxSpecularLevels) {
+        ++levels;
+    }
+    return levels;
+}
+
+
+/**
+ * @brief Computes the BRDF table, the prefiltered levels and the irradiance map, timing each.
+ *
+ * Jobs are rows, so a table of n rows keeps up to n threads busy. The sharpest
+ * level is the sky itself (roughness 0 reflects a single direction).
+ */
+void ImageBasedLighting::ComputeTables(const Settings& settings, ThreadPool* threadPool, bool vectorized){
+    PROFILE_SCOPE("ImageBasedLighting::ComputeTables");
+    mSettings = settings;
+    mStatistics = Statistics();
+    mStatistics.threads = threadPool != nullptr ? threadPool->GetThreadCount() : 1;
+    auto parallelFor = [threadPool](size_t count, const std::function<void(size_t)>& job){
+        if (threadPool != nullptr) {
+            threadPool->ParallelFor(count, [&job](size_t index, unsigned int){ job(index); });
+        } else {
+            for (size_t index = 0; index < count; ++index) {
+                job(index);
+            }
+        }
+    };
+    typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+    auto begin = std::chrono::steady_clock::now();
+    int size = settings.brdfSize;
+    mTables.brdf.assign(static_cast<size_t>(size) * size * 2, 0.0f);
+    parallelFor(size, [&](size_t y){
+        float roughness = (y + 0.5f) / size;
+        std::vector<glm::vec3> halfVectors(settings.samples);
+        for (int i = 0; i < settings.samples; ++i) {
+            halfVectors[i] = glm::vec3(SampleGgx(i, settings.samples, roughness));
+        }
+        float* row = &mTables.brdf[y * size * 2];
+        if (vectorized) {
+            BrdfRow8(roughness, size, halfVectors, row);
+        } else {
+            BrdfRowScalar(roughness, size, halfVectors, row);
+        }
+    });
+    mStatistics.brdfMilliseconds = Milliseconds(std::chrono::steady_clock::now() - begin).count();
+
+    // Rows of all faces of a cube map, convolved with one sample set
+    auto convolve = [&](int faceSize, const SampleSet& samples, std::vector<float>& texels){
+        texels.assign(static_cast<size_t>(6) * faceSize * faceSize * 3, 0.0f);
+        parallelFor(6 * faceSize, [&](size_t index){
+            int face = static_cast<int>(index) / faceSize;
+            int y = static_cast<int>(index) % faceSize;
+            float* row = &texels[index * faceSize * 3];
+            if (vectorized) {
+                ConvolveRow8(face, y, faceSize, samples, row);
+            } else {
+                ConvolveRowScalar(face, y, faceSize, samples, row);
+            }
+        });
+    };
+
+    begin = std::chrono::steady_clock::now();
+    int levels = CountSpecularLevels(settings.environmentSize);
+    mTables.specular.resize(levels);
+    for (int level = 0; level < levels; ++level) {
+        int faceSize = std::max(1, settings.environmentSize >> level);
+        SampleSet samples;
+        if (level == 0) {
+            samples.push_back(glm::vec4(0.0f, 0.0f, 1.0f, 1.0f));
+        } else {
+            BuildSpecularSamples(GetLevelRoughness(level, levels), settings.samples, samples);
+        }
+        convolve(faceSize, samples, mTables.specular[level]);
+    }
+    mStatistics.specularMilliseconds = Milliseconds(std::chrono::steady_clock::now() - begin).count();
+
+    begin = std::chrono::steady_clock::now();
+    SampleSet samples;
+    for (int i = 0; i < settings.samples; ++i) {
+        samples.push_back(glm::vec4(glm::vec3(SampleCosine(i, settings.samples)), 1.0f));
+    }
+    convolve(settings.irradianceSize, samples, mTables.irradiance);
+    mStatistics.irradianceMilliseconds = Milliseconds(std::chrono::steady_clock::now() - begin).count();
+}
+
+
+void ImageBasedLighting::Precompute(const Settings& settings, ThreadPool* threadPool){
+    ComputeTables(settings, threadPool, true);
+}
+
+
+void ImageBasedLighting::PrecomputeScalar(const Settings& settings){
+    ComputeTables(settings, nullptr, false);
+}
+
+
+/**
+ * @brief Uses the cache file of the settings when it is complete, otherwise computes the tables and writes it.
+ */
+void ImageBasedLighting::LoadOrPrecompute(const Settings& settings, const std::string& directory, ThreadPool* threadPool){
+    PROFILE_SCOPE("ImageBasedLighting::LoadOrPrecompute");
+    mSettings = settings;
+    std::string filepath = GetCachePath(directory);
+    auto begin = std::chrono::steady_clock::now();
+    if (Load(filepath)) {
+        mStatistics = Statistics();
+        mStatistics.fromCache = true;
+        mStatistics.loadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        return;
+    }
+    Precompute(settings, threadPool);
+
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error) {
+        std::cout << "IBL: unable to create " << directory << ", the tables are not cached" << std::endl;
+        return;
+    }
+    Store(filepath);
+}
+
+
+std::string ImageBasedLighting::GetCachePath(const std::string& directory) const{
+    return directory + "/ibl_" + std::to_string(mSettings.brdfSize) + "_" + std::to_string(mSettings.environmentSize) + "_" +
+           std::to_string(mSettings.irradianceSize) + "_" + std::to_string(mSettings.samples) + ".bin";
+}
+
+
+size_t ImageBasedLighting::GetBytes() const{
+    size_t floats = mTables.brdf.size() + mTables.irradiance.size();
+    for (const std::vector<float>& level : mTables.specular) {
+        floats += level.size();
+    }
+    return floats * sizeof(float);
+}
+
+
+bool ImageBasedLighting::Load(const std::string& filepath){
+    std::ifstream file(filepath, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    ImageBasedLightingHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    int levels = CountSpecularLevels(mSettings.environmentSize);
+    if (!file || std::string(header.magic, 4) != "IBLT" || header.version != kImageBasedLightingVersion ||
+        header.brdfSize != static_cast<uint32_t>(mSettings.brdfSize) ||
+        header.environmentSize != static_cast<uint32_t>(mSettings.environmentSize) ||
+        header.irradianceSize != static_cast<uint32_t>(mSettings.irradianceSize) ||
+        header.samples != static_cast<uint32_t>(mSettings.samples) || header.specularLevels != static_cast<uint32_t>(levels)) {
+        std::cout << "IBL: ignoring stale cache file " << filepath << std::endl;
+        return false;
+    }
+
+    auto read = [&file](std::vector<float>& values, size_t count){
+        values.resize(count);
+        file.read(reinterpret_cast<char*>(values.data()), count * sizeof(float));
+    };
+    read(mTables.brdf, static_cast<size_t>(mSettings.brdfSize) * mSettings.brdfSize * 2);
+    mTables.specular.resize(levels);
+    for (int level = 0; level < levels; ++level) {
+        size_t faceSize = std::max(1, mSettings.environmentSize >> level);
+        read(mTables.specular[level], 6 * faceSize * faceSize * 3);
+    }
+    read(mTables.irradiance, static_cast<size_t>(6) * mSettings.irradianceSize * mSettings.irradianceSize * 3);
+    if (!file) {
+        std::cout << "IBL: truncated cache file " << filepath << std::endl;
+        mTables = Tables();
+        return false;
+    }
+    return true;
+}
+
+
+void ImageBasedLighting::Store(const std::string& filepath) const{
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file.is_open()) {
+        std::cout << "IBL: unable to write " << filepath << std::endl;
+        return;
+    }
+    ImageBasedLightingHeader header;
+    header.magic[0] = 'I'; header.magic[1] = 'B'; header.magic[2] = 'L'; header.magic[3] = 'T';
+    header.version = kImageBasedLightingVersion;
+    header.brdfSize = mSettings.brdfSize;
+    header.environmentSize = mSettings.environmentSize;
+    header.irradianceSize = mSettings.irradianceSize;
+    header.samples = mSettings.samples;
+    header.specularLevels = static_cast<uint32_t>(mTables.specular.size());
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    auto write = [&file](const std::vector<float>& values){
+        file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(float));
+    };
+    write(mTables.brdf);
+    for (const std::vector<float>& level : mTables.specular) {
+        write(level);
+    }
+    write(mTables.irradiance);
+}
+
+
+/**
+ * @brief Integrates the split-sum BRDF of one texel with the GGX samples of the tables, in double precision.
+ */
+glm::dvec2 ImageBasedLighting::ReferenceBrdf(double NdotV, double roughness, int samples){
+    glm::dvec3 view(std::sqrt(1.0 - NdotV * NdotV), 0.0, NdotV);
+    double k = roughness * roughness * 0.5;
+    glm::dvec2 sum(0.0);
+    for (int i = 0; i < samples; ++i) {
+        glm::dvec3 h = SampleGgx(i, samples, roughness);
+        glm::dvec3 l = 2.0 * glm::dot(view, h) * h - view;
+        if (l.z <= 0.0) {
+            continue;
+        }
+        double VdotH = std::max(glm::dot(view, h), 0.0);
+        double geometry = (NdotV / (NdotV * (1.0 - k) + k)) * (l.z / (l.z * (1.0 - k) + k));
+        double visibility = geometry * VdotH / (h.z * NdotV);
+        double fresnel = std::pow(1.0 - VdotH, 5.0);
+        sum += glm::dvec2((1.0 - fresnel) * visibility, fresnel * visibility);
+    }
+    return sum / static_cast<double>(samples);
+}
+
+
+// Tangent frame from a fixed up vector, independent of the one the tables use
+static void ReferenceBasis(const glm::dvec3& n, glm::dvec3& tangent, glm::dvec3& bitangent){
+    glm::dvec3 up = std::fabs(n.z) < 0.999 ? glm::dvec3(0.0, 0.0, 1.0) : glm::dvec3(1.0, 0.0, 0.0);
+    tangent = glm::normalize(glm::cross(up, n));
+    bitangent = glm::cross(n, tangent);
+}
+
+
+glm::dvec3 ImageBasedLighting::ReferenceSpecular(const glm::vec3& direction, double roughness, int samples){
+    glm::dvec3 n(direction), tangent, bitangent;
+    ReferenceBasis(n, tangent, bitangent);
+    glm::dvec3 sum(0.0);
+    double totalWeight = 0.0;
+    for (int i = 0; i < samples; ++i) {
+        glm::dvec3 h = SampleGgx(i, samples, roughness);
+        h = tangent * h.x + bitangent * h.y + n * h.z;
+        glm::dvec3 l = 2.0 * glm::dot(n, h) * h - n;
+        double NdotL = glm::dot(n, l);
+        if (NdotL > 0.0) {
+            sum += NdotL * glm::dvec3(SkyRadiance(glm::vec3(l)));
+            totalWeight += NdotL;
+        }
+    }
+    return sum / totalWeight;
+}
+
+
+glm::dvec3 ImageBasedLighting::ReferenceIrradiance(const glm::vec3& normal, int samples){
+    glm::dvec3 n(normal), tangent, bitangent;
+    ReferenceBasis(n, tangent, bitangent);
+    glm::dvec3 sum(0.0);
+    for (int i = 0; i < samples; ++i) {
+        glm::dvec3 l = SampleCosine(i, samples);
+        sum += glm::dvec3(SkyRadiance(glm::vec3(tangent * l.x + bitangent * l.y + n * l.z)));
+    }
+    return sum / static_cast<double>(samples);
+}
+
+
+/**
+ * @brief Creates an RG16F BRDF table and RGB16F cube maps; the prefiltered one keeps a roughness per mip.
+ */
+void ImageBasedLighting::Upload(){
+    PROFILE_SCOPE("ImageBasedLighting::Upload");
+    Destroy();
+    glGenTextures(3, mTextures);
+
+    glBindTexture(GL_TEXTURE_2D, mTextures[0]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, mSettings.brdfSize, mSettings.brdfSize, 0, GL_RG, GL_FLOAT, mTables.brdf.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    mTracked.Set(Memory::GetTextureBytes(GL_RG16F, mSettings.brdfSize, mSettings.brdfSize));
+
+    auto uploadCube = [this](GLuint texture, const std::vector<std::vector<float>>& levels, int size){
+        glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+        for (size_t level = 0; level < levels.size(); ++level) {
+            int faceSize = std::max(1, size >> level);
+            mTracked.Add(Memory::GetTextureBytes(GL_RGB16F, faceSize, faceSize, 6));
+            for (int face = 0; face < 6; ++face) {
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, static_cast<GLint>(level), GL_RGB16F, faceSize, faceSize, 0,
+                             GL_RGB, GL_FLOAT, &levels[level][static_cast<size_t>(face) * faceSize * faceSize * 3]);
+            }
+        }
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(levels.size()) - 1);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    };
+    uploadCube(mTextures[1], mTables.specular, mSettings.environmentSize);
+    uploadCube(mTextures[2], {mTables.irradiance}, mSettings.irradianceSize);
+    // Filter across cube map faces, the small levels would show their edges otherwise
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+}
+
+
+void ImageBasedLighting::Destroy(){
+    if (mTextures[0] != 0) {
+        glDeleteTextures(3, mTextures);
+        mTracked.Set(0);
+        for (GLuint& texture : mTextures) {
+            texture = 0;
+        }
+    }
+}
+
+
+void ImageBasedLighting::Bind(GLuint program) const{
+    // Samplers of different types must not share a unit, so they always get their own
+    const char* samplers[3] = {"u_BrdfLut", "u_SpecularEnvironment", "u_IrradianceEnvironment"};
+    const int units[3] = {kBrdfTextureUnit, kSpecularTextureUnit, kIrradianceTextureUnit};
+    for (int i = 0; i < 3; ++i) {
+        GLint location = glGetUniformLocation(program, samplers[i]);
+        if (location >= 0) {
+            glUniform1i(location, units[i]);
+        }
+    }
+    GLint location = glGetUniformLocation(program, "u_PbrEnabled");
+    if (location >= 0) {
+        glUniform1i(location, mTextures[0] != 0 ? 1 : 0);
+    }
+    if (mTextures[0] == 0) {
+        return;
+    }
+
+    glActiveTexture(GL_TEXTURE0 + kBrdfTextureUnit);
+    glBindTexture(GL_TEXTURE_2D, mTextures[0]);
+    glActiveTexture(GL_TEXTURE0 + kSpecularTextureUnit);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, mTextures[1]);
+    glActiveTexture(GL_TEXTURE0 + kIrradianceTextureUnit);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, mTextures[2]);
+    glActiveTexture(GL_TEXTURE0);
+    location = glGetUniformLocation(program, "u_EnvironmentMaxLod");
+    if (location >= 0) {
+        glUniform1f(location, static_cast<float>(GetSpecularLevels() - 1));
+    }
+    location = glGetUniformLocation(program, "u_EnvironmentIntensity");
+    if (location >= 0) {
+        glUniform1f(location, mIntensity);
+    }
+}
@@ -0,0 +1,58 @@
+#include "ImageCompare.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+/**
+ * @brief Compares two images of the same size.
+ *
+ * @param a First image.
+ * @param b Second image.
+ * @param tolerance Largest per-channel difference that still counts as equal.
+ * @param diff Optional image of the same size that receives the difference picture.
+ * @return Statistics of the comparison, sameSize is false if the sizes differ.
+ */
+ImageCompareResult CompareImages(const PPM& a, const PPM& b, int tolerance, PPM* diff){
+    ImageCompareResult result;
+    if (a.getWidth() != b.getWidth() || a.getHeight() != b.getHeight() || a.getWidth() == 0) {
+        return result;
+    }
+    result.sameSize = true;
+    result.pixelCount = static_cast<size_t>(a.getWidth()) * a.getHeight();
+
+    const unsigned char* pixelsA = a.pixelData();
+    const unsigned char* pixelsB = b.pixelData();
+    unsigned char* pixelsDiff = (diff != nullptr && diff->getWidth() == a.getWidth() && diff->getHeight() == a.getHeight())
+                                ? diff->pixelData() : nullptr;
+
+    double sum = 0.0;
+    double squaredSum = 0.0;
+    for (size_t i = 0; i < result.pixelCount; ++i) {
+        int pixelMax = 0;
+        for (int c = 0; c < 3; ++c) {
+            int difference = std::abs(static_cast<int>(pixelsA[i * 3 + c]) - static_cast<int>(pixelsB[i * 3 + c]));
+            pixelMax = std::max(pixelMax, difference);
+            sum += difference;
+            squaredSum += static_cast<double>(difference) * difference;
+        }
+        result.maxDifference = std::max(result.maxDifference, pixelMax);
+        bool over = pixelMax > tolerance;
+        if (over) {
+            ++result.pixelsOverTolerance;
+        }
+        if (pixelsDiff != nullptr) {
+            pixelsDiff[i * 3 + 0] = over ? 255 : 32;
+            pixelsDiff[i * 3 + 1] = over ? 0 : static_cast<unsigned char>(std::min(255, 32 + pixelMax * 8));
+            pixelsDiff[i * 3 + 2] = over ? 0 : 32;
+        }
+    }
+
+    double channels = static_cast<double>(result.pixelCount) * 3.0;
+    result.meanDifference = sum / channels;
+    double meanSquaredError = squaredSum / channels;
+    result.psnr = (meanSquaredError > 0.0) ? 10.0 * std::log10(255.0 * 255.0 / meanSquaredError)
+                                           : std::numeric_limits<double>::infinity();
+    return result;
+}
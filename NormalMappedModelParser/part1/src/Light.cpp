@@ -10,6 +10,7 @@
 #include <glad/glad.h>
 
 #include "globals.hpp"
+#include "Profiler.hpp"
 
 /// Constructor
 Light::Light(){
@@ -22,10 +23,12 @@ Light::Light(){
 // OpenGL has been setup
 void Light::Initialize()
 {
+    PROFILE_SCOPE("Light::Initialize");
     std::string vertexShaderSource      = LoadShaderAsString("./shaders/light_vert.glsl");
     std::string fragmentShaderSource    = LoadShaderAsString("./shaders/light_frag.glsl");
 
     mShaderID = CreateShaderProgram(vertexShaderSource,fragmentShaderSource);
+    g.gShaderReloader.Watch(&mShaderID, "./shaders/light_vert.glsl", "./shaders/light_frag.glsl");
 
     // Draw a cube to represent the light
     const std::vector<GLfloat> vertices{
@@ -0,0 +1,473 @@
+#include "Memory.hpp"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+
+// Global heap counters, constant initialized so they work before any static constructor
+static std::atomic<size_t> sAllocations{0};
+static std::atomic<size_t> sFrees{0};
+static std::atomic<size_t> sBytes{0};
+static std::atomic<size_t> sPeakBytes{0};
+
+// Every heap block starts with its size; the header keeps the default new alignment
+static const size_t kHeaderSize = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+
+static void* CountedAllocate(size_t size){
+    void* block = std::malloc(size + kHeaderSize);
+    if (block == nullptr) {
+        return nullptr;
+    }
+    *static_cast<size_t*>(block) = size;
+    sAllocations.fetch_add(1, std::memory_order_relaxed);
+    size_t bytes = sBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    size_t peak = sPeakBytes.load(std::memory_order_relaxed);
+    while (bytes > peak && !sPeakBytes.compare_exchange_weak(peak, bytes, std::memory_order_relaxed)) {
+    }
+    return static_cast<uint8_t*>(block) + kHeaderSize;
+}
+
+
+static void CountedFree(void* pointer){
+    if (pointer == nullptr) {
+        return;
+    }
+    uint8_t* block = static_cast<uint8_t*>(pointer) - kHeaderSize;
+    sFrees.fetch_add(1, std::memory_order_relaxed);
+    sBytes.fetch_sub(*reinterpret_cast<size_t*>(block), std::memory_order_relaxed);
+    std::free(block);
+}
+
+
+// Over-aligned blocks (alignas bigger than the default new alignment): the
+// header takes a whole alignment so the pointer after it stays aligned
+static void* CountedAllocateAligned(size_t size, std::align_val_t alignment){
+    size_t align = std::max(static_cast<size_t>(alignment), kHeaderSize);
+    // aligned_alloc wants a multiple of the alignment
+    size_t blockSize = (size + align + align - 1) / align * align;
+    void* block = std::aligned_alloc(align, blockSize);
+    if (block == nullptr) {
+        return nullptr;
+    }
+    *static_cast<size_t*>(block) = size;
+    sAllocations.fetch_add(1, std::memory_order_relaxed);
+    size_t bytes = sBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    size_t peak = sPeakBytes.load(std::memory_order_relaxed);
+    while (bytes > peak && !sPeakBytes.compare_exchange_weak(peak, bytes, std::memory_order_relaxed)) {
+    }
+    return static_cast<uint8_t*>(block) + align;
+}
+
+
+static void CountedFreeAligned(void* pointer, std::align_val_t alignment){
+    if (pointer == nullptr) {
+        return;
+    }
+    size_t align = std::max(static_cast<size_t>(alignment), kHeaderSize);
+    uint8_t* block = static_cast<uint8_t*>(pointer) - align;
+    sFrees.fetch_add(1, std::memory_order_relaxed);
+    sBytes.fetch_sub(*reinterpret_cast<size_t*>(block), std::memory_order_relaxed);
+    std::free(block);
+}
+
+
+void* operator new(size_t size){
+    void* pointer = CountedAllocate(size);
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+void* operator new[](size_t size){
+    return operator new(size);
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept{
+    return CountedAllocate(size);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept{
+    return CountedAllocate(size);
+}
+void operator delete(void* pointer) noexcept{
+    CountedFree(pointer);
+}
+void operator delete[](void* pointer) noexcept{
+    CountedFree(pointer);
+}
+void operator delete(void* pointer, size_t) noexcept{
+    CountedFree(pointer);
+}
+void operator delete[](void* pointer, size_t) noexcept{
+    CountedFree(pointer);
+}
+void operator delete(void* pointer, const std::nothrow_t&) noexcept{
+    CountedFree(pointer);
+}
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept{
+    CountedFree(pointer);
+}
+void* operator new(size_t size, std::align_val_t alignment){
+    void* pointer = CountedAllocateAligned(size, alignment);
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+void* operator new[](size_t size, std::align_val_t alignment){
+    return operator new(size, alignment);
+}
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept{
+    return CountedAllocateAligned(size, alignment);
+}
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept{
+    return CountedAllocateAligned(size, alignment);
+}
+void operator delete(void* pointer, std::align_val_t alignment) noexcept{
+    CountedFreeAligned(pointer, alignment);
+}
+void operator delete[](void* pointer, std::align_val_t alignment) noexcept{
+    CountedFreeAligned(pointer, alignment);
+}
+void operator delete(void* pointer, size_t, std::align_val_t alignment) noexcept{
+    CountedFreeAligned(pointer, alignment);
+}
+void operator delete[](void* pointer, size_t, std::align_val_t alignment) noexcept{
+    CountedFreeAligned(pointer, alignment);
+}
+void operator delete(void* pointer, std::align_val_t alignment, const std::nothrow_t&) noexcept{
+    CountedFreeAligned(pointer, alignment);
+}
+void operator delete[](void* pointer, std::align_val_t alignment, const std::nothrow_t&) noexcept{
+    CountedFreeAligned(pointer, alignment);
+}
+
+
+Memory::HeapCounters Memory::GetHeapCounters(){
+    HeapCounters counters;
+    counters.allocations = sAllocations.load(std::memory_order_relaxed);
+    counters.frees = sFrees.load(std::memory_order_relaxed);
+    counters.bytes = sBytes.load(std::memory_order_relaxed);
+    counters.peakBytes = sPeakBytes.load(std::memory_order_relaxed);
+    return counters;
+}
+
+
+void Memory::ResetHeapPeak(){
+    sPeakBytes.store(sBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+
+// Live and peak bytes per category
+static std::atomic<size_t> sCategoryBytes[static_cast<size_t>(Memory::Category::Count)];
+static std::atomic<size_t> sCategoryPeakBytes[static_cast<size_t>(Memory::Category::Count)];
+
+
+void Memory::Track(Category category, int64_t bytes){
+    size_t index = static_cast<size_t>(category);
+    if (bytes < 0) {
+        sCategoryBytes[index].fetch_sub(static_cast<size_t>(-bytes), std::memory_order_relaxed);
+        return;
+    }
+    size_t live = sCategoryBytes[index].fetch_add(static_cast<size_t>(bytes), std::memory_order_relaxed) + bytes;
+    size_t peak = sCategoryPeakBytes[index].load(std::memory_order_relaxed);
+    while (live > peak && !sCategoryPeakBytes[index].compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+
+Memory::CategoryCounters Memory::GetCategoryCounters(Category category){
+    size_t index = static_cast<size_t>(category);
+    CategoryCounters counters;
+    counters.bytes = sCategoryBytes[index].load(std::memory_order_relaxed);
+    counters.peakBytes = sCategoryPeakBytes[index].load(std::memory_order_relaxed);
+    return counters;
+}
+
+
+const char* Memory::GetCategoryName(Category category){
+    switch (category) {
+        case Category::MeshCpu: return "Mesh CPU";
+        case Category::MeshGpu: return "Mesh GPU";
+        case Category::TextureCpu: return "Texture CPU";
+        case Category::TextureGpu: return "Texture GPU";
+        case Category::FrameGpu: return "Frame GPU";
+        case Category::Scratch: return "Scratch";
+        default: return "Unknown";
+    }
+}
+
+
+size_t Memory::GetTextureBytes(unsigned int internalFormat, size_t width, size_t height, size_t layers, bool mipmaps){
+    size_t texelBytes = 4;
+    switch (internalFormat) {
+        case GL_R8: texelBytes = 1; break;
+        case GL_RG8: case GL_R16F: texelBytes = 2; break;
+        case GL_RGB16F: texelBytes = 6; break;
+        case GL_RGBA16F: case GL_RG32F: texelBytes = 8; break;
+        case GL_RGB32F: texelBytes = 12; break;
+        case GL_RGBA32F: texelBytes = 16; break;
+        default: break;
+    }
+    size_t texels = width * height;
+    // Every level halves both sides down to 1x1
+    while (mipmaps && (width > 1 || height > 1)) {
+        width = std::max<size_t>(width / 2, 1);
+        height = std::max<size_t>(height / 2, 1);
+        texels += width * height;
+    }
+    return texels * layers * texelBytes;
+}
+
+
+/**
+ * @brief Prints one line per category with the live and peak megabytes, then the heap counters.
+ */
+void Memory::PrintReport(){
+    const double megabyte = 1024.0 * 1024.0;
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(2) << "Memory (live / peak MB):";
+    size_t cpu = 0, gpu = 0;
+    for (size_t i = 0; i < static_cast<size_t>(Category::Count); ++i) {
+        Category category = static_cast<Category>(i);
+        CategoryCounters counters = GetCategoryCounters(category);
+        ss << "\n  " << std::left << std::setw(12) << GetCategoryName(category) << std::right
+           << std::setw(9) << counters.bytes / megabyte << " / " << std::setw(8) << counters.peakBytes / megabyte;
+        bool onGpu = category == Category::MeshGpu || category == Category::TextureGpu || category == Category::FrameGpu;
+        (onGpu ? gpu : cpu) += counters.bytes;
+    }
+    HeapCounters heap = GetHeapCounters();
+    ss << "\n  Tracked: " << cpu / megabyte << " MB CPU, " << gpu / megabyte << " MB GPU"
+       << "\n  Heap: " << heap.bytes / megabyte << " MB live, " << heap.allocations << " allocations, "
+       << heap.frees << " frees";
+    std::cout << ss.str() << std::endl;
+}
+
+
+void TrackedMemory::Add(size_t bytes){
+    Memory::Track(mCategory, static_cast<int64_t>(bytes));
+    mBytes += bytes;
+}
+
+
+void TrackedMemory::Set(size_t bytes){
+    if (bytes > mBytes) {
+        Add(bytes - mBytes);
+    } else if (bytes < mBytes) {
+        Memory::Track(mCategory, -static_cast<int64_t>(mBytes - bytes));
+        mBytes = bytes;
+    }
+}
+
+
+static bool IsSpace(char c){
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+
+char* Memory::NextToken(char*& cursor){
+    while (IsSpace(*cursor)) {
+        ++cursor;
+    }
+    if (*cursor == '\0') {
+        return nullptr;
+    }
+    char* token = cursor;
+    while (*cursor != '\0' && !IsSpace(*cursor)) {
+        ++cursor;
+    }
+    if (*cursor != '\0') {
+        *cursor++ = '\0';
+    }
+    return token;
+}
+
+
+Arena::Arena(size_t blockSize) : mBlockSize(blockSize){
+
+}
+
+
+Arena::~Arena(){
+    Release();
+}
+
+
+/**
+ * @brief Bumps the offset of the current block, or moves on to the next block that is big enough.
+ *
+ * Blocks kept from before a Rewind() are reused when they fit, otherwise a new
+ * block is put in front of them.
+ */
+void* Arena::Allocate(size_t size, size_t alignment){
+    if (!mBlocks.empty()) {
+        Block& block = mBlocks[mCurrent];
+        size_t offset = (reinterpret_cast<uintptr_t>(block.data) + mOffset + alignment - 1) / alignment * alignment
+                        - reinterpret_cast<uintptr_t>(block.data);
+        if (offset + size <= block.size) {
+            mOffset = offset + size;
+            mPeakBytes = std::max(mPeakBytes, GetBytesUsed());
+            return block.data + offset;
+        }
+    }
+
+    size_t next = mBlocks.empty() ? 0 : mCurrent + 1;
+    if (next >= mBlocks.size() || mBlocks[next].size < size + alignment) {
+        Block block;
+        block.size = std::max(mBlockSize, size + alignment);
+        // Through operator new, so the heap counters see the arenas too
+        block.data = static_cast<uint8_t*>(::operator new(block.size));
+        mBlocks.insert(mBlocks.begin() + next, block);
+        mTracked.Add(block.size);
+    }
+    mCurrent = next;
+    mOffset = 0;
+    return Allocate(size, alignment);
+}
+
+
+Arena::Marker Arena::GetMarker() const{
+    Marker marker;
+    marker.block = mCurrent;
+    marker.offset = mOffset;
+    return marker;
+}
+
+
+void Arena::Rewind(const Marker& marker){
+    mCurrent = marker.block;
+    mOffset = marker.offset;
+}
+
+
+void Arena::Release(){
+    for (Block& block : mBlocks) {
+        ::operator delete(block.data);
+    }
+    mBlocks.clear();
+    mTracked.Set(0);
+    mCurrent = 0;
+    mOffset = 0;
+}
+
+
+size_t Arena::GetBytesUsed() const{
+    size_t bytes = mOffset;
+    for (size_t i = 0; i < mCurrent && i < mBlocks.size(); ++i) {
+        bytes += mBlocks[i].size;
+    }
+    return bytes;
+}
+
+
+size_t Arena::GetCapacity() const{
+    size_t bytes = 0;
+    for (const Block& block : mBlocks) {
+        bytes += block.size;
+    }
+    return bytes;
+}
+
+
+LineReader::LineReader(const std::string& filepath, Arena& arena, size_t bufferSize)
+    : mFile(filepath, std::ios::binary),
+      mBuffer(arena.AllocateArray<char>(bufferSize + 1)),
+      mBufferSize(bufferSize){
+
+}
+
+
+/**
+ * @brief Cuts the next line out of the buffer, moving the rest to the front and refilling it when no line break is left.
+ */
+char* LineReader::NextLine(){
+    while (true) {
+        char* begin = mBuffer + mBegin;
+        char* end = static_cast<char*>(memchr(begin, '\n', mEnd - mBegin));
+        if (end != nullptr) {
+            mBegin = end - mBuffer + 1;
+        } else if (mEndOfFile || mEnd - mBegin == mBufferSize) {
+            // The last line without a line break, or a line longer than the buffer
+            if (mBegin == mEnd) {
+                return nullptr;
+            }
+            end = mBuffer + mEnd;
+            mBegin = mEnd;
+        } else {
+            std::memmove(mBuffer, begin, mEnd - mBegin);
+            mEnd -= mBegin;
+            mBegin = 0;
+            if (mFile.is_open()) {
+                mFile.read(mBuffer + mEnd, static_cast<std::streamsize>(mBufferSize - mEnd));
+                mEnd += static_cast<size_t>(mFile.gcount());
+            }
+            mEndOfFile = !mFile.is_open() || !mFile;
+            continue;
+        }
+        // Windows line breaks
+        if (end > begin && end[-1] == '\r') {
+            --end;
+        }
+        *end = '\0';
+        return begin;
+    }
+}
+
+
+void LineReader::Rewind(){
+    mFile.clear();
+    mFile.seekg(0);
+    mBegin = 0;
+    mEnd = 0;
+    mEndOfFile = false;
+}
+
+
+PoolAllocator::PoolAllocator(size_t blockSize, size_t blocksPerChunk)
+    : mBlockSize((std::max(blockSize, sizeof(FreeBlock)) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t)
+                 * alignof(std::max_align_t)),
+      mBlocksPerChunk(std::max<size_t>(blocksPerChunk, 1)){
+
+}
+
+
+PoolAllocator::~PoolAllocator(){
+    for (uint8_t* chunk : mChunks) {
+        ::operator delete(chunk);
+    }
+}
+
+
+void* PoolAllocator::Allocate(){
+    if (mFreeList == nullptr) {
+        // Thread a new chunk onto the free list
+        uint8_t* chunk = static_cast<uint8_t*>(::operator new(mBlockSize * mBlocksPerChunk));
+        mChunks.push_back(chunk);
+        mTracked.Add(mBlockSize * mBlocksPerChunk);
+        for (size_t i = mBlocksPerChunk; i-- > 0;) {
+            FreeBlock* block = reinterpret_cast<FreeBlock*>(chunk + i * mBlockSize);
+            block->next = mFreeList;
+            mFreeList = block;
+        }
+    }
+    FreeBlock* block = mFreeList;
+    mFreeList = block->next;
+    ++mBlocksInUse;
+    return block;
+}
+
+
+void PoolAllocator::Free(void* pointer){
+    if (pointer == nullptr) {
+        return;
+    }
+    FreeBlock* block = static_cast<FreeBlock*>(pointer);
+    block->next = mFreeList;
+    mFreeList = block;
+    --mBlocksInUse;
+}
@@ -1,10 +1,15 @@
 #include "Object.hpp"
 #include "globals.hpp"
 #include "Light.hpp"
-#include <fstream>
-#include <sstream>
+#include "Profiler.hpp"
+#include "Memory.hpp"
 #include <iostream>
 #include <map>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <cfloat>
+#include <numeric>
 #include <glm/gtc/matrix_transform.hpp> 
 
 // Helper functions to load shaders (provided in the main code)
@@ -36,7 +41,9 @@ struct VertexKey {
  *
  * The constructor initializes the object by loading vertex, texture, and normal data 
  * from the specified OBJ file. It also extracts the directory from the filepath 
- * for locating related material files (MTL).
+ * for locating related material files (MTL). Textures are decoded by thread
+ * pool jobs while the rest of the OBJ is parsed; nothing touches OpenGL, so
+ * objects can be constructed on any pool thread.
  *
  * @param filepath Path to the OBJ file to load.
  */
@@ -50,7 +57,48 @@ Object::Object(const std::string& filepath)
     } else {
         mDirectory = "";
     }
-    parseOBJ(filepath);
+    mImageJobs = g.gThreadPool.CreateJob(nullptr);
+    // Scratch memory of the parse, released at once when the constructor returns
+    Arena arena;
+    parseOBJ(filepath, arena);
+    ComputeBounds();
+    g.gThreadPool.Run(mImageJobs);
+    g.gThreadPool.Wait(mImageJobs);
+    mImageJobs = nullptr;
+    TrackCpuMemory();
+}
+
+
+/**
+ * @brief Frees the vertex attributes, indices and texture images once they are on the GPU.
+ *
+ * Bounds, chunks and the occluder stay for culling. The object can only be
+ * drawn through OpenGL afterwards, the CPU renderers and the tangent space
+ * computation need the arrays.
+ */
+void Object::DropCpuCopies()
+{
+    std::vector<glm::vec3>().swap(mVertices);
+    std::vector<glm::vec2>().swap(mTexCoords);
+    std::vector<glm::vec3>().swap(mNormals);
+    std::vector<glm::vec3>().swap(mTangents);
+    std::vector<glm::vec3>().swap(mBitangents);
+    std::vector<unsigned int>().swap(mIndices);
+    mTexture->DropImage();
+    mNormalMapTexture->DropImage();
+    mSpecularTexture->DropImage();
+    TrackCpuMemory();
+}
+
+
+/**
+ * @brief Counts the capacity of the CPU arrays as mesh memory.
+ */
+void Object::TrackCpuMemory()
+{
+    mCpuMemory.Set((mVertices.capacity() + mNormals.capacity() + mTangents.capacity() + mBitangents.capacity() +
+                    mOccluder.capacity()) * sizeof(glm::vec3) + mTexCoords.capacity() * sizeof(glm::vec2) +
+                   mIndices.capacity() * sizeof(unsigned int) + mChunks.capacity() * sizeof(Chunk));
 }
 
 
@@ -59,6 +107,11 @@ Object::Object(const std::string& filepath)
  */
 Object::~Object()
 {
+    // Nothing was uploaded if the object was only used by the software renderer
+    if (mVAO == 0) {
+        return;
+    }
+
     // Delete OpenGL buffers
     glDeleteBuffers(1, &mVBO_Vertices);
     glDeleteBuffers(1, &mVBO_TexCoords);
@@ -67,70 +120,106 @@ Object::~Object()
     glDeleteVertexArrays(1, &mVAO);
     glDeleteBuffers(1, &mVBO_Tangents);
     glDeleteBuffers(1, &mVBO_Bitangents);
-    glDeleteProgram(g.gGraphicsPipelineShaderProgram);
 }
 
 
 /**
  * @brief Parses an OBJ file to load vertex, texture, and normal data for rendering.
  *
- * This function reads an OBJ file line by line, extracting vertex positions, 
- * texture coordinates, and normals. It uses a map to avoid duplicate vertices 
- * by creating unique keys for each vertex. Indices are stored for indexed drawing,
- * and faces are triangulated if they have more than 3 vertices.
+ * This function streams the OBJ file line by line through a buffer in the arena,
+ * extracting vertex positions, texture coordinates, and normals. It uses
+ * a map to avoid duplicate vertices by creating unique keys for each vertex. Indices
+ * are stored for indexed drawing, and faces are triangulated if they have more than
+ * 3 vertices. The temporary arrays live in the arena and the map nodes in a pool,
+ * a first pass over the file counts the elements so that nothing grows while parsing.
  *
  * @param filepath Path to the OBJ file.
- * @throws runtime_error if the OBJ file cannot be opened.
+ * @param arena Scratch memory, everything allocated here is released by the caller.
  */
-void Object::parseOBJ(const std::string& filepath)
+void Object::parseOBJ(const std::string& filepath, Arena& arena)
 {
-    std::ifstream objFile(filepath);
-    if (!objFile.is_open()) {
+    PROFILE_SCOPE("parseOBJ");
+    LineReader objFile(filepath, arena);
+    if (!objFile.IsOpen()) {
         std::cerr << "Failed to open OBJ file: " << filepath << std::endl;
         exit(EXIT_FAILURE);
     }
 
-    std::string line;
-    std::string mtlFilename;
-
-    std::vector<glm::vec3> temp_vertices;
-    std::vector<glm::vec2> temp_texcoords;
-    std::vector<glm::vec3> temp_normals;
-
-    std::map<VertexKey, unsigned int> vertexMap;
-
-    while (std::getline(objFile, line)) {
-        std::stringstream ss(line);
-        std::string prefix;
-        ss >> prefix;
+    // Count the elements first
+    size_t vertexCount = 0, texcoordCount = 0, normalCount = 0, faceCount = 0;
+    while (const char* line = objFile.NextLine()) {
+        while (*line == ' ' || *line == '\t') {
+            ++line;
+        }
+        if (line[0] == 'v' && (line[1] == ' ' || line[1] == '\t')) {
+            ++vertexCount;
+        } else if (line[0] == 'v' && line[1] == 't') {
+            ++texcoordCount;
+        } else if (line[0] == 'v' && line[1] == 'n') {
+            ++normalCount;
+        } else if (line[0] == 'f' && (line[1] == ' ' || line[1] == '\t')) {
+            ++faceCount;
+        }
+    }
+    objFile.Rewind();
+
+    ArenaVector<glm::vec3> temp_vertices{ArenaAllocator<glm::vec3>(arena)};
+    ArenaVector<glm::vec2> temp_texcoords{ArenaAllocator<glm::vec2>(arena)};
+    ArenaVector<glm::vec3> temp_normals{ArenaAllocator<glm::vec3>(arena)};
+    ArenaVector<unsigned int> faceVertexIndices{ArenaAllocator<unsigned int>(arena)};
+    temp_vertices.reserve(vertexCount);
+    temp_texcoords.reserve(texcoordCount);
+    temp_normals.reserve(normalCount);
+    faceVertexIndices.reserve(16);
+    // Most vertices are shared by a few faces, so there are about as many as positions
+    mVertices.reserve(vertexCount);
+    mTexCoords.reserve(vertexCount);
+    mNormals.reserve(vertexCount);
+    mIndices.reserve(faceCount * 3);
+
+    // Map nodes are the entry behind the color and three links of the tree
+    typedef std::pair<const VertexKey, unsigned int> VertexMapEntry;
+    PoolAllocator nodePool(sizeof(VertexMapEntry) + 4 * sizeof(void*));
+    std::map<VertexKey, unsigned int, std::less<VertexKey>, PoolStdAllocator<VertexMapEntry>>
+        vertexMap{std::less<VertexKey>(), PoolStdAllocator<VertexMapEntry>(nodePool)};
+
+    while (char* line = objFile.NextLine()) {
+        const char* prefix = Memory::NextToken(line);
+        if (prefix == nullptr) {
+            continue;
+        }
 
-        if (prefix == "mtllib") {
-            ss >> mtlFilename;
-            parseMTL(mDirectory + mtlFilename);
-        } else if (prefix == "v") {
+        if (strcmp(prefix, "mtllib") == 0) {
+            if (const char* mtlFilename = Memory::NextToken(line)) {
+                parseMTL(mDirectory + mtlFilename, arena);
+            }
+        } else if (strcmp(prefix, "v") == 0) {
             glm::vec3 vertex;
-            ss >> vertex.x >> vertex.y >> vertex.z;
+            vertex.x = strtof(line, &line);
+            vertex.y = strtof(line, &line);
+            vertex.z = strtof(line, &line);
             temp_vertices.push_back(vertex);
-        } else if (prefix == "vt") {
+        } else if (strcmp(prefix, "vt") == 0) {
             glm::vec2 texcoord;
-            ss >> texcoord.x >> texcoord.y;
+            texcoord.x = strtof(line, &line);
+            texcoord.y = strtof(line, &line);
             temp_texcoords.push_back(texcoord);
-        } else if (prefix == "vn") {
+        } else if (strcmp(prefix, "vn") == 0) {
             glm::vec3 normal;
-            ss >> normal.x >> normal.y >> normal.z;
+            normal.x = strtof(line, &line);
+            normal.y = strtof(line, &line);
+            normal.z = strtof(line, &line);
             temp_normals.push_back(normal);
-        } else if (prefix == "f") {
-            std::vector<unsigned int> faceVertexIndices;
-            std::string vertexData;
-            while (ss >> vertexData) {
-                std::stringstream vertexStream(vertexData);
-                std::string value;
+        } else if (strcmp(prefix, "f") == 0) {
+            faceVertexIndices.clear();
+            while (char* vertexData = Memory::NextToken(line)) {
                 unsigned int posIndex = 0, texIndex = 0, normIndex = 0;
                 int index = 0;
-                
-                while (std::getline(vertexStream, value, '/')) {
-                    if (!value.empty()) {
-                        unsigned int idx = std::stoi(value);
+
+                // pos/tex/norm, empty fields keep their index
+                for (char* value = vertexData; *value != '\0'; ++index) {
+                    if (*value != '/') {
+                        unsigned int idx = static_cast<unsigned int>(strtol(value, &value, 10));
                         if (index == 0) {
                             posIndex = idx;
                         } else if (index == 1) {
@@ -138,8 +227,12 @@ void Object::parseOBJ(const std::string& filepath)
                         } else if (index == 2) {
                             normIndex = idx;
                         }
+                        value = strchr(value, '/');
+                        if (value == nullptr) {
+                            break;
+                        }
                     }
-                    index++;
+                    ++value;
                 }
 
                 // Adjust indices (OBJ format starts counting from 1)
@@ -150,28 +243,24 @@ void Object::parseOBJ(const std::string& filepath)
                 // Create a unique key for the vertex
                 VertexKey key = {posIndex, texIndex, normIndex};
 
-                // Check if the vertex already exists
-                if (vertexMap.find(key) == vertexMap.end()) {
+                // Add the vertex unless it already exists
+                unsigned int newIndex = static_cast<unsigned int>(mVertices.size());
+                auto inserted = vertexMap.emplace(key, newIndex);
+                if (inserted.second) {
                     // Add new vertex data
                     mVertices.push_back(temp_vertices[posIndex]);
-                    if (texIndex >= 0 && texIndex < temp_texcoords.size())
+                    if (texIndex < temp_texcoords.size())
                         mTexCoords.push_back(temp_texcoords[texIndex]);
                     else
                         mTexCoords.push_back(glm::vec2(0.0f, 0.0f));
 
-                    if (normIndex >= 0 && normIndex < temp_normals.size())
+                    if (normIndex < temp_normals.size())
                         mNormals.push_back(temp_normals[normIndex]);
                     else
                         mNormals.push_back(glm::vec3(0.0f, 0.0f, 0.0f));
-
-                    // Add to map
-                    unsigned int newIndex = static_cast<unsigned int>(mVertices.size() - 1);
-                    vertexMap[key] = newIndex;
-                    faceVertexIndices.push_back(newIndex);
-                } else {
-                    // Use existing vertex
-                    faceVertexIndices.push_back(vertexMap[key]);
                 }
+                // Use the new or the existing vertex
+                faceVertexIndices.push_back(inserted.first->second);
             }
 
             if (faceVertexIndices.size() == 3) {
@@ -188,57 +277,85 @@ void Object::parseOBJ(const std::string& filepath)
             }
         }
     }
-    objFile.close();
 }
 
 /**
- * @brief Parses an MTL file to load material properties, specifically the diffuse texture map.
+ * @brief Parses an MTL file to load material properties: the diffuse, normal and (with --pbr) specular maps.
  * @param filepath The path to the MTL file to parse.
+ * @param arena Scratch memory for the read buffer, rewound before returning.
  */
-void Object::parseMTL(const std::string& filepath)
+void Object::parseMTL(const std::string& filepath, Arena& arena)
 {
-    std::ifstream mtlFile(filepath);
-    if (!mtlFile.is_open()) {
+    PROFILE_SCOPE("parseMTL");
+    ArenaScope scope(arena);
+    LineReader mtlFile(filepath, arena);
+    if (!mtlFile.IsOpen()) {
         std::cerr << "Failed to open MTL file: " << filepath << std::endl;
         return;
     }
 
-    std::string line;
-    std::string prefix;
-    while (std::getline(mtlFile, line)) {
-        std::stringstream ss(line);
-        ss >> prefix;
-        if (prefix == "map_Kd") {
-            // Texture map
-            ss >> mTextureFilepath;
-            // Append directory if necessary
-            mTextureFilepath = mDirectory + mTextureFilepath;
+    while (char* line = mtlFile.NextLine()) {
+        const char* prefix = Memory::NextToken(line);
+        const char* value = prefix != nullptr ? Memory::NextToken(line) : nullptr;
+        if (value == nullptr) {
+            continue;
+        }
+        if (strcmp(prefix, "map_Kd") == 0) {
+            // Texture map, append directory if necessary
+            mTextureFilepath = mDirectory + value;
             std::cout << "Texture file found: " << mTextureFilepath << std::endl;
-            mTexture.LoadTexture(mTextureFilepath);
-        } else if (prefix == "map_Bump") {
+            LoadImage(mTexture, mTextureFilepath);
+        } else if (strcmp(prefix, "map_Bump") == 0) {
             // Normal map
-            std::string normalMapFilepath;
-            ss >> normalMapFilepath;
-            // Append directory if necessary
-            normalMapFilepath = mDirectory + normalMapFilepath;
+            std::string normalMapFilepath = mDirectory + value;
             std::cout << "Normal map file found: " << normalMapFilepath << std::endl;
-            mNormalMapTexture.LoadTexture(normalMapFilepath);
+            LoadImage(mNormalMapTexture, normalMapFilepath);
+        } else if (strcmp(prefix, "map_Ks") == 0 && g.gPbr) {
+            // Specular map, read by the physically based path only
+            std::string specularMapFilepath = mDirectory + value;
+            std::cout << "Specular map file found: " << specularMapFilepath << std::endl;
+            LoadImage(mSpecularTexture, specularMapFilepath);
         }
     }
-    mtlFile.close();
+}
+
+
+/**
+ * @brief Acquires a texture in a pool job that the constructor waits for, it is only decoded if no other material has the same image.
+ */
+void Object::LoadImage(TextureHandle& texture, const std::string& filepath)
+{
+    g.gThreadPool.Run(g.gThreadPool.CreateJob([&texture, filepath]{ texture = g.gAssets.AcquireTexture(filepath); }, mImageJobs));
 }
 
 /**
- * @brief Initializes the object by setting up shaders, buffers, and loading the texture.
+ * @brief Initializes the object by computing the tangent space and uploading it.
  */
 void Object::Initialize()
 {
-    // Create shaders
-    std::string vertexShaderSource = LoadShaderAsString("./shaders/vert.glsl");
-    std::string fragmentShaderSource = LoadShaderAsString("./shaders/frag.glsl");
-    g.gGraphicsPipelineShaderProgram = CreateShaderProgram(vertexShaderSource, fragmentShaderSource);
-
+    PROFILE_SCOPE("Object::Initialize");
     ComputeTangentSpace();
+    Upload();
+}
+
+
+/**
+ * @brief Sets up shaders, buffers and textures. Needs the OpenGL context, the tangent space must exist.
+ */
+void Object::Upload()
+{
+    PROFILE_SCOPE("Object::Upload");
+    // Create shaders, all objects share one program
+    if (g.gGraphicsPipelineShaderProgram == 0) {
+        std::string vertexShaderSource = LoadShaderAsString("./shaders/vert.glsl");
+        std::string fragmentShaderSource = LoadShaderAsString("./shaders/frag.glsl");
+        g.gGraphicsPipelineShaderProgram = CreateShaderProgram(vertexShaderSource, fragmentShaderSource);
+        g.gShaderReloader.Watch(&g.gGraphicsPipelineShaderProgram, "./shaders/vert.glsl", "./shaders/frag.glsl");
+    }
+
+    mTexture->Upload();
+    mNormalMapTexture->Upload();
+    mSpecularTexture->Upload();
 
     glEnable(GL_CULL_FACE);
     glEnable(GL_DEPTH_TEST);
@@ -274,7 +391,6 @@ void Object::Initialize()
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, mIndices.size() * sizeof(unsigned int), &mIndices[0], GL_STATIC_DRAW);
 
     // VBO for tangents
-    GLuint mVBO_Tangents;
     glGenBuffers(1, &mVBO_Tangents);
     glBindBuffer(GL_ARRAY_BUFFER, mVBO_Tangents);
     glBufferData(GL_ARRAY_BUFFER, mTangents.size() * sizeof(glm::vec3), &mTangents[0], GL_STATIC_DRAW);
@@ -282,7 +398,6 @@ void Object::Initialize()
     glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 
     // VBO for bitangents
-    GLuint mVBO_Bitangents;
     glGenBuffers(1, &mVBO_Bitangents);
     glBindBuffer(GL_ARRAY_BUFFER, mVBO_Bitangents);
     glBufferData(GL_ARRAY_BUFFER, mBitangents.size() * sizeof(glm::vec3), &mBitangents[0], GL_STATIC_DRAW);
@@ -290,6 +405,9 @@ void Object::Initialize()
     glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 
     glBindVertexArray(0);
+    mIndexCount = mIndices.size();
+    mGpuMemory.Set((mVertices.size() + mNormals.size() + mTangents.size() + mBitangents.size()) * sizeof(glm::vec3) +
+                   mTexCoords.size() * sizeof(glm::vec2) + mIndices.size() * sizeof(unsigned int));
     std::cout << "Number of vertices loaded: " << mVertices.size() << std::endl;
     std::cout << "Number of indices loaded: " << mIndices.size() << std::endl;
     std::cout << "Number of texture coordinates loaded: " << mTexCoords.size() << std::endl;
@@ -300,30 +418,21 @@ void Object::Initialize()
 /**
  * @brief Prepares the object for drawing by setting uniforms and binding textures.
  *
- * This function applies model transformations (translation and rotation), sets 
- * various uniform variables (model, view, and projection matrices), binds the
- * texture and normal map, and passes light and view positions for lighting.
+ * This function sets various uniform variables (model, view, and projection
+ * matrices), binds the texture and normal map, and passes light and view
+ * positions for lighting.
  *
+ * @param model World matrix of the scene node the object is drawn for.
+ * @param program Forward shading program, or the G-buffer program of the deferred path.
  * @return void
  */
-void Object::PreDraw()
+void Object::PreDraw(const glm::mat4& model, GLuint program)
 {
     // Use shader 
-    glUseProgram(g.gGraphicsPipelineShaderProgram);
-
-    // Model transformation by translating our object into world space
-    glm::mat4 model = glm::translate(glm::mat4(1.0f),glm::vec3(0.0f,0.0f,g.g_uOffset)); 
-    model = glm::rotate(model,glm::radians(g.g_uRotate),glm::vec3(0.0f,1.0f,0.0f));
-    
-    // auto rotate
-    static float rot=0.0f;
-    // rot += 0.01f;
-    model = glm::rotate(model,glm::radians(rot),glm::vec3(0.0f,1.0f,0.0f)); 
-
-    glm::vec3 lightPos = glm::vec3(0.0f, 10.0f, 10.0f);
+    glUseProgram(program);
 
     // Retrieve our location of our Model Matrix
-    GLint u_ModelMatrixLocation = glGetUniformLocation(g.gGraphicsPipelineShaderProgram, "u_ModelMatrix");
+    GLint u_ModelMatrixLocation = glGetUniformLocation(program, "u_ModelMatrix");
     if (u_ModelMatrixLocation >= 0) {
         glUniformMatrix4fv(u_ModelMatrixLocation, 1, GL_FALSE, &model[0][0]);
     } else {
@@ -332,7 +441,7 @@ void Object::PreDraw()
     }
 
     // Update the View Matrix
-    GLint u_ViewMatrixLocation = glGetUniformLocation(g.gGraphicsPipelineShaderProgram, "u_ViewMatrix");
+    GLint u_ViewMatrixLocation = glGetUniformLocation(program, "u_ViewMatrix");
     if (u_ViewMatrixLocation >= 0) {
         glm::mat4 viewMatrix = g.gCamera.GetViewMatrix();
         glUniformMatrix4fv(u_ViewMatrixLocation, 1, GL_FALSE, &viewMatrix[0][0]);
@@ -348,7 +457,7 @@ void Object::PreDraw()
                                              100.0f);
 
     // Retrieve our location of our perspective matrix uniform 
-    GLint u_ProjectionLocation = glGetUniformLocation(g.gGraphicsPipelineShaderProgram, "u_Projection");
+    GLint u_ProjectionLocation = glGetUniformLocation(program, "u_Projection");
     if (u_ProjectionLocation >= 0) {
         glUniformMatrix4fv(u_ProjectionLocation, 1, GL_FALSE, &perspective[0][0]);
     } else {
@@ -357,10 +466,10 @@ void Object::PreDraw()
     }
 
     // Bind texture
-    mTexture.Bind(0);
+    mTexture->Bind(0);
 
     // Setup our uniform for our texture
-    GLint u_textureLocation = glGetUniformLocation(g.gGraphicsPipelineShaderProgram, "u_DiffuseTexture");
+    GLint u_textureLocation = glGetUniformLocation(program, "u_DiffuseTexture");
     if (u_textureLocation >= 0) {
         // Setup the slot for the texture
         glUniform1i(u_textureLocation, 0);
@@ -370,26 +479,44 @@ void Object::PreDraw()
     }
 
     // Set light position uniform
-    GLint u_LightPosLocation = glGetUniformLocation(g.gGraphicsPipelineShaderProgram, "u_LightPos");
+    GLint u_LightPosLocation = glGetUniformLocation(program, "u_LightPos");
     if (u_LightPosLocation >= 0) {
         glm::vec3 lightPos = g.gLight.GetPosition();
         glUniform3f(u_LightPosLocation, lightPos.x, lightPos.y, lightPos.z);
     }
 
     // Set view position uniform
-    GLint u_ViewPosLocation = glGetUniformLocation(g.gGraphicsPipelineShaderProgram, "u_ViewPos");
+    GLint u_ViewPosLocation = glGetUniformLocation(program, "u_ViewPos");
     if (u_ViewPosLocation >= 0) {
         glUniform3f(u_ViewPosLocation, g.gCamera.GetEyeXPosition(), g.gCamera.GetEyeYPosition(), g.gCamera.GetEyeZPosition());
     }
 
     // Bind the normal map texture
-    mNormalMapTexture.Bind(1); // Bind to texture unit 1
+    mNormalMapTexture->Bind(1); // Bind to texture unit 1
 
     // Set the normal map sampler uniform
-    GLint u_NormalMapLocation = glGetUniformLocation(g.gGraphicsPipelineShaderProgram, "u_NormalMap");
+    GLint u_NormalMapLocation = glGetUniformLocation(program, "u_NormalMap");
     if (u_NormalMapLocation >= 0) {
         glUniform1i(u_NormalMapLocation, 1); // Texture unit 1
     }
+
+    // Specular map, texture unit 6; its sampler is set even without a map so it never shares unit 0
+    mSpecularTexture->Bind(6);
+    GLint u_SpecularMapLocation = glGetUniformLocation(program, "u_SpecularMap");
+    if (u_SpecularMapLocation >= 0) {
+        glUniform1i(u_SpecularMapLocation, 6);
+    }
+    GLint u_HasSpecularMapLocation = glGetUniformLocation(program, "u_HasSpecularMap");
+    if (u_HasSpecularMapLocation >= 0) {
+        glUniform1i(u_HasSpecularMapLocation, mSpecularTexture->IsLoaded() ? 1 : 0);
+    }
+
+    // Point light clusters, texture units 2 to 4
+    g.gClusteredLights.Bind(program, g.gScreenWidth, g.gScreenHeight);
+    // Shadow cascades, texture unit 5
+    g.gCascadedShadows.Bind(program, g.gCamera.GetViewMatrix());
+    // Image based lighting tables, texture units 7 to 9
+    g.gImageBasedLighting.Bind(program);
 }
 
 
@@ -404,12 +531,137 @@ void Object::PreDraw()
 void Object::Draw()
 {
     glBindVertexArray(mVAO);
-    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(mIndices.size()), GL_UNSIGNED_INT, 0);
+    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(mIndexCount), GL_UNSIGNED_INT, 0);
     glBindVertexArray(0);
     glUseProgram(0);
 }
 
 
+/**
+ * @brief Draws a subset of the chunks with as few draw calls as possible.
+ *
+ * Chunks that follow each other in the index buffer are merged into one draw.
+ *
+ * @param chunks Indices into GetChunks(), sorted in increasing order.
+ * @return void
+ */
+void Object::DrawChunks(const std::vector<unsigned int>& chunks)
+{
+    DrawChunkRanges(chunks);
+    glUseProgram(0);
+}
+
+
+/**
+ * @brief Issues the draws of DrawChunks() but keeps the program, so many objects can share one program bind.
+ *
+ * @param chunks Indices into GetChunks(), sorted in increasing order.
+ * @return Number of draw calls.
+ */
+size_t Object::DrawChunkRanges(const std::vector<unsigned int>& chunks)
+{
+    glBindVertexArray(mVAO);
+    size_t drawCalls = 0;
+    size_t i = 0;
+    while (i < chunks.size()) {
+        size_t last = i;
+        while (last + 1 < chunks.size() && chunks[last + 1] == chunks[last] + 1) {
+            ++last;
+        }
+        const Chunk& first = mChunks[chunks[i]];
+        const Chunk& end = mChunks[chunks[last]];
+        GLsizei count = static_cast<GLsizei>(end.firstIndex + end.indexCount - first.firstIndex);
+        glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, (void*)(first.firstIndex * sizeof(unsigned int)));
+        ++drawCalls;
+        i = last + 1;
+    }
+    glBindVertexArray(0);
+    return drawCalls;
+}
+
+
+/**
+ * @brief Reorders the triangles along a Morton curve of their centers and cuts them into chunks.
+ *
+ * Triangles close to each other end up in the same chunk, so the chunk bounds
+ * are small and culling them removes whole parts of large models. The order
+ * of triangles does not change what is drawn.
+ *
+ * The largest triangles become the occluder used for occlusion culling. Being
+ * part of the real surface, they never hide anything the mesh would not.
+ *
+ * @return void
+ */
+void Object::ComputeBounds()
+{
+    PROFILE_SCOPE("ComputeBounds");
+    mChunks.clear();
+    size_t triangleCount = mIndices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+    mBoundsMin = glm::vec3(FLT_MAX);
+    mBoundsMax = glm::vec3(-FLT_MAX);
+    for (unsigned int index : mIndices) {
+        mBoundsMin = glm::min(mBoundsMin, mVertices[index]);
+        mBoundsMax = glm::max(mBoundsMax, mVertices[index]);
+    }
+
+    // 10 bits per axis of the center inside the bounds, interleaved
+    auto spreadBits = [](uint32_t v){
+        v = (v | (v << 16)) & 0x030000FF;
+        v = (v | (v << 8)) & 0x0300F00F;
+        v = (v | (v << 4)) & 0x030C30C3;
+        v = (v | (v << 2)) & 0x09249249;
+        return v;
+    };
+    glm::vec3 scale = 1023.0f / glm::max(mBoundsMax - mBoundsMin, glm::vec3(1e-6f));
+    std::vector<uint32_t> codes(triangleCount);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        glm::vec3 center = (mVertices[mIndices[t * 3]] + mVertices[mIndices[t * 3 + 1]] + mVertices[mIndices[t * 3 + 2]]) * (1.0f / 3.0f);
+        glm::uvec3 cell = glm::uvec3((center - mBoundsMin) * scale);
+        codes[t] = spreadBits(cell.x) | (spreadBits(cell.y) << 1) | (spreadBits(cell.z) << 2);
+    }
+    std::vector<uint32_t> order(triangleCount);
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [&codes](uint32_t a, uint32_t b){ return codes[a] < codes[b]; });
+    std::vector<unsigned int> sorted(mIndices.size());
+    for (size_t t = 0; t < triangleCount; ++t) {
+        std::copy_n(&mIndices[order[t] * 3], 3, &sorted[t * 3]);
+    }
+    mIndices.swap(sorted);
+
+    for (size_t first = 0; first < triangleCount; first += kTrianglesPerChunk) {
+        size_t last = std::min(triangleCount, first + kTrianglesPerChunk);
+        Chunk chunk;
+        chunk.firstIndex = static_cast<unsigned int>(first * 3);
+        chunk.indexCount = static_cast<unsigned int>((last - first) * 3);
+        chunk.boundsMin = glm::vec3(FLT_MAX);
+        chunk.boundsMax = glm::vec3(-FLT_MAX);
+        for (unsigned int i = chunk.firstIndex; i < chunk.firstIndex + chunk.indexCount; ++i) {
+            chunk.boundsMin = glm::min(chunk.boundsMin, mVertices[mIndices[i]]);
+            chunk.boundsMax = glm::max(chunk.boundsMax, mVertices[mIndices[i]]);
+        }
+        mChunks.push_back(chunk);
+    }
+
+    std::vector<std::pair<float, uint32_t>> areas(triangleCount);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        const glm::vec3& v0 = mVertices[mIndices[t * 3]];
+        glm::vec3 normal = glm::cross(mVertices[mIndices[t * 3 + 1]] - v0, mVertices[mIndices[t * 3 + 2]] - v0);
+        areas[t] = {-glm::length(normal), static_cast<uint32_t>(t)};
+    }
+    size_t occluderCount = std::min<size_t>(triangleCount, kOccluderTriangles);
+    std::partial_sort(areas.begin(), areas.begin() + occluderCount, areas.end());
+    mOccluder.clear();
+    for (size_t i = 0; i < occluderCount; ++i) {
+        for (int corner = 0; corner < 3; ++corner) {
+            mOccluder.push_back(mVertices[mIndices[areas[i].second * 3 + corner]]);
+        }
+    }
+}
+
+
 /**
  * @brief Computes tangent and bitangent vectors for each vertex to support normal mapping.
  *
@@ -421,8 +673,10 @@ void Object::Draw()
  */
 void Object::ComputeTangentSpace()
 {
+    PROFILE_SCOPE("ComputeTangentSpace");
     mTangents.resize(mVertices.size(), glm::vec3(0.0f));
     mBitangents.resize(mVertices.size(), glm::vec3(0.0f));
+    TrackCpuMemory();
 
     // Iterate over each triangle
     for (size_t i = 0; i < mIndices.size(); i += 3)
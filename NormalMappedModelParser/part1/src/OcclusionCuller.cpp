@@ -0,0 +1,326 @@
+#include "OcclusionCuller.hpp"
+#include "Profiler.hpp"
+#include "PPM.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define OCCLUSIONCULLER_SSE
+#endif
+
+// Vertices closer to the eye plane than this are not projected
+static const float kMinW = 1e-4f;
+
+
+OcclusionCuller::~OcclusionCuller(){
+    Shutdown();
+}
+
+
+/**
+ * @brief Allocates the pyramid. The width of level 0 is rounded up to a multiple of four for SSE.
+ */
+void OcclusionCuller::Initialize(int width, int height, ThreadPool* threadPool){
+    Shutdown();
+    Level level;
+    level.width = std::max(4, (width + 3) & ~3);
+    level.height = std::max(1, height);
+    level.depth.assign(static_cast<size_t>(level.width) * level.height, 1.0f);
+    mLevels.push_back(level);
+    while (level.width > 1 || level.height > 1) {
+        level.width = (level.width + 1) / 2;
+        level.height = (level.height + 1) / 2;
+        level.depth.assign(static_cast<size_t>(level.width) * level.height, 1.0f);
+        mLevels.push_back(level);
+    }
+    mThreadPool = threadPool;
+}
+
+
+void OcclusionCuller::Shutdown(){
+    if (mJob != nullptr) {
+        Wait();
+    }
+    mLevels.clear();
+    mThreadPool = nullptr;
+}
+
+
+/**
+ * @brief Queues the job on the thread pool, or runs it right away if there is no pool.
+ */
+void OcclusionCuller::Start(const glm::mat4& viewProjection, const std::vector<Occluder>& occluders,
+                            const FrustumCuller& boxes, const std::vector<uint32_t>& candidates){
+    if (mThreadPool == nullptr) {
+        Run(viewProjection, occluders, boxes, candidates);
+        return;
+    }
+    mViewProjection = viewProjection;
+    mOccluders = occluders;
+    mBoxes = &boxes;
+    mCandidates = &candidates;
+    mJob = mThreadPool->CreateJob([this]{ Execute(); });
+    mThreadPool->Run(mJob);
+}
+
+
+/**
+ * @brief Waits for the started job, running other pool jobs meanwhile.
+ */
+const std::vector<uint32_t>& OcclusionCuller::Wait(){
+    PROFILE_SCOPE("OcclusionCuller::Wait");
+    if (mJob == nullptr) {
+        return mVisible;
+    }
+    auto begin = std::chrono::steady_clock::now();
+    mThreadPool->Wait(mJob);
+    mJob = nullptr;
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+    mStatistics.waitMilliseconds = elapsed.count();
+    return mVisible;
+}
+
+
+void OcclusionCuller::Run(const glm::mat4& viewProjection, const std::vector<Occluder>& occluders,
+                          const FrustumCuller& boxes, const std::vector<uint32_t>& candidates){
+    mViewProjection = viewProjection;
+    mOccluders = occluders;
+    mBoxes = &boxes;
+    mCandidates = &candidates;
+    Execute();
+    mStatistics.waitMilliseconds = 0.0;
+}
+
+
+void OcclusionCuller::Execute(){
+    PROFILE_SCOPE("OcclusionCuller::Execute");
+    auto begin = std::chrono::steady_clock::now();
+    Rasterize();
+    BuildPyramid();
+    auto rasterized = std::chrono::steady_clock::now();
+
+    mVisible.clear();
+    glm::vec3 boundsMin, boundsMax;
+    for (uint32_t candidate : *mCandidates) {
+        mBoxes->GetBox(candidate, boundsMin, boundsMax);
+        if (TestBox(boundsMin, boundsMax)) {
+            mVisible.push_back(candidate);
+        }
+    }
+    auto tested = std::chrono::steady_clock::now();
+
+    mStatistics.tested = mCandidates->size();
+    mStatistics.occluded = mCandidates->size() - mVisible.size();
+    mStatistics.rasterMilliseconds = std::chrono::duration<double, std::milli>(rasterized - begin).count();
+    mStatistics.testMilliseconds = std::chrono::duration<double, std::milli>(tested - rasterized).count();
+}
+
+
+void OcclusionCuller::Rasterize(){
+    std::fill(mLevels[0].depth.begin(), mLevels[0].depth.end(), 1.0f);
+    size_t triangles = 0;
+    for (const Occluder& occluder : mOccluders) {
+        glm::mat4 modelViewProjection = mViewProjection * occluder.model;
+        const std::vector<glm::vec3>& corners = *occluder.triangles;
+        for (size_t i = 0; i + 2 < corners.size(); i += 3) {
+            RasterizeTriangle(modelViewProjection * glm::vec4(corners[i], 1.0f),
+                              modelViewProjection * glm::vec4(corners[i + 1], 1.0f),
+                              modelViewProjection * glm::vec4(corners[i + 2], 1.0f));
+        }
+        triangles += corners.size() / 3;
+    }
+    mStatistics.occluderTriangles = triangles;
+}
+
+
+/**
+ * @brief Writes the farthest depth of the triangle into every covered pixel where it is nearer.
+ *
+ * Using one depth for the whole triangle keeps the inner loop to a min, and it
+ * can only make the occluder look farther away than it is. Triangles that reach
+ * behind the eye are skipped, which is also safe. Both windings are drawn.
+ */
+void OcclusionCuller::RasterizeTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c){
+    if (a.w < kMinW || b.w < kMinW || c.w < kMinW) {
+        return;
+    }
+    Level& level = mLevels[0];
+    const float width = static_cast<float>(level.width);
+    const float height = static_cast<float>(level.height);
+    glm::vec2 p0((a.x / a.w * 0.5f + 0.5f) * width, (a.y / a.w * 0.5f + 0.5f) * height);
+    glm::vec2 p1((b.x / b.w * 0.5f + 0.5f) * width, (b.y / b.w * 0.5f + 0.5f) * height);
+    glm::vec2 p2((c.x / c.w * 0.5f + 0.5f) * width, (c.y / c.w * 0.5f + 0.5f) * height);
+    float depth = std::max(std::max(a.z / a.w, b.z / b.w), c.z / c.w) * 0.5f + 0.5f;
+    if (depth >= 1.0f) {
+        return;
+    }
+
+    float area = (p1.x - p0.x) * (p2.y - p0.y) - (p1.y - p0.y) * (p2.x - p0.x);
+    if (std::fabs(area) < 1e-8f) {
+        return;
+    }
+    if (area < 0.0f) {
+        std::swap(p1, p2);
+    }
+
+    int minX = std::max(0, static_cast<int>(std::floor(std::min(std::min(p0.x, p1.x), p2.x))));
+    int maxX = std::min(level.width - 1, static_cast<int>(std::ceil(std::max(std::max(p0.x, p1.x), p2.x))));
+    int minY = std::max(0, static_cast<int>(std::floor(std::min(std::min(p0.y, p1.y), p2.y))));
+    int maxY = std::min(level.height - 1, static_cast<int>(std::ceil(std::max(std::max(p0.y, p1.y), p2.y))));
+    if (minX > maxX || minY > maxY) {
+        return;
+    }
+
+    // Edge e(p) = A * p.x + B * p.y + C, positive inside
+    const glm::vec2* corners[3] = {&p0, &p1, &p2};
+    float edgeA[3], edgeB[3], edgeC[3];
+    for (int e = 0; e < 3; ++e) {
+        const glm::vec2& from = *corners[e];
+        const glm::vec2& to = *corners[(e + 1) % 3];
+        edgeA[e] = from.y - to.y;
+        edgeB[e] = to.x - from.x;
+        edgeC[e] = from.x * to.y - from.y * to.x;
+    }
+
+    minX &= ~3;
+    for (int y = minY; y <= maxY; ++y) {
+        float* row = &level.depth[static_cast<size_t>(y) * level.width];
+        float centerY = static_cast<float>(y) + 0.5f;
+        int x = minX;
+#if defined(OCCLUSIONCULLER_SSE)
+        const __m128 steps = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 triangleDepth = _mm_set1_ps(depth);
+        __m128 stepA[3], rowEdge[3];
+        for (int e = 0; e < 3; ++e) {
+            stepA[e] = _mm_set1_ps(edgeA[e] * 4.0f);
+            rowEdge[e] = _mm_add_ps(_mm_set1_ps(edgeA[e] * static_cast<float>(x) + edgeB[e] * centerY + edgeC[e]),
+                                    _mm_mul_ps(_mm_set1_ps(edgeA[e]), steps));
+        }
+        for (; x <= maxX; x += 4) {
+            __m128 inside = _mm_and_ps(_mm_cmpge_ps(rowEdge[0], zero), _mm_cmpge_ps(rowEdge[1], zero));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(rowEdge[2], zero));
+            if (_mm_movemask_ps(inside) != 0) {
+                __m128 stored = _mm_loadu_ps(row + x);
+                __m128 nearer = _mm_min_ps(stored, triangleDepth);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, stored)));
+            }
+            for (int e = 0; e < 3; ++e) {
+                rowEdge[e] = _mm_add_ps(rowEdge[e], stepA[e]);
+            }
+        }
+#else
+        for (; x <= maxX; ++x) {
+            float centerX = static_cast<float>(x) + 0.5f;
+            bool inside = true;
+            for (int e = 0; e < 3 && inside; ++e) {
+                inside = edgeA[e] * centerX + edgeB[e] * centerY + edgeC[e] >= 0.0f;
+            }
+            if (inside) {
+                row[x] = std::min(row[x], depth);
+            }
+        }
+#endif
+    }
+}
+
+
+/**
+ * @brief Every texel of a level keeps the farthest of the 2x2 texels below it.
+ */
+void OcclusionCuller::BuildPyramid(){
+    for (size_t l = 1; l < mLevels.size(); ++l) {
+        const Level& source = mLevels[l - 1];
+        Level& target = mLevels[l];
+        for (int y = 0; y < target.height; ++y) {
+            int y0 = 2 * y;
+            int y1 = std::min(y0 + 1, source.height - 1);
+            for (int x = 0; x < target.width; ++x) {
+                int x0 = 2 * x;
+                int x1 = std::min(x0 + 1, source.width - 1);
+                float farthest = std::max(std::max(source.depth[y0 * source.width + x0], source.depth[y0 * source.width + x1]),
+                                          std::max(source.depth[y1 * source.width + x0], source.depth[y1 * source.width + x1]));
+                target.depth[y * target.width + x] = farthest;
+            }
+        }
+    }
+}
+
+
+/**
+ * @brief Compares the nearest depth of the box with the farthest occluder depth over its screen rectangle.
+ *
+ * The level is picked so that the rectangle spans at most 2x2 texels. Boxes
+ * reaching behind the eye are always visible.
+ */
+bool OcclusionCuller::TestBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const{
+    glm::vec2 screenMin(FLT_MAX), screenMax(-FLT_MAX);
+    float nearest = FLT_MAX;
+    for (int corner = 0; corner < 8; ++corner) {
+        glm::vec4 position(corner & 1 ? boundsMax.x : boundsMin.x,
+                           corner & 2 ? boundsMax.y : boundsMin.y,
+                           corner & 4 ? boundsMax.z : boundsMin.z, 1.0f);
+        glm::vec4 clip = mViewProjection * position;
+        if (clip.w < kMinW) {
+            return true;
+        }
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        screenMin = glm::min(screenMin, glm::vec2(ndc));
+        screenMax = glm::max(screenMax, glm::vec2(ndc));
+        nearest = std::min(nearest, ndc.z * 0.5f + 0.5f);
+    }
+
+    const Level& base = mLevels[0];
+    int x0 = static_cast<int>(std::floor((screenMin.x * 0.5f + 0.5f) * base.width));
+    int x1 = static_cast<int>(std::floor((screenMax.x * 0.5f + 0.5f) * base.width));
+    int y0 = static_cast<int>(std::floor((screenMin.y * 0.5f + 0.5f) * base.height));
+    int y1 = static_cast<int>(std::floor((screenMax.y * 0.5f + 0.5f) * base.height));
+    if (x1 < 0 || y1 < 0 || x0 >= base.width || y0 >= base.height) {
+        return true;
+    }
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, base.width - 1);
+    y1 = std::min(y1, base.height - 1);
+
+    int size = std::max(x1 - x0, y1 - y0) + 1;
+    size_t l = 0;
+    while ((1 << l) < size && l + 1 < mLevels.size()) {
+        ++l;
+    }
+    const Level& level = mLevels[l];
+    float farthest = 0.0f;
+    for (int y = y0 >> l; y <= (y1 >> l); ++y) {
+        for (int x = x0 >> l; x <= (x1 >> l); ++x) {
+            farthest = std::max(farthest, level.depth[y * level.width + x]);
+        }
+    }
+    return nearest <= farthest;
+}
+
+
+/**
+ * @brief Level 0 as gray levels, stretched between the nearest depth and the far plane.
+ */
+void OcclusionCuller::WriteDepthImage(const std::string& filePath) const{
+    if (mLevels.empty()) {
+        return;
+    }
+    const Level& level = mLevels[0];
+    float nearest = *std::min_element(level.depth.begin(), level.depth.end());
+    float range = std::max(1.0f - nearest, 1e-6f);
+    PPM image(level.width, level.height);
+    for (int y = 0; y < level.height; ++y) {
+        for (int x = 0; x < level.width; ++x) {
+            float value = (level.depth[y * level.width + x] - nearest) / range;
+            uint8_t gray = static_cast<uint8_t>(std::min(std::max(value, 0.0f), 1.0f) * 255.0f);
+            // Rows are stored bottom up
+            image.setPixel(x, level.height - 1 - y, gray, gray, gray);
+        }
+    }
+    image.savePPM(filePath);
+}
@@ -0,0 +1,362 @@
+#include "PathTracer.hpp"
+#include "Profiler.hpp"
+#include "ImageBasedLighting.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cfloat>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <string>
+
+static const float kPi = 3.14159265f;
+// Power of the point light, chosen so a surface one unit away is lit like the rasterizer's diffuse term
+static const float kLightIntensity = 20.0f;
+// Offset of secondary rays from the surface they start on
+static const float kRayEpsilon = 1e-3f;
+
+
+// Normalize, or zero for vectors without a direction (e.g. OBJ files without normals)
+static glm::vec3 SafeNormalize(const glm::vec3& v){
+    float length = glm::length(v);
+    return (length > 0.0f && std::isfinite(length)) ? v / length : glm::vec3(0.0f);
+}
+
+
+// PCG hash, used both to seed and to step the per pixel random numbers
+static uint32_t Hash(uint32_t value){
+    uint32_t state = value * 747796405u + 2891336453u;
+    uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+
+// Uniform float in [0,1)
+static float NextRandom(uint32_t& state){
+    state = Hash(state);
+    return (state >> 8) * (1.0f / 16777216.0f);
+}
+
+
+// Constructor
+PathTracer::PathTracer(){
+
+}
+
+
+/**
+ * @brief Copies the triangles of an object into the scene.
+ *
+ * Positions and the tangent frame are moved into world space so the Bvh can be
+ * built over all objects at once.
+ *
+ * @param object Object whose vertex and index data are traced.
+ * @param model Model matrix of the object.
+ */
+void PathTracer::AddObject(const Object& object, const glm::mat4& model){
+    PROFILE_SCOPE("PathTracer::AddObject");
+    const std::vector<glm::vec3>& positions = object.GetVertices();
+    const std::vector<glm::vec3>& normals   = object.GetNormals();
+    const std::vector<glm::vec2>& texCoords = object.GetTexCoords();
+    const std::vector<glm::vec3>& tangents  = object.GetTangents();
+    const std::vector<glm::vec3>& bitangents = object.GetBitangents();
+    const std::vector<unsigned int>& indices = object.GetIndices();
+    // Tangents only exist after ComputeTangentSpace()
+    bool hasTangents = tangents.size() == positions.size() && bitangents.size() == positions.size();
+
+    Material material;
+    material.diffuse = GetMipTexture(object.GetDiffuseTextureHandle());
+    material.normalMap = GetMipTexture(object.GetNormalMapTextureHandle());
+    uint32_t materialIndex = static_cast<uint32_t>(mMaterials.size());
+    mMaterials.push_back(material);
+
+    glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+    size_t triangleCount = indices.size() / 3;
+    mCorners.reserve(mCorners.size() + triangleCount * 3);
+    for (size_t i = 0; i < triangleCount * 3; ++i) {
+        unsigned int index = indices[i];
+        mCorners.push_back(glm::vec3(model * glm::vec4(positions[index], 1.0f)));
+        mNormals.push_back(SafeNormalize(normalMatrix * normals[index]));
+        mTangents.push_back(hasTangents ? SafeNormalize(normalMatrix * tangents[index]) : glm::vec3(0.0f));
+        mBitangents.push_back(hasTangents ? SafeNormalize(normalMatrix * bitangents[index]) : glm::vec3(0.0f));
+        mTexCoords.push_back(texCoords[index]);
+    }
+    mMaterialIndices.insert(mMaterialIndices.end(), triangleCount, materialIndex);
+}
+
+
+void PathTracer::Build(){
+    mBvh.Build(mCorners);
+}
+
+
+const MipTexture* PathTracer::GetMipTexture(const TextureHandle& texture){
+    if (texture == nullptr || texture->GetImage() == nullptr) {
+        return nullptr;
+    }
+    auto found = mMipTextures.find(texture);
+    if (found == mMipTextures.end()) {
+        PROFILE_SCOPE("BuildMipTexture");
+        found = mMipTextures.emplace(texture, MipTexture()).first;
+        found->second.Build(texture->GetImage());
+    }
+    return &found->second;
+}
+
+
+void PathTracer::Initialize(int width, int height){
+    mWidth = width;
+    mHeight = height;
+    mTilesX = (width + kTileSize - 1) / kTileSize;
+    mTilesY = (height + kTileSize - 1) / kTileSize;
+    Reset();
+}
+
+
+void PathTracer::Reset(){
+    mAccumulation.assign(static_cast<size_t>(mWidth) * mHeight, glm::vec3(0.0f));
+    mSampleCount = 0;
+}
+
+
+/**
+ * @brief Adds one sample per pixel.
+ *
+ * The tiles are split into one queue per thread. Each thread works from the
+ * front of its own queue and, once that is empty, steals single tiles from the
+ * back of the others, so threads stuck with expensive tiles get help at the end
+ * of the pass. Every pixel owns its random sequence, seeded from its position
+ * and the sample index, so the image does not depend on the thread count.
+ *
+ * @param threadCount Threads to trace with, including the calling thread.
+ */
+void PathTracer::RenderPass(const glm::mat4& view, const glm::mat4& projection,
+                            const glm::vec3& eyePosition, const glm::vec3& lightPosition,
+                            unsigned int threadCount){
+    PROFILE_SCOPE("PathTracer::RenderPass");
+    auto begin = std::chrono::steady_clock::now();
+    mInverseViewProjection = glm::inverse(projection * view);
+    mEyePosition = eyePosition;
+    mLightPosition = lightPosition;
+    threadCount = std::max(1u, threadCount);
+
+    struct alignas(64) TileQueue{
+        std::mutex mutex;
+        std::deque<int> tiles;
+        size_t rays{0};
+        size_t steals{0};
+    };
+    std::vector<TileQueue> queues(threadCount);
+    int tileCount = mTilesX * mTilesY;
+    // Neighbouring tiles cost about the same, so give every thread a contiguous run
+    for (int tile = 0; tile < tileCount; ++tile) {
+        queues[static_cast<size_t>(tile) * threadCount / tileCount].tiles.push_back(tile);
+    }
+
+    auto worker = [&](unsigned int threadIndex){
+        TileQueue& own = queues[threadIndex];
+        while (true) {
+            int tile = -1;
+            {
+                std::lock_guard<std::mutex> lock(own.mutex);
+                if (!own.tiles.empty()) {
+                    tile = own.tiles.front();
+                    own.tiles.pop_front();
+                }
+            }
+            for (unsigned int i = 1; tile < 0 && i < threadCount; ++i) {
+                TileQueue& victim = queues[(threadIndex + i) % threadCount];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (!victim.tiles.empty()) {
+                    tile = victim.tiles.back();
+                    victim.tiles.pop_back();
+                    ++own.steals;
+                }
+            }
+            if (tile < 0) {
+                return;
+            }
+            RenderTile(tile, own.rays);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < threadCount; ++i) {
+        threads.emplace_back([&, i](){
+            Profiler::SetThreadName("Tracer " + std::to_string(i));
+            worker(i);
+        });
+    }
+    worker(0);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    ++mSampleCount;
+
+    mStatistics = Statistics();
+    mStatistics.samples = static_cast<size_t>(mWidth) * mHeight;
+    for (const TileQueue& queue : queues) {
+        mStatistics.rays += queue.rays;
+        mStatistics.steals += queue.steals;
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+    mStatistics.milliseconds = elapsed.count();
+}
+
+
+void PathTracer::RenderTile(int tileIndex, size_t& rays){
+    int x0 = (tileIndex % mTilesX) * kTileSize;
+    int y0 = (tileIndex / mTilesX) * kTileSize;
+    int x1 = std::min(mWidth, x0 + kTileSize);
+    int y1 = std::min(mHeight, y0 + kTileSize);
+
+    for (int y = y0; y < y1; ++y) {
+        for (int x = x0; x < x1; ++x) {
+            uint32_t randomState = Hash(static_cast<uint32_t>(y * mWidth + x) ^ Hash(mSampleCount));
+            // Jitter inside the pixel for antialiasing, row 0 is the top of the image
+            float ndcX = (x + NextRandom(randomState)) / mWidth * 2.0f - 1.0f;
+            float ndcY = 1.0f - (y + NextRandom(randomState)) / mHeight * 2.0f;
+            glm::vec4 nearPoint = mInverseViewProjection * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+            glm::vec4 farPoint = mInverseViewProjection * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+            glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - glm::vec3(nearPoint) / nearPoint.w);
+
+            glm::vec3 radiance = TracePath(Ray(mEyePosition, direction, FLT_MAX), randomState, rays);
+            // Drop NaNs and fireflies from degenerate geometry instead of ruining the pixel
+            if (!std::isfinite(radiance.x + radiance.y + radiance.z)) {
+                radiance = glm::vec3(0.0f);
+            }
+            mAccumulation[static_cast<size_t>(y) * mWidth + x] += radiance;
+        }
+    }
+}
+
+
+void PathTracer::GetSurface(const Ray& ray, const Hit& hit, Surface& surface) const{
+    size_t first = static_cast<size_t>(hit.triangle) * 3;
+    float w0 = 1.0f - hit.u - hit.v;
+    float w1 = hit.u;
+    float w2 = hit.v;
+    const Material& material = mMaterials[mMaterialIndices[hit.triangle]];
+
+    surface.position = ray.origin + ray.direction * hit.distance;
+    glm::vec3 faceNormal = SafeNormalize(glm::cross(mCorners[first + 1] - mCorners[first], mCorners[first + 2] - mCorners[first]));
+    if (glm::dot(faceNormal, ray.direction) > 0.0f) {
+        faceNormal = -faceNormal;
+    }
+    surface.geometricNormal = faceNormal;
+
+    glm::vec2 texCoord = mTexCoords[first] * w0 + mTexCoords[first + 1] * w1 + mTexCoords[first + 2] * w2;
+    float sample[3] = {0.8f, 0.8f, 0.8f};
+    if (material.diffuse != nullptr) {
+        material.diffuse->SampleBilinear(0, texCoord.x, texCoord.y, sample);
+    }
+    surface.albedo = glm::vec3(sample[0], sample[1], sample[2]);
+
+    glm::vec3 normal = mNormals[first] * w0 + mNormals[first + 1] * w1 + mNormals[first + 2] * w2;
+    // OBJ files without normals get the face normal
+    if (glm::dot(normal, normal) < 1e-12f) {
+        normal = faceNormal;
+    }
+    normal = glm::normalize(normal);
+    if (material.normalMap != nullptr) {
+        material.normalMap->SampleBilinear(0, texCoord.x, texCoord.y, sample);
+        glm::vec3 mapped = SafeNormalize(glm::vec3(sample[0], sample[1], sample[2]) * 2.0f - 1.0f);
+        glm::vec3 tangent = mTangents[first] * w0 + mTangents[first + 1] * w1 + mTangents[first + 2] * w2;
+        glm::vec3 bitangent = mBitangents[first] * w0 + mBitangents[first + 1] * w1 + mBitangents[first + 2] * w2;
+        glm::vec3 bent = SafeNormalize(tangent * mapped.x + bitangent * mapped.y + normal * mapped.z);
+        if (glm::dot(bent, bent) > 0.0f) {
+            normal = bent;
+        }
+    }
+    // Keep the shading normal on the side the ray came from
+    if (glm::dot(normal, faceNormal) < 0.0f) {
+        normal = -normal;
+    }
+    surface.shadingNormal = normal;
+}
+
+
+/**
+ * @brief Traces one path with next event estimation.
+ *
+ * At every diffuse hit the point light is sampled with a shadow ray and the
+ * path continues in a cosine weighted direction, so the Lambert BRDF and the
+ * sampling density cancel and the throughput is just multiplied by the albedo.
+ * After two bounces paths are ended by Russian roulette.
+ */
+glm::vec3 PathTracer::TracePath(Ray ray, uint32_t& randomState, size_t& rays) const{
+    glm::vec3 radiance(0.0f);
+    glm::vec3 throughput(1.0f);
+    for (int bounce = 0; bounce <= kMaxBounces; ++bounce) {
+        Hit hit;
+        ++rays;
+        if (!mBvh.Intersect(ray, hit)) {
+            radiance += throughput * ImageBasedLighting::SkyRadiance(ray.direction);
+            break;
+        }
+        Surface surface;
+        GetSurface(ray, hit, surface);
+        glm::vec3 origin = surface.position + surface.geometricNormal * kRayEpsilon;
+
+        // Direct light
+        glm::vec3 toLight = mLightPosition - origin;
+        float lightDistance = glm::length(toLight);
+        toLight /= lightDistance;
+        float cosine = glm::dot(surface.shadingNormal, toLight);
+        if (cosine > 0.0f && glm::dot(surface.geometricNormal, toLight) > 0.0f) {
+            ++rays;
+            if (!mBvh.Occluded(Ray(origin, toLight, lightDistance - kRayEpsilon))) {
+                radiance += throughput * surface.albedo * (cosine * kLightIntensity / (kPi * lightDistance * lightDistance));
+            }
+        }
+        if (bounce == kMaxBounces) {
+            break;
+        }
+
+        // Cosine weighted direction around the shading normal
+        float r1 = NextRandom(randomState);
+        float r2 = NextRandom(randomState);
+        float phi = 2.0f * kPi * r1;
+        float radius = std::sqrt(r2);
+        glm::vec3 normal = surface.shadingNormal;
+        glm::vec3 helper = std::abs(normal.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+        glm::vec3 tangent = glm::normalize(glm::cross(helper, normal));
+        glm::vec3 bitangent = glm::cross(normal, tangent);
+        glm::vec3 direction = tangent * (radius * std::cos(phi)) + bitangent * (radius * std::sin(phi))
+                            + normal * std::sqrt(std::max(0.0f, 1.0f - r2));
+        if (glm::dot(direction, surface.geometricNormal) <= 0.0f) {
+            break;
+        }
+        throughput *= surface.albedo;
+
+        if (bounce >= 2) {
+            float survive = std::min(0.95f, std::max(throughput.x, std::max(throughput.y, throughput.z)));
+            if (NextRandom(randomState) >= survive) {
+                break;
+            }
+            throughput /= survive;
+        }
+        ray = Ray(origin, direction, FLT_MAX);
+    }
+    return radiance;
+}
+
+
+/**
+ * @brief Writes the average of all passes, clamped and gamma corrected for display.
+ */
+void PathTracer::Resolve(PPM& image) const{
+    if (image.getWidth() != mWidth || image.getHeight() != mHeight || mSampleCount == 0) {
+        return;
+    }
+    float scale = 1.0f / mSampleCount;
+    unsigned char* pixels = image.pixelData();
+    for (size_t i = 0; i < mAccumulation.size(); ++i) {
+        glm::vec3 color = glm::clamp(mAccumulation[i] * scale, glm::vec3(0.0f), glm::vec3(1.0f));
+        pixels[i * 3 + 0] = static_cast<unsigned char>(std::pow(color.x, 1.0f / 2.2f) * 255.0f + 0.5f);
+        pixels[i * 3 + 1] = static_cast<unsigned char>(std::pow(color.y, 1.0f / 2.2f) * 255.0f + 0.5f);
+        pixels[i * 3 + 2] = static_cast<unsigned char>(std::pow(color.z, 1.0f / 2.2f) * 255.0f + 0.5f);
+    }
+}
@@ -0,0 +1,215 @@
+#include "PostProcess.hpp"
+#include "Profiler.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+
+const char* const PostProcess::kScene = "scene";
+const char* const PostProcess::kScreen = "screen";
+
+
+PostProcess::~PostProcess(){
+    Destroy();
+}
+
+
+void PostProcess::AddPass(const Pass& pass){
+    mPasses.push_back(pass);
+}
+
+
+void PostProcess::Destroy(){
+    for (Step& step : mSteps) {
+        if (step.program != 0) {
+            glDeleteProgram(step.program);
+        }
+    }
+    mSteps.clear();
+    if (mScreenVAO != 0) {
+        glDeleteVertexArrays(1, &mScreenVAO);
+        mScreenVAO = 0;
+    }
+}
+
+
+/**
+ * @brief Samples the first input once and hands the color through the snippet functions in order.
+ */
+std::string PostProcess::BuildPointwiseShader(const std::vector<size_t>& passes) const{
+    std::string source = "#version 410 core\n\n"
+                         "in vec2 v_UV;\n"
+                         "out vec4 fragColor;\n\n"
+                         "uniform sampler2D u_PointwiseInput;\n\n";
+    std::string body;
+    for (size_t index : passes) {
+        source += LoadShaderAsString(mPasses[index].shaderPath) + "\n";
+        body += "    color = " + mPasses[index].name + "(color, v_UV);\n";
+    }
+    source += "void main()\n{\n    vec4 color = texture(u_PointwiseInput, v_UV);\n" + body + "    fragColor = color;\n}\n";
+    return source;
+}
+
+
+/**
+ * @brief Groups the passes into draws and checks that every input is written before it is read.
+ *
+ * A pointwise pass joins the previous draw when that draw is pointwise too, has
+ * the same resolution and its output is read by this pass only.
+ */
+void PostProcess::Plan(bool merge){
+    mSteps.clear();
+    auto countReaders = [this](const std::string& resource){
+        size_t readers = 0;
+        for (const Pass& pass : mPasses) {
+            for (const Input& input : pass.inputs) {
+                readers += (input.resource == resource) ? 1 : 0;
+            }
+        }
+        return readers;
+    };
+
+    for (size_t i = 0; i < mPasses.size(); ++i) {
+        const Pass& pass = mPasses[i];
+        if (merge && pass.pointwise && !mSteps.empty()) {
+            Step& previous = mSteps.back();
+            const Pass& last = mPasses[previous.passes.back()];
+            if (last.pointwise && pass.inputs[0].resource == last.output && pass.downscale == last.downscale &&
+                countReaders(last.output) == 1) {
+                previous.name += "+" + pass.name;
+                previous.passes.push_back(i);
+                previous.inputs.insert(previous.inputs.end(), pass.inputs.begin() + 1, pass.inputs.end());
+                previous.output = pass.output;
+                previous.format = pass.format;
+                continue;
+            }
+        }
+        Step step;
+        step.name = pass.name;
+        step.passes.push_back(i);
+        step.inputs = pass.inputs;
+        if (pass.pointwise) {
+            step.inputs[0].sampler = "u_PointwiseInput";
+        }
+        step.output = pass.output;
+        step.downscale = pass.downscale;
+        step.format = pass.format;
+        mSteps.push_back(step);
+    }
+
+    std::vector<std::string> available = {kScene};
+    for (Step& step : mSteps) {
+        for (const Input& input : step.inputs) {
+            if (std::find(available.begin(), available.end(), input.resource) == available.end()) {
+                std::cout << "Post-processing pass " << step.name << " reads " << input.resource
+                          << " before it is written" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        available.push_back(step.output);
+        step.timerName = "Post " + step.name;
+    }
+}
+
+
+void PostProcess::Compile(bool merge){
+    PROFILE_SCOPE("PostProcess::Compile");
+    for (Step& step : mSteps) {
+        if (step.program != 0) {
+            glDeleteProgram(step.program);
+        }
+    }
+    Plan(merge);
+    if (mScreenVAO == 0) {
+        glGenVertexArrays(1, &mScreenVAO);
+    }
+    std::string vertexShaderSource = LoadShaderAsString("./shaders/post_vert.glsl");
+    for (Step& step : mSteps) {
+        const Pass& first = mPasses[step.passes.front()];
+        std::string fragmentShaderSource = first.pointwise ? BuildPointwiseShader(step.passes)
+                                                           : LoadShaderAsString(first.shaderPath);
+        step.program = CreateShaderProgram(vertexShaderSource, fragmentShaderSource);
+    }
+}
+
+
+std::string PostProcess::GetSummary() const{
+    std::string summary;
+    for (const Step& step : mSteps) {
+        summary += (summary.empty() ? "" : ", ") + step.name;
+    }
+    return summary;
+}
+
+
+/**
+ * @brief Declares the output image of every draw at its resolution and adds the draws as passes.
+ */
+void PostProcess::AddToGraph(FrameGraph& graph, FrameGraph::Resource scene, FrameGraph::Resource screen, GpuTimer& gpuTimer){
+    std::vector<std::pair<std::string, FrameGraph::Resource>> resources = {{kScene, scene}, {kScreen, screen}};
+    auto find = [&resources](const std::string& name){
+        for (const auto& resource : resources) {
+            if (resource.first == name) {
+                return resource.second;
+            }
+        }
+        return FrameGraph::kInvalidResource;
+    };
+
+    int width = graph.GetWidth(scene);
+    int height = graph.GetHeight(scene);
+    for (const Step& step : mSteps) {
+        std::vector<FrameGraph::Resource> inputs;
+        for (const Input& input : step.inputs) {
+            inputs.push_back(find(input.resource));
+        }
+        FrameGraph::Resource output = find(step.output);
+        if (output == FrameGraph::kInvalidResource) {
+            FrameGraph::TextureDescription description;
+            description.width = (width + step.downscale - 1) / step.downscale;
+            description.height = (height + step.downscale - 1) / step.downscale;
+            description.format = step.format;
+            output = graph.CreateTexture(step.output, description);
+            resources.emplace_back(step.output, output);
+        }
+        const Step* drawn = &step;
+        graph.AddPass(step.timerName, inputs, {output}, [this, drawn, inputs, &graph, &gpuTimer](){
+            gpuTimer.Begin(drawn->timerName.c_str());
+            Draw(*drawn, graph, inputs);
+            gpuTimer.End();
+        });
+    }
+}
+
+
+void PostProcess::Draw(const Step& step, const FrameGraph& graph, const std::vector<FrameGraph::Resource>& inputs) const{
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+    GLboolean blend = glIsEnabled(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_BLEND);
+
+    glUseProgram(step.program);
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(i));
+        glBindTexture(GL_TEXTURE_2D, graph.GetTexture(inputs[i]));
+        glUniform1i(glGetUniformLocation(step.program, step.inputs[i].sampler.c_str()), static_cast<GLint>(i));
+    }
+    glUniform2f(glGetUniformLocation(step.program, "u_TexelSize"), 1.0f / graph.GetWidth(inputs[0]),
+                1.0f / graph.GetHeight(inputs[0]));
+    for (size_t index : step.passes) {
+        if (mPasses[index].setUniforms) {
+            mPasses[index].setUniforms(step.program);
+        }
+    }
+    glBindVertexArray(mScreenVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+
+    if (depthTest) glEnable(GL_DEPTH_TEST);
+    if (cullFace) glEnable(GL_CULL_FACE);
+    if (blend) glEnable(GL_BLEND);
+}
@@ -0,0 +1,141 @@
+#include "Profiler.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(PROFILER_USE_RDTSC) && (defined(__x86_64__) || defined(_M_X64))
+    #include <x86intrin.h>
+    #define PROFILER_RDTSC 1
+#endif
+
+// Ring buffer written by exactly one thread. The write index is published with
+// release semantics so that a dump from another thread sees complete events.
+struct ProfilerThreadBuffer{
+    uint32_t threadId{0};
+    std::string threadName;
+    std::atomic<uint64_t> writeIndex{0};
+    ProfileEvent events[Profiler::kEventsPerThread];
+};
+
+// All buffers ever created, the lock is only taken when a thread records
+// its first zone and when dumping
+static std::mutex gBuffersMutex;
+static std::vector<std::unique_ptr<ProfilerThreadBuffer>> gBuffers;
+static double gTicksPerMicrosecond = 1.0;
+static uint64_t gStartTicks = 0;
+
+static thread_local ProfilerThreadBuffer* tBuffer = nullptr;
+
+
+// Returns the buffer of the calling thread, creating it on first use
+static ProfilerThreadBuffer* GetThreadBuffer(){
+    if (tBuffer == nullptr) {
+        std::unique_ptr<ProfilerThreadBuffer> buffer(new ProfilerThreadBuffer());
+        std::lock_guard<std::mutex> lock(gBuffersMutex);
+        buffer->threadId = static_cast<uint32_t>(gBuffers.size() + 1);
+        buffer->threadName = "Thread " + std::to_string(buffer->threadId);
+        tBuffer = buffer.get();
+        gBuffers.push_back(std::move(buffer));
+    }
+    return tBuffer;
+}
+
+
+/**
+ * @brief Records the start time and, with rdtsc, measures the tick rate.
+ *
+ * steady_clock is used by default. Building with -D PROFILER_USE_RDTSC reads the
+ * CPU time stamp counter instead, which is cheaper but assumes an invariant TSC.
+ */
+void Profiler::Initialize(){
+#if defined(PROFILER_RDTSC)
+    auto wallStart = std::chrono::steady_clock::now();
+    uint64_t tickStart = __rdtsc();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    uint64_t tickEnd = __rdtsc();
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - wallStart;
+    gTicksPerMicrosecond = (tickEnd - tickStart) / elapsed.count();
+#else
+    gTicksPerMicrosecond = 1000.0;
+#endif
+    gStartTicks = Now();
+    SetThreadName("Main");
+}
+
+
+uint64_t Profiler::Now(){
+#if defined(PROFILER_RDTSC)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+
+void Profiler::SetThreadName(const std::string& name){
+    ProfilerThreadBuffer* buffer = GetThreadBuffer();
+    std::lock_guard<std::mutex> lock(gBuffersMutex);
+    buffer->threadName = name;
+}
+
+
+void Profiler::Record(const char* name, uint64_t start, uint64_t end){
+    ProfilerThreadBuffer* buffer = GetThreadBuffer();
+    uint64_t index = buffer->writeIndex.load(std::memory_order_relaxed);
+    buffer->events[index % kEventsPerThread] = {name, start, end};
+    buffer->writeIndex.store(index + 1, std::memory_order_release);
+}
+
+
+/**
+ * @brief Writes every thread's buffer as a Chrome trace_event JSON file.
+ *
+ * Zones are written as complete ("X") events with microsecond timestamps.
+ * Threads keep recording while the dump runs; a zone that is overwritten
+ * during the copy may show up with mixed values, which is acceptable for
+ * a debugging aid.
+ *
+ * @param filepath Output JSON file.
+ * @return true if the file was written.
+ */
+bool Profiler::WriteChromeTrace(const std::string& filepath){
+    std::ofstream trace(filepath);
+    if (!trace.is_open()) {
+        std::cout << "Profiler: unable to write " << filepath << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(gBuffersMutex);
+    trace << std::fixed << std::setprecision(3);
+    trace << "{\"traceEvents\":[\n";
+    bool first = true;
+    size_t eventCount = 0;
+    for (const auto& buffer : gBuffers) {
+        if (!first) trace << ",\n";
+        first = false;
+        trace << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId
+              << ",\"args\":{\"name\":\"" << buffer->threadName << "\"}}";
+
+        uint64_t end = buffer->writeIndex.load(std::memory_order_acquire);
+        uint64_t begin = (end > kEventsPerThread) ? end - kEventsPerThread : 0;
+        for (uint64_t i = begin; i < end; ++i) {
+            const ProfileEvent& event = buffer->events[i % kEventsPerThread];
+            double ts = (event.start - gStartTicks) / gTicksPerMicrosecond;
+            double dur = (event.end - event.start) / gTicksPerMicrosecond;
+            trace << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+                  << ",\"ts\":" << ts << ",\"dur\":" << dur << "}";
+            ++eventCount;
+        }
+    }
+    trace << "\n]}\n";
+
+    std::cout << "Profiler: wrote " << eventCount << " zones to " << filepath << std::endl;
+    return true;
+}
@@ -0,0 +1,105 @@
+#include "RenderTargetPool.hpp"
+
+#include <iostream>
+
+
+RenderTargetPool::~RenderTargetPool(){
+    Destroy();
+}
+
+
+/**
+ * @brief Returns a free matching target, or creates one with linear filtering and clamped edges.
+ */
+RenderTarget* RenderTargetPool::Acquire(int width, int height, GLenum format, bool depth){
+    for (RenderTarget* target : mTargets) {
+        if (!target->inUse && target->width == width && target->height == height && target->format == format &&
+            (target->depthRenderbuffer != 0) == depth) {
+            target->inUse = true;
+            return target;
+        }
+    }
+
+    RenderTarget* target = new RenderTarget();
+    target->width = width;
+    target->height = height;
+    target->format = format;
+    target->inUse = true;
+
+    GLenum type = (format == GL_RGBA16F || format == GL_RGB16F || format == GL_R11F_G11F_B10F) ? GL_FLOAT : GL_UNSIGNED_BYTE;
+    glGenTextures(1, &target->texture);
+    glBindTexture(GL_TEXTURE_2D, target->texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, GL_RGBA, type, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGenFramebuffers(1, &target->framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target->texture, 0);
+    if (depth) {
+        glGenRenderbuffers(1, &target->depthRenderbuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, target->depthRenderbuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, target->depthRenderbuffer);
+    }
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "Render target " << width << "x" << height << " is incomplete" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+
+    mTargets.push_back(target);
+    mTracked.Set(GetBytes());
+    return target;
+}
+
+
+void RenderTargetPool::Release(RenderTarget* target){
+    if (target != nullptr) {
+        target->inUse = false;
+    }
+}
+
+
+void RenderTargetPool::Destroy(){
+    for (RenderTarget* target : mTargets) {
+        glDeleteFramebuffers(1, &target->framebuffer);
+        glDeleteTextures(1, &target->texture);
+        if (target->depthRenderbuffer != 0) {
+            glDeleteRenderbuffers(1, &target->depthRenderbuffer);
+        }
+        delete target;
+    }
+    mTargets.clear();
+    mTracked.Set(0);
+}
+
+
+size_t RenderTargetPool::GetBytesPerPixel(GLenum format){
+    switch (format) {
+        case GL_RGBA16F:            return 8;
+        case GL_RGB16F:             return 6;
+        case GL_RGBA8:              return 4;
+        case GL_R11F_G11F_B10F:     return 4;
+        default:                    return 4;
+    }
+}
+
+
+size_t RenderTargetPool::GetBytes() const{
+    size_t bytes = 0;
+    for (const RenderTarget* target : mTargets) {
+        size_t pixels = static_cast<size_t>(target->width) * target->height;
+        bytes += pixels * GetBytesPerPixel(target->format);
+        if (target->depthRenderbuffer != 0) {
+            bytes += pixels * 4;
+        }
+    }
+    return bytes;
+}
@@ -0,0 +1,215 @@
+#include "SceneGraph.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <numeric>
+
+#if defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define SCENEGRAPH_SSE
+#endif
+
+
+/**
+ * @brief world = parent * local, one column of the result per four multiply-adds.
+ */
+static inline void MultiplyMatrices(const glm::mat4& parent, const glm::mat4& local, glm::mat4& world){
+#if defined(SCENEGRAPH_SSE)
+    __m128 p0 = _mm_loadu_ps(&parent[0][0]);
+    __m128 p1 = _mm_loadu_ps(&parent[1][0]);
+    __m128 p2 = _mm_loadu_ps(&parent[2][0]);
+    __m128 p3 = _mm_loadu_ps(&parent[3][0]);
+    for (int column = 0; column < 4; ++column) {
+        __m128 result = _mm_mul_ps(p0, _mm_set1_ps(local[column][0]));
+        result = _mm_add_ps(result, _mm_mul_ps(p1, _mm_set1_ps(local[column][1])));
+        result = _mm_add_ps(result, _mm_mul_ps(p2, _mm_set1_ps(local[column][2])));
+        result = _mm_add_ps(result, _mm_mul_ps(p3, _mm_set1_ps(local[column][3])));
+        _mm_storeu_ps(&world[column][0], result);
+    }
+#else
+    world = parent * local;
+#endif
+}
+
+
+/**
+ * @brief Local matrix of a translation, rotation and scale (scale applied first).
+ */
+static inline glm::mat4 ComposeTransform(const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale){
+    glm::mat3 rotationMatrix = glm::mat3_cast(rotation);
+    return glm::mat4(glm::vec4(rotationMatrix[0] * scale.x, 0.0f),
+                     glm::vec4(rotationMatrix[1] * scale.y, 0.0f),
+                     glm::vec4(rotationMatrix[2] * scale.z, 0.0f),
+                     glm::vec4(translation, 1.0f));
+}
+
+
+/**
+ * @brief Appends a node. It stays in depth order as long as no node is added below a shallower one.
+ *
+ * @param parent Handle of the parent, kInvalidNode for a root.
+ * @return Handle of the new node.
+ */
+NodeHandle SceneGraph::CreateNode(NodeHandle parent){
+    uint32_t parentIndex = (parent == kInvalidNode) ? kInvalidNode : mIndices[parent];
+    uint32_t depth = (parentIndex == kInvalidNode) ? 0 : mDepths[parentIndex] + 1;
+    if (!mDepths.empty() && depth < mDepths.back()) {
+        mNeedsSort = true;
+    }
+
+    NodeHandle handle = static_cast<NodeHandle>(mIndices.size());
+    uint32_t index = static_cast<uint32_t>(mParents.size());
+    mParents.push_back(parentIndex);
+    mDepths.push_back(depth);
+    mTranslations.push_back(glm::vec3(0.0f));
+    mRotations.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+    mScales.push_back(glm::vec3(1.0f));
+    mWorldMatrices.push_back(glm::mat4(1.0f));
+    mMeshes.push_back(-1);
+    mDirty.push_back(0);
+    mHandles.push_back(handle);
+    mIndices.push_back(index);
+    MarkDirty(index);
+    return handle;
+}
+
+
+void SceneGraph::Clear(){
+    mParents.clear();
+    mDepths.clear();
+    mTranslations.clear();
+    mRotations.clear();
+    mScales.clear();
+    mWorldMatrices.clear();
+    mMeshes.clear();
+    mDirty.clear();
+    mHandles.clear();
+    mIndices.clear();
+    mFirstDirty = 0;
+    mNeedsSort = false;
+}
+
+
+void SceneGraph::MarkDirty(uint32_t index){
+    if (!mDirty[index]) {
+        mDirty[index] = 1;
+        mFirstDirty = std::min(mFirstDirty, static_cast<size_t>(index));
+    }
+}
+
+
+void SceneGraph::SetTranslation(NodeHandle node, const glm::vec3& translation){
+    uint32_t index = mIndices[node];
+    mTranslations[index] = translation;
+    MarkDirty(index);
+}
+
+
+void SceneGraph::SetRotation(NodeHandle node, const glm::quat& rotation){
+    uint32_t index = mIndices[node];
+    mRotations[index] = rotation;
+    MarkDirty(index);
+}
+
+
+void SceneGraph::SetScale(NodeHandle node, const glm::vec3& scale){
+    uint32_t index = mIndices[node];
+    mScales[index] = scale;
+    MarkDirty(index);
+}
+
+
+void SceneGraph::SetMesh(NodeHandle node, int mesh){
+    mMeshes[mIndices[node]] = mesh;
+}
+
+
+/**
+ * @brief Reorders every array so that the nodes are sorted by depth, keeping the order within a depth.
+ */
+void SceneGraph::SortByDepth(){
+    PROFILE_SCOPE("SceneGraph::SortByDepth");
+    size_t count = mParents.size();
+    std::vector<uint32_t> order(count);
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b){ return mDepths[a] < mDepths[b]; });
+
+    // New index of every old index
+    std::vector<uint32_t> remap(count);
+    for (size_t i = 0; i < count; ++i) {
+        remap[order[i]] = static_cast<uint32_t>(i);
+    }
+    auto permute = [&order](auto& values){
+        auto sorted = values;
+        for (size_t i = 0; i < order.size(); ++i) {
+            sorted[i] = values[order[i]];
+        }
+        values.swap(sorted);
+    };
+    permute(mParents);
+    permute(mDepths);
+    permute(mTranslations);
+    permute(mRotations);
+    permute(mScales);
+    permute(mWorldMatrices);
+    permute(mMeshes);
+    permute(mDirty);
+    permute(mHandles);
+    for (size_t i = 0; i < count; ++i) {
+        if (mParents[i] != kInvalidNode) {
+            mParents[i] = remap[mParents[i]];
+        }
+        mIndices[mHandles[i]] = static_cast<uint32_t>(i);
+    }
+    mFirstDirty = 0;
+    mNeedsSort = false;
+}
+
+
+/**
+ * @brief Recomputes the world matrix of every dirty node and of all nodes below them.
+ *
+ * Parents are stored first, so by the time a node is reached its parent's flag
+ * says whether the parent changed in this pass. Changed nodes set their own
+ * flag, which carries the change down the subtree.
+ */
+void SceneGraph::Update(){
+    PROFILE_SCOPE("SceneGraph::Update");
+    auto begin = std::chrono::steady_clock::now();
+    if (mNeedsSort) {
+        SortByDepth();
+    }
+
+    size_t count = mParents.size();
+    size_t updated = 0;
+    size_t first = std::min(mFirstDirty, count);
+    uint8_t* dirty = mDirty.data();
+    const uint32_t* parents = mParents.data();
+    glm::mat4* world = mWorldMatrices.data();
+    for (size_t i = first; i < count; ++i) {
+        uint32_t parent = parents[i];
+        bool parentChanged = (parent != kInvalidNode) && dirty[parent];
+        if (!dirty[i] && !parentChanged) {
+            continue;
+        }
+        dirty[i] = 1;
+        glm::mat4 local = ComposeTransform(mTranslations[i], mRotations[i], mScales[i]);
+        if (parent == kInvalidNode) {
+            world[i] = local;
+        } else {
+            MultiplyMatrices(world[parent], local, world[i]);
+        }
+        ++updated;
+    }
+    if (first < count) {
+        std::memset(dirty + first, 0, count - first);
+    }
+    mFirstDirty = count;
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+    mStatistics.nodesUpdated = updated;
+    mStatistics.nodesScanned = count - first;
+    mStatistics.milliseconds = elapsed.count();
+}
@@ -0,0 +1,235 @@
+#include "ShaderCache.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <filesystem>
+
+// Program binary enums (GL 4.1), not part of our GL 3.3 glad header
+#define SHADERCACHE_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define SHADERCACHE_PROGRAM_BINARY_LENGTH           0x8741
+#define SHADERCACHE_NUM_PROGRAM_BINARY_FORMATS      0x87FE
+
+// Header written in front of every cached binary
+struct ShaderCacheHeader{
+    char     magic[4];      // "GLPB"
+    uint32_t version;       // Bumped whenever the file layout changes
+    uint64_t key;           // Key the binary was stored under
+    uint32_t binaryFormat;  // Format returned by glGetProgramBinary
+    uint32_t binaryLength;  // Number of bytes following the header
+};
+
+static const uint32_t kShaderCacheVersion = 1;
+
+
+// Constructor
+ShaderCache::ShaderCache(){
+
+}
+
+
+/**
+ * @brief Resolves the program binary functions and records the driver strings.
+ *
+ * The driver strings are part of every key, so a driver update or a different
+ * GPU produces a cache miss instead of feeding the driver an incompatible binary.
+ *
+ * @param loader The same loader used to initialize glad.
+ * @param directory Directory where binaries are stored.
+ */
+void ShaderCache::Initialize(GLADloadproc loader, const std::string& directory){
+    m_directory = directory;
+
+    m_getProgramBinary  = (PFNGETPROGRAMBINARYPROC)loader("glGetProgramBinary");
+    m_programBinary     = (PFNPROGRAMBINARYPROC)loader("glProgramBinary");
+    m_programParameteri = (PFNPROGRAMPARAMETERIPROC)loader("glProgramParameteri");
+
+    GLint numFormats = 0;
+    if(m_getProgramBinary && m_programBinary && m_programParameteri){
+        glGetIntegerv(SHADERCACHE_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+        // Some loaders hand back a pointer even if the call is unsupported
+        while(glGetError() != GL_NO_ERROR){
+            numFormats = 0;
+        }
+    }
+    m_supported = numFormats > 0;
+
+    m_driverString  = reinterpret_cast<const char*>(glGetString(GL_VENDOR));
+    m_driverString += '\n';
+    m_driverString += reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+    m_driverString += '\n';
+    m_driverString += reinterpret_cast<const char*>(glGetString(GL_VERSION));
+
+    if(m_supported && m_enabled){
+        std::error_code error;
+        std::filesystem::create_directories(m_directory, error);
+        if(error){
+            std::cout << "Shader cache: unable to create " << m_directory << ", cache disabled\n";
+            m_supported = false;
+        }
+    }
+
+    std::cout << "Shader cache: " << (m_supported ? "supported" : "not supported by driver")
+              << (m_enabled ? "" : " (disabled)") << std::endl;
+}
+
+
+void ShaderCache::SetEnabled(bool enabled){
+    m_enabled = enabled;
+}
+
+
+bool ShaderCache::IsActive() const{
+    return m_supported && m_enabled;
+}
+
+
+/**
+ * @brief 64-bit FNV-1a hash over both shader sources and the driver strings.
+ */
+uint64_t ShaderCache::ComputeKey(const std::string& vertexShaderSource, const std::string& fragmentShaderSource) const{
+    uint64_t hash = 14695981039346656037ull;
+    auto append = [&hash](const std::string& text){
+        for(unsigned char c : text){
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        // Separator so that moving text between the sources changes the key
+        hash ^= 0xff;
+        hash *= 1099511628211ull;
+    };
+    append(vertexShaderSource);
+    append(fragmentShaderSource);
+    append(m_driverString);
+    return hash;
+}
+
+
+std::string ShaderCache::GetFilepath(uint64_t key) const{
+    std::stringstream ss;
+    ss << m_directory << "/" << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+    return ss.str();
+}
+
+
+/**
+ * @brief Tries to create a program from a cached binary.
+ *
+ * @return A linked program, or 0 if there is no entry or the driver rejected it.
+ *         Rejected entries are deleted so that they get rebuilt.
+ */
+GLuint ShaderCache::LoadProgram(const std::string& vertexShaderSource, const std::string& fragmentShaderSource){
+    if(!IsActive()){
+        return 0;
+    }
+
+    uint64_t key = ComputeKey(vertexShaderSource, fragmentShaderSource);
+    std::string filepath = GetFilepath(key);
+
+    std::ifstream file(filepath, std::ios::binary);
+    if(!file.is_open()){
+        return 0;
+    }
+
+    ShaderCacheHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if(!file || std::string(header.magic, 4) != "GLPB" || header.version != kShaderCacheVersion || header.key != key){
+        std::cout << "Shader cache: ignoring stale entry " << filepath << std::endl;
+        return 0;
+    }
+
+    std::vector<char> binary(header.binaryLength);
+    file.read(binary.data(), binary.size());
+    if(!file){
+        std::cout << "Shader cache: truncated entry " << filepath << std::endl;
+        return 0;
+    }
+    file.close();
+
+    GLuint programObject = glCreateProgram();
+    m_programBinary(programObject, header.binaryFormat, binary.data(), static_cast<GLsizei>(binary.size()));
+
+    // The driver is free to reject a binary (e.g. after an update), fall back to compiling
+    GLint linked = GL_FALSE;
+    glGetProgramiv(programObject, GL_LINK_STATUS, &linked);
+    if(linked == GL_FALSE){
+        while(glGetError() != GL_NO_ERROR){
+        }
+        glDeleteProgram(programObject);
+        std::filesystem::remove(filepath);
+        std::cout << "Shader cache: driver rejected " << filepath << ", recompiling" << std::endl;
+        return 0;
+    }
+
+    return programObject;
+}
+
+
+void ShaderCache::PrepareForLink(GLuint program) const{
+    if(IsActive()){
+        m_programParameteri(program, SHADERCACHE_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+}
+
+
+/**
+ * @brief Writes the binary of a freshly linked program to disk.
+ */
+void ShaderCache::StoreProgram(const std::string& vertexShaderSource, const std::string& fragmentShaderSource, GLuint program){
+    if(!IsActive() || program == 0){
+        return;
+    }
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if(linked == GL_FALSE){
+        return;
+    }
+
+    GLint length = 0;
+    glGetProgramiv(program, SHADERCACHE_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0){
+        return;
+    }
+
+    std::vector<char> binary(length);
+    GLenum binaryFormat = 0;
+    m_getProgramBinary(program, length, &length, &binaryFormat, binary.data());
+
+    uint64_t key = ComputeKey(vertexShaderSource, fragmentShaderSource);
+    ShaderCacheHeader header = {{'G','L','P','B'}, kShaderCacheVersion, key,
+                                static_cast<uint32_t>(binaryFormat), static_cast<uint32_t>(length)};
+
+    std::string filepath = GetFilepath(key);
+    std::ofstream file(filepath, std::ios::binary);
+    if(!file.is_open()){
+        std::cout << "Shader cache: unable to write " << filepath << std::endl;
+        return;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(binary.data(), length);
+}
+
+
+void ShaderCache::RecordProgramTime(double milliseconds, bool hit){
+    if(hit){
+        ++m_hits;
+        m_hitMilliseconds += milliseconds;
+    }else{
+        ++m_misses;
+        m_missMilliseconds += milliseconds;
+    }
+}
+
+
+void ShaderCache::PrintStatistics() const{
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(2)
+       << "Shader programs: " << (m_hits + m_misses) << " created in "
+       << (m_hitMilliseconds + m_missMilliseconds) << " ms ("
+       << m_hits << " from cache in " << m_hitMilliseconds << " ms, "
+       << m_misses << " compiled in " << m_missMilliseconds << " ms)";
+    std::cout << ss.str() << std::endl;
+}
@@ -0,0 +1,291 @@
+#include "ShaderReloader.hpp"
+#include "globals.hpp"
+#include "util.hpp"
+#include "Profiler.hpp"
+
+#include <iostream>
+#include <chrono>
+#include <filesystem>
+
+#if defined(LINUX)
+    #include <sys/inotify.h>
+    #include <poll.h>
+    #include <unistd.h>
+#endif
+
+// GL_KHR_parallel_shader_compile, not part of our GL 3.3 glad header
+#define SHADERRELOADER_COMPLETION_STATUS_KHR 0x91B1
+typedef void (APIENTRYP PFNMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+
+// Constructor
+ShaderReloader::ShaderReloader(){
+
+}
+
+
+// Destructor
+ShaderReloader::~ShaderReloader(){
+    Shutdown();
+}
+
+
+/**
+ * @brief Starts the background thread that watches the shader directory.
+ *
+ * When the driver exposes GL_KHR_parallel_shader_compile, compiles are handed to
+ * driver threads and polled for completion, so the render loop never waits on them.
+ * Without it the driver compiles inside the GL calls of StartBuild().
+ *
+ * @param loader The same loader used to initialize glad.
+ * @param directory Directory that holds the shader files.
+ */
+void ShaderReloader::Initialize(GLADloadproc loader, const std::string& directory){
+    m_directory = directory;
+
+    GLint extensionCount = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+    for(GLint i = 0; i < extensionCount; ++i){
+        const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if(std::string(extension) == "GL_KHR_parallel_shader_compile"){
+            m_parallelCompile = true;
+        }
+    }
+    if(m_parallelCompile){
+        PFNMAXSHADERCOMPILERTHREADSKHRPROC maxShaderCompilerThreads =
+            (PFNMAXSHADERCOMPILERTHREADSKHRPROC)loader("glMaxShaderCompilerThreadsKHR");
+        if(maxShaderCompilerThreads){
+            // Let the driver pick the number of threads
+            maxShaderCompilerThreads(0xFFFFFFFF);
+        }
+    }
+    std::cout << "Shader hot-reload: watching " << m_directory
+              << (m_parallelCompile ? " (parallel compile)" : "") << std::endl;
+
+    m_running = true;
+    m_thread = std::thread(&ShaderReloader::WatchThread, this);
+}
+
+
+/**
+ * @brief Registers a program for reloading.
+ *
+ * @param program Pointer to the handle the rest of the code draws with.
+ * @param vertexShaderPath Path of the vertex shader the program was built from.
+ * @param fragmentShaderPath Path of the fragment shader the program was built from.
+ */
+void ShaderReloader::Watch(GLuint* program, const std::string& vertexShaderPath, const std::string& fragmentShaderPath){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_watched.push_back({program, vertexShaderPath, fragmentShaderPath});
+    m_sources[GetFilename(vertexShaderPath)]   = LoadShaderAsString(vertexShaderPath);
+    m_sources[GetFilename(fragmentShaderPath)] = LoadShaderAsString(fragmentShaderPath);
+}
+
+
+/**
+ * @brief Starts rebuilds for changed files and swaps in finished programs.
+ *
+ * Must be called on the thread that owns the OpenGL context, between frames.
+ */
+void ShaderReloader::Update(){
+    PROFILE_SCOPE("ShaderReloader::Update");
+    std::vector<std::string> changedFiles;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        changedFiles.swap(m_changedFiles);
+    }
+
+    for(size_t i = 0; i < m_watched.size(); ++i){
+        const WatchedProgram& watched = m_watched[i];
+        for(const std::string& file : changedFiles){
+            if(file == GetFilename(watched.vertexShaderPath) || file == GetFilename(watched.fragmentShaderPath)){
+                std::cout << "Shader hot-reload: " << file << " changed, rebuilding" << std::endl;
+                StartBuild(i);
+                break;
+            }
+        }
+    }
+
+    // Finish builds in submission order, keep the ones still compiling for the next frame
+    for(size_t i = 0; i < m_pending.size();){
+        if(IsBuildComplete(m_pending[i])){
+            FinishBuild(m_pending[i]);
+            m_pending.erase(m_pending.begin() + i);
+        }else{
+            ++i;
+        }
+    }
+}
+
+
+void ShaderReloader::StartBuild(size_t watchedIndex){
+    const WatchedProgram& watched = m_watched[watchedIndex];
+
+    PendingBuild build;
+    build.watchedIndex = watchedIndex;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        build.vertexShaderSource   = m_sources[GetFilename(watched.vertexShaderPath)];
+        build.fragmentShaderSource = m_sources[GetFilename(watched.fragmentShaderPath)];
+    }
+    const char* vertexSource   = build.vertexShaderSource.c_str();
+    const char* fragmentSource = build.fragmentShaderSource.c_str();
+
+    // None of these calls query a status, so a driver with parallel compile returns right away
+    build.vertexShader   = glCreateShader(GL_VERTEX_SHADER);
+    build.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(build.vertexShader, 1, &vertexSource, nullptr);
+    glShaderSource(build.fragmentShader, 1, &fragmentSource, nullptr);
+    glCompileShader(build.vertexShader);
+    glCompileShader(build.fragmentShader);
+
+    build.program = glCreateProgram();
+    glAttachShader(build.program, build.vertexShader);
+    glAttachShader(build.program, build.fragmentShader);
+    g.gShaderCache.PrepareForLink(build.program);
+    glLinkProgram(build.program);
+
+    m_pending.push_back(build);
+}
+
+
+bool ShaderReloader::IsBuildComplete(const PendingBuild& build) const{
+    if(!m_parallelCompile){
+        return true;
+    }
+    GLint complete = GL_FALSE;
+    glGetProgramiv(build.program, SHADERRELOADER_COMPLETION_STATUS_KHR, &complete);
+    return complete == GL_TRUE;
+}
+
+
+void ShaderReloader::FinishBuild(const PendingBuild& build){
+    const WatchedProgram& watched = m_watched[build.watchedIndex];
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(build.program, GL_LINK_STATUS, &linked);
+
+    if(linked == GL_TRUE){
+        // Swap the handle, everything looks up uniforms by name every frame
+        GLuint oldProgram = *watched.program;
+        *watched.program = build.program;
+        if(oldProgram != 0){
+            glDeleteProgram(oldProgram);
+        }
+        g.gShaderCache.StoreProgram(build.vertexShaderSource, build.fragmentShaderSource, build.program);
+        std::cout << "Shader hot-reload: program " << build.program << " replaces " << oldProgram << std::endl;
+    }else{
+        // Print whatever the compiler and linker had to say, the old program stays live
+        GLuint objects[3] = {build.vertexShader, build.fragmentShader, build.program};
+        for(int i = 0; i < 3; ++i){
+            GLint length = 0;
+            char log[1024] = {0};
+            if(i < 2){
+                glGetShaderInfoLog(objects[i], sizeof(log), &length, log);
+            }else{
+                glGetProgramInfoLog(objects[i], sizeof(log), &length, log);
+            }
+            if(length > 0){
+                std::cout << log << "\n";
+            }
+        }
+        std::cout << "Shader hot-reload: build failed, keeping program " << *watched.program << std::endl;
+    }
+
+    glDetachShader(build.program, build.vertexShader);
+    glDetachShader(build.program, build.fragmentShader);
+    glDeleteShader(build.vertexShader);
+    glDeleteShader(build.fragmentShader);
+
+    if(linked != GL_TRUE){
+        glDeleteProgram(build.program);
+    }
+}
+
+
+void ShaderReloader::Shutdown(){
+    if(m_running){
+        m_running = false;
+        m_thread.join();
+    }
+}
+
+
+/**
+ * @brief Background thread: waits for file changes and reads the new text.
+ *
+ * Uses inotify on Linux. Other platforms poll the modification times of the
+ * watched files a few times per second.
+ */
+void ShaderReloader::WatchThread(){
+    Profiler::SetThreadName("ShaderWatcher");
+    auto fileChanged = [this](const std::string& filename){
+        PROFILE_SCOPE("ReadChangedShader");
+        std::string text = LoadShaderAsString(m_directory + "/" + filename);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // Only files that belong to a watched program are interesting
+        if(m_sources.count(filename) == 0 || text.empty()){
+            return;
+        }
+        m_sources[filename] = text;
+        m_changedFiles.push_back(filename);
+    };
+
+#if defined(LINUX)
+    int fd = inotify_init1(IN_NONBLOCK);
+    if(fd < 0 || inotify_add_watch(fd, m_directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0){
+        std::cout << "Shader hot-reload: unable to watch " << m_directory << std::endl;
+        return;
+    }
+
+    alignas(struct inotify_event) char buffer[4096];
+    while(m_running){
+        struct pollfd pfd = {fd, POLLIN, 0};
+        // Wake up regularly to notice Shutdown()
+        if(poll(&pfd, 1, 100) <= 0){
+            continue;
+        }
+        ssize_t length = read(fd, buffer, sizeof(buffer));
+        for(ssize_t offset = 0; offset < length;){
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(buffer + offset);
+            if(event->len > 0){
+                fileChanged(event->name);
+            }
+            offset += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    close(fd);
+#else
+    std::map<std::string, std::filesystem::file_time_type> lastWriteTimes;
+    while(m_running){
+        std::vector<std::string> files;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for(const auto& source : m_sources){
+                files.push_back(source.first);
+            }
+        }
+        for(const std::string& filename : files){
+            std::error_code error;
+            auto writeTime = std::filesystem::last_write_time(m_directory + "/" + filename, error);
+            if(error){
+                continue;
+            }
+            if(lastWriteTimes.count(filename) != 0 && lastWriteTimes[filename] != writeTime){
+                fileChanged(filename);
+            }
+            lastWriteTimes[filename] = writeTime;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    }
+#endif
+}
+
+
+std::string ShaderReloader::GetFilename(const std::string& path){
+    size_t lastSlash = path.find_last_of("/\\");
+    if(lastSlash == std::string::npos){
+        return path;
+    }
+    return path.substr(lastSlash + 1);
+}
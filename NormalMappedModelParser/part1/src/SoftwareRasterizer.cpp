@@ -0,0 +1,622 @@
+#include "SoftwareRasterizer.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define SOFTWARERASTERIZER_SSE
+#endif
+
+
+// Normalize, or zero for vectors without a direction (e.g. OBJ files without normals)
+static glm::vec3 SafeNormalize(const glm::vec3& v){
+    float length = glm::length(v);
+    return (length > 0.0f && std::isfinite(length)) ? v / length : glm::vec3(0.0f);
+}
+
+
+// Constructor
+SoftwareRasterizer::SoftwareRasterizer(){
+
+}
+
+
+/**
+ * @brief Allocates the framebuffer and the tile bins.
+ *
+ * @param width Width of the image in pixels.
+ * @param height Height of the image in pixels.
+ * @param threadPool Threads that transform vertices and process tiles.
+ */
+void SoftwareRasterizer::Initialize(int width, int height, ThreadPool* threadPool){
+    mThreadPool = threadPool;
+    mWidth = width;
+    mHeight = height;
+    mTilesX = (width + kTileSize - 1) / kTileSize;
+    mTilesY = (height + kTileSize - 1) / kTileSize;
+    mBlocksX = (width + kBlockSize - 1) / kBlockSize;
+    int blocksY = (height + kBlockSize - 1) / kBlockSize;
+    mPitch = mBlocksX * kBlockSize;
+
+    size_t paddedPixels = static_cast<size_t>(mPitch) * blocksY * kBlockSize;
+    mDepth.resize(paddedPixels);
+    mTriangleIds.resize(paddedPixels);
+    mBarycentric1.resize(paddedPixels);
+    mBarycentric2.resize(paddedPixels);
+    mColor.resize(static_cast<size_t>(width) * height * 3);
+    mBlockMaxDepth.resize(static_cast<size_t>(mBlocksX) * blocksY);
+
+    mThreadStatistics.resize(mThreadPool->GetThreadCount());
+}
+
+
+void SoftwareRasterizer::BeginFrame(const glm::mat4& view, const glm::mat4& projection,
+                                    const glm::vec3& eyePosition, const glm::vec3& lightPosition,
+                                    const glm::vec3& clearColor){
+    mViewProjection = projection * view;
+    mEyePosition = eyePosition;
+    mLightPosition = lightPosition;
+    mClearColor = clearColor;
+    mChunkCount = 0;
+    mStatistics = Statistics();
+    std::fill(mThreadStatistics.begin(), mThreadStatistics.end(), ThreadStatistics());
+}
+
+
+/**
+ * @brief Runs the vertex stage and bins the triangles of an object.
+ *
+ * Vertices are transformed in parallel, then every chunk of triangles is
+ * clipped, set up and binned by one job into its own bins.
+ *
+ * @param object Object whose vertex and index data are drawn.
+ * @param model Model matrix of the object.
+ */
+void SoftwareRasterizer::Submit(const Object& object, const glm::mat4& model){
+    PROFILE_SCOPE("SoftwareRasterizer::Submit");
+    auto begin = std::chrono::steady_clock::now();
+
+    const std::vector<glm::vec3>& positions = object.GetVertices();
+    const std::vector<glm::vec3>& normals   = object.GetNormals();
+    const std::vector<glm::vec2>& texCoords = object.GetTexCoords();
+    const std::vector<glm::vec3>& tangents  = object.GetTangents();
+    const std::vector<glm::vec3>& bitangents = object.GetBitangents();
+    const std::vector<unsigned int>& indices = object.GetIndices();
+    Material material;
+    material.diffuse = GetMipTexture(object.GetDiffuseTextureHandle());
+    material.normalMap = GetMipTexture(object.GetNormalMapTextureHandle());
+    // Tangents only exist after ComputeTangentSpace()
+    bool hasTangents = tangents.size() == positions.size() && bitangents.size() == positions.size();
+
+    glm::mat4 modelViewProjection = mViewProjection * model;
+    glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+
+    // Vertex stage
+    const size_t kVerticesPerJob = 1024;
+    mVertices.resize(positions.size());
+    mThreadPool->ParallelFor((positions.size() + kVerticesPerJob - 1) / kVerticesPerJob,
+        [&](size_t job, unsigned int){
+            size_t end = std::min(positions.size(), (job + 1) * kVerticesPerJob);
+            for (size_t i = job * kVerticesPerJob; i < end; ++i) {
+                glm::vec4 position(positions[i], 1.0f);
+                mVertices[i].clip = modelViewProjection * position;
+                mVertices[i].position = glm::vec3(model * position);
+                // Same as the vertex shader: T, B and N are normalized per vertex
+                mVertices[i].normal = SafeNormalize(normalMatrix * normals[i]);
+                mVertices[i].tangent = hasTangents ? SafeNormalize(normalMatrix * tangents[i]) : glm::vec3(0.0f);
+                mVertices[i].bitangent = hasTangents ? SafeNormalize(normalMatrix * bitangents[i]) : glm::vec3(0.0f);
+                mVertices[i].texCoord = texCoords[i];
+            }
+        });
+
+    // Triangle setup and binning, one chunk per job
+    size_t triangleCount = indices.size() / 3;
+    size_t firstChunk = mChunkCount;
+    size_t chunkCount = (triangleCount + kTrianglesPerChunk - 1) / kTrianglesPerChunk;
+    mChunkCount += chunkCount;
+    if (mChunks.size() < mChunkCount) {
+        mChunks.resize(mChunkCount);
+    }
+    mThreadPool->ParallelFor(chunkCount, [&](size_t job, unsigned int threadIndex){
+        Chunk& chunk = mChunks[firstChunk + job];
+        chunk.triangles.clear();
+        chunk.bins.resize(mTilesX * mTilesY);
+        for (std::vector<uint32_t>& bin : chunk.bins) {
+            bin.clear();
+        }
+
+        size_t end = std::min(triangleCount, (job + 1) * kTrianglesPerChunk);
+        for (size_t i = job * kTrianglesPerChunk; i < end; ++i) {
+            ClipAndSetup(mVertices[indices[i * 3]], mVertices[indices[i * 3 + 1]], mVertices[indices[i * 3 + 2]],
+                         material, chunk);
+        }
+        for (const std::vector<uint32_t>& bin : chunk.bins) {
+            mThreadStatistics[threadIndex].binEntries += bin.size();
+        }
+    });
+
+    mStatistics.trianglesSubmitted += triangleCount;
+    for (size_t c = firstChunk; c < mChunkCount; ++c) {
+        mStatistics.trianglesVisible += mChunks[c].triangles.size();
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+    mStatistics.vertexMilliseconds += elapsed.count();
+}
+
+
+const MipTexture* SoftwareRasterizer::GetMipTexture(const TextureHandle& texture){
+    if (texture == nullptr || texture->GetImage() == nullptr) {
+        return nullptr;
+    }
+    auto found = mMipTextures.find(texture);
+    if (found == mMipTextures.end()) {
+        PROFILE_SCOPE("BuildMipTexture");
+        found = mMipTextures.emplace(texture, MipTexture()).first;
+        found->second.Build(texture->GetImage());
+    }
+    return &found->second;
+}
+
+
+/**
+ * @brief Clips a triangle against the near plane (z = -w) like OpenGL does.
+ *
+ * Triangles that are completely outside one of the frustum planes are dropped
+ * here, all other planes are handled by the screen bounding box and depth test.
+ */
+void SoftwareRasterizer::ClipAndSetup(const Vertex& v0, const Vertex& v1, const Vertex& v2, const Material& material, Chunk& chunk){
+    const Vertex* input[3] = {&v0, &v1, &v2};
+
+    // Trivial reject against the six frustum planes
+    for (int axis = 0; axis < 3; ++axis) {
+        if (v0.clip[axis] >  v0.clip.w && v1.clip[axis] >  v1.clip.w && v2.clip[axis] >  v2.clip.w) return;
+        if (v0.clip[axis] < -v0.clip.w && v1.clip[axis] < -v1.clip.w && v2.clip[axis] < -v2.clip.w) return;
+    }
+
+    float distance[3];
+    int inside = 0;
+    for (int i = 0; i < 3; ++i) {
+        distance[i] = input[i]->clip.z + input[i]->clip.w;
+        inside += (distance[i] >= 0.0f) ? 1 : 0;
+    }
+    if (inside == 3) {
+        SetupTriangle(v0, v1, v2, material, chunk);
+        return;
+    }
+
+    // Sutherland-Hodgman against a single plane gives at most 4 vertices
+    Vertex clipped[4];
+    int count = 0;
+    for (int i = 0; i < 3; ++i) {
+        int j = (i + 1) % 3;
+        if (distance[i] >= 0.0f) {
+            clipped[count++] = *input[i];
+        }
+        if ((distance[i] >= 0.0f) != (distance[j] >= 0.0f)) {
+            float t = distance[i] / (distance[i] - distance[j]);
+            Vertex& v = clipped[count++];
+            v.clip     = glm::mix(input[i]->clip, input[j]->clip, t);
+            v.position = glm::mix(input[i]->position, input[j]->position, t);
+            v.normal   = glm::mix(input[i]->normal, input[j]->normal, t);
+            v.tangent  = glm::mix(input[i]->tangent, input[j]->tangent, t);
+            v.bitangent = glm::mix(input[i]->bitangent, input[j]->bitangent, t);
+            v.texCoord = glm::mix(input[i]->texCoord, input[j]->texCoord, t);
+        }
+    }
+    for (int i = 1; i + 1 < count; ++i) {
+        SetupTriangle(clipped[0], clipped[i], clipped[i + 1], material, chunk);
+    }
+}
+
+
+/**
+ * @brief Projects a triangle to the screen, culls back faces and adds it to the tile bins.
+ *
+ * Vertices are snapped to 1/16 of a pixel so that edges shared by two
+ * triangles produce exactly the same edge function values.
+ */
+void SoftwareRasterizer::SetupTriangle(const Vertex& v0, const Vertex& v1, const Vertex& v2, const Material& material, Chunk& chunk){
+    const Vertex* vertices[3] = {&v0, &v1, &v2};
+    float x[3], y[3], z[3], invW[3];
+    for (int i = 0; i < 3; ++i) {
+        invW[i] = 1.0f / vertices[i]->clip.w;
+        float ndcX = vertices[i]->clip.x * invW[i];
+        float ndcY = vertices[i]->clip.y * invW[i];
+        x[i] = std::round((ndcX * 0.5f + 0.5f) * mWidth * 16.0f) / 16.0f;
+        // Row 0 is the top of the image
+        y[i] = std::round((0.5f - ndcY * 0.5f) * mHeight * 16.0f) / 16.0f;
+        z[i] = vertices[i]->clip.z * invW[i] * 0.5f + 0.5f;
+    }
+
+    // Counter-clockwise front faces become clockwise once y points down
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+    if (area >= 0.0f) {
+        return;
+    }
+    // Swap two vertices so the edge functions are positive inside
+    int order[3] = {0, 2, 1};
+    area = -area;
+
+    Triangle triangle;
+    float sx[3], sy[3], sz[3];
+    for (int i = 0; i < 3; ++i) {
+        int k = order[i];
+        sx[i] = x[k];
+        sy[i] = y[k];
+        sz[i] = z[k];
+        triangle.invW[i] = invW[k];
+        triangle.position[i] = vertices[k]->position;
+        triangle.normal[i] = vertices[k]->normal;
+        triangle.tangent[i] = vertices[k]->tangent;
+        triangle.bitangent[i] = vertices[k]->bitangent;
+        triangle.texCoord[i] = vertices[k]->texCoord;
+    }
+
+    triangle.minX = std::max(0, static_cast<int>(std::floor(std::min({sx[0], sx[1], sx[2]}))));
+    triangle.minY = std::max(0, static_cast<int>(std::floor(std::min({sy[0], sy[1], sy[2]}))));
+    triangle.maxX = std::min(mWidth - 1, static_cast<int>(std::ceil(std::max({sx[0], sx[1], sx[2]}))));
+    triangle.maxY = std::min(mHeight - 1, static_cast<int>(std::ceil(std::max({sy[0], sy[1], sy[2]}))));
+    if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+        return;
+    }
+
+    // Edge i is opposite of vertex i, so E_i / area is the barycentric weight of vertex i
+    for (int i = 0; i < 3; ++i) {
+        int a = (i + 1) % 3;
+        int b = (i + 2) % 3;
+        triangle.edgeA[i] = sy[a] - sy[b];
+        triangle.edgeB[i] = sx[b] - sx[a];
+        triangle.edgeC[i] = -(triangle.edgeA[i] * sx[a] + triangle.edgeB[i] * sy[a]);
+        // Pixels exactly on an edge belong to the triangle only for top and left edges
+        bool topLeft = triangle.edgeA[i] > 0.0f || (triangle.edgeA[i] == 0.0f && triangle.edgeB[i] > 0.0f);
+        triangle.edgeThreshold[i] = topLeft ? 0.0f : FLT_MIN;
+    }
+    triangle.invArea = 1.0f / area;
+
+    triangle.zA = (sz[0] * triangle.edgeA[0] + sz[1] * triangle.edgeA[1] + sz[2] * triangle.edgeA[2]) * triangle.invArea;
+    triangle.zB = (sz[0] * triangle.edgeB[0] + sz[1] * triangle.edgeB[1] + sz[2] * triangle.edgeB[2]) * triangle.invArea;
+    triangle.zC = (sz[0] * triangle.edgeC[0] + sz[1] * triangle.edgeC[1] + sz[2] * triangle.edgeC[2]) * triangle.invArea;
+    triangle.minZ = std::min({sz[0], sz[1], sz[2]});
+
+    // texCoord/w and 1/w are affine in screen space, their derivatives are constant
+    triangle.texCoordOverWdx = glm::vec2(0.0f);
+    triangle.texCoordOverWdy = glm::vec2(0.0f);
+    triangle.invWdx = 0.0f;
+    triangle.invWdy = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+        float dldx = triangle.edgeA[i] * triangle.invArea;
+        float dldy = triangle.edgeB[i] * triangle.invArea;
+        triangle.texCoordOverWdx += triangle.texCoord[i] * triangle.invW[i] * dldx;
+        triangle.texCoordOverWdy += triangle.texCoord[i] * triangle.invW[i] * dldy;
+        triangle.invWdx += triangle.invW[i] * dldx;
+        triangle.invWdy += triangle.invW[i] * dldy;
+    }
+
+    glm::vec3 faceNormal = glm::cross(v1.position - v0.position, v2.position - v0.position);
+    float length = glm::length(faceNormal);
+    triangle.faceNormal = (length > 0.0f) ? faceNormal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+    triangle.diffuse = material.diffuse;
+    triangle.normalMap = material.normalMap;
+
+    uint32_t index = static_cast<uint32_t>(chunk.triangles.size());
+    chunk.triangles.push_back(triangle);
+
+    int tileX0 = triangle.minX / kTileSize;
+    int tileY0 = triangle.minY / kTileSize;
+    int tileX1 = triangle.maxX / kTileSize;
+    int tileY1 = triangle.maxY / kTileSize;
+    for (int ty = tileY0; ty <= tileY1; ++ty) {
+        for (int tx = tileX0; tx <= tileX1; ++tx) {
+            chunk.bins[ty * mTilesX + tx].push_back(index);
+        }
+    }
+}
+
+
+/**
+ * @brief Rasterizes and shades all tiles in parallel.
+ */
+void SoftwareRasterizer::EndFrame(){
+    PROFILE_SCOPE("SoftwareRasterizer::EndFrame");
+    auto begin = std::chrono::steady_clock::now();
+
+    mThreadPool->ParallelFor(static_cast<size_t>(mTilesX) * mTilesY, [this](size_t tile, unsigned int threadIndex){
+        ProcessTile(static_cast<int>(tile), mThreadStatistics[threadIndex]);
+    });
+
+    for (const ThreadStatistics& statistics : mThreadStatistics) {
+        mStatistics.binEntries += statistics.binEntries;
+        mStatistics.blocksTested += statistics.blocksTested;
+        mStatistics.blocksSkippedByDepth += statistics.blocksSkippedByDepth;
+        mStatistics.pixelsShaded += statistics.pixelsShaded;
+        mStatistics.shadeMilliseconds += statistics.shadeMilliseconds;
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+    mStatistics.tileMilliseconds = elapsed.count();
+}
+
+
+void SoftwareRasterizer::ProcessTile(int tileIndex, ThreadStatistics& statistics){
+    PROFILE_SCOPE("Tile");
+    int tileX0 = (tileIndex % mTilesX) * kTileSize;
+    int tileY0 = (tileIndex / mTilesX) * kTileSize;
+    // Padded to whole blocks, only the last row and column of tiles can be smaller
+    int tileX1 = std::min(tileX0 + kTileSize, mPitch);
+    int tileY1 = std::min(tileY0 + kTileSize, static_cast<int>(mDepth.size() / mPitch));
+
+    // Clear this tile
+    for (int y = tileY0; y < tileY1; ++y) {
+        size_t row = static_cast<size_t>(y) * mPitch;
+        std::fill(mDepth.begin() + row + tileX0, mDepth.begin() + row + tileX1, 1.0f);
+        std::fill(mTriangleIds.begin() + row + tileX0, mTriangleIds.begin() + row + tileX1, kNoTriangle);
+    }
+    for (int by = tileY0 / kBlockSize; by < tileY1 / kBlockSize; ++by) {
+        for (int bx = tileX0 / kBlockSize; bx < tileX1 / kBlockSize; ++bx) {
+            mBlockMaxDepth[by * mBlocksX + bx] = 1.0f;
+        }
+    }
+
+    // Chunks are walked in submission order, so overlapping triangles resolve like on the GPU
+    for (size_t c = 0; c < mChunkCount; ++c) {
+        const Chunk& chunk = mChunks[c];
+        for (uint32_t index : chunk.bins[tileIndex]) {
+            RasterizeTriangle(chunk.triangles[index], static_cast<uint32_t>(c) * kChunkCapacity + index,
+                              tileX0, tileY0, tileX1, tileY1, statistics);
+        }
+    }
+
+    ShadeTile(tileX0, tileY0, std::min(tileX1, mWidth), std::min(tileY1, mHeight), statistics);
+}
+
+
+/**
+ * @brief Rasterizes the part of a triangle that overlaps one tile.
+ *
+ * The triangle's bounding box is walked in 8x8 blocks. A block is skipped if
+ * its farthest stored depth is already closer than the nearest point of the
+ * triangle, or if it lies completely outside one of the edges. Inside a block
+ * every row is tested 4 pixels at a time.
+ */
+void SoftwareRasterizer::RasterizeTriangle(const Triangle& triangle, uint32_t id,
+                                           int tileX0, int tileY0, int tileX1, int tileY1,
+                                           ThreadStatistics& statistics){
+    int blockX0 = std::max(triangle.minX, tileX0) / kBlockSize * kBlockSize;
+    int blockY0 = std::max(triangle.minY, tileY0) / kBlockSize * kBlockSize;
+    int blockX1 = std::min(triangle.maxX + 1, tileX1);
+    int blockY1 = std::min(triangle.maxY + 1, tileY1);
+
+    for (int by = blockY0; by < blockY1; by += kBlockSize) {
+        for (int bx = blockX0; bx < blockX1; bx += kBlockSize) {
+            ++statistics.blocksTested;
+            float& blockMaxDepth = mBlockMaxDepth[(by / kBlockSize) * mBlocksX + bx / kBlockSize];
+            if (triangle.minZ >= blockMaxDepth) {
+                ++statistics.blocksSkippedByDepth;
+                continue;
+            }
+
+            // Reject the block if the pixel center that is most inside an edge is still outside it
+            bool outside = false;
+            for (int e = 0; e < 3; ++e) {
+                float x = bx + 0.5f + ((triangle.edgeA[e] > 0.0f) ? kBlockSize - 1 : 0);
+                float y = by + 0.5f + ((triangle.edgeB[e] > 0.0f) ? kBlockSize - 1 : 0);
+                if (triangle.edgeA[e] * x + triangle.edgeB[e] * y + triangle.edgeC[e] < triangle.edgeThreshold[e]) {
+                    outside = true;
+                    break;
+                }
+            }
+            if (outside) {
+                continue;
+            }
+
+            bool written = false;
+            for (int py = by; py < by + kBlockSize; ++py) {
+                float centerY = py + 0.5f;
+                for (int px = bx; px < bx + kBlockSize; px += 4) {
+                    size_t pixel = static_cast<size_t>(py) * mPitch + px;
+                    float centerX = px + 0.5f;
+                    float e0 = triangle.edgeA[0] * centerX + triangle.edgeB[0] * centerY + triangle.edgeC[0];
+                    float e1 = triangle.edgeA[1] * centerX + triangle.edgeB[1] * centerY + triangle.edgeC[1];
+                    float e2 = triangle.edgeA[2] * centerX + triangle.edgeB[2] * centerY + triangle.edgeC[2];
+                    float z  = triangle.zA * centerX + triangle.zB * centerY + triangle.zC;
+#if defined(SOFTWARERASTERIZER_SSE)
+                    const __m128 steps = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+                    __m128 edge0 = _mm_add_ps(_mm_set1_ps(e0), _mm_mul_ps(_mm_set1_ps(triangle.edgeA[0]), steps));
+                    __m128 edge1 = _mm_add_ps(_mm_set1_ps(e1), _mm_mul_ps(_mm_set1_ps(triangle.edgeA[1]), steps));
+                    __m128 edge2 = _mm_add_ps(_mm_set1_ps(e2), _mm_mul_ps(_mm_set1_ps(triangle.edgeA[2]), steps));
+                    __m128 depth = _mm_add_ps(_mm_set1_ps(z), _mm_mul_ps(_mm_set1_ps(triangle.zA), steps));
+
+                    __m128 mask = _mm_and_ps(_mm_cmpge_ps(edge0, _mm_set1_ps(triangle.edgeThreshold[0])),
+                                             _mm_cmpge_ps(edge1, _mm_set1_ps(triangle.edgeThreshold[1])));
+                    mask = _mm_and_ps(mask, _mm_cmpge_ps(edge2, _mm_set1_ps(triangle.edgeThreshold[2])));
+                    if (_mm_movemask_ps(mask) == 0) {
+                        continue;
+                    }
+                    __m128 storedDepth = _mm_loadu_ps(&mDepth[pixel]);
+                    mask = _mm_and_ps(mask, _mm_cmplt_ps(depth, storedDepth));
+                    if (_mm_movemask_ps(mask) == 0) {
+                        continue;
+                    }
+
+                    // Blend the new values into the covered lanes
+                    auto blend = [&mask](__m128 newValue, __m128 oldValue){
+                        return _mm_or_ps(_mm_and_ps(mask, newValue), _mm_andnot_ps(mask, oldValue));
+                    };
+                    __m128 invArea = _mm_set1_ps(triangle.invArea);
+                    _mm_storeu_ps(&mDepth[pixel], blend(depth, storedDepth));
+                    _mm_storeu_ps(&mBarycentric1[pixel], blend(_mm_mul_ps(edge1, invArea), _mm_loadu_ps(&mBarycentric1[pixel])));
+                    _mm_storeu_ps(&mBarycentric2[pixel], blend(_mm_mul_ps(edge2, invArea), _mm_loadu_ps(&mBarycentric2[pixel])));
+                    __m128 ids = _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(id)));
+                    __m128 storedIds = _mm_loadu_ps(reinterpret_cast<const float*>(&mTriangleIds[pixel]));
+                    _mm_storeu_ps(reinterpret_cast<float*>(&mTriangleIds[pixel]), blend(ids, storedIds));
+                    written = true;
+#else
+                    for (int lane = 0; lane < 4; ++lane) {
+                        float l0 = e0 + triangle.edgeA[0] * lane;
+                        float l1 = e1 + triangle.edgeA[1] * lane;
+                        float l2 = e2 + triangle.edgeA[2] * lane;
+                        float d  = z + triangle.zA * lane;
+                        if (l0 >= triangle.edgeThreshold[0] && l1 >= triangle.edgeThreshold[1] &&
+                            l2 >= triangle.edgeThreshold[2] && d < mDepth[pixel + lane]) {
+                            mDepth[pixel + lane] = d;
+                            mBarycentric1[pixel + lane] = l1 * triangle.invArea;
+                            mBarycentric2[pixel + lane] = l2 * triangle.invArea;
+                            mTriangleIds[pixel + lane] = id;
+                            written = true;
+                        }
+                    }
+#endif
+                }
+            }
+
+            if (written) {
+                float maxDepth = 0.0f;
+                for (int py = by; py < by + kBlockSize; ++py) {
+                    const float* row = &mDepth[static_cast<size_t>(py) * mPitch + bx];
+                    maxDepth = std::max(maxDepth, *std::max_element(row, row + kBlockSize));
+                }
+                blockMaxDepth = maxDepth;
+            }
+        }
+    }
+}
+
+
+// log2 of the texels a pixel covers, the same rho as the OpenGL specification uses
+static float ComputeLod(const MipTexture& texture, const glm::vec2& texCoordDx, const glm::vec2& texCoordDy){
+    glm::vec2 size(texture.GetWidth(), texture.GetHeight());
+    glm::vec2 dx = texCoordDx * size;
+    glm::vec2 dy = texCoordDy * size;
+    return 0.5f * std::log2(std::max(glm::dot(dx, dx), glm::dot(dy, dy)));
+}
+
+
+/**
+ * @brief Shades the visible pixels of a tile.
+ *
+ * Attributes are interpolated per pixel and textures are sampled into a
+ * FragmentBatch; every 8 fragments the batch is lit by ShadeNormalMappedPhong().
+ * Objects without a diffuse texture are drawn light gray instead of black.
+ */
+void SoftwareRasterizer::ShadeTile(int tileX0, int tileY0, int tileX1, int tileY1, ThreadStatistics& statistics){
+    auto begin = std::chrono::steady_clock::now();
+
+    FragmentBatch batch = {};
+    uint8_t* targets[FragmentBatch::kWidth];
+    uint8_t shaded[FragmentBatch::kWidth * 3];
+    int count = 0;
+    auto flush = [&](){
+        ShadeNormalMappedPhong(batch, mLightPosition, mEyePosition, shaded);
+        for (int lane = 0; lane < count; ++lane) {
+            targets[lane][0] = shaded[lane * 3 + 0];
+            targets[lane][1] = shaded[lane * 3 + 1];
+            targets[lane][2] = shaded[lane * 3 + 2];
+        }
+        statistics.pixelsShaded += count;
+        count = 0;
+    };
+
+    const uint8_t clear[3] = {static_cast<uint8_t>(mClearColor.r * 255.0f),
+                              static_cast<uint8_t>(mClearColor.g * 255.0f),
+                              static_cast<uint8_t>(mClearColor.b * 255.0f)};
+
+    for (int y = tileY0; y < tileY1; ++y) {
+        uint8_t* color = &mColor[(static_cast<size_t>(y) * mWidth + tileX0) * 3];
+        for (int x = tileX0; x < tileX1; ++x, color += 3) {
+            size_t pixel = static_cast<size_t>(y) * mPitch + x;
+            uint32_t id = mTriangleIds[pixel];
+            if (id == kNoTriangle) {
+                color[0] = clear[0];
+                color[1] = clear[1];
+                color[2] = clear[2];
+                continue;
+            }
+            const Triangle& triangle = mChunks[id / kChunkCapacity].triangles[id % kChunkCapacity];
+
+            // Screen space barycentrics to perspective correct weights
+            float l1 = mBarycentric1[pixel];
+            float l2 = mBarycentric2[pixel];
+            float l0 = 1.0f - l1 - l2;
+            float w0 = l0 * triangle.invW[0];
+            float w1 = l1 * triangle.invW[1];
+            float w2 = l2 * triangle.invW[2];
+            float invW = w0 + w1 + w2;
+            float invSum = 1.0f / invW;
+            w0 *= invSum;
+            w1 *= invSum;
+            w2 *= invSum;
+
+            glm::vec3 position  = triangle.position[0] * w0 + triangle.position[1] * w1 + triangle.position[2] * w2;
+            glm::vec2 texCoord  = triangle.texCoord[0] * w0 + triangle.texCoord[1] * w1 + triangle.texCoord[2] * w2;
+            glm::vec3 normal    = triangle.normal[0] * w0 + triangle.normal[1] * w1 + triangle.normal[2] * w2;
+            glm::vec3 tangent   = triangle.tangent[0] * w0 + triangle.tangent[1] * w1 + triangle.tangent[2] * w2;
+            glm::vec3 bitangent = triangle.bitangent[0] * w0 + triangle.bitangent[1] * w1 + triangle.bitangent[2] * w2;
+            // OBJ files without normals get the face normal
+            if (glm::dot(normal, normal) < 1e-12f) {
+                normal = triangle.faceNormal;
+            }
+
+            // d(texCoord)/dx = (d(texCoord/w)/dx - texCoord * d(1/w)/dx) * w
+            glm::vec2 texCoordDx = (triangle.texCoordOverWdx - texCoord * triangle.invWdx) * invSum;
+            glm::vec2 texCoordDy = (triangle.texCoordOverWdy - texCoord * triangle.invWdy) * invSum;
+
+            float sample[3] = {0.8f, 0.8f, 0.8f};
+            if (triangle.diffuse != nullptr) {
+                triangle.diffuse->SampleTrilinear(texCoord.x, texCoord.y,
+                                                  ComputeLod(*triangle.diffuse, texCoordDx, texCoordDy), sample);
+            }
+            batch.albedoR[count] = sample[0];
+            batch.albedoG[count] = sample[1];
+            batch.albedoB[count] = sample[2];
+
+            sample[0] = 0.5f;
+            sample[1] = 0.5f;
+            sample[2] = 1.0f;
+            if (triangle.normalMap != nullptr) {
+                triangle.normalMap->SampleTrilinear(texCoord.x, texCoord.y,
+                                                    ComputeLod(*triangle.normalMap, texCoordDx, texCoordDy), sample);
+            }
+            batch.normalMapX[count] = sample[0];
+            batch.normalMapY[count] = sample[1];
+            batch.normalMapZ[count] = sample[2];
+
+            batch.positionX[count] = position.x;
+            batch.positionY[count] = position.y;
+            batch.positionZ[count] = position.z;
+            batch.normalX[count] = normal.x;
+            batch.normalY[count] = normal.y;
+            batch.normalZ[count] = normal.z;
+            batch.tangentX[count] = tangent.x;
+            batch.tangentY[count] = tangent.y;
+            batch.tangentZ[count] = tangent.z;
+            batch.bitangentX[count] = bitangent.x;
+            batch.bitangentY[count] = bitangent.y;
+            batch.bitangentZ[count] = bitangent.z;
+            targets[count] = color;
+            if (++count == FragmentBatch::kWidth) {
+                flush();
+            }
+        }
+    }
+    if (count > 0) {
+        flush();
+    }
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+    statistics.shadeMilliseconds += elapsed.count();
+}
+
+
+/**
+ * @brief Copies the color buffer into an image, top row first like PPM::savePPM writes it.
+ */
+void SoftwareRasterizer::Resolve(PPM& image) const{
+    if (image.getWidth() != mWidth || image.getHeight() != mHeight) {
+        return;
+    }
+    std::memcpy(image.pixelData(), mColor.data(), mColor.size());
+}
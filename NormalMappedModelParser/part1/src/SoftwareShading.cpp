@@ -0,0 +1,179 @@
+#include "SoftwareShading.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if !defined(SOFTWARESHADING_SSE)
+Float8 Sqrt(const Float8& a){
+    Float8 r;
+    for (int i = 0; i < 8; ++i) r.v[i] = std::sqrt(a.v[i]);
+    return r;
+}
+#endif
+
+
+/**
+ * @brief Builds the mip chain of an image the way glGenerateMipmap does (2x2 box filter).
+ *
+ * @param image Image data as uploaded to OpenGL (bottom row first, RGB).
+ */
+void MipTexture::Build(Image* image){
+    mLevels.clear();
+    if (image == nullptr || image->GetPixelDataPtr() == nullptr) {
+        return;
+    }
+
+    Level base;
+    base.width = image->GetWidth();
+    base.height = image->GetHeight();
+    base.texels.assign(image->GetPixelDataPtr(), image->GetPixelDataPtr() + base.width * base.height * 3);
+    mLevels.push_back(std::move(base));
+
+    while (mLevels.back().width > 1 || mLevels.back().height > 1) {
+        const Level& previous = mLevels.back();
+        Level level;
+        level.width = std::max(1, previous.width / 2);
+        level.height = std::max(1, previous.height / 2);
+        level.texels.resize(level.width * level.height * 3);
+        for (int y = 0; y < level.height; ++y) {
+            int y0 = std::min(previous.height - 1, y * 2);
+            int y1 = std::min(previous.height - 1, y * 2 + 1);
+            for (int x = 0; x < level.width; ++x) {
+                int x0 = std::min(previous.width - 1, x * 2);
+                int x1 = std::min(previous.width - 1, x * 2 + 1);
+                for (int c = 0; c < 3; ++c) {
+                    int sum = previous.texels[(y0 * previous.width + x0) * 3 + c]
+                            + previous.texels[(y0 * previous.width + x1) * 3 + c]
+                            + previous.texels[(y1 * previous.width + x0) * 3 + c]
+                            + previous.texels[(y1 * previous.width + x1) * 3 + c];
+                    level.texels[(y * level.width + x) * 3 + c] = static_cast<uint8_t>((sum + 2) / 4);
+                }
+            }
+        }
+        mLevels.push_back(std::move(level));
+    }
+}
+
+
+void MipTexture::SampleBilinear(int level, float u, float v, float* rgb) const{
+    const Level& l = mLevels[level];
+    // Texel centers are at half integers, like GL_LINEAR
+    float x = u * l.width - 0.5f;
+    float y = v * l.height - 0.5f;
+    float fx = std::floor(x);
+    float fy = std::floor(y);
+    float ax = x - fx;
+    float ay = y - fy;
+    int x0 = std::min(l.width - 1, std::max(0, static_cast<int>(fx)));
+    int x1 = std::min(l.width - 1, std::max(0, static_cast<int>(fx) + 1));
+    int y0 = std::min(l.height - 1, std::max(0, static_cast<int>(fy)));
+    int y1 = std::min(l.height - 1, std::max(0, static_cast<int>(fy) + 1));
+
+    const uint8_t* t00 = &l.texels[(y0 * l.width + x0) * 3];
+    const uint8_t* t10 = &l.texels[(y0 * l.width + x1) * 3];
+    const uint8_t* t01 = &l.texels[(y1 * l.width + x0) * 3];
+    const uint8_t* t11 = &l.texels[(y1 * l.width + x1) * 3];
+    for (int c = 0; c < 3; ++c) {
+        float top    = t00[c] + (t10[c] - t00[c]) * ax;
+        float bottom = t01[c] + (t11[c] - t01[c]) * ax;
+        rgb[c] = (top + (bottom - top) * ay) * (1.0f / 255.0f);
+    }
+}
+
+
+/**
+ * @brief Samples between the two closest mip levels.
+ *
+ * @param lod log2 of the texel footprint of a pixel, 0 or less magnifies the base level.
+ */
+void MipTexture::SampleTrilinear(float u, float v, float lod, float* rgb) const{
+    int lastLevel = static_cast<int>(mLevels.size()) - 1;
+    if (lod <= 0.0f || lastLevel == 0) {
+        SampleBilinear(0, u, v, rgb);
+        return;
+    }
+    lod = std::min(lod, static_cast<float>(lastLevel));
+    int level = static_cast<int>(lod);
+    float blend = lod - level;
+    SampleBilinear(level, u, v, rgb);
+    if (blend > 0.0f && level < lastLevel) {
+        float next[3];
+        SampleBilinear(level + 1, u, v, next);
+        for (int c = 0; c < 3; ++c) {
+            rgb[c] += (next[c] - rgb[c]) * blend;
+        }
+    }
+}
+
+
+/**
+ * @brief Shades 8 fragments with the lighting of shaders/frag.glsl.
+ *
+ * The normal map sample is moved to [-1,1], rotated into world space with the
+ * interpolated TBN and lit with ambient, diffuse and a white specular highlight
+ * (exponent 32). All arithmetic runs on 8 lanes at once.
+ */
+void ShadeNormalMappedPhong(const FragmentBatch& batch, const glm::vec3& lightPosition,
+                            const glm::vec3& eyePosition, uint8_t* rgb){
+    const Float8 one(1.0f);
+    const Float8 two(2.0f);
+    const Float8 zero(0.0f);
+    auto normalizeInPlace = [](Float8& x, Float8& y, Float8& z){
+        Float8 invLength = Float8(1.0f) / Sqrt(Max(x * x + y * y + z * z, Float8(1e-20f)));
+        x = x * invLength;
+        y = y * invLength;
+        z = z * invLength;
+    };
+
+    // Normal from the normal map, in tangent space
+    Float8 mapX = Float8::Load(batch.normalMapX) * two - one;
+    Float8 mapY = Float8::Load(batch.normalMapY) * two - one;
+    Float8 mapZ = Float8::Load(batch.normalMapZ) * two - one;
+    normalizeInPlace(mapX, mapY, mapZ);
+
+    // normal = normalize(TBN * mapNormal)
+    Float8 normalX = Float8::Load(batch.tangentX) * mapX + Float8::Load(batch.bitangentX) * mapY + Float8::Load(batch.normalX) * mapZ;
+    Float8 normalY = Float8::Load(batch.tangentY) * mapX + Float8::Load(batch.bitangentY) * mapY + Float8::Load(batch.normalY) * mapZ;
+    Float8 normalZ = Float8::Load(batch.tangentZ) * mapX + Float8::Load(batch.bitangentZ) * mapY + Float8::Load(batch.normalZ) * mapZ;
+    normalizeInPlace(normalX, normalY, normalZ);
+
+    Float8 positionX = Float8::Load(batch.positionX);
+    Float8 positionY = Float8::Load(batch.positionY);
+    Float8 positionZ = Float8::Load(batch.positionZ);
+
+    // Diffuse
+    Float8 lightX = Float8(lightPosition.x) - positionX;
+    Float8 lightY = Float8(lightPosition.y) - positionY;
+    Float8 lightZ = Float8(lightPosition.z) - positionZ;
+    normalizeInPlace(lightX, lightY, lightZ);
+    Float8 normalDotLight = normalX * lightX + normalY * lightY + normalZ * lightZ;
+    Float8 diffuse = Max(normalDotLight, zero);
+
+    // Specular: reflect(-L, N) = 2 * dot(N, L) * N - L
+    Float8 viewX = Float8(eyePosition.x) - positionX;
+    Float8 viewY = Float8(eyePosition.y) - positionY;
+    Float8 viewZ = Float8(eyePosition.z) - positionZ;
+    normalizeInPlace(viewX, viewY, viewZ);
+    Float8 reflectX = two * normalDotLight * normalX - lightX;
+    Float8 reflectY = two * normalDotLight * normalY - lightY;
+    Float8 reflectZ = two * normalDotLight * normalZ - lightZ;
+    Float8 specular = Max(viewX * reflectX + viewY * reflectY + viewZ * reflectZ, zero);
+    // pow(x, 32)
+    for (int i = 0; i < 5; ++i) {
+        specular = specular * specular;
+    }
+
+    // ambient + diffuse share the albedo: albedo * (0.1 + diff) + spec
+    Float8 light = Float8(0.1f) + diffuse;
+    const Float8 scale(255.0f);
+    const Float8 half(0.5f);
+    float channels[3][FragmentBatch::kWidth];
+    (Min(Float8::Load(batch.albedoR) * light + specular, one) * scale + half).Store(channels[0]);
+    (Min(Float8::Load(batch.albedoG) * light + specular, one) * scale + half).Store(channels[1]);
+    (Min(Float8::Load(batch.albedoB) * light + specular, one) * scale + half).Store(channels[2]);
+    for (int lane = 0; lane < FragmentBatch::kWidth; ++lane) {
+        rgb[lane * 3 + 0] = static_cast<uint8_t>(channels[0][lane]);
+        rgb[lane * 3 + 1] = static_cast<uint8_t>(channels[1][lane]);
+        rgb[lane * 3 + 2] = static_cast<uint8_t>(channels[2][lane]);
+    }
+}
@@ -0,0 +1,150 @@
+#include "StatsOverlay.hpp"
+#include "globals.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+
+// Layout of the overlay in pixels
+static const float kPanelX       = 10.0f;
+static const float kPanelY       = 10.0f;
+static const float kLabelWidth   = 12.0f;
+static const float kBarWidth     = 240.0f;
+static const float kRowHeight    = 14.0f;
+static const float kGraphHeight  = 60.0f;
+// A full bar or graph column is two frames at 60Hz
+static const float kFullScaleMs  = 33.3f;
+
+// Row colors, the GPU passes cycle through the last entries
+static const glm::vec4 kRowColors[] = {
+    glm::vec4(1.0f, 1.0f, 1.0f, 1.0f),    // CPU frame
+    glm::vec4(0.6f, 0.6f, 1.0f, 1.0f),    // CPU submit
+    glm::vec4(0.3f, 0.9f, 0.3f, 1.0f),    // GPU passes
+    glm::vec4(1.0f, 0.7f, 0.2f, 1.0f),
+    glm::vec4(0.2f, 0.8f, 0.9f, 1.0f),
+    glm::vec4(0.9f, 0.4f, 0.9f, 1.0f),
+};
+static const int kRowColorCount = sizeof(kRowColors) / sizeof(kRowColors[0]);
+
+
+// Constructor
+StatsOverlay::StatsOverlay(){
+
+}
+
+
+void StatsOverlay::Initialize(){
+    std::string vertexShaderSource   = LoadShaderAsString("./shaders/overlay_vert.glsl");
+    std::string fragmentShaderSource = LoadShaderAsString("./shaders/overlay_frag.glsl");
+    mShaderID = CreateShaderProgram(vertexShaderSource, fragmentShaderSource);
+
+    glGenVertexArrays(1, &mVAO);
+    glBindVertexArray(mVAO);
+    glGenBuffers(1, &mVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, mVBO);
+
+    GLsizei stride = 6 * sizeof(GLfloat);
+    // Position in pixels
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride, (void*)0);
+    // Color
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, (void*)(2 * sizeof(GLfloat)));
+
+    glBindVertexArray(0);
+}
+
+
+void StatsOverlay::AddQuad(float x, float y, float width, float height, const glm::vec4& color){
+    const float corners[6][2] = {
+        {x, y}, {x + width, y}, {x, y + height},
+        {x, y + height}, {x + width, y}, {x + width, y + height}
+    };
+    for (int i = 0; i < 6; ++i) {
+        mVertices.insert(mVertices.end(), {corners[i][0], corners[i][1], color.r, color.g, color.b, color.a});
+    }
+}
+
+
+void StatsOverlay::AddRow(int row, const RollingStats& stats, const glm::vec4& color){
+    float y = kPanelY + 4.0f + row * kRowHeight;
+    float x = kPanelX + 4.0f;
+    float scale = kBarWidth / kFullScaleMs;
+
+    // Color key on the left, then the bar with min and p99 ticks
+    AddQuad(x, y, kLabelWidth - 4.0f, kRowHeight - 4.0f, color);
+    x += kLabelWidth;
+    AddQuad(x, y, std::min(kBarWidth, (float)stats.GetAverage() * scale), kRowHeight - 4.0f, color * 0.8f);
+    AddQuad(x + std::min(kBarWidth, (float)stats.GetMin() * scale), y, 2.0f, kRowHeight - 4.0f,
+            glm::vec4(0.1f, 0.1f, 0.1f, 1.0f));
+    AddQuad(x + std::min(kBarWidth, (float)stats.GetPercentile(99.0) * scale), y, 2.0f, kRowHeight - 4.0f,
+            glm::vec4(1.0f, 0.2f, 0.2f, 1.0f));
+}
+
+
+/**
+ * @brief Builds all quads on the CPU and draws them with one glDrawArrays call.
+ */
+void StatsOverlay::Draw(const GpuTimer& timer, int screenWidth, int screenHeight){
+    mVertices.clear();
+
+    const std::vector<GpuTimer::Pass>& passes = timer.GetPasses();
+    int rows = 2 + static_cast<int>(passes.size());
+    float panelWidth = kLabelWidth + kBarWidth + 8.0f;
+    float panelHeight = rows * kRowHeight + kGraphHeight + 12.0f;
+
+    // Translucent background
+    AddQuad(kPanelX, kPanelY, panelWidth, panelHeight, glm::vec4(0.0f, 0.0f, 0.0f, 0.6f));
+
+    AddRow(0, timer.GetCpuFrameStats(), kRowColors[0]);
+    AddRow(1, timer.GetCpuSubmitStats(), kRowColors[1]);
+    for (size_t i = 0; i < passes.size(); ++i) {
+        AddRow(2 + static_cast<int>(i), passes[i].stats, kRowColors[2 + i % (kRowColorCount - 2)]);
+    }
+
+    // CPU frame time history, one column per frame, with a line at 16.7ms
+    float graphBottom = kPanelY + panelHeight - 4.0f;
+    float graphX = kPanelX + 4.0f + kLabelWidth;
+    float columnWidth = kBarWidth / RollingStats::kWindow;
+    std::vector<double> history = timer.GetCpuFrameStats().GetHistory();
+    for (size_t i = 0; i < history.size(); ++i) {
+        float height = std::min(kGraphHeight, (float)history[i] / kFullScaleMs * kGraphHeight);
+        AddQuad(graphX + i * columnWidth, graphBottom - height, columnWidth, height, kRowColors[0]);
+    }
+    AddQuad(graphX, graphBottom - 16.7f / kFullScaleMs * kGraphHeight, kBarWidth, 1.0f,
+            glm::vec4(1.0f, 0.2f, 0.2f, 1.0f));
+
+    // Draw on top of everything without disturbing the scene's state
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+    GLint polygonMode[2];
+    glGetIntegerv(GL_POLYGON_MODE, polygonMode);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+    glUseProgram(mShaderID);
+    GLint u_ScreenSizeLocation = glGetUniformLocation(mShaderID, "u_ScreenSize");
+    glUniform2f(u_ScreenSizeLocation, (float)screenWidth, (float)screenHeight);
+
+    glBindVertexArray(mVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, mVBO);
+    glBufferData(GL_ARRAY_BUFFER, mVertices.size() * sizeof(GLfloat), mVertices.data(), GL_STREAM_DRAW);
+    glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(mVertices.size() / 6));
+    glBindVertexArray(0);
+    glUseProgram(0);
+
+    glDisable(GL_BLEND);
+    glPolygonMode(GL_FRONT_AND_BACK, polygonMode[0]);
+    if (depthTest) glEnable(GL_DEPTH_TEST);
+    if (cullFace) glEnable(GL_CULL_FACE);
+}
+
+
+void StatsOverlay::Destroy(){
+    if (mVBO) glDeleteBuffers(1, &mVBO);
+    if (mVAO) glDeleteVertexArrays(1, &mVAO);
+    if (mShaderID) glDeleteProgram(mShaderID);
+    mVBO = mVAO = mShaderID = 0;
+}
@@ -6,6 +6,9 @@
 
 
 #include "Texture.hpp"
+#include "Profiler.hpp"
+#include "Memory.hpp"
+#include "globals.hpp"
 
 #include <stdio.h>
 #include <string.h>
@@ -26,7 +29,9 @@ Texture::Texture(){
 // Default Destructor
 Texture::~Texture(){
 	// Delete our texture from the GPU
-	glDeleteTextures(1,&m_textureID);
+    if(m_textureID != 0){
+	    glDeleteTextures(1,&m_textureID);
+    }
 
     // Delete our image
     if(m_image != nullptr){
@@ -36,18 +41,37 @@ Texture::~Texture(){
 }
 
 void Texture::LoadTexture(const std::string filepath){
+    LoadImage(filepath);
+    Upload();
+}
+
+
+void Texture::LoadImage(const std::string filepath){
+    PROFILE_SCOPE("LoadImage");
 	// Set member variable
     m_filepath = filepath;
     // Load our actual image data
     m_image = new Image(filepath);
-    m_image->LoadPPM(true);
+    Arena scratch;
+    m_image->LoadPPM(true, scratch);
+    m_cpuMemory.Set(static_cast<size_t>(m_image->GetWidth()) * m_image->GetHeight() * 3);
 	std::cout << "Loading texture: " << filepath << std::endl;
+}
+
+
+void Texture::Upload(){
+    PROFILE_SCOPE("Texture::Upload");
+    // The software renderer samples the image directly and has no OpenGL context
+    if(g.gSoftwareRenderer || m_image == nullptr || m_textureID != 0){
+        return;
+    }
 
     glEnable(GL_TEXTURE_2D); 
 		// Generate a buffer for our texture
     glGenTextures(1,&m_textureID);
     glBindTexture(GL_TEXTURE_2D, m_textureID);
-	 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); 
+	 	// Use the mipmaps generated below (the software renderer filters the same way)
+	 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR); 
 	 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR); 
 		// Wrap mode describes what to do if we go outside the boundaries of texture.
   	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); 
@@ -64,6 +88,16 @@ void Texture::LoadTexture(const std::string filepath){
     // Generate a mipmap
     glGenerateMipmap(GL_TEXTURE_2D);                           
 		glBindTexture(GL_TEXTURE_2D, 0);
+    m_gpuMemory.Set(Memory::GetTextureBytes(GL_RGB, m_image->GetWidth(), m_image->GetHeight(), 1, true));
+}
+
+
+void Texture::DropImage(){
+    if(m_image != nullptr){
+        delete m_image;
+        m_image = nullptr;
+    }
+    m_cpuMemory.Set(0);
 }
 
 
@@ -0,0 +1,464 @@
+#include "ThreadPool.hpp"
+#include "Profiler.hpp"
+
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+
+// Workers yield this many times without finding a job before they go to sleep
+static const unsigned int kSpinCount = 64;
+
+static int64_t Now(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Pool and index of a worker thread, threads outside every pool count as thread 0
+static thread_local const ThreadPool* tPool = nullptr;
+static thread_local unsigned int tThreadIndex = 0;
+
+
+struct alignas(64) ThreadPool::Job{
+    std::function<void()> function;
+    // Notified when this job and all its children have finished
+    Job* parent{nullptr};
+    // The job itself until it has run, plus its unfinished children
+    std::atomic<int> unfinished{0};
+    bool mainThread{false};
+};
+
+
+/**
+ * @brief Chase-Lev work stealing deque of fixed capacity.
+ *
+ * The owner pushes and pops at the bottom, other threads steal from the top.
+ * Memory orders follow Le, Pop, Cohen and Zappa Nardelli, "Correct and
+ * Efficient Work-Stealing for Weak Memory Models" (2013).
+ */
+class JobDeque{
+public:
+    typedef ThreadPool::Job Job;
+
+    // Owner only, false when the deque is full
+    bool Push(Job* job){
+        int64_t bottom = mBottom.load(std::memory_order_relaxed);
+        int64_t top = mTop.load(std::memory_order_acquire);
+        if (bottom - top >= static_cast<int64_t>(ThreadPool::kMaxJobsPerThread)) {
+            return false;
+        }
+        mJobs[bottom & kMask].store(job, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        mBottom.store(bottom + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Owner only, the most recently pushed job
+    Job* Pop(){
+        int64_t bottom = mBottom.load(std::memory_order_relaxed) - 1;
+        mBottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = mTop.load(std::memory_order_relaxed);
+        if (top > bottom) {
+            mBottom.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        Job* job = mJobs[bottom & kMask].load(std::memory_order_relaxed);
+        if (top == bottom) {
+            // The last job, thieves may be taking it too
+            if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                job = nullptr;
+            }
+            mBottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    // Any thread, the oldest job
+    Job* Steal(){
+        int64_t top = mTop.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = mBottom.load(std::memory_order_acquire);
+        if (top >= bottom) {
+            return nullptr;
+        }
+        Job* job = mJobs[top & kMask].load(std::memory_order_relaxed);
+        if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return job;
+    }
+private:
+    static const int64_t kMask = ThreadPool::kMaxJobsPerThread - 1;
+
+    // On their own cache lines, the owner writes the bottom and thieves the top
+    alignas(64) std::atomic<int64_t> mTop{0};
+    alignas(64) std::atomic<int64_t> mBottom{0};
+    alignas(64) std::atomic<Job*> mJobs[ThreadPool::kMaxJobsPerThread];
+};
+
+
+struct ThreadPool::ThreadData{
+    explicit ThreadData(unsigned int threadIndex) : random(2654435761u * (threadIndex + 1)) {}
+
+    JobDeque deque;
+    // Ring of the jobs created by this thread
+    std::unique_ptr<Job[]> jobs{new Job[kMaxJobsPerThread]};
+    size_t allocated{0};
+    // Picks the first victim to steal from
+    uint32_t random;
+
+    std::atomic<size_t> executed{0};
+    std::atomic<size_t> steals{0};
+    std::atomic<int64_t> idleNanoseconds{0};
+    // Start of the current idle span, -1 while running jobs
+    std::atomic<int64_t> idleSince{-1};
+};
+
+
+// Constructor
+ThreadPool::ThreadPool(){
+    mThreadData.push_back(std::make_unique<ThreadData>(0));
+    ResetStatistics();
+}
+
+
+// Destructor
+ThreadPool::~ThreadPool(){
+    Shutdown();
+}
+
+
+/**
+ * @brief Starts the worker threads.
+ *
+ * @param threadCount Total number of threads including the calling thread, which becomes thread 0.
+ *                    0 uses std::thread::hardware_concurrency().
+ */
+void ThreadPool::Initialize(unsigned int threadCount){
+    Shutdown();
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    mThreadData.clear();
+    for (unsigned int i = 0; i < threadCount; ++i) {
+        mThreadData.push_back(std::make_unique<ThreadData>(i));
+    }
+    ResetStatistics();
+    mRunning = true;
+    for (unsigned int i = 1; i < threadCount; ++i) {
+        mThreads.emplace_back(&ThreadPool::WorkerThread, this, i);
+    }
+    std::cout << "ThreadPool: " << threadCount << " threads" << std::endl;
+}
+
+
+unsigned int ThreadPool::GetThreadIndex() const{
+    return tPool == this ? tThreadIndex : 0;
+}
+
+
+/**
+ * @brief Takes the next free slot of the calling thread's job ring.
+ *
+ * Slots of long running jobs, like the root of a ParallelFor, are skipped.
+ */
+ThreadPool::Job* ThreadPool::AllocateJob(){
+    ThreadData& data = *mThreadData[GetThreadIndex()];
+    for (unsigned int i = 0; i < kMaxJobsPerThread; ++i) {
+        Job* job = &data.jobs[data.allocated++ & (kMaxJobsPerThread - 1)];
+        if (job->unfinished.load(std::memory_order_acquire) == 0) {
+            return job;
+        }
+    }
+    std::cout << "ThreadPool: more than " << kMaxJobsPerThread << " jobs in flight on one thread" << std::endl;
+    exit(EXIT_FAILURE);
+}
+
+
+ThreadPool::Job* ThreadPool::CreateJob(std::function<void()> function, Job* parent){
+    Job* job = AllocateJob();
+    job->function = std::move(function);
+    job->parent = parent;
+    job->mainThread = false;
+    job->unfinished.store(1, std::memory_order_relaxed);
+    if (parent != nullptr) {
+        parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+
+ThreadPool::Job* ThreadPool::CreateMainThreadJob(std::function<void()> function, Job* parent){
+    Job* job = CreateJob(std::move(function), parent);
+    job->mainThread = true;
+    return job;
+}
+
+
+/**
+ * @brief Queues a job on the calling thread's deque, or on the main thread queue.
+ *
+ * A full deque runs the job right away. Sleeping workers are woken up; the
+ * queued job count and the sleeping worker count are both sequentially
+ * consistent, so either this thread sees a sleeper or the sleeper sees the job.
+ */
+void ThreadPool::Run(Job* job){
+    if (job->mainThread) {
+        std::lock_guard<std::mutex> lock(mMainThreadMutex);
+        mMainThreadJobs.push_back(job);
+        mMainThreadJobCount.fetch_add(1);
+        return;
+    }
+
+    unsigned int threadIndex = GetThreadIndex();
+    if (!mThreadData[threadIndex]->deque.Push(job)) {
+        Execute(job, threadIndex);
+        return;
+    }
+    mQueuedJobs.fetch_add(1);
+    if (mSleepingWorkers.load() > 0) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mWakeWorkers.notify_one();
+    }
+}
+
+
+/**
+ * @brief Runs other jobs until the job has finished.
+ *
+ * Thread 0 also runs the main thread jobs meanwhile, so waiting on the main
+ * thread for jobs that upload to OpenGL does not deadlock.
+ */
+void ThreadPool::Wait(Job* job){
+    unsigned int threadIndex = GetThreadIndex();
+    while (job->unfinished.load(std::memory_order_acquire) > 0) {
+        Job* next = FindJob(threadIndex);
+        if (next != nullptr) {
+            Execute(next, threadIndex);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+
+void ThreadPool::ProcessMainThreadJobs(){
+    while (mMainThreadJobCount.load() > 0) {
+        Job* job = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mMainThreadMutex);
+            if (mMainThreadJobs.empty()) {
+                return;
+            }
+            job = mMainThreadJobs.front();
+            mMainThreadJobs.pop_front();
+            mMainThreadJobCount.fetch_sub(1);
+        }
+        Execute(job, 0);
+    }
+}
+
+
+ThreadPool::Job* ThreadPool::FindJob(unsigned int threadIndex){
+    if (threadIndex == 0 && mMainThreadJobCount.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lock(mMainThreadMutex);
+        if (!mMainThreadJobs.empty()) {
+            Job* job = mMainThreadJobs.front();
+            mMainThreadJobs.pop_front();
+            mMainThreadJobCount.fetch_sub(1);
+            return job;
+        }
+    }
+
+    ThreadData& data = *mThreadData[threadIndex];
+    Job* job = data.deque.Pop();
+    if (job != nullptr) {
+        mQueuedJobs.fetch_sub(1);
+        return job;
+    }
+
+    // Steal, starting at a random victim so thieves spread out
+    unsigned int count = static_cast<unsigned int>(mThreadData.size());
+    if (count < 2 || mQueuedJobs.load(std::memory_order_relaxed) <= 0) {
+        return nullptr;
+    }
+    data.random ^= data.random << 13;
+    data.random ^= data.random >> 17;
+    data.random ^= data.random << 5;
+    unsigned int start = data.random % count;
+    for (unsigned int i = 0; i < count; ++i) {
+        unsigned int victim = (start + i) % count;
+        if (victim == threadIndex) {
+            continue;
+        }
+        job = mThreadData[victim]->deque.Steal();
+        if (job != nullptr) {
+            mQueuedJobs.fetch_sub(1);
+            data.steals.fetch_add(1, std::memory_order_relaxed);
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+
+void ThreadPool::Execute(Job* job, unsigned int threadIndex){
+    if (job->function) {
+        job->function();
+        // Release the captures now, the slot is reused once the job has finished
+        job->function = nullptr;
+    }
+    mThreadData[threadIndex]->executed.fetch_add(1, std::memory_order_relaxed);
+    Finish(job);
+}
+
+
+void ThreadPool::Finish(Job* job){
+    while (job != nullptr) {
+        // Read before the decrement, a finished job's slot may be taken right away
+        Job* parent = job->parent;
+        if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            return;
+        }
+        job = parent;
+    }
+}
+
+
+void ThreadPool::WorkerThread(unsigned int threadIndex){
+    tPool = this;
+    tThreadIndex = threadIndex;
+    Profiler::SetThreadName("Worker " + std::to_string(threadIndex));
+    ThreadData& data = *mThreadData[threadIndex];
+
+    unsigned int spins = 0;
+    while (mRunning.load(std::memory_order_acquire)) {
+        Job* job = FindJob(threadIndex);
+        if (job != nullptr) {
+            if (spins > 0) {
+                // Only the part of the idle span inside the statistics window counts
+                int64_t idleBegin = std::max(data.idleSince.exchange(-1), mStatisticsBegin.load());
+                data.idleNanoseconds.fetch_add(std::max<int64_t>(0, Now() - idleBegin), std::memory_order_relaxed);
+                spins = 0;
+            }
+            Execute(job, threadIndex);
+            continue;
+        }
+
+        if (spins++ == 0) {
+            data.idleSince = Now();
+        }
+        if (spins < kSpinCount) {
+            std::this_thread::yield();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mMutex);
+        mSleepingWorkers.fetch_add(1);
+        mWakeWorkers.wait(lock, [this]{ return mQueuedJobs.load() > 0 || !mRunning; });
+        mSleepingWorkers.fetch_sub(1);
+        // Still idle until a job is found
+        spins = 1;
+    }
+}
+
+
+/**
+ * @brief Runs a job for every index in [0,count) on all threads.
+ *
+ * Returns once every index has been processed. The range is split in halves
+ * on the calling thread and on the thieves, so the number of jobs grows with
+ * the number of threads that help instead of the count.
+ *
+ * @param count Number of work items.
+ * @param job Called as job(index, threadIndex), threadIndex is in [0,GetThreadCount()).
+ * @param grain Items per job, 0 gives about kJobsPerThread jobs per thread.
+ */
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t, unsigned int)>& job, size_t grain){
+    if (count == 0) {
+        return;
+    }
+    if (grain == 0) {
+        grain = std::max<size_t>(1, count / (GetThreadCount() * kJobsPerThread));
+    }
+    if (mThreads.empty() || count <= grain) {
+        unsigned int threadIndex = GetThreadIndex();
+        for (size_t i = 0; i < count; ++i) {
+            job(i, threadIndex);
+        }
+        return;
+    }
+
+    Job* root = CreateJob(nullptr);
+    RunRange(0, count, grain, &job, root);
+    Run(root);
+    Wait(root);
+}
+
+
+void ThreadPool::RunRange(size_t begin, size_t end, size_t grain, const std::function<void(size_t, unsigned int)>* job,
+                          Job* parent){
+    while (end - begin > grain) {
+        size_t middle = begin + (end - begin) / 2;
+        Run(CreateJob([this, middle, end, grain, job, parent]{ RunRange(middle, end, grain, job, parent); }, parent));
+        end = middle;
+    }
+    unsigned int threadIndex = GetThreadIndex();
+    for (size_t i = begin; i < end; ++i) {
+        (*job)(i, threadIndex);
+    }
+}
+
+
+void ThreadPool::Shutdown(){
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mRunning) {
+            return;
+        }
+        mRunning = false;
+    }
+    mWakeWorkers.notify_all();
+    for (std::thread& thread : mThreads) {
+        thread.join();
+    }
+    mThreads.clear();
+    // Thread 0 keeps its deque, jobs then run on the calling thread
+    mThreadData.resize(1);
+    mQueuedJobs = 0;
+}
+
+
+std::vector<ThreadPool::ThreadStatistics> ThreadPool::GetStatistics() const{
+    std::vector<ThreadStatistics> statistics(mThreadData.size());
+    int64_t now = Now();
+    for (size_t i = 0; i < mThreadData.size(); ++i) {
+        const ThreadData& data = *mThreadData[i];
+        int64_t idle = data.idleNanoseconds.load(std::memory_order_relaxed);
+        // Add the idle span the worker is in right now
+        int64_t idleSince = data.idleSince.load();
+        if (idleSince >= 0) {
+            idle += std::max<int64_t>(0, now - std::max(idleSince, mStatisticsBegin.load()));
+        }
+        statistics[i].jobs = data.executed.load(std::memory_order_relaxed);
+        statistics[i].steals = data.steals.load(std::memory_order_relaxed);
+        statistics[i].idleMilliseconds = idle / 1e6;
+    }
+    return statistics;
+}
+
+
+double ThreadPool::GetStatisticsMilliseconds() const{
+    return (Now() - mStatisticsBegin.load()) / 1e6;
+}
+
+
+void ThreadPool::ResetStatistics(){
+    for (std::unique_ptr<ThreadData>& data : mThreadData) {
+        data->executed = 0;
+        data->steals = 0;
+        data->idleNanoseconds = 0;
+    }
+    mStatisticsBegin = Now();
+}
@@ -11,12 +11,25 @@
 #include <vector>
 #include <string>
 #include <fstream>
+#include <chrono>
+#include <cctype>
+#include <cfloat>
+#include <cstdint>
+#include <functional>
+#include <numeric>
+#include <unordered_set>
 
 // Our libraries
 #include "Camera.hpp"
 #include "Texture.hpp"
 #include "Object.hpp"
+#include "SceneGraph.hpp"
 #include "util.hpp"
+#include "PPM.hpp"
+#include "Profiler.hpp"
+#include "ImageCompare.hpp"
+#include "Memory.hpp"
+#include "AssetManager.hpp"
 
 #include "globals.hpp"
 
@@ -28,6 +41,196 @@ GLuint 	gVertexBufferObject					= 0;
 // Index Buffer Object (IBO)
 GLuint 	gIndexBufferObject                  = 0;
 
+// Scene node (storage index) and object chunk of every box in the frustum culler
+struct CullItem{
+    uint32_t node;
+    uint32_t chunk;
+};
+std::vector<CullItem> gCullItems;
+std::vector<uint32_t> gVisibleItems;
+// Clear color, also drawn by the deferred lighting pass where there is no geometry
+static const glm::vec3 kBackgroundColor(1.0f, 1.0f, 0.0f);
+// Projection of every renderer
+static const float kFieldOfView = 45.0f;
+static const float kNearPlane = 0.1f;
+static const float kFarPlane = 100.0f;
+// Nearest objects in view that are drawn into the occlusion depth buffer
+static const size_t kMaxOccluderObjects = 16;
+std::vector<OcclusionCuller::Occluder> gOccluders;
+// Bounds of all chunk boxes, updated with them
+glm::vec3 gSceneMin(0.0f), gSceneMax(0.0f);
+// Chunks (indices into gCullItems) drawn into every shadow cascade
+std::vector<uint32_t> gShadowCasters[CascadedShadows::kCascades];
+
+/**
+ * @brief Reads the image based lighting tables of --pbr from the cache, or computes them, and uploads them.
+ *
+ * @return void
+ */
+void SetupImageBasedLighting(){
+    ImageBasedLighting::Settings settings;
+    g.gImageBasedLighting.LoadOrPrecompute(settings, "./ibl_cache", &g.gThreadPool);
+    g.gImageBasedLighting.Upload();
+
+    const ImageBasedLighting::Statistics& statistics = g.gImageBasedLighting.GetStatistics();
+    std::cout << "IBL: BRDF table " << settings.brdfSize << "x" << settings.brdfSize << ", sky " << settings.environmentSize
+              << " in " << g.gImageBasedLighting.GetSpecularLevels() << " levels, irradiance " << settings.irradianceSize
+              << ", " << settings.samples << " samples, " << g.gImageBasedLighting.GetBytes() / 1024 << " KB ";
+    if (statistics.fromCache) {
+        std::cout << "read from " << g.gImageBasedLighting.GetCachePath("./ibl_cache") << " in "
+                  << statistics.loadMilliseconds << " ms" << std::endl;
+    } else {
+        std::cout << "computed in " << statistics.brdfMilliseconds + statistics.specularMilliseconds + statistics.irradianceMilliseconds
+                  << " ms on " << statistics.threads << " threads (BRDF " << statistics.brdfMilliseconds << " ms, prefiltered "
+                  << statistics.specularMilliseconds << " ms, irradiance " << statistics.irradianceMilliseconds << " ms)"
+                  << std::endl;
+    }
+}
+
+
+/**
+ * @brief Declares the post-processing passes (--post) and compiles them.
+ *
+ * Bloom runs at half and quarter resolution: the bright parts of the scene are
+ * downsampled twice and blurred. Tonemapping and the vignette are pointwise and
+ * become a single draw unless --no-merge is given. FXAA writes to the screen.
+ * Without createPrograms only the draws are planned, no OpenGL context is needed.
+ *
+ * @return void
+ */
+void SetupPostProcess(bool createPrograms){
+    PostProcess::Pass bright;
+    bright.name = "Bright";
+    bright.inputs = {{PostProcess::kScene, "u_Scene"}};
+    bright.output = "bright";
+    bright.downscale = 2;
+    bright.shaderPath = "./shaders/post_bright_frag.glsl";
+    bright.setUniforms = [](GLuint program){
+        glUniform1f(glGetUniformLocation(program, "u_Threshold"), 1.0f);
+        glUniform1f(glGetUniformLocation(program, "u_Knee"), 0.5f);
+    };
+    g.gPostProcess.AddPass(bright);
+
+    PostProcess::Pass downsample;
+    downsample.name = "Downsample";
+    downsample.inputs = {{"bright", "u_Input"}};
+    downsample.output = "quarter";
+    downsample.downscale = 4;
+    downsample.shaderPath = "./shaders/post_downsample_frag.glsl";
+    g.gPostProcess.AddPass(downsample);
+
+    PostProcess::Pass blurH;
+    blurH.name = "BlurH";
+    blurH.inputs = {{"quarter", "u_Input"}};
+    blurH.output = "blurH";
+    blurH.downscale = 4;
+    blurH.shaderPath = "./shaders/post_blur_frag.glsl";
+    blurH.setUniforms = [](GLuint program){
+        glUniform2f(glGetUniformLocation(program, "u_Direction"), 1.0f, 0.0f);
+    };
+    g.gPostProcess.AddPass(blurH);
+
+    // Reuses the target of the downsample pass, which is free again by now
+    PostProcess::Pass blurV = blurH;
+    blurV.name = "BlurV";
+    blurV.inputs = {{"blurH", "u_Input"}};
+    blurV.output = "bloom";
+    blurV.setUniforms = [](GLuint program){
+        glUniform2f(glGetUniformLocation(program, "u_Direction"), 0.0f, 1.0f);
+    };
+    g.gPostProcess.AddPass(blurV);
+
+    PostProcess::Pass tonemap;
+    tonemap.name = "Tonemap";
+    tonemap.inputs = {{PostProcess::kScene, ""}, {"bloom", "u_Bloom"}};
+    tonemap.output = "ldr";
+    tonemap.format = GL_RGBA8;
+    tonemap.shaderPath = "./shaders/post_tonemap.glsl";
+    tonemap.pointwise = true;
+    tonemap.setUniforms = [](GLuint program){
+        glUniform1f(glGetUniformLocation(program, "u_Exposure"), 1.0f);
+        glUniform1f(glGetUniformLocation(program, "u_BloomStrength"), 0.6f);
+    };
+    g.gPostProcess.AddPass(tonemap);
+
+    PostProcess::Pass vignette;
+    vignette.name = "Vignette";
+    vignette.inputs = {{"ldr", ""}};
+    vignette.output = "vignette";
+    vignette.format = GL_RGBA8;
+    vignette.shaderPath = "./shaders/post_vignette.glsl";
+    vignette.pointwise = true;
+    vignette.setUniforms = [](GLuint program){
+        glUniform1f(glGetUniformLocation(program, "u_VignetteStrength"), 0.5f);
+    };
+    g.gPostProcess.AddPass(vignette);
+
+    PostProcess::Pass fxaa;
+    fxaa.name = "FXAA";
+    fxaa.inputs = {{"vignette", "u_Input"}};
+    fxaa.output = PostProcess::kScreen;
+    fxaa.shaderPath = "./shaders/post_fxaa_frag.glsl";
+    g.gPostProcess.AddPass(fxaa);
+
+    if (createPrograms) {
+        g.gPostProcess.Compile(g.gPostMerge);
+    } else {
+        g.gPostProcess.Plan(g.gPostMerge);
+    }
+    std::cout << "Post-processing: " << g.gPostProcess.GetPassCount() << " passes in "
+              << g.gPostProcess.GetDrawCount() << " draws (" << g.gPostProcess.GetSummary() << ")" << std::endl;
+}
+
+
+/**
+ * @brief Sets up an OpenGL context without a window for headless benchmark runs.
+ *
+ * Everything renders into the offscreen framebuffer of the headless context.
+ * Shader hot-reload is not started since nothing is interactive.
+ */
+void InitializeHeadlessProgram(){
+    if (!g.gHeadlessContext.Initialize(g.gScreenWidth, g.gScreenHeight)) {
+        exit(1);
+    }
+    g.gHeadlessContext.Bind();
+
+    g.gShaderCache.SetEnabled(g.gShaderCacheEnabled);
+    g.gShaderCache.Initialize(g.gHeadlessContext.GetLoader(), "./shader_cache");
+
+    g.gLight.Initialize();
+    g.gStatsOverlay.Initialize();
+    // Culls large scenes and assigns lights in parallel
+    g.gThreadPool.Initialize(g.gThreadCount);
+    g.gOcclusionCuller.Initialize(g.gScreenWidth / 4, g.gScreenHeight / 4, &g.gThreadPool);
+    g.gClusteredLights.Initialize();
+    if (g.gDeferred) {
+        g.gDeferredRenderer.Initialize(g.gScreenWidth, g.gScreenHeight);
+    }
+    if (g.gShadows) {
+        g.gCascadedShadows.Initialize(g.gShadowQuality);
+    }
+    if (g.gPbr) {
+        SetupImageBasedLighting();
+    }
+    if (g.gPostProcessing) {
+        SetupPostProcess(true);
+    }
+
+    // Headless runs always log GPU pass times
+    g.gGpuTimer.SetEnabled(true);
+    g.gGpuTimer.OpenCsv(g.gGpuTimesFile);
+}
+
+
+/**
+ * @brief Sets up the CPU renderer, no window or OpenGL context is created.
+ */
+void InitializeSoftwareProgram(){
+    g.gThreadPool.Initialize(g.gThreadCount);
+    g.gSoftwareRasterizer.Initialize(g.gScreenWidth, g.gScreenHeight, &g.gThreadPool);
+}
+
+
 /**
  * @brief Sets up the SDL environment and initializes OpenGL context and window.
  * 
@@ -38,6 +241,17 @@ GLuint 	gIndexBufferObject                  = 0;
  * @throws runtime_error if SDL or GLAD initialization fails or if the window cannot be created.
  */
 void InitializeProgram(){
+    PROFILE_SCOPE("InitializeProgram");
+
+    if (g.gSoftwareRenderer) {
+        InitializeSoftwareProgram();
+        return;
+    }
+    if (g.gHeadless) {
+        InitializeHeadlessProgram();
+        return;
+    }
+
     // Initialize SDL
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         std::cout << "SDL could not initialize! SDL Error: " << SDL_GetError() << "\n";
@@ -77,7 +291,36 @@ void InitializeProgram(){
         std::cout << "glad did not initialize" << std::endl;
         exit(1);
     }
+
+    // Shader binaries are looked up from here on
+    g.gShaderCache.SetEnabled(g.gShaderCacheEnabled);
+    g.gShaderCache.Initialize(SDL_GL_GetProcAddress, "./shader_cache");
+    g.gShaderReloader.Initialize(SDL_GL_GetProcAddress, "./shaders");
+
     g.gLight.Initialize();
+    g.gStatsOverlay.Initialize();
+    g.gShaderReloader.Watch(&g.gStatsOverlay.mShaderID, "./shaders/overlay_vert.glsl", "./shaders/overlay_frag.glsl");
+    g.gGpuTimer.SetEnabled(g.gShowStats);
+    // Culls large scenes and assigns lights in parallel
+    g.gThreadPool.Initialize(g.gThreadCount);
+    g.gOcclusionCuller.Initialize(g.gScreenWidth / 4, g.gScreenHeight / 4, &g.gThreadPool);
+    g.gClusteredLights.Initialize();
+    if (g.gDeferred) {
+        g.gDeferredRenderer.Initialize(g.gScreenWidth, g.gScreenHeight);
+        g.gShaderReloader.Watch(&g.gDeferredRenderer.mGeometryShaderID, "./shaders/vert.glsl", "./shaders/gbuffer_frag.glsl");
+        g.gShaderReloader.Watch(&g.gDeferredRenderer.mLightingShaderID, "./shaders/deferred_light_vert.glsl", "./shaders/deferred_light_frag.glsl");
+        g.gShaderReloader.Watch(&g.gDeferredRenderer.mVolumeShaderID, "./shaders/light_volume_vert.glsl", "./shaders/light_volume_frag.glsl");
+    }
+    if (g.gShadows) {
+        g.gCascadedShadows.Initialize(g.gShadowQuality);
+        g.gShaderReloader.Watch(&g.gCascadedShadows.mShaderID, "./shaders/shadow_vert.glsl", "./shaders/shadow_frag.glsl");
+    }
+    if (g.gPbr) {
+        SetupImageBasedLighting();
+    }
+    if (g.gPostProcessing) {
+        SetupPostProcess(true);
+    }
 }
 
 
@@ -85,25 +328,402 @@ void InitializeProgram(){
  * @brief Sets OpenGL states and clears buffers before drawing the frame.
  *
  * This function configures OpenGL settings needed for the frame, such as
- * enabling texture mapping, setting viewport dimensions, clearing the color 
- * and depth buffers, and preparing the object for drawing if it exists.
+ * enabling texture mapping, setting viewport dimensions and clearing the color 
+ * and depth buffers.
  *
  * @return void
  */
 void PreDraw(){
+    PROFILE_SCOPE("PreDraw");
     // Enable texture mapping
     glEnable(GL_TEXTURE_2D);
 
     // Initialize clear color
     glViewport(0, 0, g.gScreenWidth, g.gScreenHeight);
-    glClearColor(1.f, 1.f, 0.f, 1.f);
+    glClearColor(kBackgroundColor.r, kBackgroundColor.g, kBackgroundColor.b, 1.f);
 
     // Clear color buffer and Depth Buffer
     glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+}
+
+
+/**
+ * @brief Moves and rotates the scene root by g_uOffset and g_uRotate (arrow keys).
+ *
+ * @return void
+ */
+void UpdateSceneRoot(){
+    g.gScene.SetTranslation(g.gSceneRoot, glm::vec3(0.0f, 0.0f, g.g_uOffset));
+    g.gScene.SetRotation(g.gSceneRoot, glm::angleAxis(glm::radians(g.g_uRotate), glm::vec3(0.0f, 1.0f, 0.0f)));
+}
+
+
+/**
+ * @brief Loads every OBJ file given on the command line into g.gObjects, in command line order.
+ *
+ * The files are hashed first: a file with the content of a mesh in g.gAssets,
+ * or of an earlier file on the command line, shares that object. One pool job
+ * per remaining object parses it (its textures are acquired by child jobs)
+ * and computes the tangent space; the OpenGL upload follows as a main thread
+ * job of the same object, run by the main thread while it waits for the rest.
+ *
+ * With --drop-cpu-copies the mesh arrays and images are freed after the upload.
+ *
+ * @param upload False for the software renderer, which only uses the CPU data.
+ * @return void
+ */
+void LoadObjects(bool upload){
+    PROFILE_SCOPE("LoadObject");
+    auto begin = std::chrono::steady_clock::now();
+    Memory::ResetHeapPeak();
+    Memory::HeapCounters heapBefore = Memory::GetHeapCounters();
+    size_t first = g.gObjects.size();
+    g.gObjects.resize(first + g.gObjFilePaths.size(), nullptr);
+    std::vector<AssetManager::Hash> hashes(g.gObjFilePaths.size());
+    g.gThreadPool.ParallelFor(hashes.size(), [&hashes](size_t i, unsigned int){
+        hashes[i] = AssetManager::HashFile(g.gObjFilePaths[i]);
+    }, 1);
+
+    // Files equal to an earlier one of this load, filled in once it is loaded
+    std::vector<size_t> duplicates;
+    std::unordered_set<AssetManager::Hash> loading;
+    ThreadPool::Job* root = g.gThreadPool.CreateJob(nullptr);
+    for (size_t i = 0; i < g.gObjFilePaths.size(); ++i) {
+        AssetManager::Hash hash = hashes[i];
+        if (hash != 0 && loading.count(hash) > 0) {
+            duplicates.push_back(i);
+            continue;
+        }
+        MeshHandle* object = &g.gObjects[first + i];
+        *object = g.gAssets.FindMesh(hash);
+        if (*object != nullptr) {
+            continue;
+        }
+        loading.insert(hash);
+        const std::string& path = g.gObjFilePaths[i];
+        g.gThreadPool.Run(g.gThreadPool.CreateJob([object, &path, hash, root, upload]{
+            *object = std::make_shared<Object>(path);
+            (*object)->ComputeTangentSpace();
+            g.gAssets.AddMesh(hash, *object);
+            if (upload) {
+                g.gThreadPool.Run(g.gThreadPool.CreateMainThreadJob([object]{
+                    (*object)->Upload();
+                    if (g.gDropCpuCopies) {
+                        (*object)->DropCpuCopies();
+                    }
+                }, root));
+            }
+        }, root));
+    }
+    g.gThreadPool.Run(root);
+    g.gThreadPool.Wait(root);
+    for (size_t i : duplicates) {
+        g.gObjects[first + i] = g.gAssets.FindMesh(hashes[i]);
+    }
+    // Objects of earlier loads may have been released
+    g.gAssets.Trim();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+    Memory::HeapCounters heapAfter = Memory::GetHeapCounters();
+    std::cout << "Loaded " << g.gObjFilePaths.size() << " objects in " << elapsed.count() << " ms on "
+              << g.gThreadPool.GetThreadCount() << " threads, " << heapAfter.allocations - heapBefore.allocations
+              << " heap allocations, heap peak " << (heapAfter.peakBytes - heapBefore.bytes) / (1024.0 * 1024.0)
+              << " MB above the start, " << (heapAfter.bytes - heapBefore.bytes) / (1024.0 * 1024.0) << " MB kept" << std::endl;
+    g.gAssets.PrintStatistics();
+}
+
 
-    if (g.gObject != nullptr) {
-        g.gObject->PreDraw();
+/**
+ * @brief Creates the scene: a root and one node per loaded object.
+ *
+ * A single object sits at the root like before. Several objects are placed
+ * side by side along x, each centered on its own bounds. With --grid N the
+ * objects are instead repeated over N x N cells on the xz plane.
+ *
+ * @return void
+ */
+void CreateScene(){
+    g.gScene.Clear();
+    g.gSceneRoot = g.gScene.CreateNode();
+    UpdateSceneRoot();
+
+    std::vector<glm::vec3> boundsMin, boundsMax;
+    float totalWidth = 0.0f;
+    for (const MeshHandle& object : g.gObjects) {
+        // Every vertex belongs to a face, so these are the bounds of all vertices
+        const glm::vec3& low = object->GetBoundsMin();
+        const glm::vec3& high = object->GetBoundsMax();
+        boundsMin.push_back(low);
+        boundsMax.push_back(high);
+        totalWidth += high.x - low.x;
+    }
+
+    if (g.gSceneGrid > 1) {
+        float cellSize = 0.0f;
+        for (size_t i = 0; i < g.gObjects.size(); ++i) {
+            glm::vec3 size = boundsMax[i] - boundsMin[i];
+            cellSize = std::max(cellSize, 1.2f * std::max(size.x, size.z));
+        }
+        float origin = -0.5f * cellSize * (g.gSceneGrid - 1);
+        for (unsigned int cell = 0; cell < g.gSceneGrid * g.gSceneGrid; ++cell) {
+            size_t mesh = cell % g.gObjects.size();
+            NodeHandle node = g.gScene.CreateNode(g.gSceneRoot);
+            g.gScene.SetMesh(node, static_cast<int>(mesh));
+            glm::vec3 center = 0.5f * (boundsMin[mesh] + boundsMax[mesh]);
+            g.gScene.SetTranslation(node, glm::vec3(origin + cellSize * (cell % g.gSceneGrid) - center.x, 0.0f,
+                                                    origin + cellSize * (cell / g.gSceneGrid) - center.z));
+        }
+        return;
     }
+
+    // Leave a tenth of the total width between neighbours
+    float gap = (g.gObjects.size() > 1) ? 0.1f * totalWidth : 0.0f;
+    float x = -0.5f * (totalWidth + gap * (g.gObjects.size() - 1));
+    for (size_t i = 0; i < g.gObjects.size(); ++i) {
+        NodeHandle node = g.gScene.CreateNode(g.gSceneRoot);
+        g.gScene.SetMesh(node, static_cast<int>(i));
+        if (g.gObjects.size() > 1) {
+            float width = boundsMax[i].x - boundsMin[i].x;
+            float center = 0.5f * (boundsMin[i].x + boundsMax[i].x);
+            g.gScene.SetTranslation(node, glm::vec3(x + 0.5f * width - center, 0.0f, 0.0f));
+            x += width + gap;
+        }
+    }
+}
+
+
+/**
+ * @brief Projection used by every renderer.
+ */
+glm::mat4 GetProjectionMatrix(){
+    return glm::perspective(glm::radians(kFieldOfView), (float)g.gScreenWidth / (float)g.gScreenHeight, kNearPlane, kFarPlane);
+}
+
+
+/**
+ * @brief Puts the world bounds of every chunk of every object in the scene into the frustum culler.
+ *
+ * Items are stored node by node, so the visible list groups the chunks of a node.
+ * The bounds of the whole scene are updated with them.
+ *
+ * @return void
+ */
+void UpdateCullBoxes(){
+    PROFILE_SCOPE("UpdateCullBoxes");
+    const std::vector<glm::mat4>& worldMatrices = g.gScene.GetWorldMatrices();
+    const std::vector<int>& meshes = g.gScene.GetMeshes();
+    gCullItems.clear();
+    for (size_t node = 0; node < meshes.size(); ++node) {
+        if (meshes[node] < 0) {
+            continue;
+        }
+        size_t chunkCount = g.gObjects[meshes[node]]->GetChunks().size();
+        for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+            gCullItems.push_back({static_cast<uint32_t>(node), static_cast<uint32_t>(chunk)});
+        }
+    }
+    g.gFrustumCuller.Resize(gCullItems.size());
+    for (size_t i = 0; i < gCullItems.size(); ++i) {
+        const Object::Chunk& chunk = g.gObjects[meshes[gCullItems[i].node]]->GetChunks()[gCullItems[i].chunk];
+        g.gFrustumCuller.SetTransformedBox(i, worldMatrices[gCullItems[i].node], chunk.boundsMin, chunk.boundsMax);
+    }
+
+    gSceneMin = glm::vec3(FLT_MAX);
+    gSceneMax = glm::vec3(-FLT_MAX);
+    for (size_t i = 0; i < gCullItems.size(); ++i) {
+        glm::vec3 boundsMin, boundsMax;
+        g.gFrustumCuller.GetBox(i, boundsMin, boundsMax);
+        gSceneMin = glm::min(gSceneMin, boundsMin);
+        gSceneMax = glm::max(gSceneMax, boundsMax);
+    }
+}
+
+
+/**
+ * @brief Scatters count point lights with random colors over the bounds of the scene.
+ *
+ * The same count always gives the same lights. The radius shrinks as the count
+ * grows so the lit area stays about the same.
+ *
+ * @return void
+ */
+void CreatePointLights(unsigned int count){
+    std::vector<PointLight> lights;
+    if (count > 0 && !g.gObjects.empty()) {
+        g.gScene.Update();
+        UpdateCullBoxes();
+        glm::vec3 sceneMin = gSceneMin, sceneMax = gSceneMax;
+        // Lights hover up to a tenth of the scene size away from the geometry
+        glm::vec3 margin = 0.1f * (sceneMax - sceneMin);
+        sceneMin -= margin;
+        sceneMax += margin;
+        float radius = 0.5f * glm::length(sceneMax - sceneMin) / std::cbrt(static_cast<float>(count));
+
+        uint32_t seed = 4242u;
+        auto random = [&seed](){ seed = seed * 1664525u + 1013904223u; return seed >> 8; };
+        auto randomFloat = [&random](float low, float high){ return low + (high - low) * (random() & 0xFFFF) / 65535.0f; };
+        for (unsigned int i = 0; i < count; ++i) {
+            PointLight light;
+            light.position = glm::vec3(randomFloat(sceneMin.x, sceneMax.x), randomFloat(sceneMin.y, sceneMax.y),
+                                       randomFloat(sceneMin.z, sceneMax.z));
+            light.radius = radius * randomFloat(0.75f, 1.25f);
+            light.color = glm::vec3(randomFloat(0.0f, 1.0f), randomFloat(0.0f, 1.0f), randomFloat(0.0f, 1.0f));
+            lights.push_back(light);
+        }
+    }
+    g.gClusteredLights.SetLights(lights);
+}
+
+
+/**
+ * @brief Fits the shadow cascades to the camera and culls the casters of every cascade.
+ *
+ * The light is treated as directional, shining from its position towards the
+ * center of the scene. Runs before the camera cull, whose statistics are shown.
+ *
+ * @return void
+ */
+void PrepareShadows(){
+    PROFILE_SCOPE("PrepareShadows");
+    glm::vec3 direction = 0.5f * (gSceneMin + gSceneMax) - g.gLight.GetPosition();
+    direction = (glm::length(direction) > 1e-3f) ? glm::normalize(direction) : glm::vec3(0.0f, -1.0f, 0.0f);
+    g.gCascadedShadows.Update(g.gCamera.GetViewMatrix(), glm::radians(kFieldOfView), (float)g.gScreenWidth / (float)g.gScreenHeight,
+                              kNearPlane, direction, gSceneMin, gSceneMax);
+
+    auto cullBegin = std::chrono::steady_clock::now();
+    for (int cascade = 0; cascade < CascadedShadows::kCascades; ++cascade) {
+        if (g.gFrustumCulling) {
+            g.gFrustumCuller.Cull(g.gCascadedShadows.GetViewProjection(cascade), &g.gThreadPool, gShadowCasters[cascade]);
+        } else {
+            gShadowCasters[cascade].resize(gCullItems.size());
+            std::iota(gShadowCasters[cascade].begin(), gShadowCasters[cascade].end(), 0u);
+        }
+    }
+    std::chrono::duration<double, std::milli> cullTime = std::chrono::steady_clock::now() - cullBegin;
+    g.gCascadedShadows.SetCullMilliseconds(cullTime.count());
+}
+
+
+/**
+ * @brief Updates the scene's world matrices, culls the chunks against the frustum and starts occlusion culling.
+ *
+ * The bounds are only transformed again when a node moved. The occluders are
+ * the nearest objects with a chunk in view. The occlusion job runs on the
+ * thread pool until DrawScene() waits for it, the culler boxes and
+ * gVisibleItems must not change in between.
+ *
+ * @return void
+ */
+void PrepareScene(){
+    PROFILE_SCOPE("PrepareScene");
+    g.gScene.Update();
+    if (g.gScene.GetStatistics().nodesUpdated > 0 || gCullItems.empty()) {
+        UpdateCullBoxes();
+    }
+    if (g.gCascadedShadows.IsInitialized()) {
+        PrepareShadows();
+    }
+    glm::mat4 viewProjection = GetProjectionMatrix() * g.gCamera.GetViewMatrix();
+    if (g.gFrustumCulling) {
+        g.gFrustumCuller.Cull(viewProjection, &g.gThreadPool, gVisibleItems);
+    } else {
+        gVisibleItems.resize(gCullItems.size());
+        std::iota(gVisibleItems.begin(), gVisibleItems.end(), 0u);
+    }
+    // The deferred path draws light volumes instead of using the clusters
+    if (!g.gClusteredLights.GetLights().empty() && !g.gDeferred) {
+        g.gClusteredLights.Assign(g.gCamera.GetViewMatrix(), glm::radians(kFieldOfView),
+                                  (float)g.gScreenWidth / (float)g.gScreenHeight, kNearPlane, kFarPlane, &g.gThreadPool);
+    }
+    if (!g.gOcclusionCulling) {
+        return;
+    }
+
+    // Distance of every node with a chunk in view, the items of a node are adjacent
+    const std::vector<glm::mat4>& worldMatrices = g.gScene.GetWorldMatrices();
+    const std::vector<int>& meshes = g.gScene.GetMeshes();
+    glm::vec3 eye = g.gCamera.GetPosition();
+    std::vector<std::pair<float, uint32_t>> nodes;
+    for (size_t i = 0; i < gVisibleItems.size(); ++i) {
+        uint32_t node = gCullItems[gVisibleItems[i]].node;
+        if (nodes.empty() || nodes.back().second != node) {
+            nodes.push_back({glm::length(glm::vec3(worldMatrices[node][3]) - eye), node});
+        }
+    }
+    size_t occluderCount = std::min(nodes.size(), kMaxOccluderObjects);
+    std::partial_sort(nodes.begin(), nodes.begin() + occluderCount, nodes.end());
+    gOccluders.clear();
+    for (size_t i = 0; i < occluderCount; ++i) {
+        uint32_t node = nodes[i].second;
+        gOccluders.push_back({&g.gObjects[meshes[node]]->GetOccluder(), worldMatrices[node]});
+    }
+    g.gOcclusionCuller.Start(viewProjection, gOccluders, g.gFrustumCuller, gVisibleItems);
+}
+
+
+/**
+ * @brief Draws the chunks that survived culling, waiting for the occlusion job started by PrepareScene().
+ *
+ * @param program Program the objects are drawn with.
+ * @return void
+ */
+void DrawScene(GLuint program){
+    PROFILE_SCOPE("DrawScene");
+    if (!g.gClusteredLights.GetLights().empty() && !g.gDeferred) {
+        g.gClusteredLights.Upload();
+    }
+    const std::vector<uint32_t>& visibleItems = g.gOcclusionCulling ? g.gOcclusionCuller.Wait() : gVisibleItems;
+
+    const std::vector<glm::mat4>& worldMatrices = g.gScene.GetWorldMatrices();
+    const std::vector<int>& meshes = g.gScene.GetMeshes();
+    std::vector<unsigned int> chunks;
+    size_t i = 0;
+    while (i < visibleItems.size()) {
+        uint32_t node = gCullItems[visibleItems[i]].node;
+        chunks.clear();
+        for (; i < visibleItems.size() && gCullItems[visibleItems[i]].node == node; ++i) {
+            chunks.push_back(gCullItems[visibleItems[i]].chunk);
+        }
+        Object* object = g.gObjects[meshes[node]].get();
+        object->PreDraw(worldMatrices[node], program);
+        object->DrawChunks(chunks);
+    }
+}
+
+
+/**
+ * @brief Draws the casters of every cascade into its shadow map layer with the depth only program.
+ *
+ * The program is bound once for all cascades, per object only the model matrix changes.
+ *
+ * @return void
+ */
+void RenderShadows(){
+    PROFILE_SCOPE("RenderShadows");
+    static const char* kPassNames[CascadedShadows::kCascades] = {"Shadow 0", "Shadow 1", "Shadow 2", "Shadow 3"};
+    const std::vector<glm::mat4>& worldMatrices = g.gScene.GetWorldMatrices();
+    const std::vector<int>& meshes = g.gScene.GetMeshes();
+    std::vector<unsigned int> chunks;
+    for (int cascade = 0; cascade < CascadedShadows::kCascades; ++cascade) {
+        g.gGpuTimer.Begin(kPassNames[cascade]);
+        g.gCascadedShadows.BeginCascade(cascade);
+        GLint modelLocation = glGetUniformLocation(g.gCascadedShadows.mShaderID, "u_ModelMatrix");
+        const std::vector<uint32_t>& casters = gShadowCasters[cascade];
+        size_t drawCalls = 0;
+        size_t i = 0;
+        while (i < casters.size()) {
+            uint32_t node = gCullItems[casters[i]].node;
+            chunks.clear();
+            for (; i < casters.size() && gCullItems[casters[i]].node == node; ++i) {
+                chunks.push_back(gCullItems[casters[i]].chunk);
+            }
+            glUniformMatrix4fv(modelLocation, 1, GL_FALSE, &worldMatrices[node][0][0]);
+            drawCalls += g.gObjects[meshes[node]]->DrawChunkRanges(chunks);
+        }
+        g.gCascadedShadows.EndCascade(cascade, casters.size(), drawCalls);
+        g.gGpuTimer.End();
+    }
+    g.gCascadedShadows.EndShadowPass();
+    glUseProgram(0);
 }
 
 
@@ -120,12 +740,16 @@ void PreDraw(){
  * @return void
  */
 void VertexSpecification(){
+    PROFILE_SCOPE("VertexSpecification");
 	// We will load a texture here prior
-	g.gTexture.LoadTexture("./starter/brick.ppm");
-    g.gNormalMap.LoadTexture("./starter/normal.ppm");
+	g.gTexture = g.gAssets.AcquireTexture("./starter/brick.ppm");
+    g.gTexture->Upload();
+    g.gNormalMap = g.gAssets.AcquireTexture("./starter/normal.ppm");
+    g.gNormalMap->Upload();
     std::string brickVertexShader = LoadShaderAsString("./shaders/brick_vert.glsl");
     std::string brickFragmentShader = LoadShaderAsString("./shaders/brick_frag.glsl");
     g.gGraphicsPipelineShaderProgram = CreateShaderProgram(brickVertexShader, brickFragmentShader);
+    g.gShaderReloader.Watch(&g.gGraphicsPipelineShaderProgram, "./shaders/brick_vert.glsl", "./shaders/brick_frag.glsl");
 
     // Geometry Data: Positions, Normals, Texture Coordinates, Tangents, Bitangents
     const std::vector<GLfloat> vertexData = {
@@ -214,6 +838,7 @@ void VertexSpecification(){
  * @return void
  */
 void Draw(){
+    PROFILE_SCOPE("Draw");
     glUseProgram(g.gGraphicsPipelineShaderProgram);
 
     // Set transformation matrices
@@ -238,11 +863,11 @@ void Draw(){
 
     // Bind textures
     glActiveTexture(GL_TEXTURE0);
-    g.gTexture.Bind(0);
+    g.gTexture->Bind(0);
     glUniform1i(glGetUniformLocation(g.gGraphicsPipelineShaderProgram, "diffuseMap"), 0);
 
     glActiveTexture(GL_TEXTURE1);
-    g.gNormalMap.Bind(1);
+    g.gNormalMap->Bind(1);
     glUniform1i(glGetUniformLocation(g.gGraphicsPipelineShaderProgram, "normalMap"), 1);
 
     // Bind VAO and draw
@@ -254,6 +879,108 @@ void Draw(){
 }
 
 
+/**
+ * @brief Draws the scene forward or deferred (--deferred), or the default square, timing every GPU pass.
+ *
+ * @return void
+ */
+void RenderScene(){
+    if (!g.gDeferred || g.gObjects.empty()) {
+        g.gGpuTimer.Begin("Scene");
+        PreDraw();
+        if (!g.gObjects.empty()) {
+            DrawScene(g.gGraphicsPipelineShaderProgram);
+        } else {
+            Draw();
+        }
+        g.gGpuTimer.End();
+        return;
+    }
+
+    PreDraw();
+    glm::mat4 viewProjection = GetProjectionMatrix() * g.gCamera.GetViewMatrix();
+    glm::vec3 eye = g.gCamera.GetPosition();
+    g.gGpuTimer.Begin("GBuffer");
+    g.gDeferredRenderer.BeginGeometryPass();
+    DrawScene(g.gDeferredRenderer.mGeometryShaderID);
+    g.gDeferredRenderer.EndGeometryPass();
+    g.gGpuTimer.End();
+
+    g.gGpuTimer.Begin("Lighting");
+    g.gDeferredRenderer.LightingPass(g.gCamera.GetViewMatrix(), viewProjection, eye, g.gLight.GetPosition(), kBackgroundColor,
+                                     g.gCascadedShadows);
+    g.gGpuTimer.End();
+
+    g.gGpuTimer.Begin("LightVolumes");
+    g.gDeferredRenderer.LightVolumePass(viewProjection, eye, g.gClusteredLights.GetLights());
+    g.gGpuTimer.End();
+}
+
+
+/**
+ * @brief Declares the passes of a frame: shadows (--shadows), the scene and the light, then post-processing (--post).
+ *
+ * With post-processing the scene is drawn into a transient HDR target that the
+ * post passes read, otherwise straight into the screen framebuffer.
+ *
+ * @return void
+ */
+void BuildFrameGraph(GLint screenFramebuffer){
+    FrameGraph& graph = g.gFrameGraph;
+    graph.Reset();
+    FrameGraph::Resource screen = graph.ImportFramebuffer("screen", screenFramebuffer, g.gScreenWidth, g.gScreenHeight);
+    FrameGraph::Resource target = screen;
+    if (g.gPostProcessing) {
+        FrameGraph::TextureDescription description;
+        description.width = g.gScreenWidth;
+        description.height = g.gScreenHeight;
+        description.format = GL_RGBA16F;
+        description.depth = true;
+        target = graph.CreateTexture("scene", description);
+    }
+
+    // The shadow map lives across frames, the graph only orders its use
+    std::vector<FrameGraph::Resource> sceneInputs;
+    if (g.gShadows) {
+        int resolution = 0, kernelSize = 0;
+        CascadedShadows::GetSettings(g.gShadowQuality, resolution, kernelSize);
+        FrameGraph::Resource shadowMap = graph.ImportFramebuffer("shadows", g.gCascadedShadows.GetFramebuffer(),
+                                                                 resolution, resolution);
+        graph.AddPass("Shadows", {}, {shadowMap}, [](){
+            RenderShadows();
+        });
+        sceneInputs.push_back(shadowMap);
+    }
+    graph.AddPass("Scene", sceneInputs, {target}, [](){
+        RenderScene();
+    });
+    graph.AddPass("Light", {}, {target}, [](){
+        PROFILE_SCOPE("Light");
+        g.gGpuTimer.Begin("Light");
+        g.gLight.PreDraw();
+        g.gLight.Draw();
+        g.gGpuTimer.End();
+    });
+    if (g.gPostProcessing) {
+        g.gPostProcess.AddToGraph(graph, target, screen, g.gGpuTimer);
+    }
+    graph.Compile();
+}
+
+
+/**
+ * @brief Builds and runs the frame graph into the framebuffer that is bound.
+ *
+ * @return void
+ */
+void RenderFrame(){
+    GLint screenFramebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &screenFramebuffer);
+    BuildFrameGraph(screenFramebuffer);
+    g.gFrameGraph.Execute();
+}
+
+
 /**
  * @brief Prints the current OpenGL version and graphics driver information.
  *
@@ -280,6 +1007,8 @@ void getOpenGLVersionInfo(){
  * @return void
  */
 void Input(){
+    PROFILE_SCOPE("Input");
+
     SDL_Event e;
     while (SDL_PollEvent(&e) != 0) {
         if (e.type == SDL_QUIT) {
@@ -290,6 +1019,26 @@ void Input(){
             std::cout << "ESC: Goodbye! (Leaving MainApplicationLoop())" << std::endl;
             g.gQuit = true;
         }
+        if(e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_p){
+            // Dump what the profiler recorded so far
+            Profiler::WriteChromeTrace(g.gProfileTraceFile);
+        }
+        if(e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_c){
+            g.gFrustumCulling = !g.gFrustumCulling;
+            std::cout << "Frustum culling " << (g.gFrustumCulling ? "on" : "off") << std::endl;
+        }
+        if(e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_o){
+            g.gOcclusionCulling = !g.gOcclusionCulling;
+            std::cout << "Occlusion culling " << (g.gOcclusionCulling ? "on" : "off") << std::endl;
+        }
+        if(e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_g){
+            // Toggle GPU timers and the statistics overlay
+            g.gShowStats = !g.gShowStats;
+            g.gGpuTimer.SetEnabled(g.gShowStats);
+            if (!g.gShowStats) {
+                SDL_SetWindowTitle(g.gGraphicsApplicationWindow, "OpenGL First Program");
+            }
+        }
     }
 
     const Uint8* state = SDL_GetKeyboardState(NULL);
@@ -309,6 +1058,11 @@ void Input(){
         g.g_uRotate += 1.0f;
         std::cout << "g_uRotate: " << g.g_uRotate << std::endl;
     }
+    if (!g.gObjects.empty() &&
+        (state[SDL_SCANCODE_UP] || state[SDL_SCANCODE_DOWN] || state[SDL_SCANCODE_LEFT] || state[SDL_SCANCODE_RIGHT])) {
+        // Only the root is marked dirty, Update() carries it down to the objects
+        UpdateSceneRoot();
+    }
     if (state[SDL_SCANCODE_J]) {
         g.gCamera.MoveUp(0.01f);
     }
@@ -358,27 +1112,880 @@ void Input(){
 void MainLoop(){
     SDL_WarpMouseInWindow(g.gGraphicsApplicationWindow, g.gScreenWidth / 2, g.gScreenHeight / 2);
 
+    unsigned long frame = 0;
+
     // While application is running
     while (!g.gQuit) {
+        PROFILE_SCOPE("Frame");
+        auto frameBegin = std::chrono::steady_clock::now();
+
+        // Read back GPU timings of earlier frames
+        g.gGpuTimer.BeginFrame();
+
         // Handle Input
         Input();
 
-        // Pre-draw setup
-        PreDraw();
+        // Swap in any shaders that were edited and finished compiling
+        g.gShaderReloader.Update();
 
-        // Draw the scene
-        if (g.gObject != nullptr) {
-            g.gObject->Draw();
-        } else {
-            Draw();
+        // Cull this frame before presenting the previous one, so the
+        // occlusion job runs while the swap waits for the GPU
+        if (!g.gObjects.empty()) {
+            PrepareScene();
+        }
+        if (frame > 0) {
+            PROFILE_SCOPE("SwapWindow");
+            SDL_GL_SwapWindow(g.gGraphicsApplicationWindow);
         }
 
-        g.gLight.PreDraw();
-        g.gLight.Draw();
+        // Draw the scene, the light and post-processing
+        RenderFrame();
+        auto submitEnd = std::chrono::steady_clock::now();
+
+        if (g.gShowStats) {
+            PROFILE_SCOPE("StatsOverlay");
+            g.gStatsOverlay.Draw(g.gGpuTimer, g.gScreenWidth, g.gScreenHeight);
+            // The numbers go into the title, the overlay only draws bars
+            if (frame % 30 == 0) {
+                const FrustumCuller::Statistics& culling = g.gFrustumCuller.GetStatistics();
+                std::string title = g.gGpuTimer.GetSummary() + " | chunks " + std::to_string(culling.visible) +
+                                    "/" + std::to_string(culling.tested);
+                if (g.gDeferred) {
+                    const DeferredRenderer::Statistics& deferred = g.gDeferredRenderer.GetStatistics();
+                    title += " | G-buffer " + std::to_string(deferred.megabytesWritten) + " MB written, " +
+                             std::to_string(deferred.megabytesRead) + " MB read";
+                }
+                if (g.gPostProcessing) {
+                    title += " | post targets " + std::to_string(g.gFrameGraph.GetPool().GetBytes() / (1024.0 * 1024.0)) + " MB";
+                }
+                if (g.gOcclusionCulling) {
+                    const OcclusionCuller::Statistics& occlusion = g.gOcclusionCuller.GetStatistics();
+                    title += " | occluded " + std::to_string(occlusion.occluded) + " (" +
+                             std::to_string(occlusion.rasterMilliseconds + occlusion.testMilliseconds) + " ms)";
+                }
+                SDL_SetWindowTitle(g.gGraphicsApplicationWindow, title.c_str());
+            }
+        }
+
+        std::chrono::duration<double, std::milli> submitTime = submitEnd - frameBegin;
+        std::chrono::duration<double, std::milli> frameTime = std::chrono::steady_clock::now() - frameBegin;
+        g.gGpuTimer.EndFrame(frameTime.count(), submitTime.count());
+        ++frame;
+    }
+}
+
+
+/**
+ * @brief Renders a fixed number of frames along the camera path without a window.
+ *
+ * The CPU time of every frame is written to a CSV file, split into the time
+ * spent submitting commands and the time until the frame finished rendering
+ * (glFinish). Every n-th frame can be written to a PPM for visual checks.
+ *
+ * @return void
+ */
+void HeadlessLoop(){
+    if (g.gCameraPathFile.empty() || !g.gCameraPath.Load(g.gCameraPathFile)) {
+        std::cout << "Using the default orbit camera path" << std::endl;
+        g.gCameraPath.CreateOrbit(3.0f, 0.5f, 8);
+    }
+
+    std::ofstream frameTimes(g.gFrameTimesFile);
+    frameTimes << "frame,submit_ms,frame_ms,occluded,occlusion_ms,occlusion_wait_ms\n";
+
+    double totalMilliseconds = 0.0;
+    double minMilliseconds = 1e9;
+    double maxMilliseconds = 0.0;
+    size_t totalOccluded = 0;
+    double totalOcclusionMilliseconds = 0.0;
+    std::vector<uint8_t> pixels;
+    g.gThreadPool.ResetStatistics();
+
+    for (unsigned int frame = 0; frame < g.gHeadlessFrames; ++frame) {
+        PROFILE_SCOPE("Frame");
+        auto frameBegin = std::chrono::steady_clock::now();
+        g.gGpuTimer.BeginFrame();
+
+        // Camera follows the path instead of the mouse and keyboard
+        glm::vec3 eyePosition, viewDirection;
+        float t = (g.gHeadlessFrames > 1) ? (float)frame / (float)(g.gHeadlessFrames - 1) : 0.0f;
+        g.gCameraPath.Evaluate(t, eyePosition, viewDirection);
+        g.gCamera.SetCameraEyePosition(eyePosition.x, eyePosition.y, eyePosition.z);
+        g.gCamera.SetViewDirection(viewDirection);
+
+        if (!g.gObjects.empty()) {
+            PrepareScene();
+        }
+        RenderFrame();
+        if (g.gShowStats) {
+            g.gStatsOverlay.Draw(g.gGpuTimer, g.gScreenWidth, g.gScreenHeight);
+        }
+
+        auto submitEnd = std::chrono::steady_clock::now();
+        {
+            PROFILE_SCOPE("glFinish");
+            glFinish();
+        }
+        auto frameEnd = std::chrono::steady_clock::now();
+
+        std::chrono::duration<double, std::milli> submitTime = submitEnd - frameBegin;
+        std::chrono::duration<double, std::milli> frameTime = frameEnd - frameBegin;
+        const OcclusionCuller::Statistics& occlusion = g.gOcclusionCuller.GetStatistics();
+        bool occlusionRan = g.gOcclusionCulling && !g.gObjects.empty();
+        double occlusionMilliseconds = occlusionRan ? occlusion.rasterMilliseconds + occlusion.testMilliseconds : 0.0;
+        frameTimes << frame << "," << submitTime.count() << "," << frameTime.count() << ","
+                   << (occlusionRan ? occlusion.occluded : 0) << "," << occlusionMilliseconds << ","
+                   << (occlusionRan ? occlusion.waitMilliseconds : 0.0) << "\n";
+        totalOccluded += occlusionRan ? occlusion.occluded : 0;
+        totalOcclusionMilliseconds += occlusionMilliseconds;
+        g.gGpuTimer.EndFrame(frameTime.count(), submitTime.count());
+
+        totalMilliseconds += frameTime.count();
+        minMilliseconds = std::min(minMilliseconds, frameTime.count());
+        maxMilliseconds = std::max(maxMilliseconds, frameTime.count());
+
+        if (g.gDumpEveryNFrames > 0 && frame % g.gDumpEveryNFrames == 0) {
+            g.gHeadlessContext.ReadPixels(pixels);
+            PPM image(g.gScreenWidth, g.gScreenHeight);
+            std::copy(pixels.begin(), pixels.end(), image.pixelData());
+            char filename[64];
+            snprintf(filename, sizeof(filename), "./frame_%04u.ppm", frame);
+            image.savePPM(filename);
+            if (occlusionRan) {
+                snprintf(filename, sizeof(filename), "./occlusion_%04u.ppm", frame);
+                g.gOcclusionCuller.WriteDepthImage(filename);
+            }
+        }
+    }
+
+    std::cout << "Headless: " << g.gHeadlessFrames << " frames, avg "
+              << totalMilliseconds / std::max(1u, g.gHeadlessFrames) << " ms, min "
+              << minMilliseconds << " ms, max " << maxMilliseconds << " ms"
+              << " (per-frame times in " << g.gFrameTimesFile << ", GPU pass times in " << g.gGpuTimesFile << ")" << std::endl;
+    std::cout << g.gGpuTimer.GetSummary() << std::endl;
+    if (!g.gObjects.empty()) {
+        const FrustumCuller::Statistics& culling = g.gFrustumCuller.GetStatistics();
+        std::cout << "Culling (last frame): " << culling.visible << " of " << culling.tested << " chunks visible, "
+                  << culling.culled << " culled in " << culling.milliseconds << " ms" << std::endl;
+    }
+    if (!g.gObjects.empty() && g.gOcclusionCulling) {
+        const OcclusionCuller::Statistics& occlusion = g.gOcclusionCuller.GetStatistics();
+        unsigned int frames = std::max(1u, g.gHeadlessFrames);
+        std::cout << "Occlusion: avg " << static_cast<double>(totalOccluded) / frames << " chunks occluded in "
+                  << totalOcclusionMilliseconds / frames << " ms per frame; last frame " << occlusion.occluded
+                  << " of " << occlusion.tested << " with " << occlusion.occluderTriangles << " occluder triangles (raster "
+                  << occlusion.rasterMilliseconds << " ms, test " << occlusion.testMilliseconds << " ms, waited "
+                  << occlusion.waitMilliseconds << " ms)" << std::endl;
+    }
+    if (g.gDeferred) {
+        const DeferredRenderer::Statistics& deferred = g.gDeferredRenderer.GetStatistics();
+        std::cout << "Deferred: G-buffer " << g.gDeferredRenderer.GetMegabytes() << " MB ("
+                  << DeferredRenderer::kBytesPerPixel << " bytes per pixel); last resolved frame "
+                  << deferred.geometrySamples << " geometry and " << deferred.volumeSamples << " light volume samples ("
+                  << deferred.lightVolumes << " lights), about " << deferred.megabytesWritten << " MB written and "
+                  << deferred.megabytesRead << " MB read" << std::endl;
+    }
+    if (g.gShadows && !g.gObjects.empty()) {
+        const CascadedShadows::Statistics& shadows = g.gCascadedShadows.GetStatistics();
+        std::cout << "Shadows: " << CascadedShadows::kCascades << " cascades of " << g.gCascadedShadows.GetResolution() << "x"
+                  << g.gCascadedShadows.GetResolution() << " (" << g.gCascadedShadows.GetMegabytes() << " MB), PCF "
+                  << g.gCascadedShadows.GetKernelSize() << "x" << g.gCascadedShadows.GetKernelSize()
+                  << ", casters culled in " << shadows.cullMilliseconds << " ms" << std::endl;
+        for (int cascade = 0; cascade < CascadedShadows::kCascades; ++cascade) {
+            std::cout << "  cascade " << cascade << ": up to " << shadows.splitFar[cascade] << ", "
+                      << shadows.casters[cascade] << " caster chunks in " << shadows.drawCalls[cascade] << " draw calls"
+                      << std::endl;
+        }
+    }
+    if (g.gPostProcessing) {
+        const RenderTargetPool& pool = g.gFrameGraph.GetPool();
+        std::cout << "Post: " << g.gPostProcess.GetPassCount() << " passes in " << g.gPostProcess.GetDrawCount()
+                  << " draws (" << g.gPostProcess.GetSummary() << "), " << pool.GetTargetCount()
+                  << " pooled render targets using " << pool.GetBytes() / (1024.0 * 1024.0) << " MB" << std::endl;
+    }
+    const FrameGraph::Statistics& frameGraph = g.gFrameGraph.GetStatistics();
+    std::cout << "Frame graph (last frame): " << frameGraph.passes - frameGraph.culledPasses << " of " << frameGraph.passes
+              << " passes run, " << frameGraph.resources << " transient images in " << frameGraph.physicalTargets
+              << " targets (" << frameGraph.allocatedBytes / (1024.0 * 1024.0) << " of "
+              << frameGraph.declaredBytes / (1024.0 * 1024.0) << " MB), compiled in " << frameGraph.compileMilliseconds
+              << " ms (--framegraph-report lists it)" << std::endl;
+    std::vector<ThreadPool::ThreadStatistics> jobs = g.gThreadPool.GetStatistics();
+    double jobWindow = g.gThreadPool.GetStatisticsMilliseconds();
+    std::cout << "Jobs: " << jobs.size() << " threads, main thread ran " << jobs[0].jobs << " jobs";
+    for (size_t thread = 1; thread < jobs.size(); ++thread) {
+        std::cout << "; worker " << thread << ": " << jobs[thread].jobs << " jobs, " << jobs[thread].steals << " stolen, "
+                  << 100.0 * (1.0 - jobs[thread].idleMilliseconds / jobWindow) << "% busy";
+    }
+    std::cout << std::endl;
+    if (!g.gClusteredLights.GetLights().empty() && !g.gDeferred) {
+        const ClusteredLights::Statistics& lights = g.gClusteredLights.GetStatistics();
+        std::cout << "Lights (last frame): " << lights.lightsInView << " of " << lights.lights << " in view, "
+                  << lights.indices << " cluster references, at most " << lights.maxLightsPerCluster
+                  << " per cluster, assigned in " << lights.assignMilliseconds << " ms" << std::endl;
+    }
+}
+
+
+/**
+ * @brief Renders the camera path without a window for 0 and then 64, 128, ... up to maxLights point lights.
+ *
+ * Prints, per light count, the average frame time until glFinish, the CPU time
+ * to assign the lights to clusters and upload them, and how many light
+ * references the clusters hold.
+ *
+ * @return void
+ */
+void RunLightBenchmark(unsigned int maxLights){
+    if (g.gObjects.empty()) {
+        std::cout << "The light benchmark needs an OBJ file" << std::endl;
+        return;
+    }
+    if (g.gCameraPathFile.empty() || !g.gCameraPath.Load(g.gCameraPathFile)) {
+        g.gCameraPath.CreateOrbit(3.0f, 0.5f, 8);
+    }
+    std::vector<unsigned int> counts = {0};
+    for (unsigned int count = 64; count < maxLights; count *= 2) {
+        counts.push_back(count);
+    }
+    counts.push_back(maxLights);
+
+    unsigned int frames = std::max(1u, g.gHeadlessFrames);
+    std::cout << "Light benchmark, " << frames << " frames per count, " << ClusteredLights::kClustersX << "x"
+              << ClusteredLights::kClustersY << "x" << ClusteredLights::kClustersZ << " clusters" << std::endl;
+    std::cout << "lights  frame_ms  assign_ms  upload_ms  in_view  refs  max_per_cluster" << std::endl;
+    for (unsigned int count : counts) {
+        CreatePointLights(count);
+        double frameMilliseconds = 0.0, assignMilliseconds = 0.0, uploadMilliseconds = 0.0;
+        double inView = 0.0, references = 0.0;
+        size_t maxPerCluster = 0;
+        for (unsigned int frame = 0; frame < frames; ++frame) {
+            auto frameBegin = std::chrono::steady_clock::now();
+            glm::vec3 eyePosition, viewDirection;
+            g.gCameraPath.Evaluate((frames > 1) ? (float)frame / (float)(frames - 1) : 0.0f, eyePosition, viewDirection);
+            g.gCamera.SetCameraEyePosition(eyePosition.x, eyePosition.y, eyePosition.z);
+            g.gCamera.SetViewDirection(viewDirection);
+            PrepareScene();
+            RenderFrame();
+            glFinish();
+            std::chrono::duration<double, std::milli> frameTime = std::chrono::steady_clock::now() - frameBegin;
+
+            const ClusteredLights::Statistics& statistics = g.gClusteredLights.GetStatistics();
+            frameMilliseconds += frameTime.count();
+            assignMilliseconds += statistics.assignMilliseconds;
+            uploadMilliseconds += statistics.uploadMilliseconds;
+            inView += statistics.lightsInView;
+            references += statistics.indices;
+            maxPerCluster = std::max(maxPerCluster, statistics.maxLightsPerCluster);
+        }
+        std::cout << count << "  " << frameMilliseconds / frames << "  " << assignMilliseconds / frames << "  "
+                  << uploadMilliseconds / frames << "  " << inView / frames << "  " << references / frames << "  "
+                  << maxPerCluster << std::endl;
+    }
+}
+
+
+/**
+ * @brief Renders a fixed number of frames along the camera path with the CPU rasterizer.
+ *
+ * Uses the same camera path, model matrix and projection as the OpenGL path.
+ * Prints the average frame time and the triangle throughput; the time of every
+ * frame is written to the frame times CSV.
+ *
+ * @return void
+ */
+void SoftwareLoop(){
+    if (g.gCameraPathFile.empty() || !g.gCameraPath.Load(g.gCameraPathFile)) {
+        std::cout << "Using the default orbit camera path" << std::endl;
+        g.gCameraPath.CreateOrbit(3.0f, 0.5f, 8);
+    }
+
+    std::ofstream frameTimes(g.gFrameTimesFile);
+    frameTimes << "frame,vertex_ms,tile_ms,frame_ms\n";
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f),
+                                            (float)g.gScreenWidth / (float)g.gScreenHeight,
+                                            0.1f,
+                                            100.0f);
+    // Where the orbiting light of the OpenGL path starts
+    glm::vec3 lightPosition(3.0f, 0.0f, 0.0f);
+
+    double totalMilliseconds = 0.0;
+    double minMilliseconds = 1e9;
+    double maxMilliseconds = 0.0;
+    size_t totalTriangles = 0;
+    size_t totalFragments = 0;
+    double totalShadeMilliseconds = 0.0;
+    double totalTileMilliseconds = 0.0;
+    SoftwareRasterizer::Statistics statistics;
+
+    for (unsigned int frame = 0; frame < g.gHeadlessFrames; ++frame) {
+        PROFILE_SCOPE("Frame");
+        auto frameBegin = std::chrono::steady_clock::now();
+
+        glm::vec3 eyePosition, viewDirection;
+        float t = (g.gHeadlessFrames > 1) ? (float)frame / (float)(g.gHeadlessFrames - 1) : 0.0f;
+        g.gCameraPath.Evaluate(t, eyePosition, viewDirection);
+        g.gCamera.SetCameraEyePosition(eyePosition.x, eyePosition.y, eyePosition.z);
+        g.gCamera.SetViewDirection(viewDirection);
+
+        g.gSoftwareRasterizer.BeginFrame(g.gCamera.GetViewMatrix(), projection, eyePosition, lightPosition,
+                                         glm::vec3(1.0f, 1.0f, 0.0f));
+        g.gScene.Update();
+        const std::vector<glm::mat4>& worldMatrices = g.gScene.GetWorldMatrices();
+        const std::vector<int>& meshes = g.gScene.GetMeshes();
+        for (size_t i = 0; i < meshes.size(); ++i) {
+            if (meshes[i] >= 0) {
+                g.gSoftwareRasterizer.Submit(*g.gObjects[meshes[i]], worldMatrices[i]);
+            }
+        }
+        g.gSoftwareRasterizer.EndFrame();
+
+        std::chrono::duration<double, std::milli> frameTime = std::chrono::steady_clock::now() - frameBegin;
+        statistics = g.gSoftwareRasterizer.GetStatistics();
+        frameTimes << frame << "," << statistics.vertexMilliseconds << "," << statistics.tileMilliseconds
+                   << "," << frameTime.count() << "\n";
+
+        totalMilliseconds += frameTime.count();
+        minMilliseconds = std::min(minMilliseconds, frameTime.count());
+        maxMilliseconds = std::max(maxMilliseconds, frameTime.count());
+        totalTriangles += statistics.trianglesSubmitted;
+        totalFragments += statistics.pixelsShaded;
+        totalShadeMilliseconds += statistics.shadeMilliseconds;
+        totalTileMilliseconds += statistics.tileMilliseconds;
+
+        if (g.gDumpEveryNFrames > 0 && frame % g.gDumpEveryNFrames == 0) {
+            PPM image(g.gScreenWidth, g.gScreenHeight);
+            g.gSoftwareRasterizer.Resolve(image);
+            char filename[64];
+            snprintf(filename, sizeof(filename), "./frame_%04u.ppm", frame);
+            image.savePPM(filename);
+        }
+    }
+
+    std::cout << "Software: " << g.gHeadlessFrames << " frames on " << g.gThreadPool.GetThreadCount()
+              << " threads, avg " << totalMilliseconds / std::max(1u, g.gHeadlessFrames) << " ms, min "
+              << minMilliseconds << " ms, max " << maxMilliseconds << " ms, "
+              << totalTriangles / (totalMilliseconds * 1000.0) << " Mtris/s"
+              << " (per-frame times in " << g.gFrameTimesFile << ")" << std::endl;
+    std::cout << "Last frame: " << statistics.trianglesSubmitted << " triangles, "
+              << statistics.trianglesVisible << " after culling, "
+              << statistics.binEntries << " tile bin entries, "
+              << statistics.blocksSkippedByDepth << " of " << statistics.blocksTested << " blocks skipped by depth, "
+              << statistics.pixelsShaded << " pixels shaded" << std::endl;
+    // Shading time is summed over the threads, the tile time is wall clock
+    std::cout << "Shading: " << totalFragments / (totalShadeMilliseconds * 1000.0) << " Mfragments/s per thread, "
+              << totalFragments / (totalTileMilliseconds * 1000.0) << " Mfragments/s including rasterization" << std::endl;
+}
+
+
+/**
+ * @brief Path traces the first camera path position with gPathTraceSamples samples per pixel.
+ *
+ * Writes the result to pathtrace.ppm and, with --snapshot-every, the image so
+ * far every N samples. With --scaling the samples per second are first measured
+ * for 1, 2, 4, ... threads up to the configured count.
+ *
+ * @return void
+ */
+void PathTraceLoop(){
+    if (g.gCameraPathFile.empty() || !g.gCameraPath.Load(g.gCameraPathFile)) {
+        std::cout << "Using the default orbit camera path" << std::endl;
+        g.gCameraPath.CreateOrbit(3.0f, 0.5f, 8);
+    }
+    glm::vec3 eyePosition, viewDirection;
+    g.gCameraPath.Evaluate(0.0f, eyePosition, viewDirection);
+    g.gCamera.SetCameraEyePosition(eyePosition.x, eyePosition.y, eyePosition.z);
+    g.gCamera.SetViewDirection(viewDirection);
+    glm::mat4 view = g.gCamera.GetViewMatrix();
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f),
+                                            (float)g.gScreenWidth / (float)g.gScreenHeight,
+                                            0.1f,
+                                            100.0f);
+    glm::vec3 lightPosition(3.0f, 0.0f, 0.0f);
+    unsigned int threadCount = g.gThreadPool.GetThreadCount();
+
+    auto buildBegin = std::chrono::steady_clock::now();
+    g.gScene.Update();
+    const std::vector<glm::mat4>& worldMatrices = g.gScene.GetWorldMatrices();
+    const std::vector<int>& meshes = g.gScene.GetMeshes();
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        if (meshes[i] >= 0) {
+            g.gPathTracer.AddObject(*g.gObjects[meshes[i]], worldMatrices[i]);
+        }
+    }
+    g.gPathTracer.Build();
+    std::chrono::duration<double, std::milli> buildTime = std::chrono::steady_clock::now() - buildBegin;
+    std::cout << "Path tracer: " << g.gPathTracer.GetTriangleCount() << " triangles, "
+              << g.gPathTracer.GetNodeCount() << " BVH nodes, built in " << buildTime.count() << " ms" << std::endl;
+    g.gPathTracer.Initialize(g.gScreenWidth, g.gScreenHeight);
+
+    if (g.gPathTraceScaling) {
+        const unsigned int kScalingPasses = 4;
+        std::vector<unsigned int> threadCounts;
+        for (unsigned int threads = 1; threads < threadCount; threads *= 2) {
+            threadCounts.push_back(threads);
+        }
+        threadCounts.push_back(threadCount);
+        double baseline = 0.0;
+        for (unsigned int threads : threadCounts) {
+            g.gPathTracer.Reset();
+            size_t samples = 0;
+            double milliseconds = 0.0;
+            for (unsigned int pass = 0; pass < kScalingPasses; ++pass) {
+                g.gPathTracer.RenderPass(view, projection, eyePosition, lightPosition, threads);
+                samples += g.gPathTracer.GetStatistics().samples;
+                milliseconds += g.gPathTracer.GetStatistics().milliseconds;
+            }
+            double samplesPerSecond = samples / (milliseconds * 1000.0);
+            if (threads == 1) {
+                baseline = samplesPerSecond;
+            }
+            double speedup = samplesPerSecond / baseline;
+            std::cout << "Scaling: " << threads << " threads, " << samplesPerSecond << " Msamples/s, speedup "
+                      << speedup << ", efficiency " << 100.0 * speedup / threads << "%" << std::endl;
+        }
+        g.gPathTracer.Reset();
+    }
+
+    std::ofstream passTimes(g.gFrameTimesFile);
+    passTimes << "sample,pass_ms,rays,steals\n";
+    size_t totalSamples = 0;
+    size_t totalRays = 0;
+    size_t totalSteals = 0;
+    double totalMilliseconds = 0.0;
+    for (unsigned int sample = 0; sample < g.gPathTraceSamples; ++sample) {
+        PROFILE_SCOPE("Frame");
+        g.gPathTracer.RenderPass(view, projection, eyePosition, lightPosition, threadCount);
+        const PathTracer::Statistics& statistics = g.gPathTracer.GetStatistics();
+        passTimes << sample << "," << statistics.milliseconds << "," << statistics.rays << "," << statistics.steals << "\n";
+        totalSamples += statistics.samples;
+        totalRays += statistics.rays;
+        totalSteals += statistics.steals;
+        totalMilliseconds += statistics.milliseconds;
+
+        if (g.gSnapshotEveryNSamples > 0 && (sample + 1) % g.gSnapshotEveryNSamples == 0) {
+            PPM image(g.gScreenWidth, g.gScreenHeight);
+            g.gPathTracer.Resolve(image);
+            char filename[64];
+            snprintf(filename, sizeof(filename), "./pathtrace_%04u.ppm", sample + 1);
+            image.savePPM(filename);
+        }
+    }
+
+    PPM image(g.gScreenWidth, g.gScreenHeight);
+    g.gPathTracer.Resolve(image);
+    image.savePPM("./pathtrace.ppm");
+    std::cout << "Path tracer: " << g.gPathTracer.GetSampleCount() << " samples per pixel on " << threadCount
+              << " threads in " << totalMilliseconds << " ms, "
+              << totalSamples / (totalMilliseconds * 1000.0) << " Msamples/s ("
+              << totalSamples / (totalMilliseconds * 1000.0 * threadCount) << " per thread), "
+              << totalRays / (totalMilliseconds * 1000.0) << " Mrays/s, "
+              << totalSteals << " tiles stolen, image in pathtrace.ppm"
+              << " (per-sample times in " << g.gFrameTimesFile << ")" << std::endl;
+}
+
+
+/**
+ * @brief Measures the scene graph with nodeCount random nodes, no window or model needed.
+ *
+ * Times a full update (root moved), an update with 1% of the nodes changed and
+ * an update with nothing changed, and compares them with a tree of individually
+ * allocated nodes updated recursively every frame. The world matrices of both
+ * are compared to check the propagation.
+ *
+ * @return void
+ */
+void RunSceneBenchmark(size_t nodeCount){
+    const int kRepeats = 20;
+    // Fixed seed so every run builds the same tree
+    uint32_t seed = 12345u;
+    auto random = [&seed](){ seed = seed * 1664525u + 1013904223u; return seed >> 8; };
+    auto randomFloat = [&random](float low, float high){ return low + (high - low) * (random() & 0xFFFF) / 65535.0f; };
+
+    // Pointer based tree as the comparison
+    struct TreeNode{
+        glm::vec3 translation;
+        glm::quat rotation;
+        glm::vec3 scale;
+        glm::mat4 world;
+        std::vector<TreeNode*> children;
+    };
+    std::vector<TreeNode*> treeNodes;
+    std::vector<NodeHandle> handles;
+    SceneGraph scene;
+    size_t maxDepth = 0;
+    std::vector<size_t> depths;
+    for (size_t i = 0; i < nodeCount; ++i) {
+        // Random recursive tree: every node picks an earlier node as its parent
+        size_t parent = (i == 0) ? 0 : random() % i;
+        TreeNode* node = new TreeNode();
+        node->translation = glm::vec3(randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f));
+        node->rotation = glm::angleAxis(randomFloat(0.0f, 6.28f), glm::normalize(glm::vec3(randomFloat(-1.0f, 1.0f), 1.0f, 0.5f)));
+        node->scale = glm::vec3(randomFloat(0.9f, 1.1f));
+        treeNodes.push_back(node);
+        handles.push_back(scene.CreateNode((i == 0) ? kInvalidNode : handles[parent]));
+        scene.SetTranslation(handles[i], node->translation);
+        scene.SetRotation(handles[i], node->rotation);
+        scene.SetScale(handles[i], node->scale);
+        depths.push_back((i == 0) ? 0 : depths[parent] + 1);
+        maxDepth = std::max(maxDepth, depths[i]);
+        if (i > 0) {
+            treeNodes[parent]->children.push_back(node);
+        }
+    }
+
+    // First update also sorts by depth
+    auto sortBegin = std::chrono::steady_clock::now();
+    scene.Update();
+    std::chrono::duration<double, std::milli> sortTime = std::chrono::steady_clock::now() - sortBegin;
+
+    auto measure = [&](const std::function<void()>& change){
+        double milliseconds = 0.0;
+        size_t updated = 0;
+        for (int repeat = 0; repeat < kRepeats; ++repeat) {
+            change();
+            scene.Update();
+            milliseconds += scene.GetStatistics().milliseconds;
+            updated = scene.GetStatistics().nodesUpdated;
+        }
+        return std::make_pair(milliseconds / kRepeats, updated);
+    };
+    float angle = 0.0f;
+    auto full = measure([&](){
+        angle += 0.01f;
+        scene.SetRotation(handles[0], glm::angleAxis(angle, glm::vec3(0.0f, 1.0f, 0.0f)));
+    });
+    auto sparse = measure([&](){
+        for (size_t i = 0; i < nodeCount / 100; ++i) {
+            NodeHandle node = handles[random() % nodeCount];
+            scene.SetTranslation(node, scene.GetTranslation(node) + glm::vec3(0.0f, 0.001f, 0.0f));
+        }
+    });
+    auto clean = measure([](){});
+
+    // The comparison recomputes everything, as there are no dirty flags
+    std::function<void(TreeNode*, const glm::mat4&)> updateTree = [&](TreeNode* node, const glm::mat4& parent){
+        node->world = parent * glm::translate(glm::mat4(1.0f), node->translation) *
+                      glm::mat4_cast(node->rotation) * glm::scale(glm::mat4(1.0f), node->scale);
+        for (TreeNode* child : node->children) {
+            updateTree(child, node->world);
+        }
+    };
+    for (size_t i = 0; i < nodeCount; ++i) {
+        treeNodes[i]->translation = scene.GetTranslation(handles[i]);
+        treeNodes[i]->rotation = scene.GetRotation(handles[i]);
+    }
+    double treeMilliseconds = 0.0;
+    for (int repeat = 0; repeat < kRepeats; ++repeat) {
+        auto begin = std::chrono::steady_clock::now();
+        updateTree(treeNodes[0], glm::mat4(1.0f));
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+        treeMilliseconds += elapsed.count();
+    }
+    treeMilliseconds /= kRepeats;
+
+    float maxDifference = 0.0f;
+    for (size_t i = 0; i < nodeCount; ++i) {
+        const glm::mat4& a = scene.GetWorldMatrix(handles[i]);
+        for (int c = 0; c < 4; ++c) {
+            glm::vec4 difference = glm::abs(a[c] - treeNodes[i]->world[c]);
+            maxDifference = std::max(maxDifference, std::max(std::max(difference.x, difference.y), std::max(difference.z, difference.w)));
+        }
+    }
+    for (TreeNode* node : treeNodes) {
+        delete node;
+    }
+
+    // One small box per node, seen from the middle of the tree
+    FrustumCuller culler;
+    culler.Resize(nodeCount);
+    for (size_t i = 0; i < nodeCount; ++i) {
+        culler.SetTransformedBox(i, scene.GetWorldMatrix(handles[i]), glm::vec3(-0.1f), glm::vec3(0.1f));
+    }
+    glm::mat4 viewProjection = GetProjectionMatrix() * glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+                                                                   glm::vec3(0.0f, 1.0f, 0.0f));
+    std::vector<uint32_t> scalarVisible, visible;
+    double cullMilliseconds[3] = {0.0, 0.0, 0.0};
+    g.gThreadPool.Initialize(g.gThreadCount);
+    for (int repeat = 0; repeat < kRepeats; ++repeat) {
+        culler.CullScalar(viewProjection, scalarVisible);
+        cullMilliseconds[0] += culler.GetStatistics().milliseconds;
+        culler.Cull(viewProjection, nullptr, visible);
+        cullMilliseconds[1] += culler.GetStatistics().milliseconds;
+        culler.Cull(viewProjection, &g.gThreadPool, visible);
+        cullMilliseconds[2] += culler.GetStatistics().milliseconds;
+    }
+    g.gThreadPool.Shutdown();
+
+    std::cout << "Scene benchmark: " << nodeCount << " nodes, depth " << maxDepth
+              << ", first update with depth sort " << sortTime.count() << " ms" << std::endl;
+    std::cout << "  root moved:   " << full.first << " ms, " << full.second << " nodes updated, "
+              << full.second / (full.first * 1000.0) << " Mnodes/s" << std::endl;
+    std::cout << "  1% changed:   " << sparse.first << " ms, " << sparse.second << " nodes updated" << std::endl;
+    std::cout << "  unchanged:    " << clean.first << " ms, " << clean.second << " nodes updated" << std::endl;
+    std::cout << "  pointer tree: " << treeMilliseconds << " ms for a recursive update of all nodes, "
+              << "largest difference to the scene graph " << maxDifference << std::endl;
+    std::cout << "Culling " << nodeCount << " boxes: " << visible.size() << " visible"
+              << (visible == scalarVisible ? "" : " (DIFFERS from the scalar test)") << ", scalar "
+              << cullMilliseconds[0] / kRepeats << " ms, SSE " << cullMilliseconds[1] / kRepeats << " ms, SSE on "
+              << culler.GetStatistics().threads << " threads " << cullMilliseconds[2] / kRepeats << " ms" << std::endl;
+}
+
+
+/**
+ * @brief Times the CPU precompute of the --pbr lookup tables at several sizes and validates them, no window needed.
+ *
+ * Every size is computed one texel at a time, with Float8 on one thread and with
+ * Float8 on the thread pool. The tables of the default settings are then compared
+ * with the double precision reference at a spread of texels.
+ *
+ * @return void
+ */
+void RunIblBenchmark(){
+    const int kReferenceSamples = 65536;
+    g.gThreadPool.Initialize(g.gThreadCount);
+    ImageBasedLighting scalar, vectorized, threaded;
+    std::cout << "IBL precompute, " << ImageBasedLighting::Settings().samples << " samples per texel, scalar / Float8 / Float8 on "
+              << g.gThreadPool.GetThreadCount() << " threads" << std::endl;
+    for (int step = 0; step < 4; ++step) {
+        ImageBasedLighting::Settings settings;
+        settings.brdfSize = 32 << step;
+        settings.environmentSize = 16 << step;
+        settings.irradianceSize = 4 << step;
+        scalar.PrecomputeScalar(settings);
+        vectorized.Precompute(settings, nullptr);
+        threaded.Precompute(settings, &g.gThreadPool);
+
+        // The vectorized tables must match the scalar ones up to rounding
+        float maxDifference = 0.0f;
+        auto compare = [&maxDifference](const std::vector<float>& a, const std::vector<float>& b){
+            for (size_t i = 0; i < a.size(); ++i) {
+                maxDifference = std::max(maxDifference, std::fabs(a[i] - b[i]));
+            }
+        };
+        compare(scalar.GetTables().brdf, threaded.GetTables().brdf);
+        for (int level = 0; level < scalar.GetSpecularLevels(); ++level) {
+            compare(scalar.GetTables().specular[level], threaded.GetTables().specular[level]);
+        }
+        compare(scalar.GetTables().irradiance, threaded.GetTables().irradiance);
+
+        const ImageBasedLighting::Statistics& a = scalar.GetStatistics();
+        const ImageBasedLighting::Statistics& b = vectorized.GetStatistics();
+        const ImageBasedLighting::Statistics& c = threaded.GetStatistics();
+        std::cout << "  BRDF " << settings.brdfSize << "x" << settings.brdfSize << ": " << a.brdfMilliseconds << " / "
+                  << b.brdfMilliseconds << " / " << c.brdfMilliseconds << " ms" << std::endl;
+        std::cout << "  prefiltered " << settings.environmentSize << " (" << threaded.GetSpecularLevels() << " levels): "
+                  << a.specularMilliseconds << " / " << b.specularMilliseconds << " / " << c.specularMilliseconds << " ms" << std::endl;
+        std::cout << "  irradiance " << settings.irradianceSize << ": " << a.irradianceMilliseconds << " / "
+                  << b.irradianceMilliseconds << " / " << c.irradianceMilliseconds << " ms, largest scalar to Float8 difference "
+                  << maxDifference << std::endl;
+    }
+
+    // Texels of the default tables against the reference, evaluated on the pool
+    ImageBasedLighting::Settings settings;
+    threaded.Precompute(settings, &g.gThreadPool);
+    const ImageBasedLighting::Tables& tables = threaded.GetTables();
+    struct Check{
+        int table;      // 0 BRDF, 1 prefiltered, 2 irradiance
+        int level, face, x, y, size;
+        double error;
+    };
+    std::vector<Check> checks;
+    for (int y = 0; y < settings.brdfSize; y += settings.brdfSize / 16) {
+        for (int x = 0; x < settings.brdfSize; x += settings.brdfSize / 16) {
+            checks.push_back({0, 0, 0, x, y, settings.brdfSize, 0.0});
+        }
+    }
+    for (int level = 0; level < threaded.GetSpecularLevels(); ++level) {
+        int size = std::max(1, settings.environmentSize >> level);
+        for (int face = 0; face < 6; ++face) {
+            for (int y = 0; y < size; y += std::max(1, size / 4)) {
+                for (int x = 0; x < size; x += std::max(1, size / 4)) {
+                    checks.push_back({1, level, face, x, y, size, 0.0});
+                }
+            }
+        }
+    }
+    for (int face = 0; face < 6; ++face) {
+        for (int y = 0; y < settings.irradianceSize; y += std::max(1, settings.irradianceSize / 4)) {
+            for (int x = 0; x < settings.irradianceSize; x += std::max(1, settings.irradianceSize / 4)) {
+                checks.push_back({2, 0, face, x, y, settings.irradianceSize, 0.0});
+            }
+        }
+    }
+    int levels = threaded.GetSpecularLevels();
+    g.gThreadPool.ParallelFor(checks.size(), [&](size_t index, unsigned int){
+        Check& check = checks[index];
+        size_t texel = (static_cast<size_t>(check.face) * check.size + check.y) * check.size + check.x;
+        if (check.table == 0) {
+            glm::dvec2 reference = ImageBasedLighting::ReferenceBrdf((check.x + 0.5) / check.size, (check.y + 0.5) / check.size,
+                                                                     kReferenceSamples);
+            check.error = std::max(std::fabs(reference.x - tables.brdf[texel * 2]), std::fabs(reference.y - tables.brdf[texel * 2 + 1]));
+            return;
+        }
+        glm::vec3 direction = ImageBasedLighting::CubeDirection(check.face, check.x, check.y, check.size);
+        glm::dvec3 reference = (check.table == 1)
+            ? ImageBasedLighting::ReferenceSpecular(direction, ImageBasedLighting::GetLevelRoughness(check.level, levels), kReferenceSamples)
+            : ImageBasedLighting::ReferenceIrradiance(direction, kReferenceSamples);
+        const float* value = (check.table == 1) ? &tables.specular[check.level][texel * 3] : &tables.irradiance[texel * 3];
+        for (int c = 0; c < 3; ++c) {
+            check.error = std::max(check.error, std::fabs(reference[c] - value[c]));
+        }
+    });
+    g.gThreadPool.Shutdown();
+
+    const char* names[3] = {"BRDF", "prefiltered", "irradiance"};
+    std::cout << "Validation of the default tables against the double precision reference (" << kReferenceSamples
+              << " samples):" << std::endl;
+    for (int table = 0; table < 3; ++table) {
+        double maxError = 0.0, sumError = 0.0;
+        size_t count = 0;
+        for (const Check& check : checks) {
+            if (check.table == table) {
+                maxError = std::max(maxError, check.error);
+                sumError += check.error;
+                ++count;
+            }
+        }
+        std::cout << "  " << names[table] << ": " << count << " texels, largest error " << maxError << ", mean "
+                  << sumError / std::max<size_t>(count, 1) << std::endl;
+    }
+}
+
+
+/**
+ * @brief Spawns a binary tree of jobs of the given depth; every inner job waits for its two children.
+ *
+ * @return void
+ */
+void ForkJoinTree(ThreadPool& pool, int depth){
+    if (depth == 0) {
+        return;
+    }
+    ThreadPool::Job* parent = pool.CreateJob(nullptr);
+    for (int child = 0; child < 2; ++child) {
+        pool.Run(pool.CreateJob([&pool, depth]{ ForkJoinTree(pool, depth - 1); }, parent));
+    }
+    pool.Run(parent);
+    pool.Wait(parent);
+}
 
-        // Update screen
-        SDL_GL_SwapWindow(g.gGraphicsApplicationWindow);
+
+/**
+ * @brief Measures the job system at 1, 2, 4, ... threads up to --threads, no window needed.
+ *
+ * Per thread count: the cost of an empty job created, run and finished from
+ * the main thread, binary fork-join trees of growing depth, and the speedup of
+ * a ParallelFor with automatic grain over a fixed amount of arithmetic, with
+ * the share of the time every worker was busy.
+ *
+ * @return void
+ */
+void RunJobBenchmark(){
+    const size_t kEmptyJobs = 200000;
+    const size_t kBatch = ThreadPool::kMaxJobsPerThread / 2;
+    const int kDepths[3] = {8, 12, 16};
+    const size_t kItems = 1 << 20;
+    const int kRepeats = 5;
+
+    unsigned int maxThreads = g.gThreadCount > 0 ? g.gThreadCount : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned int> threadCounts;
+    for (unsigned int threads = 1; threads < maxThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    std::vector<float> output(kItems), reference;
+    auto work = [&output](size_t index, unsigned int){
+        float x = static_cast<float>(index) * 1e-6f;
+        for (int i = 0; i < 64; ++i) {
+            x = x * 0.999f + 0.5f;
+        }
+        output[index] = x;
+    };
+
+    double baseMilliseconds = 0.0;
+    for (unsigned int threads : threadCounts) {
+        ThreadPool pool;
+        pool.Initialize(threads);
+
+        // Empty jobs below one parent per batch, the ring holds kMaxJobsPerThread
+        auto begin = std::chrono::steady_clock::now();
+        for (size_t done = 0; done < kEmptyJobs; done += kBatch) {
+            ThreadPool::Job* root = pool.CreateJob(nullptr);
+            for (size_t i = 0; i < kBatch; ++i) {
+                pool.Run(pool.CreateJob([]{}, root));
+            }
+            pool.Run(root);
+            pool.Wait(root);
+        }
+        std::chrono::duration<double, std::nano> emptyTime = std::chrono::steady_clock::now() - begin;
+        size_t emptyJobs = (kEmptyJobs + kBatch - 1) / kBatch * kBatch;
+        std::cout << "  " << threads << " threads: empty job " << emptyTime.count() / emptyJobs << " ns" << std::endl;
+
+        std::cout << "    fork-join";
+        for (int depth : kDepths) {
+            begin = std::chrono::steady_clock::now();
+            ForkJoinTree(pool, depth);
+            std::chrono::duration<double, std::milli> treeTime = std::chrono::steady_clock::now() - begin;
+            // Every inner node creates a parent and two children
+            size_t jobs = ((size_t(1) << depth) - 1) * 3;
+            std::cout << (depth == kDepths[0] ? " " : ", ") << "depth " << depth << " " << treeTime.count() << " ms ("
+                      << treeTime.count() * 1e6 / jobs << " ns per job)";
+        }
+        std::cout << std::endl;
+
+        pool.ParallelFor(kItems, work);
+        pool.ResetStatistics();
+        begin = std::chrono::steady_clock::now();
+        for (int repeat = 0; repeat < kRepeats; ++repeat) {
+            pool.ParallelFor(kItems, work);
+        }
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count() / kRepeats;
+        if (reference.empty()) {
+            reference = output;
+            baseMilliseconds = milliseconds;
+        }
+        std::cout << "    parallel-for " << kItems << " items: " << milliseconds << " ms, speedup "
+                  << baseMilliseconds / milliseconds << (output == reference ? "" : " (results DIFFER)");
+        std::vector<ThreadPool::ThreadStatistics> statistics = pool.GetStatistics();
+        double window = pool.GetStatisticsMilliseconds();
+        for (size_t thread = 1; thread < statistics.size(); ++thread) {
+            std::cout << (thread == 1 ? ", workers busy " : " / ")
+                      << static_cast<int>(100.0 * (1.0 - statistics[thread].idleMilliseconds / window) + 0.5) << "%";
+        }
+        std::cout << std::endl;
+        pool.Shutdown();
+    }
+}
+
+
+/**
+ * @brief Compares two PPM images, e.g. a --software reference against a --headless frame.
+ *
+ * Writes the difference picture to diff.ppm.
+ *
+ * @return 0 if at most maxMismatchPercent of the pixels differ by more than the tolerance.
+ */
+int CompareImageFiles(const std::string& firstFile, const std::string& secondFile, int tolerance, double maxMismatchPercent){
+    PPM first(firstFile);
+    PPM second(secondFile);
+    PPM diff(first.getWidth(), first.getHeight());
+    ImageCompareResult result = CompareImages(first, second, tolerance, &diff);
+    if (!result.sameSize) {
+        std::cout << "Compare: " << firstFile << " and " << secondFile << " differ in size" << std::endl;
+        return 1;
     }
+    diff.savePPM("./diff.ppm");
+
+    double mismatchPercent = 100.0 * result.pixelsOverTolerance / result.pixelCount;
+    bool passed = mismatchPercent <= maxMismatchPercent;
+    std::cout << "Compare: max difference " << result.maxDifference
+              << ", mean " << result.meanDifference
+              << ", PSNR " << result.psnr << " dB, "
+              << mismatchPercent << "% of pixels over tolerance " << tolerance
+              << (passed ? " (passed)" : " (FAILED)") << ", differences in diff.ppm" << std::endl;
+    return passed ? 0 : 1;
 }
 
 
@@ -392,8 +1999,35 @@ void MainLoop(){
  * @return void
  */
 void CleanUp(){
-    SDL_DestroyWindow(g.gGraphicsApplicationWindow);
-    g.gGraphicsApplicationWindow = nullptr;
+    g.gShaderReloader.Shutdown();
+
+    // What the scene cost, before anything is freed
+    Memory::PrintReport();
+
+    Profiler::WriteChromeTrace(g.gProfileTraceFile);
+
+    // The culler may still have a job on the pool
+    g.gOcclusionCuller.Shutdown();
+    g.gThreadPool.Shutdown();
+    if (g.gSoftwareRenderer) {
+        g.gObjects.clear();
+        g.gAssets.Clear();
+        return;
+    }
+
+    g.gGpuTimer.Destroy();
+    g.gStatsOverlay.Destroy();
+    g.gClusteredLights.Destroy();
+    g.gDeferredRenderer.Destroy();
+    g.gCascadedShadows.Destroy();
+    g.gImageBasedLighting.Destroy();
+    g.gPostProcess.Destroy();
+    g.gFrameGraph.Destroy();
+
+    if (!g.gHeadless) {
+        SDL_DestroyWindow(g.gGraphicsApplicationWindow);
+        g.gGraphicsApplicationWindow = nullptr;
+    }
 
     // Delete OpenGL objects if they were created
     if (gVertexBufferObject) glDeleteBuffers(1, &gVertexBufferObject);
@@ -403,10 +2037,15 @@ void CleanUp(){
     // Delete shader program
     if (g.gGraphicsPipelineShaderProgram) glDeleteProgram(g.gGraphicsPipelineShaderProgram);
 
-    // Delete the Object if it exists
-    if (g.gObject) {
-        delete g.gObject;
-        g.gObject = nullptr;
+    // Delete the Objects, the textures go with the assets
+    g.gObjects.clear();
+    g.gTexture.reset();
+    g.gNormalMap.reset();
+    g.gAssets.Clear();
+
+    if (g.gHeadless) {
+        g.gHeadlessContext.Destroy();
+        return;
     }
 
     // Quit SDL
@@ -423,25 +2062,175 @@ int main( int argc, char* args[] ){
     std::cout << "Use arrow keys to move and rotate\n";
     std::cout << "Use WASD to move\n";
 
+    std::string compareFiles[2];
+    int compareTolerance = 8;
+    double compareMaxMismatch = 1.0;
+    size_t sceneBenchmarkNodes = 0;
+    unsigned int lightBenchmarkMaxLights = 0;
+    bool frameGraphReport = false;
+    bool iblBenchmark = false;
+    bool jobBenchmark = false;
+
+    // Parse command line options, every argument that is not an option is an OBJ file
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = args[i];
+        if (arg == "--no-shader-cache") {
+            g.gShaderCacheEnabled = false;
+        } else if (arg == "--headless") {
+            g.gHeadless = true;
+        } else if (arg == "--camera-path" && i + 1 < argc) {
+            g.gCameraPathFile = args[++i];
+        } else if (arg == "--frames" && i + 1 < argc) {
+            g.gHeadlessFrames = std::stoi(args[++i]);
+        } else if (arg == "--dump-frames" && i + 1 < argc) {
+            g.gDumpEveryNFrames = std::stoi(args[++i]);
+        } else if (arg == "--frame-times" && i + 1 < argc) {
+            g.gFrameTimesFile = args[++i];
+        } else if (arg == "--software") {
+            g.gSoftwareRenderer = true;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            g.gThreadCount = std::stoi(args[++i]);
+        } else if (arg == "--pathtrace") {
+            g.gPathTrace = true;
+            g.gSoftwareRenderer = true;
+        } else if (arg == "--samples" && i + 1 < argc) {
+            g.gPathTraceSamples = std::stoi(args[++i]);
+        } else if (arg == "--snapshot-every" && i + 1 < argc) {
+            g.gSnapshotEveryNSamples = std::stoi(args[++i]);
+        } else if (arg == "--scaling") {
+            g.gPathTraceScaling = true;
+        } else if (arg == "--compare" && i + 2 < argc) {
+            compareFiles[0] = args[++i];
+            compareFiles[1] = args[++i];
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            compareTolerance = std::stoi(args[++i]);
+        } else if (arg == "--max-mismatch" && i + 1 < argc) {
+            compareMaxMismatch = std::stod(args[++i]);
+        } else if (arg == "--stats") {
+            g.gShowStats = true;
+        } else if (arg == "--gpu-times" && i + 1 < argc) {
+            g.gGpuTimesFile = args[++i];
+        } else if (arg == "--profile-trace" && i + 1 < argc) {
+            g.gProfileTraceFile = args[++i];
+        } else if (arg == "--no-culling") {
+            g.gFrustumCulling = false;
+        } else if (arg == "--no-occlusion") {
+            g.gOcclusionCulling = false;
+        } else if (arg == "--deferred") {
+            g.gDeferred = true;
+        } else if (arg == "--shadows") {
+            // Optional quality, e.g. --shadows high
+            g.gShadows = true;
+            std::string quality = (i + 1 < argc) ? args[i + 1] : "";
+            if (quality == "low" || quality == "medium" || quality == "high") {
+                g.gShadowQuality = (quality == "low") ? CascadedShadows::Quality::Low :
+                                   (quality == "high") ? CascadedShadows::Quality::High : CascadedShadows::Quality::Medium;
+                ++i;
+            }
+        } else if (arg == "--pbr") {
+            g.gPbr = true;
+        } else if (arg == "--ibl-bench") {
+            iblBenchmark = true;
+        } else if (arg == "--job-bench") {
+            jobBenchmark = true;
+        } else if (arg == "--asset-budget" && i + 1 < argc) {
+            // Megabytes of cached meshes and textures before unused ones are freed
+            g.gAssets.SetBudget(static_cast<size_t>(std::stoul(args[++i])) * 1024 * 1024);
+        } else if (arg == "--drop-cpu-copies") {
+            g.gDropCpuCopies = true;
+        } else if (arg == "--post") {
+            g.gPostProcessing = true;
+        } else if (arg == "--no-merge") {
+            g.gPostMerge = false;
+        } else if (arg == "--framegraph-report") {
+            frameGraphReport = true;
+        } else if (arg == "--lights" && i + 1 < argc) {
+            g.gPointLightCount = std::stoi(args[++i]);
+        } else if (arg == "--light-bench") {
+            // Optional largest light count, e.g. --light-bench 4096
+            lightBenchmarkMaxLights = (i + 1 < argc && std::isdigit(args[i + 1][0])) ? std::stoul(args[++i]) : 1024;
+            g.gHeadless = true;
+        } else if (arg == "--grid" && i + 1 < argc) {
+            g.gSceneGrid = std::max(1, std::stoi(args[++i]));
+        } else if (arg == "--scene-bench") {
+            // Optional node count, e.g. --scene-bench 100000
+            sceneBenchmarkNodes = (i + 1 < argc && std::isdigit(args[i + 1][0])) ? std::stoul(args[++i]) : 100000;
+        } else {
+            g.gObjFilePaths.push_back(arg);
+        }
+    }
+
+    // Comparing images needs neither a context nor a model
+    if (!compareFiles[0].empty()) {
+        return CompareImageFiles(compareFiles[0], compareFiles[1], compareTolerance, compareMaxMismatch);
+    }
+    if (sceneBenchmarkNodes > 0) {
+        RunSceneBenchmark(sceneBenchmarkNodes);
+        return 0;
+    }
+    if (iblBenchmark) {
+        RunIblBenchmark();
+        return 0;
+    }
+    if (jobBenchmark) {
+        RunJobBenchmark();
+        return 0;
+    }
+    if (g.gPbr && g.gDeferred) {
+        std::cout << "--pbr shades the forward path, --deferred keeps its Phong lighting" << std::endl;
+    }
+    // Compiling the frame graph is CPU work only, no context is created
+    if (frameGraphReport) {
+        if (g.gPostProcessing) {
+            SetupPostProcess(false);
+        }
+        BuildFrameGraph(0);
+        std::cout << g.gFrameGraph.GetReport();
+        return 0;
+    }
+
+    auto startupBegin = std::chrono::steady_clock::now();
+    Profiler::Initialize();
+
     // Initialize program
     InitializeProgram();
 
-    if (argc < 2) {
+    if (g.gSoftwareRenderer) {
+        if (g.gObjFilePaths.empty()) {
+            std::cout << "The software renderer needs an OBJ file" << std::endl;
+            exit(1);
+        }
+        // Only the mesh and texture data on the CPU are used
+        LoadObjects(false);
+        CreateScene();
+    } else if (g.gObjFilePaths.empty()) {
         std::cout << "No OBJ file specified, using default square.\n";
         VertexSpecification();
-        // No OBJ file, so we don't create g.gObject
-        g.gObject = nullptr;
+        // No OBJ file, so there are no objects in the scene
     } else {
-        // We have an OBJ file specified
-        g.objFilePath = args[1];
-
-        // Create and initialize object
-        g.gObject = new Object(g.objFilePath);
-        g.gObject->Initialize();
+        // Create and initialize the objects
+        LoadObjects(true);
+        CreateScene();
+        CreatePointLights(g.gPointLightCount);
     }
 
+    // Startup time with and without the shader cache can be compared with --no-shader-cache
+    std::chrono::duration<double, std::milli> startupTime = std::chrono::steady_clock::now() - startupBegin;
+    g.gShaderCache.PrintStatistics();
+    std::cout << "Startup took " << startupTime.count() << " ms" << std::endl;
+
     // Main loop
-    MainLoop();
+    if (g.gPathTrace) {
+        PathTraceLoop();
+    } else if (g.gSoftwareRenderer) {
+        SoftwareLoop();
+    } else if (lightBenchmarkMaxLights > 0) {
+        RunLightBenchmark(lightBenchmarkMaxLights);
+    } else if (g.gHeadless) {
+        HeadlessLoop();
+    } else {
+        MainLoop();
+    }
 
     // Clean up
     CleanUp();
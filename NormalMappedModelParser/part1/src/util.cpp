@@ -3,8 +3,12 @@
 #include <string>
 #include <fstream>
 #include <iostream>
+#include <chrono>
 #include <glad/glad.h>
 
+#include "globals.hpp"
+#include "Profiler.hpp"
+
 
 // Error Handling Routines
 void GLClearAllErrors(){
@@ -111,12 +115,13 @@ GLuint CompileShader(GLuint type, const std::string& source){
 
 /**
 * Creates a graphics program object (i.e. graphics pipeline) with a Vertex Shader and a Fragment Shader
+* by compiling and linking the GLSL sources.
 *
 * @param vertexShaderSource Vertex source code as a string
 * @param fragmentShaderSource Fragment shader source code as a string
 * @return id of the program Object
 */
-GLuint CreateShaderProgram(const std::string& vertexShaderSource, const std::string& fragmentShaderSource){
+GLuint LinkShaderProgram(const std::string& vertexShaderSource, const std::string& fragmentShaderSource){
 
     // Create a new program object
     GLuint programObject = glCreateProgram();
@@ -128,6 +133,7 @@ GLuint CreateShaderProgram(const std::string& vertexShaderSource, const std::str
     // Link two shader programs together.
     glAttachShader(programObject,myVertexShader);
     glAttachShader(programObject,myFragmentShader);
+    g.gShaderCache.PrepareForLink(programObject);
     glLinkProgram(programObject);
 
     // Validate program
@@ -140,3 +146,32 @@ GLuint CreateShaderProgram(const std::string& vertexShaderSource, const std::str
 
     return programObject;
 }
+
+
+/**
+* Creates a graphics program object (i.e. graphics pipeline) with a Vertex Shader and a Fragment Shader.
+* A program binary from the shader cache is used when one exists for these sources, otherwise the
+* sources are compiled and the result is stored in the cache for the next run.
+*
+* @param vertexShaderSource Vertex source code as a string
+* @param fragmentShaderSource Fragment shader source code as a string
+* @return id of the program Object
+*/
+GLuint CreateShaderProgram(const std::string& vertexShaderSource, const std::string& fragmentShaderSource){
+    PROFILE_SCOPE("CreateShaderProgram");
+    auto start = std::chrono::steady_clock::now();
+
+    GLuint programObject = g.gShaderCache.LoadProgram(vertexShaderSource, fragmentShaderSource);
+    bool hit = (programObject != 0);
+    if(!hit){
+        programObject = LinkShaderProgram(vertexShaderSource, fragmentShaderSource);
+        g.gShaderCache.StoreProgram(vertexShaderSource, fragmentShaderSource, programObject);
+    }
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    g.gShaderCache.RecordProgramTime(elapsed.count(), hit);
+    std::cout << "Shader program " << programObject << (hit ? " loaded from cache in " : " compiled in ")
+              << elapsed.count() << " ms" << std::endl;
+
+    return programObject;
+}